@@ -0,0 +1,625 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file  triangle_bench.cc
+//! \brief Rendering path benchmark: draws the subdivided (twisted)
+//!        triangle of the glsl examples with immediate mode (01), a
+//!        raw VBO (02), the TwistTriangle class (03, vertex buffer and
+//!        gl_VertexID), and indexed and instanced variants, in a
+//!        hidden window. Times CPU generation, generation + upload,
+//!        and draw (each followed by glFinish) per subdivision level,
+//!        and prints a comparison table.
+//! \author Hadi Fadaifard, 2022
+
+#include <iostream>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include <boost/program_options.hpp>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <glm/glm.hpp>
+#include <glm/ext.hpp>
+#include <spdlog/spdlog.h>
+#include "types.h"
+#include "utils/utils.h"
+#include "utils/glshader.h"
+#include "utils/gldrawdata.h"
+#include "twist_triangle.h"
+
+using namespace std;
+using namespace olio;
+
+//! \brief Benchmark settings
+struct BenchOptions {
+  int warmup{1};                //!< untimed runs per case
+  int repetitions{5};           //!< timed runs per case
+  int min_level{0};             //!< lowest subdivision level
+  int max_level{10};            //!< highest subdivision level
+  int instance_levels{4};       //!< levels of the instanced base mesh
+  int size{512};                //!< framebuffer width and height
+  Real twist_angle{45};         //!< degrees
+  std::vector<std::string> paths;  //!< paths to run (default: all)
+};
+
+
+//! \brief Median times (milliseconds) of one path at one level;
+//!        negative when the path has no such stage
+struct PathTiming {
+  double generate_ms{-1};       //!< cpu generation only
+  double build_ms{-1};          //!< generation and upload (until glFinish)
+  double draw_ms{-1};           //!< draw call(s) (until glFinish)
+  double frame_ms{-1};          //!< frame with an animated twist
+};
+
+
+//! \brief A way of drawing the subdivided triangle
+struct RenderPath {
+  std::string name;
+  int max_level;                //!< higher levels are skipped
+  std::function<PathTiming(int level)> run;
+};
+
+
+//! \brief Run func warmup + repetitions times and return the median
+//!        time of the timed repetitions (milliseconds)
+double
+RunTimed(const std::function<void()> &func, const BenchOptions &options)
+{
+  using Clock = std::chrono::steady_clock;
+  vector<double> times;
+  for (int i = 0; i < options.warmup + options.repetitions; ++i) {
+    auto start = Clock::now();
+    func();
+    auto elapsed = std::chrono::duration<double, std::milli>
+      (Clock::now() - start).count();
+    if (i >= options.warmup)
+      times.push_back(elapsed);
+  }
+  if (times.empty())
+    return 0;
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+
+
+//! \brief Rotate point about center by twist_angle (degrees) times its
+//!        distance from center, as the original examples do
+inline Vec3f
+TwistPoint(const Vec3f &point, const Vec3f &center, Real twist_angle)
+{
+  Mat3f R{Mat3f::Identity()};
+  float r = (point - center).norm();
+  float c = static_cast<float>(cos(twist_angle * r * kDEGtoRAD));
+  float s = static_cast<float>(sin(twist_angle * r * kDEGtoRAD));
+  R(0,0) = c; R(0,1) = -s;
+  R(1,0) = s; R(1,1) = c;
+  return R * (point - center) + center;
+}
+
+
+//! \brief Immediate mode subdivision (01_triangle_subdivide_legacy)
+void
+DivideTriangleLegacy(const Vec3f &p0, const Vec3f &p1, const Vec3f &p2,
+                     int level, const Vec3f &color1, const Vec3f &color2,
+                     Real twist_angle, const Vec3f &center)
+{
+  if (level <= 0) {
+    glColor3f(color1[0], color1[1], color1[2]);
+    for (const auto *point : {&p0, &p1, &p2}) {
+      Vec3f pt = TwistPoint(*point, center, twist_angle);
+      glVertex3f(pt[0], pt[1], pt[2]);
+    }
+    return;
+  }
+  Vec3f p01 = 0.5f * (p0 + p1);
+  Vec3f p02 = 0.5f * (p0 + p2);
+  Vec3f p12 = 0.5f * (p1 + p2);
+  DivideTriangleLegacy(p0, p01, p02, level - 1, color1, color2, twist_angle, center);
+  DivideTriangleLegacy(p01, p1, p12, level - 1, color1, color2, twist_angle, center);
+  DivideTriangleLegacy(p02, p12, p2, level - 1, color1, color2, twist_angle, center);
+  DivideTriangleLegacy(p01, p12, p02, level - 1, color2, color1, twist_angle, center);
+}
+
+
+//! \brief Recursive subdivision into a growing array
+//!        (02_triangle_subdivide)
+void
+DivideTriangleVector(const Vec3f &p0, const Vec3f &p1, const Vec3f &p2,
+                     int level, const Vec3f &color1, const Vec3f &color2,
+                     Real twist_angle, const Vec3f &center,
+                     std::vector<GLfloat> &positions_and_colors)
+{
+  if (level <= 0) {
+    vector<Vec3f> points{p0, p1, p2};
+    for (const auto &point : points) {
+      Vec3f pt = TwistPoint(point, center, twist_angle);
+      positions_and_colors.insert(positions_and_colors.end(), {pt[0], pt[1], pt[2]});
+      positions_and_colors.insert(positions_and_colors.end(),
+                                  {color1[0], color1[1], color1[2]});
+    }
+    return;
+  }
+  Vec3f p01 = 0.5f * (p0 + p1);
+  Vec3f p02 = 0.5f * (p0 + p2);
+  Vec3f p12 = 0.5f * (p1 + p2);
+  DivideTriangleVector(p0, p01, p02, level - 1, color1, color2, twist_angle, center,
+                       positions_and_colors);
+  DivideTriangleVector(p01, p1, p12, level - 1, color1, color2, twist_angle, center,
+                       positions_and_colors);
+  DivideTriangleVector(p02, p12, p2, level - 1, color1, color2, twist_angle, center,
+                       positions_and_colors);
+  DivideTriangleVector(p01, p12, p02, level - 1, color2, color1, twist_angle, center,
+                       positions_and_colors);
+}
+
+
+//! \brief Shared vertices of the subdivision (a triangular lattice
+//!        with 2^level + 1 vertices per side) and triangle indices.
+//!        Colors are per vertex, so triangles are not colored by
+//!        orientation as in the other paths
+void
+BuildIndexedTriangle(int level, std::vector<GLfloat> &positions_and_colors,
+                     std::vector<GLuint> &indices)
+{
+  Vec3f p0, p1, p2;
+  TwistTriangle::GetTriangle(p0, p1, p2);
+  uint n = 1u << level;
+  auto VertexIndex = [n](uint i, uint j) {
+    // row j holds n + 1 - j vertices
+    return j * (n + 1) - j * (j - 1) / 2 + i;
+  };
+  positions_and_colors.clear();
+  positions_and_colors.reserve(6 * size_t{n + 1} * (n + 2) / 2);
+  for (uint j = 0; j <= n; ++j)
+    for (uint i = 0; i + j <= n; ++i) {
+      Vec3f point = p0 + (static_cast<float>(i) / static_cast<float>(n)) * (p1 - p0) +
+        (static_cast<float>(j) / static_cast<float>(n)) * (p2 - p0);
+      auto red = static_cast<GLfloat>((i + j) % 2);
+      positions_and_colors.insert(positions_and_colors.end(),
+                                  {point[0], point[1], point[2], red, 1 - red, 0});
+    }
+  indices.clear();
+  indices.reserve(3 * size_t{n} * n);
+  for (uint j = 0; j < n; ++j)
+    for (uint i = 0; i + j < n; ++i) {
+      indices.insert(indices.end(), {VertexIndex(i, j), VertexIndex(i + 1, j),
+            VertexIndex(i, j + 1)});
+      if (i + j + 1 < n)
+        indices.insert(indices.end(), {VertexIndex(i + 1, j), VertexIndex(i + 1, j + 1),
+              VertexIndex(i, j + 1)});
+    }
+}
+
+
+//! \brief Vertex array with interleaved position/color buffers (and
+//!        optionally an index buffer) for the raw GL paths
+class BenchBuffers {
+public:
+  BenchBuffers() {glGenVertexArrays(1, &vao_);}
+  ~BenchBuffers() {
+    glDeleteBuffers(1, &vbo_);
+    glDeleteBuffers(1, &ebo_);
+    glDeleteVertexArrays(1, &vao_);
+  }
+  BenchBuffers(const BenchBuffers &) = delete;
+  BenchBuffers& operator=(const BenchBuffers &) = delete;
+
+  //! \brief Upload (reallocating) vertices and indices
+  void Upload(const GLShader &glshader, const std::vector<GLfloat> &positions_and_colors,
+              const std::vector<GLuint> &indices=std::vector<GLuint>{}) {
+    glBindVertexArray(vao_);
+    if (!vbo_)
+      glGenBuffers(1, &vbo_);
+    glBindBuffer(GL_ARRAY_BUFFER, vbo_);
+    glBufferData(GL_ARRAY_BUFFER,
+                 static_cast<GLsizeiptr>(positions_and_colors.size() * sizeof(GLfloat)),
+                 positions_and_colors.data(), GL_STATIC_DRAW);
+    auto position_index = glGetAttribLocation(glshader.GetProgramID(), "position");
+    auto color_index = glGetAttribLocation(glshader.GetProgramID(), "color");
+    glVertexAttribPointer(static_cast<GLuint>(position_index), 3, GL_FLOAT, GL_FALSE,
+                          6 * sizeof(GLfloat), (void*)(0));
+    glEnableVertexAttribArray(static_cast<GLuint>(position_index));
+    glVertexAttribPointer(static_cast<GLuint>(color_index), 3, GL_FLOAT, GL_FALSE,
+                          6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(static_cast<GLuint>(color_index));
+    if (!indices.empty()) {
+      if (!ebo_)
+        glGenBuffers(1, &ebo_);
+      glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo_);
+      glBufferData(GL_ELEMENT_ARRAY_BUFFER,
+                   static_cast<GLsizeiptr>(indices.size() * sizeof(GLuint)),
+                   indices.data(), GL_STATIC_DRAW);
+    }
+    glBindVertexArray(0);
+    vertex_count_ = positions_and_colors.size() / 6;
+    index_count_ = indices.size();
+  }
+
+  void Bind() const {glBindVertexArray(vao_);}
+  GLsizei GetVertexCount() const {return static_cast<GLsizei>(vertex_count_);}
+  GLsizei GetIndexCount() const {return static_cast<GLsizei>(index_count_);}
+protected:
+  GLuint vao_{0};
+  GLuint vbo_{0};
+  GLuint ebo_{0};
+  size_t vertex_count_{0};
+  size_t index_count_{0};
+};
+
+
+//! \brief Create the rendering paths
+//! \param[in] glshader shader of the 03 example (twist in the vertex
+//!                     shader)
+//! \param[in] draw_data matrices
+//! \param[in] options benchmark settings
+std::vector<RenderPath>
+CreateRenderPaths(GLShader::Ptr glshader, const GLDrawData &draw_data,
+                  const BenchOptions &options)
+{
+  Vec3f p0, p1, p2;
+  TwistTriangle::GetTriangle(p0, p1, p2);
+  Vec3f center = (p0 + p1 + p2) / 3;
+  Vec3f color1{1, 0, 0}, color2{0, 1, 0};
+  auto twist_angle = options.twist_angle;
+
+  // uniforms of the raw GL paths: twist in the shader (unless already
+  // applied on the cpu)
+  auto shader_triangle = make_shared<TwistTriangle>();
+  shader_triangle->SetVertexSource(TwistTriangle::VertexSource::kVertexBuffer);
+  auto UseShader = [=](Real shader_twist_angle) {
+    glshader->Use();
+    shader_triangle->SetTwistAngle(shader_twist_angle);
+    shader_triangle->SetupUniforms(*glshader, draw_data);
+  };
+
+  vector<RenderPath> paths;
+
+  // 01: immediate mode, fixed function; the triangle is subdivided and
+  // twisted while it's submitted
+  paths.push_back(RenderPath{"legacy", 10, [=, &options](int level) {
+    PathTiming timing;
+    glUseProgram(0);
+    glMatrixMode(GL_PROJECTION);
+    glLoadMatrixf(glm::value_ptr(draw_data.GetProjectionMatrix()));
+    glMatrixMode(GL_MODELVIEW);
+    glLoadMatrixf(glm::value_ptr(draw_data.GetViewMatrix() * draw_data.GetModelMatrix()));
+    timing.draw_ms = RunTimed([&]() {
+        glBegin(GL_TRIANGLES);
+        DivideTriangleLegacy(p0, p1, p2, level, color1, color2, twist_angle, center);
+        glEnd();
+        glFinish();
+      }, options);
+    timing.frame_ms = timing.draw_ms;
+    return timing;
+  }});
+
+  // 02: recursive generation (twist on the cpu) into a vector, then a
+  // new VBO
+  auto vbo_buffers = make_shared<BenchBuffers>();
+  paths.push_back(RenderPath{"vbo", 11, [=, &options](int level) {
+    PathTiming timing;
+    vector<GLfloat> positions_and_colors;
+    timing.generate_ms = RunTimed([&]() {
+        positions_and_colors.clear();
+        positions_and_colors.shrink_to_fit();
+        DivideTriangleVector(p0, p1, p2, level, color1, color2, twist_angle, center,
+                             positions_and_colors);
+      }, options);
+    UseShader(0);
+    timing.build_ms = RunTimed([&]() {
+        positions_and_colors.clear();
+        positions_and_colors.shrink_to_fit();
+        DivideTriangleVector(p0, p1, p2, level, color1, color2, twist_angle, center,
+                             positions_and_colors);
+        vbo_buffers->Upload(*glshader, positions_and_colors);
+        glFinish();
+      }, options);
+    vbo_buffers->Bind();
+    timing.draw_ms = RunTimed([&]() {
+        glDrawArrays(GL_TRIANGLES, 0, vbo_buffers->GetVertexCount());
+        glFinish();
+      }, options);
+    glBindVertexArray(0);
+    timing.frame_ms = timing.build_ms + timing.draw_ms;
+    return timing;
+  }});
+
+  // 03: TwistTriangle, untwisted vertex buffer generated in parallel,
+  // twist in the shader
+  auto class_triangle = make_shared<TwistTriangle>();
+  class_triangle->SetGLShader(glshader);
+  class_triangle->SetTwistAngle(twist_angle);
+  class_triangle->SetVertexSource(TwistTriangle::VertexSource::kVertexBuffer);
+  paths.push_back(RenderPath{"class", 12, [=, &options](int level) {
+    PathTiming timing;
+    vector<GLfloat> positions_and_colors(6 * TwistTriangle::GetVertexCount(level));
+    timing.generate_ms = RunTimed([&]() {
+        TwistTriangle::GenerateTriangles(level, 0, positions_and_colors.data());
+      }, options);
+    class_triangle->SetSubdivisions(level);
+    timing.build_ms = RunTimed([&]() {
+        class_triangle->UpdateGLBuffers(glshader, true);
+        glFinish();
+      }, options);
+    timing.draw_ms = RunTimed([&]() {
+        class_triangle->DrawGL(draw_data);
+        glFinish();
+      }, options);
+    timing.frame_ms = timing.draw_ms;
+    return timing;
+  }});
+
+  // 03: TwistTriangle, vertices derived from gl_VertexID
+  auto vertex_id_triangle = make_shared<TwistTriangle>();
+  vertex_id_triangle->SetGLShader(glshader);
+  vertex_id_triangle->SetTwistAngle(twist_angle);
+  vertex_id_triangle->SetVertexSource(TwistTriangle::VertexSource::kVertexID);
+  paths.push_back(RenderPath{"vertex_id", 14, [=, &options](int level) {
+    PathTiming timing;
+    vertex_id_triangle->SetSubdivisions(level);
+    timing.build_ms = RunTimed([&]() {
+        vertex_id_triangle->UpdateGLBuffers(glshader, true);
+        glFinish();
+      }, options);
+    timing.draw_ms = RunTimed([&]() {
+        vertex_id_triangle->DrawGL(draw_data);
+        glFinish();
+      }, options);
+    timing.frame_ms = timing.draw_ms;
+    return timing;
+  }});
+
+  // shared lattice vertices and an index buffer, twist in the shader
+  auto indexed_buffers = make_shared<BenchBuffers>();
+  paths.push_back(RenderPath{"indexed", 12, [=, &options](int level) {
+    PathTiming timing;
+    vector<GLfloat> positions_and_colors;
+    vector<GLuint> indices;
+    timing.generate_ms = RunTimed([&]() {
+        BuildIndexedTriangle(level, positions_and_colors, indices);
+      }, options);
+    UseShader(twist_angle);
+    timing.build_ms = RunTimed([&]() {
+        BuildIndexedTriangle(level, positions_and_colors, indices);
+        indexed_buffers->Upload(*glshader, positions_and_colors, indices);
+        glFinish();
+      }, options);
+    indexed_buffers->Bind();
+    timing.draw_ms = RunTimed([&]() {
+        glDrawElements(GL_TRIANGLES, indexed_buffers->GetIndexCount(), GL_UNSIGNED_INT,
+                       nullptr);
+        glFinish();
+      }, options);
+    glBindVertexArray(0);
+    timing.frame_ms = timing.draw_ms;
+    return timing;
+  }});
+
+  // a small subdivided triangle drawn once per sub-triangle of the
+  // remaining levels, placed by gl_InstanceID
+  auto instanced_buffers = make_shared<BenchBuffers>();
+  paths.push_back(RenderPath{"instanced", 14, [=, &options](int level) {
+    PathTiming timing;
+    int base_level = std::min(level, options.instance_levels);
+    int instance_levels = level - base_level;
+    vector<GLfloat> positions_and_colors(6 * TwistTriangle::GetVertexCount(base_level));
+    timing.generate_ms = RunTimed([&]() {
+        TwistTriangle::GenerateTriangles(base_level, 0, positions_and_colors.data());
+      }, options);
+    UseShader(twist_angle);
+    glshader->SetUniformInt("instance_subdivisions", instance_levels);
+    timing.build_ms = RunTimed([&]() {
+        TwistTriangle::GenerateTriangles(base_level, 0, positions_and_colors.data());
+        instanced_buffers->Upload(*glshader, positions_and_colors);
+        glFinish();
+      }, options);
+    instanced_buffers->Bind();
+    auto instance_count = static_cast<GLsizei>(1u << (2 * instance_levels));
+    timing.draw_ms = RunTimed([&]() {
+        glDrawArraysInstanced(GL_TRIANGLES, 0, instanced_buffers->GetVertexCount(),
+                              instance_count);
+        glFinish();
+      }, options);
+    glBindVertexArray(0);
+    glshader->SetUniformInt("instance_subdivisions", 0);
+    timing.frame_ms = timing.draw_ms;
+    return timing;
+  }});
+
+  return paths;
+}
+
+
+//! \brief Format a time for the table ("-" if the path has no such
+//!        stage)
+std::string
+FormatTime(double ms)
+{
+  return ms < 0 ? std::string{"-"} : fmt::format("{:.3f}", ms);
+}
+
+
+//! \brief Create a hidden window, so that drawing can be timed
+//!        without presenting anything
+//! \param[in] size framebuffer width and height
+//! \return window (nullptr on failure)
+GLFWwindow*
+CreateHiddenGLContext(int size)
+{
+  if (!glfwInit()) {
+    spdlog::error("glfwInit failed");
+    return nullptr;
+  }
+  // immediate mode needs a compatibility context, so on macos (core
+  // profile only) the legacy path fails
+#if !defined(__APPLE__)
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+#else
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  auto *window = glfwCreateWindow(size, size, "olio_triangle_bench", nullptr, nullptr);
+  if (!window) {
+    spdlog::error("glfwCreatewindow failed");
+    glfwTerminate();
+    return nullptr;
+  }
+  glfwMakeContextCurrent(window);
+  if (glewInit() != GLEW_OK) {
+    spdlog::error("glewInit failed");
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return nullptr;
+  }
+  // don't wait for vsync
+  glfwSwapInterval(0);
+  return window;
+}
+
+
+//! \brief Parse command line arguments
+bool
+ParseArguments(int argc, char **argv, std::string *shaders_dir, BenchOptions *options)
+{
+  namespace po = boost::program_options;
+  po::options_description desc("options");
+  try {
+    desc.add_options()
+      ("help,h", "print usage")
+      ("shaders_dir,s",
+       po::value<std::string>(shaders_dir)->default_value("../shaders"),
+       "Directory with simple_vert.glsl and simple_frag.glsl")
+      ("paths,p",
+       po::value<vector<std::string>>(&options->paths)->multitoken(),
+       "Paths to run: legacy, vbo, class, vertex_id, indexed, instanced "
+       "(default: all)")
+      ("min_level", po::value<int>(&options->min_level)->default_value(0),
+       "Lowest subdivision level")
+      ("max_level", po::value<int>(&options->max_level)->default_value(10),
+       "Highest subdivision level (paths skip levels above their limit)")
+      ("instance_levels", po::value<int>(&options->instance_levels)->default_value(4),
+       "Subdivision levels of the instanced base triangle")
+      ("size", po::value<int>(&options->size)->default_value(512),
+       "Framebuffer width and height")
+      ("twist,t", po::value<Real>(&options->twist_angle)->default_value(45),
+       "Twist angle (degrees)")
+      ("warmup,w", po::value<int>(&options->warmup)->default_value(1),
+       "Untimed warmup runs per case")
+      ("repetitions,r", po::value<int>(&options->repetitions)->default_value(5),
+       "Timed runs per case");
+
+    // parse arguments
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      cout << desc << endl;
+      return false;
+    }
+    po::notify(vm);
+  } catch(std::exception &e) {
+    cout << desc << endl;
+    spdlog::error("{}", e.what());
+    return false;
+  } catch(...) {
+    cout << desc << endl;
+    spdlog::error("Invalid arguments");
+    return false;
+  }
+  options->min_level = std::max(options->min_level, 0);
+  options->instance_levels = std::max(options->instance_levels, 0);
+  return true;
+}
+
+
+//! \brief Main executable function
+int
+main(int argc, char **argv)
+{
+  std::string shaders_dir;
+  BenchOptions options;
+  if (!ParseArguments(argc, argv, &shaders_dir, &options))
+    return -1;
+
+  auto window = CreateHiddenGLContext(options.size);
+  if (!window)
+    return -1;
+  spdlog::info("renderer: {} ({})",
+               reinterpret_cast<const char*>(glGetString(GL_RENDERER)),
+               reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+  spdlog::info("warmup: {}, repetitions: {}, framebuffer: {}x{}", options.warmup,
+               options.repetitions, options.size, options.size);
+
+  auto glshader = make_shared<GLShader>();
+  if (!glshader->LoadShaders(shaders_dir + "/simple_vert.glsl",
+                             shaders_dir + "/simple_frag.glsl")) {
+    spdlog::error("Failed to load shaders.");
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return -1;
+  }
+
+  // same view as the 03 example (square framebuffer)
+  GLDrawData draw_data;
+  draw_data.SetModelMatrix(glm::mat4{1.0f});
+  draw_data.SetViewMatrix(glm::lookAt(glm::vec3(0, 0, 1), glm::vec3(0, 0, 0),
+                                      glm::vec3(0, 1, 0)));
+  draw_data.SetProjectionMatrix(glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, -1.0f, 1.0f));
+  glViewport(0, 0, options.size, options.size);
+
+  // TwistTriangle logs every rebuild
+  auto log_level = spdlog::default_logger()->level();
+  spdlog::set_level(spdlog::level::warn);
+  auto paths = CreateRenderPaths(glshader, draw_data, options);
+  vector<std::pair<RenderPath, vector<PathTiming>>> results;
+  for (const auto &path : paths) {
+    if (!options.paths.empty() &&
+        std::find(options.paths.begin(), options.paths.end(), path.name) == options.paths.end())
+      continue;
+    vector<PathTiming> timings;
+    for (int level = options.min_level; level <= options.max_level; ++level) {
+      if (level > path.max_level)
+        break;
+      glClear(GL_COLOR_BUFFER_BIT);
+      timings.push_back(path.run(level));
+    }
+    results.emplace_back(path, timings);
+  }
+  spdlog::set_level(log_level);
+
+  // comparison table
+  spdlog::info("{:<10} {:>5} {:>12} {:>12} {:>12} {:>12} {:>12}", "path", "level",
+               "triangles", "generate ms", "build ms", "draw ms", "frame ms");
+  for (int level = options.min_level; level <= options.max_level; ++level) {
+    for (const auto &result : results) {
+      auto index = static_cast<size_t>(level - options.min_level);
+      if (index >= result.second.size())
+        continue;
+      const auto &timing = result.second[index];
+      spdlog::info("{:<10} {:>5} {:>12} {:>12} {:>12} {:>12} {:>12}", result.first.name,
+                   level, TwistTriangle::GetVertexCount(level) / 3,
+                   FormatTime(timing.generate_ms), FormatTime(timing.build_ms),
+                   FormatTime(timing.draw_ms), FormatTime(timing.frame_ms));
+    }
+  }
+  spdlog::info("frame: time per frame while the twist angle animates");
+
+  CheckOpenGLError();
+  results.clear();
+  paths.clear();
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  return 0;
+}
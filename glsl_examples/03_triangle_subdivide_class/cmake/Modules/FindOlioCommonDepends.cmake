@@ -40,9 +40,11 @@ find_package(spdlog REQUIRED)
 set(SPDLOG_LIBRARIES spdlog::spdlog)
 endif()
 
-# catch2
+# catch2 (single header, <catch2/catch.hpp>): third_party copy or
+# system install. tests are skipped without it
 set(CATCH2_DIR ${CMAKE_CURRENT_SOURCE_DIR}/third_party/Catch2)
-set(CATCH2_INCLUDE_DIRS ${CATCH2_DIR}/include)
+find_path(CATCH2_INCLUDE_DIRS catch2/catch.hpp
+  HINTS ${CATCH2_DIR}/include ${CATCH2_DIR}/single_include)
 
 # tqdm
 set(TQDM_INCLUDE_DIRS ${CMAKE_CURRENT_SOURCE_DIR}/third_party/tqdm/include)
@@ -1,6 +1,6 @@
 #version 140
 
-// input vertex attributes
+// input vertex attributes (unused when vertex_id_positions is set)
 in vec3 position;
 in vec3 color;
 
@@ -9,12 +9,103 @@ uniform mat4 mv_matrix;
 uniform mat4 norm_matrix;
 uniform mat4 proj_matrix;
 
+// twist: rotation about twist_center (in the xy plane), in radians
+// per unit distance from it
+uniform float twist_angle;
+uniform vec3 twist_center;
+
+// generate the subdivided triangle from gl_VertexID instead of
+// reading the vertex attributes
+uniform bool vertex_id_positions;
+uniform int subdivisions;
+uniform vec3 triangle_p0;
+uniform vec3 triangle_p1;
+uniform vec3 triangle_p2;
+
+// instancing: instance i draws the vertices (attributes or
+// gl_VertexID) mapped into the i-th of the 4^instance_subdivisions
+// sub-triangles of the triangle
+uniform int instance_subdivisions;
+
 // output attributes
 out vec3 vertex_position;
 out vec4 vertex_color;
 
+// descend levels subdivision levels (4 children per level) from
+// triangle (p0, p1, p2) to its descendant at index (base 4 child
+// indices, most significant first)
+void SelectTriangle(int index, int levels, inout vec3 p0, inout vec3 p1,
+                    inout vec3 p2, inout bool flipped)
+{
+  for (int level = levels - 1; level >= 0; --level) {
+    int child = (index >> (2 * level)) & 3;
+    vec3 p01 = 0.5 * (p0 + p1);
+    vec3 p02 = 0.5 * (p0 + p2);
+    vec3 p12 = 0.5 * (p1 + p2);
+    if (child == 0) {
+      p1 = p01;
+      p2 = p02;
+    } else if (child == 1) {
+      p0 = p01;
+      p2 = p12;
+    } else if (child == 2) {
+      p0 = p02;
+      p1 = p12;
+    } else {
+      p0 = p01;
+      p1 = p12;
+      p2 = p02;
+      flipped = !flipped;
+    }
+  }
+}
+
+// vertex of the subdivided triangle: three vertices per triangle, in
+// depth first order of the subdivision tree
+void SubdividedVertex(int vertex_id, out vec3 subdivided_position,
+                      out vec3 subdivided_color)
+{
+  vec3 p0 = triangle_p0;
+  vec3 p1 = triangle_p1;
+  vec3 p2 = triangle_p2;
+  bool flipped = false;
+  int triangle = vertex_id / 3;
+  SelectTriangle(triangle, subdivisions, p0, p1, p2, flipped);
+  int corner = vertex_id - 3 * triangle;
+  subdivided_position = corner == 0 ? p0 : (corner == 1 ? p1 : p2);
+  subdivided_color = flipped ? vec3(0, 1, 0) : vec3(1, 0, 0);
+}
+
 void main(void)
 {
-  gl_Position = proj_matrix * mv_matrix * vec4(position, 1);
-  vertex_color = vec4(color, 1);
+  vec3 untwisted_position = position;
+  vec3 untwisted_color = color;
+  if (vertex_id_positions)
+    SubdividedVertex(gl_VertexID, untwisted_position, untwisted_color);
+
+  if (instance_subdivisions > 0) {
+    // map the vertex from the triangle to the instance's sub-triangle
+    // (same barycentric coordinates)
+    vec3 p0 = triangle_p0;
+    vec3 p1 = triangle_p1;
+    vec3 p2 = triangle_p2;
+    bool flipped = false;
+    SelectTriangle(gl_InstanceID, instance_subdivisions, p0, p1, p2, flipped);
+    mat2 edges = mat2((triangle_p1 - triangle_p0).xy, (triangle_p2 - triangle_p0).xy);
+    vec2 barycentric = inverse(edges) * (untwisted_position - triangle_p0).xy;
+    untwisted_position = p0 + barycentric.x * (p1 - p0) + barycentric.y * (p2 - p0);
+    if (flipped)
+      untwisted_color = untwisted_color.grb;
+  }
+
+  // twist
+  vec3 offset = untwisted_position - twist_center;
+  float angle = twist_angle * length(offset);
+  float c = cos(angle);
+  float s = sin(angle);
+  vec3 twisted_position = twist_center +
+    vec3(c * offset.x - s * offset.y, s * offset.x + c * offset.y, offset.z);
+
+  gl_Position = proj_matrix * mv_matrix * vec4(twisted_position, 1);
+  vertex_color = vec4(untwisted_color, 1);
 }
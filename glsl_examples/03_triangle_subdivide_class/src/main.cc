@@ -130,6 +130,11 @@ KeyboardCallback(GLFWwindow */*window*/, int key, int /*scancode*/, int action,
     case GLFW_KEY_2:            // increase number of subdivisions
       twist_triangle_g->SetSubdivisions(twist_triangle_g->GetSubdivisions() + 1);
       break;
+    case GLFW_KEY_V:            // toggle vertex buffer/gl_VertexID vertices
+      twist_triangle_g->SetVertexSource(
+          twist_triangle_g->GetVertexSource() == TwistTriangle::VertexSource::kVertexID ?
+          TwistTriangle::VertexSource::kVertexBuffer : TwistTriangle::VertexSource::kVertexID);
+      break;
     default:
       break;
     }
@@ -10,8 +10,12 @@
 //! \author Hadi Fadaifard, 2022
 
 #include "twist_triangle.h"
+#include <cmath>
+#include <chrono>
 #include <vector>
 #include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <spdlog/spdlog.h>
 #include "utils/gldrawdata.h"
 
@@ -34,64 +38,229 @@ TwistTriangle::~TwistTriangle()
 void
 TwistTriangle::SetSubdivisions(int subdivisions)
 {
-  subdivisions_ = CLAMP(subdivisions, 0, max_subdivisions_);
+  subdivisions = CLAMP(subdivisions, 0, GetMaxSubdivisions());
+  if (subdivisions == subdivisions_ && vertex_count_)
+    return;
+  subdivisions_ = subdivisions;
   gl_buffers_dirty_ = true;
 }
 
+
 void
 TwistTriangle::SetTwistAngle(Real twist_angle)
 {
+  // applied in the vertex shader
   twist_angle_ = twist_angle;
-  gl_buffers_dirty_ = true;
 }
 
 
 void
-TwistTriangle::DivideTriangle(const Vec3f &p0, const Vec3f &p1, const Vec3f &p2,
-                              int level, const Vec3f &color1,
-                              const Vec3f &color2, Real twist_angle,
-                              const Vec3f &center,
-                              std::vector<GLfloat> &positions_and_colors)
-{
-  if (level <= 0) {
-    // rotate and draw triangle vertices
-    vector<Vec3f> points{p0, p1, p2};
-    for (const auto &point : points) {
-      Mat3f R{Mat3f::Identity()};
-      float r = (point - center).norm();
-      float c = static_cast<float>(cos(twist_angle * r * kDEGtoRAD));
-      float s = static_cast<float>(sin(twist_angle * r * kDEGtoRAD));
-      R(0,0) = c; R(0,1) = -s;
-      R(1,0) = s; R(1,1) = c;
-      Vec3f pt = R * (point - center) + center;
-
-      // add vertex position
-      positions_and_colors.push_back(pt[0]);
-      positions_and_colors.push_back(pt[1]);
-      positions_and_colors.push_back(pt[2]);
-
-      // add vertex color
-      positions_and_colors.push_back(color1[0]);
-      positions_and_colors.push_back(color1[1]);
-      positions_and_colors.push_back(color1[2]);
-    }
+TwistTriangle::SetVertexSource(VertexSource vertex_source)
+{
+  if (vertex_source == vertex_source_)
     return;
+  vertex_source_ = vertex_source;
+  subdivisions_ = std::min(subdivisions_, GetMaxSubdivisions());
+  gl_buffers_dirty_ = true;
+}
+
+
+int
+TwistTriangle::GetMaxSubdivisions() const
+{
+  // 50M vertices (1.2GB vertex buffer) vs. 805M vertices (still
+  // within GLsizei)
+  return vertex_source_ == VertexSource::kVertexBuffer ? 12 : 14;
+}
+
+
+// subdivision levels generated by one parallel task (4^6 triangles)
+static constexpr int kTaskLevels = 6;
+// vertices twisted per batch
+static constexpr int kTwistBatchSize = 256;
+
+//! \brief Triangle of the subdivision tree
+struct SubdividedTriangle {
+  Vec3f p0, p1, p2;
+  bool flipped;                 //!< pointing down (uses color2)
+};
+
+
+//! \brief Triangle that is subdivided (the twist is about its center)
+inline SubdividedTriangle
+GetRootTriangle()
+{
+  return SubdividedTriangle{Vec3f{0, 0.75f, 0}, Vec3f{0.65f, -0.375f, 0},
+      Vec3f{-0.65f, -0.375f, 0}, false};
+}
+
+
+//! \brief Replace triangle with one of its four children, in the order
+//!        they are visited by a depth first traversal
+inline void
+SelectChild(SubdividedTriangle &triangle, size_t child)
+{
+  Vec3f p01 = 0.5f * (triangle.p0 + triangle.p1);
+  Vec3f p02 = 0.5f * (triangle.p0 + triangle.p2);
+  Vec3f p12 = 0.5f * (triangle.p1 + triangle.p2);
+  switch (child) {
+  case 0:
+    triangle.p1 = p01;
+    triangle.p2 = p02;
+    break;
+  case 1:
+    triangle.p0 = p01;
+    triangle.p2 = p12;
+    break;
+  case 2:
+    triangle.p0 = p02;
+    triangle.p1 = p12;
+    break;
+  default:
+    triangle.p0 = p01;
+    triangle.p1 = p12;
+    triangle.p2 = p02;
+    triangle.flipped = !triangle.flipped;
+    break;
   }
+}
+
+
+//! \brief Descend from triangle to the descendant at index (base 4
+//!        digits, most significant first) levels below it
+inline void
+SelectDescendant(SubdividedTriangle &triangle, size_t index, int levels)
+{
+  for (int level = levels - 1; level >= 0; --level)
+    SelectChild(triangle, (index >> (2 * level)) & 3);
+}
 
-  // compute edge midpoints
-  Vec3f p01 = 0.5f * (p0 + p1);
-  Vec3f p02 = 0.5f * (p0 + p2);
-  Vec3f p12 = 0.5f * (p1 + p2);
 
-  // draw subdivided triangles
-  DivideTriangle(p0, p01, p02, level - 1, color1, color2, twist_angle, center,
-                 positions_and_colors);
-  DivideTriangle(p01, p1, p12, level - 1, color1, color2, twist_angle, center,
-                 positions_and_colors);
-  DivideTriangle(p02, p12, p2, level - 1, color1, color2, twist_angle, center,
-                 positions_and_colors);
-  DivideTriangle(p01, p12, p02, level - 1, color2, color1, twist_angle, center,
-                 positions_and_colors);
+//! \brief sin and cos of x (in radians), accurate to a few float ulps
+//!        for moderate |x|, without calls so that loops over it
+//!        vectorize. Cody-Waite reduction to [-pi/4, pi/4] and the
+//!        cephes sinf/cosf polynomials
+inline void
+SinCos(float x, float &sin_x, float &cos_x)
+{
+  // nearest multiple of pi/2 (truncation, rather than floor, vectorizes)
+  auto q = static_cast<int>(x * 0.636619772367581f + (x < 0 ? -0.5f : 0.5f));
+  auto quadrant = static_cast<float>(q);
+  float r = ((x - quadrant * 1.5703125f) - quadrant * 4.837512969970703125e-4f) -
+    quadrant * 7.54978995489188216e-8f;
+  float r2 = r * r;
+  float s = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f +
+                                                    r2 * -1.9515295891e-4f));
+  float c = 1 - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f +
+                                       r2 * (-1.388731625493765e-3f +
+                                             r2 * 2.443315711809948e-5f));
+  sin_x = (q & 1) ? c : s;
+  cos_x = (q & 1) ? s : c;
+  sin_x = (q & 2) ? -sin_x : sin_x;
+  cos_x = ((q + 1) & 2) ? -cos_x : cos_x;
+}
+
+
+//! \brief Rotate vertices about center (in the xy plane) by twist
+//!        times their distance from center
+//! \param[in,out] vertices interleaved position/color floats
+//! \param[in] count number of vertices
+static void
+TwistVertices(GLfloat *vertices, size_t count, const Vec3f &center, float twist)
+{
+  float x[kTwistBatchSize], y[kTwistBatchSize], z[kTwistBatchSize];
+  for (size_t start = 0; start < count; start += kTwistBatchSize) {
+    auto batch_size = static_cast<int>(std::min<size_t>(kTwistBatchSize, count - start));
+    auto *batch = vertices + 6 * start;
+    for (int i = 0; i < batch_size; ++i) {
+      x[i] = batch[6 * i] - center[0];
+      y[i] = batch[6 * i + 1] - center[1];
+      z[i] = batch[6 * i + 2] - center[2];
+    }
+    // vectorized: no calls or branches
+    for (int i = 0; i < batch_size; ++i) {
+      float s, c;
+      SinCos(twist * std::sqrt(x[i] * x[i] + y[i] * y[i] + z[i] * z[i]), s, c);
+      float rotated_x = c * x[i] - s * y[i];
+      y[i] = s * x[i] + c * y[i];
+      x[i] = rotated_x;
+    }
+    for (int i = 0; i < batch_size; ++i) {
+      batch[6 * i] = x[i] + center[0];
+      batch[6 * i + 1] = y[i] + center[1];
+    }
+  }
+}
+
+
+void
+TwistTriangle::GetTriangle(Vec3f &p0, Vec3f &p1, Vec3f &p2)
+{
+  auto root = GetRootTriangle();
+  p0 = root.p0;
+  p1 = root.p1;
+  p2 = root.p2;
+}
+
+
+size_t
+TwistTriangle::GetVertexCount(int subdivisions)
+{
+  return size_t{3} << (2 * subdivisions);
+}
+
+
+void
+TwistTriangle::GenerateTriangles(int subdivisions, Real twist_angle,
+                                 GLfloat *positions_and_colors)
+{
+  const auto root = GetRootTriangle();
+  const Vec3f center = (root.p0 + root.p1 + root.p2) / 3;
+  const Vec3f colors[2] = {Vec3f{1, 0, 0}, Vec3f{0, 1, 0}};
+  const auto twist = static_cast<float>(twist_angle * kDEGtoRAD);
+
+  // each task fills the consecutive triangles of one subtree
+  int task_levels = std::min(subdivisions, kTaskLevels);
+  size_t task_triangles = size_t{1} << (2 * task_levels);
+  size_t task_count = size_t{1} << (2 * (subdivisions - task_levels));
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, task_count),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t task = range.begin(); task != range.end(); ++task) {
+      auto subtree = root;
+      SelectDescendant(subtree, task, subdivisions - task_levels);
+      auto *task_vertices = positions_and_colors + 18 * task * task_triangles;
+      auto *vertex = task_vertices;
+
+      // path[l] is the current triangle's ancestor l levels below the
+      // subtree root. only the levels whose child index changed since
+      // the previous triangle are recomputed
+      SubdividedTriangle path[kTaskLevels + 1];
+      path[0] = subtree;
+      for (size_t i = 0; i < task_triangles; ++i) {
+        // a child index that wrapped around to 0 also advanced its
+        // parent's (without subdivisions the subtree root is drawn)
+        int first_level = std::max(task_levels - 1, 0);
+        while (first_level > 0 &&
+               ((i >> (2 * (task_levels - 1 - first_level))) & 3) == 0)
+          --first_level;
+        for (int level = first_level; level < task_levels; ++level) {
+          path[level + 1] = path[level];
+          SelectChild(path[level + 1], (i >> (2 * (task_levels - 1 - level))) & 3);
+        }
+        const auto &triangle = path[task_levels];
+        const auto &color = colors[triangle.flipped ? 1 : 0];
+        for (const auto *point : {&triangle.p0, &triangle.p1, &triangle.p2}) {
+          for (int k = 0; k < 3; ++k) {
+            vertex[k] = (*point)[k];
+            vertex[3 + k] = color[k];
+          }
+          vertex += 6;
+        }
+      }
+      if (twist != 0)
+        TwistVertices(task_vertices, 3 * task_triangles, center, twist);
+    }
+  });
 }
 
 
@@ -138,29 +307,49 @@ TwistTriangle::UpdateGLBuffers(GLShader::Ptr glshader, bool force_update)
   // bind VAO
   glBindVertexArray(vao_);
 
-  // generate triangles
-  Vec3f p0{0, 0.75f, 0};
-  Vec3f p1{0.65f, -0.375, 0};
-  Vec3f p2{-0.65f, -0.375, 0};
-  Vec3f center = (p0 + p1 + p2) / 3;
-  Vec3f color1{1, 0, 0};
-  Vec3f color2{0, 1, 0};
-  vector<GLfloat> positions_and_colors;
-  DivideTriangle(p0, p1, p2, subdivisions_, color1, color2,
-                 twist_angle_, center, positions_and_colors);
-  vertex_count_ = positions_and_colors.size() / 6;
-
   // generate position and color VBOs
   GLint positions_attr_index = 0;
   GLint colors_attr_index = 1;
   positions_attr_index = glGetAttribLocation(glshader->GetProgramID(), "position");
   colors_attr_index = glGetAttribLocation(glshader->GetProgramID(), "color");
 
-  // create VBO for positions and colors
+  vertex_count_ = GetVertexCount(subdivisions_);
+  if (vertex_source_ == VertexSource::kVertexID) {
+    // positions and colors come from gl_VertexID: an empty VAO is all
+    // we need
+    glBindVertexArray(0);
+    gl_buffers_dirty_ = false;
+    spdlog::info("TwistTriangle: level {}: {} triangles from gl_VertexID",
+                 subdivisions_, vertex_count_ / 3);
+    return;
+  }
+
+  // create VBO for positions and colors, and generate the untwisted
+  // triangles straight into it
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  auto buffer_size = 6 * vertex_count_ * sizeof(GLfloat);
   glGenBuffers(1, &positions_colors_vbo_);
   glBindBuffer(GL_ARRAY_BUFFER, positions_colors_vbo_);
-  glBufferData(GL_ARRAY_BUFFER, positions_and_colors.size() * sizeof(GLfloat),
-               &positions_and_colors[0], GL_STATIC_DRAW);
+  glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(buffer_size), nullptr,
+               GL_STATIC_DRAW);
+  auto *positions_and_colors = static_cast<GLfloat*>(
+      glMapBufferRange(GL_ARRAY_BUFFER, 0, static_cast<GLsizeiptr>(buffer_size),
+                       GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+  if (positions_and_colors)
+    GenerateTriangles(subdivisions_, 0, positions_and_colors);
+  if (!positions_and_colors || glUnmapBuffer(GL_ARRAY_BUFFER) != GL_TRUE) {
+    spdlog::error("TwistTriangle::UpdateGLBuffers: failed to fill {} byte vertex buffer",
+                  buffer_size);
+    glBindVertexArray(0);
+    DeleteGLBuffers();
+    vertex_count_ = 0;
+    gl_buffers_dirty_ = false;
+    return;
+  }
+  auto ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  spdlog::info("TwistTriangle: level {}: {} triangles in {:.2f} ms", subdivisions_,
+               vertex_count_ / 3, ms);
 
   // enable positions attribute and set pointer
   glVertexAttribPointer(positions_attr_index, 3, GL_FLOAT, GL_FALSE,
@@ -178,6 +367,29 @@ TwistTriangle::UpdateGLBuffers(GLShader::Ptr glshader, bool force_update)
 }
 
 
+void
+TwistTriangle::SetupUniforms(const GLShader &glshader, const GLDrawData &draw_data) const
+{
+  // set model, view, and projection matrices
+  glshader.SetMVPMatrices(draw_data.GetModelMatrix(), draw_data.GetViewMatrix(),
+                          draw_data.GetProjectionMatrix());
+
+  // twist (in radians per unit distance from the center), and the
+  // triangle to subdivide when generating vertices from gl_VertexID
+  auto root = GetRootTriangle();
+  Vec3f center = (root.p0 + root.p1 + root.p2) / 3;
+  glshader.SetUniformFloat("twist_angle", static_cast<GLfloat>(twist_angle_ * kDEGtoRAD));
+  glshader.SetUniformVec3("twist_center", glm::vec3{center[0], center[1], center[2]});
+  glshader.SetUniformInt("vertex_id_positions",
+                         vertex_source_ == VertexSource::kVertexID ? 1 : 0);
+  glshader.SetUniformInt("subdivisions", subdivisions_);
+  glshader.SetUniformVec3("triangle_p0", glm::vec3{root.p0[0], root.p0[1], root.p0[2]});
+  glshader.SetUniformVec3("triangle_p1", glm::vec3{root.p1[0], root.p1[1], root.p1[2]});
+  glshader.SetUniformVec3("triangle_p2", glm::vec3{root.p2[0], root.p2[1], root.p2[2]});
+  glshader.SetUniformInt("instance_subdivisions", 0);
+}
+
+
 void
 TwistTriangle::DrawGL(const GLDrawData &draw_data)
 {
@@ -185,19 +397,18 @@ TwistTriangle::DrawGL(const GLDrawData &draw_data)
   if (!glshader_ || !glshader_->Use())
     return;
 
-  if (gl_buffers_dirty_ || !vao_ || !positions_colors_vbo_)
+  auto from_vertex_id = vertex_source_ == VertexSource::kVertexID;
+  if (gl_buffers_dirty_ || !vao_ || (!from_vertex_id && !positions_colors_vbo_))
     UpdateGLBuffers(glshader_, false);
 
-  if (!vao_ || !positions_colors_vbo_ || !vertex_count_)
+  if (!vao_ || (!from_vertex_id && !positions_colors_vbo_) || !vertex_count_)
     return;
 
   // bind VAO and draw triangles
   glBindVertexArray(vao_);
 
-  // set model, view, and projection matrices
-  glshader_->SetMVPMatrices(draw_data.GetModelMatrix(),
-                            draw_data.GetViewMatrix(),
-                            draw_data.GetProjectionMatrix());
+  // set matrices and twist
+  SetupUniforms(*glshader_, draw_data);
 
   // draw triangles
   glDrawArrays(GL_TRIANGLES, 0, static_cast<GLsizei>(vertex_count_));
@@ -21,10 +21,19 @@ namespace olio {
 
 class GLDrawData;
 
+//! \class TwistTriangle
+//! \brief Subdivided triangle, twisted in the vertex shader (so
+//!        changing the twist angle only changes a uniform)
 class TwistTriangle {
 public:
   using Ptr = std::shared_ptr<TwistTriangle>;
 
+  //! \brief Where the vertex shader gets the untwisted vertices from
+  enum class VertexSource {
+    kVertexBuffer = 0,   //!< generated on the cpu once per level
+    kVertexID            //!< derived from gl_VertexID (no vertex buffer)
+  };
+
   explicit TwistTriangle(int subdivisions=0);
   TwistTriangle(const TwistTriangle &) = delete;
   TwistTriangle(TwistTriangle &&) = delete;
@@ -34,37 +43,48 @@ public:
 
   void SetSubdivisions(int subdivisions);
   void SetTwistAngle(Real twist_angle);
+  void SetVertexSource(VertexSource vertex_source);
   int GetSubdivisions() const {return subdivisions_;}
   Real GetTwistAngle() const {return twist_angle_;}
+  VertexSource GetVertexSource() const {return vertex_source_;}
+
+  //! \brief Highest subdivision level of the current vertex source
+  int GetMaxSubdivisions() const;
+
+  //! \brief Corners of the triangle that is subdivided
+  static void GetTriangle(Vec3f &p0, Vec3f &p1, Vec3f &p2);
+
+  //! \brief Number of vertices generated for a subdivision level
+  //!        (three per triangle, 4^subdivisions triangles)
+  static size_t GetVertexCount(int subdivisions);
 
-  //! \brief recursive function that subdivides and draws all the
-  //!        triangles that are displayed by the application
-  //! \param[in] p0 first triangle vertex
-  //! \param[in] p1 second triangle vertex
-  //! \param[in] p2 third triangle vertex
-  //! \param[in] level subdivision level
-  //! \param[in] color1 color of triangles pointing up
-  //! \param[in] color2 color of triangles pointing down
+  //! \brief Subdivide and twist the triangle, writing interleaved
+  //!        position/color floats (6 per vertex) in the order of a
+  //!        depth first traversal of the subdivision tree. Disjoint
+  //!        ranges of the output are filled in parallel.
+  //! \param[in] subdivisions subdivision level
   //! \param[in] twist_angle amount by which to rotate triangle vertices
-  //!                        (in degrees)
-  //! \param[in] center center of rotation
-  void DivideTriangle(const Vec3f &p0, const Vec3f &p1, const Vec3f &p2,
-                      int level, const Vec3f &color1,
-                      const Vec3f &color2, Real twist_angle, const Vec3f &center,
-                      std::vector<GLfloat> &positions_and_colors);
+  //!                        (in degrees per unit distance from center)
+  //! \param[out] positions_and_colors 6 * GetVertexCount(subdivisions)
+  //!                                  floats
+  static void GenerateTriangles(int subdivisions, Real twist_angle,
+                                GLfloat *positions_and_colors);
 
   // opengl
   void SetGLShader(GLShader::Ptr shader) { glshader_ = shader; }
   GLShader::Ptr GetGLShader() {return glshader_;}
   void DeleteGLBuffers();
   void UpdateGLBuffers(GLShader::Ptr glshader, bool force_update=false);
+  //! \brief Set the matrices, twist and vertex source uniforms of the
+  //!        (bound) shader
+  void SetupUniforms(const GLShader &glshader, const GLDrawData &draw_data) const;
   void DrawGL(const GLDrawData &draw_data);
 protected:
   GLShader::Ptr glshader_;
   int subdivisions_ = 0;  //!< number of subdivision levels
   Real twist_angle_ = 0;   //!< degrees
+  VertexSource vertex_source_ = VertexSource::kVertexID;
   size_t vertex_count_ = 0;
-  int max_subdivisions_ = 10;
 
   // opengl
   bool gl_buffers_dirty_ = false;
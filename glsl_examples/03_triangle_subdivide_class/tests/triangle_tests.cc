@@ -0,0 +1,173 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file   triangle_tests.cc
+//! \brief  Tests of the subdivided (twisted) triangle generated by
+//!         TwistTriangle::GenerateTriangles, against a recursive
+//!         subdivision
+//! \author Hadi Fadaifard, 2022
+
+#define CATCH_CONFIG_MAIN
+#include <cmath>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "twist_triangle.h"
+
+using namespace olio;
+using namespace std;
+
+namespace {
+struct Triangle {
+  Vec3f p0, p1, p2;
+  bool flipped;
+};
+
+
+// depth first recursive subdivision, children in the order of the
+// generated triangles (corner, corner, corner, then the center
+// triangle, which points the other way)
+void
+Subdivide(const Triangle &triangle, int levels, vector<Triangle> &triangles)
+{
+  if (!levels) {
+    triangles.push_back(triangle);
+    return;
+  }
+  Vec3f p01 = 0.5f * (triangle.p0 + triangle.p1);
+  Vec3f p02 = 0.5f * (triangle.p0 + triangle.p2);
+  Vec3f p12 = 0.5f * (triangle.p1 + triangle.p2);
+  Subdivide(Triangle{triangle.p0, p01, p02, triangle.flipped}, levels - 1, triangles);
+  Subdivide(Triangle{p01, triangle.p1, p12, triangle.flipped}, levels - 1, triangles);
+  Subdivide(Triangle{p02, p12, triangle.p2, triangle.flipped}, levels - 1, triangles);
+  Subdivide(Triangle{p01, p12, p02, !triangle.flipped}, levels - 1, triangles);
+}
+
+
+vector<Triangle>
+GetReferenceTriangles(int subdivisions)
+{
+  Triangle root{Vec3f::Zero(), Vec3f::Zero(), Vec3f::Zero(), false};
+  TwistTriangle::GetTriangle(root.p0, root.p1, root.p2);
+  vector<Triangle> triangles;
+  Subdivide(root, subdivisions, triangles);
+  return triangles;
+}
+
+
+vector<GLfloat>
+GenerateTriangles(int subdivisions, Real twist_angle)
+{
+  vector<GLfloat> vertices(6 * TwistTriangle::GetVertexCount(subdivisions));
+  TwistTriangle::GenerateTriangles(subdivisions, twist_angle, vertices.data());
+  return vertices;
+}
+
+
+Vec3d
+GetPosition(const vector<GLfloat> &vertices, size_t vertex)
+{
+  const auto *position = &vertices[6 * vertex];
+  return Vec3d{position[0], position[1], position[2]};
+}
+
+
+Vec3d
+GetColor(const vector<GLfloat> &vertices, size_t vertex)
+{
+  const auto *color = &vertices[6 * vertex + 3];
+  return Vec3d{color[0], color[1], color[2]};
+}
+}  // namespace
+
+
+TEST_CASE("vertex counts", "[triangle]")
+{
+  CHECK(TwistTriangle::GetVertexCount(0) == 3);
+  CHECK(TwistTriangle::GetVertexCount(1) == 12);
+  CHECK(TwistTriangle::GetVertexCount(6) == 3 * 4096);
+  CHECK(TwistTriangle::GetVertexCount(12) == size_t{3} << 24);
+}
+
+
+TEST_CASE("generated triangles match a recursive subdivision", "[triangle]")
+{
+  // levels below, at and above the levels generated per parallel task
+  for (int subdivisions = 0; subdivisions <= 8; ++subdivisions) {
+    INFO("subdivisions " << subdivisions);
+    auto vertices = GenerateTriangles(subdivisions, 0);
+    auto reference = GetReferenceTriangles(subdivisions);
+    REQUIRE(vertices.size() == 18 * reference.size());
+
+    double max_error = 0;
+    size_t wrong_colors = 0, flipped = 0;
+    for (size_t t = 0; t < reference.size(); ++t) {
+      const auto &triangle = reference[t];
+      Vec3d color = triangle.flipped ? Vec3d{0, 1, 0} : Vec3d{1, 0, 0};
+      flipped += triangle.flipped;
+      const Vec3f *points[] = {&triangle.p0, &triangle.p1, &triangle.p2};
+      for (size_t k = 0; k < 3; ++k) {
+        max_error = std::max(max_error, (GetPosition(vertices, 3 * t + k) -
+                                         points[k]->cast<double>()).norm());
+        wrong_colors += GetColor(vertices, 3 * t + k) != color;
+      }
+    }
+    CHECK(max_error <= 1e-6);
+    CHECK(wrong_colors == 0);
+    // 4^n triangles, of which (4^n - 2^n) / 2 point down
+    CHECK(flipped == ((size_t{1} << (2 * subdivisions)) - (size_t{1} << subdivisions)) / 2);
+  }
+}
+
+
+TEST_CASE("subdivided triangles have equal areas", "[triangle]")
+{
+  const int subdivisions = 7;
+  auto vertices = GenerateTriangles(subdivisions, 0);
+  Vec3f p0, p1, p2;
+  TwistTriangle::GetTriangle(p0, p1, p2);
+  auto root_area = 0.5 * (p1 - p0).cross(p2 - p0).cast<double>().norm();
+  auto area = root_area / static_cast<double>(size_t{1} << (2 * subdivisions));
+  double max_error = 0;
+  for (size_t v = 0; v < vertices.size() / 6; v += 3) {
+    auto a = GetPosition(vertices, v);
+    auto triangle_area = 0.5 * (GetPosition(vertices, v + 1) - a).cross(
+      GetPosition(vertices, v + 2) - a).norm();
+    max_error = std::max(max_error, std::abs(triangle_area - area) / area);
+  }
+  CHECK(max_error <= 1e-4);
+}
+
+
+TEST_CASE("twist rotates vertices about the center", "[triangle]")
+{
+  Vec3f p0, p1, p2;
+  TwistTriangle::GetTriangle(p0, p1, p2);
+  Vec3d center = ((p0 + p1 + p2) / 3).cast<double>();
+  for (Real twist_angle : {Real(-30), Real(45), Real(360)}) {
+    for (int subdivisions : {0, 3, 7}) {
+      INFO("twist " << twist_angle << ", subdivisions " << subdivisions);
+      auto untwisted = GenerateTriangles(subdivisions, 0);
+      auto twisted = GenerateTriangles(subdivisions, twist_angle);
+      REQUIRE(twisted.size() == untwisted.size());
+      double max_error = 0;
+      size_t wrong_colors = 0;
+      for (size_t v = 0; v < untwisted.size() / 6; ++v) {
+        // rotate by twist_angle degrees per unit distance from center
+        Vec3d offset = GetPosition(untwisted, v) - center;
+        auto angle = static_cast<double>(twist_angle) * M_PI / 180.0 * offset.norm();
+        Vec3d expected{std::cos(angle) * offset[0] - std::sin(angle) * offset[1],
+                       std::sin(angle) * offset[0] + std::cos(angle) * offset[1],
+                       offset[2]};
+        max_error = std::max(max_error, (GetPosition(twisted, v) - center -
+                                         expected).norm());
+        wrong_colors += GetColor(twisted, v) != GetColor(untwisted, v);
+      }
+      CHECK(max_error <= 1e-5);
+      CHECK(wrong_colors == 0);
+    }
+  }
+}
@@ -0,0 +1,775 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file  olio_bench.cc
+//! \brief Geometry benchmarks: times mesh loading, bounds, normal
+//!        computation, GL buffer packing and (optionally) upload, and
+//!        sphere tessellation, and reports geometry memory. Built once
+//!        per precision (olio_bench and olio_bench_sp) so the two can
+//!        be compared on the same models. Timings can be written as
+//!        JSON to track regressions across runs (correctness is tested
+//!        by olio_tests). Heap allocator activity of loads
+//!        (and of parallel loads, with or without per-thread arenas)
+//!        is reported so builds with and without OLIO_USE_JEMALLOC can
+//!        be compared.
+//! \author Hadi Fadaifard, 2022
+
+#include <iostream>
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+#include <spdlog/spdlog.h>
+#include "types.h"
+#include "trimesh.h"
+#include "mesh_normals.h"
+#include "bvh.h"
+#include "ambient_occlusion.h"
+#include "transform_kernels.h"
+#include "sphere.h"
+#include "utils/memory_stats.h"
+#include "utils/allocator.h"
+
+using namespace std;
+using namespace olio;
+namespace fs = boost::filesystem;
+
+//! \brief Benchmark settings
+struct BenchOptions {
+  int warmup{1};                //!< untimed runs per case
+  int repetitions{5};           //!< timed runs per case
+  bool gl_upload{false};        //!< also time GL buffer uploads
+  uint load_threads{0};         //!< threads of the parallel load case (0: skip)
+  bool thread_arenas{true};     //!< loader threads get their own arenas
+};
+
+
+//! \brief Timing of one benchmark case (milliseconds)
+struct BenchTiming {
+  double min_ms{0};
+  double median_ms{0};
+  double mad_ms{0};             //!< median absolute deviation (noise)
+};
+
+
+//! \class BenchReport
+//! \brief Timings and measured values of a run
+class BenchReport {
+public:
+  //! \brief Add the timing of a case
+  //! \param[in] subject model (or synthetic input) name
+  //! \param[in] name case name
+  //! \param[in] timing case timing
+  //! \param[in] items items processed per run (vertices, rays, ...)
+  void AddTiming(const std::string &subject, const std::string &name,
+                 const BenchTiming &timing, size_t items=0) {
+    timings_.push_back(Timing{subject, name, timing, items});
+  }
+
+  //! \brief Add a measured value (allocation counts, bytes, ...)
+  void AddMetric(const std::string &subject, const std::string &name, double value) {
+    metrics_.push_back(Metric{subject, name, value});
+  }
+
+  //! \brief Write the report as JSON
+  //! \param[in] path output file
+  //! \param[in] options settings of the run
+  //! \return true on success
+  bool WriteJSON(const fs::path &path, const BenchOptions &options) const;
+protected:
+  struct Timing {
+    std::string subject;
+    std::string name;
+    BenchTiming timing;
+    size_t items;
+  };
+  struct Metric {
+    std::string subject;
+    std::string name;
+    double value;
+  };
+  std::vector<Timing> timings_;
+  std::vector<Metric> metrics_;
+};
+
+BenchReport report_g;
+
+
+//! \brief Quote and escape a string for JSON
+std::string
+JSONString(const std::string &str)
+{
+  std::string quoted{"\""};
+  for (auto c : str) {
+    if (c == '"' || c == '\\')
+      quoted += {'\\', c};
+    else if (static_cast<unsigned char>(c) < 0x20)
+      quoted += fmt::format("\\u{:04x}", static_cast<int>(c));
+    else
+      quoted += c;
+  }
+  return quoted + "\"";
+}
+
+
+bool
+BenchReport::WriteJSON(const fs::path &path, const BenchOptions &options) const
+{
+  std::ofstream out(path.string());
+  if (!out) {
+    spdlog::error("failed to open {}", path.string());
+    return false;
+  }
+  out << "{\n";
+  out << fmt::format("  \"precision\": {},\n",
+                     JSONString(sizeof(Real) == sizeof(float) ? "single" : "double"));
+  out << fmt::format("  \"transform_isa\": {},\n", JSONString(GetTransformKernelsISA()));
+  out << fmt::format("  \"allocator\": {},\n  \"thread_arenas\": {},\n",
+                     JSONString(GetAllocatorName()), options.thread_arenas ? "true" : "false");
+  out << fmt::format("  \"warmup\": {},\n  \"repetitions\": {},\n", options.warmup,
+                     options.repetitions);
+  out << "  \"timings\": [";
+  for (size_t i = 0; i < timings_.size(); ++i) {
+    const auto &timing = timings_[i];
+    out << (i ? ",\n    " : "\n    ");
+    out << fmt::format("{{\"subject\": {}, \"name\": {}, \"min_ms\": {:.6f}, "
+                       "\"median_ms\": {:.6f}, \"mad_ms\": {:.6f}, \"items\": {}}}",
+                       JSONString(timing.subject), JSONString(timing.name),
+                       timing.timing.min_ms, timing.timing.median_ms,
+                       timing.timing.mad_ms, timing.items);
+  }
+  out << "\n  ],\n  \"metrics\": [";
+  for (size_t i = 0; i < metrics_.size(); ++i) {
+    const auto &metric = metrics_[i];
+    out << (i ? ",\n    " : "\n    ");
+    out << fmt::format("{{\"subject\": {}, \"name\": {}, \"value\": {}}}",
+                       JSONString(metric.subject), JSONString(metric.name), metric.value);
+  }
+  out << "\n  ]\n}\n";
+  return static_cast<bool>(out);
+}
+
+
+//! \brief Run func warmup + repetitions times and return min/median
+//!        time (and median absolute deviation) of the timed
+//!        repetitions
+BenchTiming
+RunTimed(const std::function<void()> &setup, const std::function<void()> &func,
+         int warmup, int repetitions)
+{
+  using Clock = std::chrono::steady_clock;
+  vector<double> times;
+  for (int i = 0; i < warmup + repetitions; ++i) {
+    if (setup)
+      setup();
+    auto start = Clock::now();
+    func();
+    auto elapsed = std::chrono::duration<double, std::milli>
+      (Clock::now() - start).count();
+    if (i >= warmup)
+      times.push_back(elapsed);
+  }
+  BenchTiming timing;
+  if (times.empty())
+    return timing;
+  std::sort(times.begin(), times.end());
+  timing.min_ms = times.front();
+  timing.median_ms = times[times.size() / 2];
+  for (auto &time : times)
+    time = std::abs(time - timing.median_ms);
+  std::sort(times.begin(), times.end());
+  timing.mad_ms = times[times.size() / 2];
+  return timing;
+}
+
+
+//! \brief Collect .obj/.off files under dir
+vector<fs::path>
+FindModels(const fs::path &dir)
+{
+  vector<fs::path> models;
+  boost::system::error_code ec;
+  if (!fs::is_directory(dir, ec))
+    return models;
+  for (fs::recursive_directory_iterator it(dir, ec), end; it != end && !ec;
+       it.increment(ec)) {
+    if (!fs::is_regular_file(it->path(), ec))
+      continue;
+    auto ext = it->path().extension().string();
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    if (ext == ".obj" || ext == ".off")
+      models.push_back(it->path());
+  }
+  std::sort(models.begin(), models.end());
+  return models;
+}
+
+
+//! \brief Run the batched transform benchmarks on a mesh's points and
+//!        vertex normals: one XformPoint per point vs the SoA kernels
+void
+BenchTransforms(TriMesh &mesh, const std::string &name, const BenchOptions &options)
+{
+  auto count = mesh.n_vertices();
+  if (!count)
+    return;
+  const auto *points = mesh.points();
+  Mat4r xform{Mat4r::Identity()};
+  xform.topLeftCorner<3, 3>() = Real(1.5) *
+    Eigen::AngleAxis<Real>(Real(0.7), Vec3r{1, 2, 3}.normalized()).toRotationMatrix();
+  xform.topRightCorner<3, 1>() = Vec3r{Real(0.1), -2, 3};
+
+  // one point at a time, through homogeneous coordinates
+  vector<Vec3r> reference(count);
+  auto xform_point = RunTimed(nullptr, [&]() {
+      for (size_t i = 0; i < count; ++i)
+        reference[i] = XformPoint(xform, points[i]);
+    }, options.warmup, options.repetitions);
+
+  // batched, in both precisions
+  SoAPointsf points_f, output_f;
+  SoAPointsd points_d, output_d;
+  ToSoA(points, count, points_f);
+  ToSoA(points, count, points_d);
+  auto points_float = RunTimed(nullptr, [&]() {
+      TransformPoints(xform, points_f, output_f);
+    }, options.warmup, options.repetitions);
+  auto points_double = RunTimed(nullptr, [&]() {
+      TransformPoints(xform, points_d, output_d);
+    }, options.warmup, options.repetitions);
+
+  // normals (inverse transpose and renormalization)
+  BenchTiming normals_float;
+  if (mesh.has_vertex_normals()) {
+    SoAPointsf normals_f;
+    ToSoA(mesh.vertex_normals(), count, normals_f);
+    normals_float = RunTimed(nullptr, [&]() {
+        TransformNormals(xform, normals_f, output_f);
+      }, options.warmup, options.repetitions);
+  }
+
+  auto Throughput = [count](const BenchTiming &timing) {
+    return timing.min_ms > 0 ? static_cast<double>(count) / (timing.min_ms * 1e3) : 0.0;
+  };
+  spdlog::info("  xform points       min {:9.3f} ms  median {:9.3f} ms  ({:.0f} Mpts/s)",
+               xform_point.min_ms, xform_point.median_ms, Throughput(xform_point));
+  spdlog::info("  soa points (f32)   min {:9.3f} ms  median {:9.3f} ms  ({:.0f} Mpts/s, {})",
+               points_float.min_ms, points_float.median_ms, Throughput(points_float),
+               GetTransformKernelsISA());
+  spdlog::info("  soa points (f64)   min {:9.3f} ms  median {:9.3f} ms  ({:.0f} Mpts/s)",
+               points_double.min_ms, points_double.median_ms, Throughput(points_double));
+  if (mesh.has_vertex_normals())
+    spdlog::info("  soa normals (f32)  min {:9.3f} ms  median {:9.3f} ms  ({:.0f} Mpts/s)",
+                 normals_float.min_ms, normals_float.median_ms, Throughput(normals_float));
+  report_g.AddTiming(name, "xform points", xform_point, count);
+  report_g.AddTiming(name, "soa points (f32)", points_float, count);
+  report_g.AddTiming(name, "soa points (f64)", points_double, count);
+  if (mesh.has_vertex_normals())
+    report_g.AddTiming(name, "soa normals (f32)", normals_float, count);
+}
+
+
+//! \brief Run the bounds/normals/pack (and GL upload) benchmarks on a
+//!        mesh
+//! \param[in] mesh input mesh
+//! \param[in] name mesh name, in the report
+//! \param[in] options benchmark settings
+void
+BenchGeometry(TriMesh &mesh, const std::string &name, const BenchOptions &options)
+{
+  spdlog::set_level(spdlog::level::warn);
+
+  // bounding box (full vertex scan)
+  Vec3r bmin, bmax;
+  auto bounds = RunTimed([&]() {mesh.InvalidateBounds();},
+                         [&]() {mesh.GetBoundingBox(bmin, bmax);},
+                         options.warmup, options.repetitions);
+
+  // normals: OpenMesh's circulator-based update vs the flat kernels
+  auto openmesh_normals = RunTimed(nullptr, [&]() {
+      mesh.update_face_normals();
+      mesh.update_vertex_normals();
+    }, options.warmup, options.repetitions);
+  const char *weighting_names[] = {"uniform", "area", "angle"};
+  const NormalWeighting weightings[] = {NormalWeighting::kUniform,
+    NormalWeighting::kArea, NormalWeighting::kAngle};
+  BenchTiming normals[3];
+  for (int i = 0; i < 3; ++i)
+    normals[i] = RunTimed(nullptr, [&]() {
+        mesh.ComputeFaceNormals();
+        mesh.ComputeVertexNormals(weightings[i]);
+      }, options.warmup, options.repetitions);
+
+  // GL buffer packing into vectors
+  vector<GLfloat> vertices, positions_only;
+  vector<GLuint> indices;
+  auto pack = RunTimed(nullptr, [&]() {
+      mesh.PackGLBuffers(vertices, positions_only, indices);
+    }, options.warmup, options.repetitions);
+  auto gl_bytes = (vertices.size() + positions_only.size()) * sizeof(GLfloat) +
+    indices.size() * sizeof(GLuint);
+  vector<GLfloat>().swap(vertices);
+  vector<GLfloat>().swap(positions_only);
+  vector<GLuint>().swap(indices);
+
+  // bvh build and closest-hit queries (pick latency) with rays from
+  // outside the bounding box towards random points inside it
+  auto bvh_build = RunTimed(nullptr, [&]() {mesh.UpdateBVH(false);},
+                            options.warmup, options.repetitions);
+  const size_t ray_count = 10000;
+  double query_us = 0;
+  size_t query_hits = 0;
+  auto bvh = mesh.GetBVH();
+  if (bvh) {
+    Vec3r bmin, bmax;
+    mesh.GetBoundingBox(bmin, bmax);
+    Vec3f center = (Real(0.5) * (bmin + bmax)).cast<float>();
+    Vec3f extent = (bmax - bmin).cast<float>();
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> uniform(-0.5f, 0.5f);
+    vector<Ray> rays(ray_count);
+    for (auto &ray : rays) {
+      Vec3f target = center + Vec3f{uniform(rng), uniform(rng), uniform(rng)}.cwiseProduct(extent);
+      Vec3f offset = Vec3f{uniform(rng), uniform(rng), uniform(rng)}.normalized();
+      ray.origin = target + 2.0f * extent.norm() * offset;
+      ray.direction = target - ray.origin;
+    }
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &ray : rays) {
+      RayHit hit;
+      if (bvh->Intersect(ray, hit))
+        ++query_hits;
+    }
+    query_us = std::chrono::duration<double, std::micro>(
+        std::chrono::steady_clock::now() - start).count() / ray_count;
+  }
+
+  // ambient occlusion bake (uncached) over the bvh
+  AOSettings ao_settings;
+  ao_settings.ray_count = 16;
+  AOStats ao_stats;
+  auto ao_bake = RunTimed(nullptr, [&]() {
+      mesh.UpdateAmbientOcclusion(ao_settings, false, &ao_stats);
+    }, options.warmup, options.repetitions);
+
+  // GL upload (packs straight into mapped buffers)
+  BenchTiming upload;
+  size_t upload_rss = 0;
+  if (options.gl_upload) {
+    auto rss_before = GetProcessRSS();
+    upload = RunTimed(nullptr, [&]() {
+        mesh.UpdateGLBuffers(true);
+        glFinish();
+      }, options.warmup, options.repetitions);
+    auto rss_after = GetProcessRSS();
+    upload_rss = rss_after > rss_before ? rss_after - rss_before : 0;
+  }
+  spdlog::set_level(spdlog::level::info);
+
+  auto vertex_count = mesh.n_vertices();
+  auto face_count = mesh.n_faces();
+  spdlog::info("  bounds             min {:9.3f} ms  median {:9.3f} ms",
+               bounds.min_ms, bounds.median_ms);
+  report_g.AddTiming(name, "bounds", bounds, vertex_count);
+  spdlog::info("  normals (openmesh) min {:9.3f} ms  median {:9.3f} ms",
+               openmesh_normals.min_ms, openmesh_normals.median_ms);
+  report_g.AddTiming(name, "normals (openmesh)", openmesh_normals, vertex_count);
+  for (int i = 0; i < 3; ++i) {
+    spdlog::info("  normals ({:<8}) min {:9.3f} ms  median {:9.3f} ms",
+                 weighting_names[i], normals[i].min_ms, normals[i].median_ms);
+    report_g.AddTiming(name, fmt::format("normals ({})", weighting_names[i]), normals[i],
+                       vertex_count);
+  }
+  spdlog::info("  bvh build          min {:9.3f} ms  median {:9.3f} ms  ({} nodes)",
+               bvh_build.min_ms, bvh_build.median_ms, bvh ? bvh->GetNodeCount() : 0);
+  spdlog::info("  bvh query          {:9.3f} us/ray ({:.1f}% hits)", query_us,
+               100.0 * static_cast<double>(query_hits) / static_cast<double>(ray_count));
+  spdlog::info("  ao bake ({:>2} rays) min {:9.3f} ms  median {:9.3f} ms  "
+               "({:.2f} Mrays/s)", ao_settings.ray_count, ao_bake.min_ms,
+               ao_bake.median_ms, ao_stats.GetRaysPerSecond() * 1e-6);
+  report_g.AddTiming(name, "bvh build", bvh_build, face_count);
+  BenchTiming query;
+  query.min_ms = query.median_ms = query_us * 1e-3 * static_cast<double>(ray_count);
+  report_g.AddTiming(name, "bvh query", query, ray_count);
+  report_g.AddTiming(name, "ao bake", ao_bake, vertex_count);
+  spdlog::info("  pack               min {:9.3f} ms  median {:9.3f} ms",
+               pack.min_ms, pack.median_ms);
+  report_g.AddTiming(name, "pack", pack, vertex_count);
+  if (options.gl_upload) {
+    auto stats = mesh.GetMemoryStats();
+    spdlog::info("  upload             min {:9.3f} ms  median {:9.3f} ms  "
+                 "(staging {}, rss growth {})", upload.min_ms, upload.median_ms,
+                 FormatBytes(stats.upload_bytes), FormatBytes(upload_rss));
+    report_g.AddTiming(name, "upload", upload, vertex_count);
+    mesh.DeleteGLBuffers();
+  }
+  auto stats = mesh.GetMemoryStats();
+  spdlog::info("  topology {}, properties {}, gl buffers {}",
+               FormatBytes(stats.connectivity_bytes),
+               FormatBytes(stats.property_bytes), FormatBytes(gl_bytes));
+  BenchTransforms(mesh, name, options);
+}
+
+
+//! \brief Report the heap allocator's activity of loading a model:
+//!        allocations per load, fragmentation while the mesh is alive,
+//!        and memory the allocator keeps once it is freed. Optionally
+//!        time processing loaded copies of the model on several threads
+//!        at once. TriMesh::Load serializes OpenMesh's reads, so only
+//!        the work after reading (normals, bvh build, gl packing) runs
+//!        concurrently and is timed
+void
+BenchLoadAllocations(const fs::path &model_path, const std::string &name,
+                     const BenchOptions &options)
+{
+  spdlog::set_level(spdlog::level::warn);
+  AllocatorStats before, loaded, freed;
+  bool has_stats = GetAllocatorStats(before);
+  {
+    TriMesh mesh;
+    mesh.Load(model_path);
+    has_stats = has_stats && GetAllocatorStats(loaded);
+  }
+  has_stats = has_stats && GetAllocatorStats(freed);
+
+  // concurrent post-read processing (wall time), each thread working
+  // on its own copy. the copies are read up front, since reads are
+  // serialized and would only measure waiting on the read lock
+  BenchTiming parallel_load;
+  AllocatorStats parallel_loaded;
+  vector<std::unique_ptr<TriMesh>> meshes(options.load_threads);
+  for (auto &mesh : meshes) {
+    mesh.reset(new TriMesh);
+    mesh->Load(model_path);
+  }
+  if (options.load_threads) {
+    parallel_load = RunTimed(nullptr, [&]() {
+        vector<std::thread> loaders;
+        for (auto &mesh : meshes)
+          loaders.emplace_back([&mesh]() {
+              UseThreadArena();
+              mesh->ComputeFaceNormals();
+              mesh->ComputeVertexNormals();
+              mesh->UpdateBVH(false);
+              vector<GLfloat> vertices, positions_only;
+              vector<GLuint> indices;
+              mesh->PackGLBuffers(vertices, positions_only, indices);
+            });
+        for (auto &loader : loaders)
+          loader.join();
+      }, options.warmup, options.repetitions);
+
+    // heap state with all the copies loaded
+    if (!GetAllocatorStats(parallel_loaded))
+      parallel_loaded = AllocatorStats{};
+    meshes.clear();
+  }
+  spdlog::set_level(spdlog::level::info);
+
+  if (has_stats) {
+    auto allocations = loaded.allocations - before.allocations;
+    auto retained = freed.resident > before.resident ? freed.resident - before.resident : 0;
+    spdlog::info("  heap ({:<8})    {} allocations, fragmentation {:.1f}%, "
+                 "{} retained after free", GetAllocatorName(),
+                 allocations ? fmt::format("{}", allocations) : std::string{"n/a"},
+                 100.0 * loaded.GetFragmentation(), FormatBytes(retained));
+    if (allocations)
+      report_g.AddMetric(name, "load allocations", static_cast<double>(allocations));
+    report_g.AddMetric(name, "load fragmentation", loaded.GetFragmentation());
+    report_g.AddMetric(name, "load retained bytes", static_cast<double>(retained));
+  }
+  if (options.load_threads) {
+    auto arenas = options.thread_arenas ? "thread arenas" : "shared arenas";
+    spdlog::info("  post-read ({:>2} thr) min {:9.3f} ms  median {:9.3f} ms  ({}, "
+                 "fragmentation {:.1f}%; reads are serialized and not timed)",
+                 options.load_threads, parallel_load.min_ms, parallel_load.median_ms,
+                 arenas, 100.0 * parallel_loaded.GetFragmentation());
+    auto case_name = fmt::format("parallel post-read ({} threads, {})",
+                                 options.load_threads, arenas);
+    report_g.AddTiming(name, case_name, parallel_load, options.load_threads);
+    report_g.AddMetric(name, case_name + " fragmentation", parallel_loaded.GetFragmentation());
+  }
+}
+
+
+//! \brief Run the load/normals/pack benchmarks on a single model
+bool
+BenchModel(const fs::path &model_path, const BenchOptions &options)
+{
+  // load once to validate the model and measure its memory. per-load
+  // logging is suppressed while timing
+  spdlog::set_level(spdlog::level::warn);
+  TriMesh reference;
+  if (!reference.Load(model_path)) {
+    spdlog::set_level(spdlog::level::info);
+    return false;
+  }
+
+  // load
+  std::unique_ptr<TriMesh> mesh;
+  auto load = RunTimed([&]() {mesh.reset(new TriMesh);},
+                       [&]() {mesh->Load(model_path);},
+                       options.warmup, options.repetitions);
+  mesh.reset();
+  spdlog::set_level(spdlog::level::info);
+
+  auto name = model_path.filename().string();
+  spdlog::info("{}: vertices: {}, faces: {}", name, reference.n_vertices(),
+               reference.n_faces());
+  spdlog::info("  load               min {:9.3f} ms  median {:9.3f} ms",
+               load.min_ms, load.median_ms);
+  report_g.AddTiming(name, "load", load, reference.n_faces());
+  BenchLoadAllocations(model_path, name, options);
+  BenchGeometry(reference, name, options);
+  return true;
+}
+
+
+//! \brief Build a regular grid mesh of (about) face_count triangles
+//!        on a bumpy height field
+//! \param[out] mesh output mesh
+//! \param[in] face_count requested number of triangles
+//! \return true on success
+bool
+BuildGridMesh(TriMesh &mesh, size_t face_count)
+{
+  auto n = static_cast<size_t>(std::sqrt(static_cast<double>(face_count) / 2.0)) + 1;
+  if (n < 2)
+    n = 2;
+  mesh.request_vertex_normals();
+  mesh.request_face_normals();
+  mesh.reserve(n * n, 3 * (n - 1) * (n - 1), 2 * (n - 1) * (n - 1));
+  vector<TriMesh::VertexHandle> vhandles;
+  vhandles.reserve(n * n);
+  for (size_t j = 0; j < n; ++j) {
+    for (size_t i = 0; i < n; ++i) {
+      auto x = static_cast<Real>(i) / static_cast<Real>(n - 1);
+      auto y = static_cast<Real>(j) / static_cast<Real>(n - 1);
+      auto z = Real(0.05) * std::sin(Real(20) * x) * std::cos(Real(20) * y);
+      vhandles.push_back(mesh.add_vertex(TriMesh::Point{x, y, z}));
+    }
+  }
+  for (size_t j = 0; j + 1 < n; ++j) {
+    for (size_t i = 0; i + 1 < n; ++i) {
+      auto v00 = vhandles[j * n + i], v10 = vhandles[j * n + i + 1];
+      auto v01 = vhandles[(j + 1) * n + i], v11 = vhandles[(j + 1) * n + i + 1];
+      mesh.add_face(v00, v10, v11);
+      mesh.add_face(v00, v11, v01);
+    }
+  }
+  return mesh.ComputeFaceNormals() && mesh.ComputeVertexNormals();
+}
+
+
+//! \brief Time watertight sphere tessellation on a grid_size^2 grid
+void
+BenchSphere(uint grid_size, const BenchOptions &options)
+{
+  auto name = fmt::format("sphere {0}x{0}", grid_size);
+  size_t vertex_count = 0, index_count = 0;
+  GetWatertightSphereSize(grid_size, grid_size, vertex_count, index_count);
+  const Vec3r center{1, -2, 3};
+  const Real radius = 2;
+  vector<GLfloat> vertices(6 * vertex_count);
+  vector<GLuint> indices(index_count);
+  auto build_vertices = RunTimed(nullptr, [&]() {
+      BuildWatertightSphereVertices(center, radius, grid_size, grid_size, vertices.data());
+    }, options.warmup, options.repetitions);
+  auto build_indices = RunTimed(nullptr, [&]() {
+      BuildWatertightSphereIndices(grid_size, grid_size, indices.data());
+    }, options.warmup, options.repetitions);
+  spdlog::info("{}: vertices: {}, faces: {}", name, vertex_count, index_count / 3);
+  spdlog::info("  sphere vertices    min {:9.3f} ms  median {:9.3f} ms",
+               build_vertices.min_ms, build_vertices.median_ms);
+  spdlog::info("  sphere indices     min {:9.3f} ms  median {:9.3f} ms",
+               build_indices.min_ms, build_indices.median_ms);
+  report_g.AddTiming(name, "sphere vertices", build_vertices, vertex_count);
+  report_g.AddTiming(name, "sphere indices", build_indices, index_count / 3);
+}
+
+
+//! \brief Create a hidden window, so GL uploads can be timed
+//! \return window (nullptr on failure)
+GLFWwindow*
+CreateHiddenGLContext()
+{
+  if (!glfwInit()) {
+    spdlog::error("glfwInit failed");
+    return nullptr;
+  }
+#if !defined(__APPLE__)
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+#else
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+  glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 1);
+  glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+  glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+  auto *window = glfwCreateWindow(64, 64, "olio_bench", nullptr, nullptr);
+  if (!window) {
+    spdlog::error("glfwCreatewindow failed");
+    glfwTerminate();
+    return nullptr;
+  }
+  glfwMakeContextCurrent(window);
+  if (glewInit() != GLEW_OK) {
+    spdlog::error("glewInit failed");
+    glfwDestroyWindow(window);
+    glfwTerminate();
+    return nullptr;
+  }
+  return window;
+}
+
+
+//! \brief Parse command line arguments
+bool
+ParseArguments(int argc, char **argv, std::vector<std::string> *mesh_names,
+               std::string *models_dir, std::vector<size_t> *grid_faces,
+               std::vector<uint> *sphere_grids, std::string *json_path,
+               BenchOptions *options)
+{
+  namespace po = boost::program_options;
+  po::options_description desc("options");
+  bool shared_arenas = false;
+  try {
+    desc.add_options()
+      ("help,h", "print usage")
+      ("mesh_name,m",
+       po::value<vector<std::string>>(mesh_names)->multitoken(),
+       "Mesh filenames (default: all models in models_dir)")
+      ("models_dir,d",
+       po::value<std::string>(models_dir)->default_value("../data/models"),
+       "Directory searched for .obj/.off models")
+      ("grid_faces,f",
+       po::value<vector<size_t>>(grid_faces)->multitoken(),
+       "Also benchmark synthetic grid meshes with about this many "
+       "triangles (e.g. 10000000)")
+      ("sphere_grids,s",
+       po::value<vector<uint>>(sphere_grids)->multitoken()->
+       default_value(vector<uint>{64, 512, 2048}, "64 512 2048"),
+       "Grid sizes of the sphere tessellation benchmarks (0 to skip)")
+      ("json,j", po::value<std::string>(json_path),
+       "Write timings to this JSON file")
+      ("load_threads,l", po::value<uint>(&options->load_threads)->default_value(0),
+       "Also time processing each model after loading (normals, bvh, gl "
+       "packing) on this many threads at once; reads are serialized, so "
+       "they are not part of the timing")
+      ("shared_arenas", po::bool_switch(&shared_arenas),
+       "Loader threads share jemalloc's arenas instead of getting one each")
+      ("gl_upload,g", po::bool_switch(&options->gl_upload),
+       "Time GL buffer uploads (needs a display)")
+      ("warmup,w", po::value<int>(&options->warmup)->default_value(1),
+       "Untimed warmup runs per case")
+      ("repetitions,r", po::value<int>(&options->repetitions)->default_value(5),
+       "Timed runs per case");
+
+    // parse arguments
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      cout << desc << endl;
+      return false;
+    }
+    po::notify(vm);
+    options->thread_arenas = !shared_arenas;
+    SetThreadArenasEnabled(options->thread_arenas);
+  } catch(std::exception &e) {
+    cout << desc << endl;
+    spdlog::error("{}", e.what());
+    return false;
+  } catch(...) {
+    cout << desc << endl;
+    spdlog::error("Invalid arguments");
+    return false;
+  }
+  return true;
+}
+
+
+//! \brief Main executable function
+int
+main(int argc, char **argv)
+{
+  std::vector<std::string> mesh_names;
+  std::string models_dir;
+  std::vector<size_t> grid_faces;
+  std::vector<uint> sphere_grids;
+  std::string json_path;
+  BenchOptions options;
+  if (!ParseArguments(argc, argv, &mesh_names, &models_dir, &grid_faces, &sphere_grids,
+                      &json_path, &options))
+    return -1;
+
+  vector<fs::path> models;
+  for (const auto &name : mesh_names)
+    models.push_back(name);
+  if (models.empty())
+    models = FindModels(models_dir);
+  if (models.empty() && grid_faces.empty()) {
+    spdlog::error("no models found in {}", models_dir);
+    return -1;
+  }
+
+  GLFWwindow *window = nullptr;
+  if (options.gl_upload) {
+    window = CreateHiddenGLContext();
+    if (!window)
+      return -1;
+    // element array buffer bindings are vao state, so bind one
+    GLuint vao = 0;
+    glGenVertexArrays(1, &vao);
+    glBindVertexArray(vao);
+  }
+
+  spdlog::info("precision: {} (sizeof(Real) = {}, sizeof(Vec3r) = {})",
+               sizeof(Real) == sizeof(float) ? "single" : "double",
+               sizeof(Real), sizeof(Vec3r));
+  spdlog::info("warmup: {}, repetitions: {}", options.warmup, options.repetitions);
+  spdlog::info("allocator: {}{}", GetAllocatorName(),
+               options.thread_arenas ? "" : " (shared arenas)");
+
+  size_t failed = 0;
+  for (const auto &model : models)
+    if (!BenchModel(model, options))
+      ++failed;
+  for (auto face_count : grid_faces) {
+    TriMesh grid("grid");
+    if (!BuildGridMesh(grid, face_count)) {
+      ++failed;
+      continue;
+    }
+    spdlog::info("grid: vertices: {}, faces: {}", grid.n_vertices(), grid.n_faces());
+    BenchGeometry(grid, fmt::format("grid {}", face_count), options);
+  }
+  for (auto grid_size : sphere_grids)
+    if (grid_size >= 3)
+      BenchSphere(grid_size, options);
+  spdlog::info("peak RSS: {}", FormatBytes(GetProcessPeakRSS()));
+
+  if (!json_path.empty() && !report_g.WriteJSON(json_path, options))
+    ++failed;
+
+  if (window) {
+    glfwDestroyWindow(window);
+    glfwTerminate();
+  }
+  return failed ? -1 : 0;
+}
@@ -19,6 +19,9 @@ if (UNIX AND NOT APPLE)
   endif()
 endif()
 
+# threads (octree chunk loader)
+find_package(Threads REQUIRED)
+
 # OpenMesh
 include(FindOpenMesh)
 find_package(OpenMesh 9.0 REQUIRED)
@@ -27,9 +30,11 @@ find_package(OpenMesh 9.0 REQUIRED)
 # find_package(OpenCV 4.1 REQUIRED PATHS "$ENV{OPENCV_DIR}")
 find_package(OpenCV REQUIRED)
 
-# jemalloc
-if(UNIX AND NOT APPLE)
-find_package(jemalloc)
+# jemalloc (opt-in: linking it replaces malloc)
+if(OLIO_USE_JEMALLOC)
+find_package(jemalloc REQUIRED)
+else()
+set(JEMALLOC_SHARED_LIB "")
 endif()
 
 # spdlog
@@ -40,9 +45,11 @@ find_package(spdlog REQUIRED)
 set(SPDLOG_LIBRARIES spdlog::spdlog)
 endif()
 
-# catch2
+# catch2 (single header, <catch2/catch.hpp>): third_party copy or
+# system install. tests are skipped without it
 set(CATCH2_DIR ${CMAKE_CURRENT_SOURCE_DIR}/third_party/Catch2)
-set(CATCH2_INCLUDE_DIRS ${CATCH2_DIR}/include)
+find_path(CATCH2_INCLUDE_DIRS catch2/catch.hpp
+  HINTS ${CATCH2_DIR}/include ${CATCH2_DIR}/single_include)
 
 # tqdm
 set(TQDM_INCLUDE_DIRS ${CMAKE_CURRENT_SOURCE_DIR}/third_party/tqdm/include)
@@ -83,6 +90,12 @@ set (olio_COMMON_SYSTEM_INCLUDE_DIRS
   SYSTEM ${SPDLOG_INCLUDE_DIRS}
   SYSTEM ${GLFW_INCLUDE_DIRS}
 )
+if(OLIO_USE_JEMALLOC)
+set (olio_COMMON_SYSTEM_INCLUDE_DIRS
+  ${olio_COMMON_SYSTEM_INCLUDE_DIRS}
+  SYSTEM ${JEMALLOC_INCLUDE_DIR}
+)
+endif()
 
 set (olio_COMMON_EXTERNAL_LIBRARIES
   ${OPENMESH_LIBRARIES}
@@ -96,6 +109,7 @@ set (olio_COMMON_EXTERNAL_LIBRARIES
   ${GLM_LIBRARIES}
   GLEW::GLEW
   ${GLFW_LIBRARIES}
+  Threads::Threads
 )
 
 # add libdl to non-windows builds
@@ -3,9 +3,21 @@
 #define MAX_LIGHTS 10
 #define EPSILON 0.000001
 
+// optional compile-time switches (injected by GLShaderPermutations):
+//   POINT_LIGHT_COUNT  -- number of point lights; unrolls the light loop
+//   HAS_TEXCOORDS      -- vertex stream contains texture coordinates
+//   HAS_VERTEX_AO      -- per-vertex ambient occlusion attribute
+//   USE_UNIFORM_BLOCKS -- read matrices from FrameBlock/ObjectBlock
+
 // input vertex attributes
 in vec3 position;
 in vec3 normal;
+#if defined(HAS_TEXCOORDS)
+in vec2 texcoord;
+#endif
+#if defined(HAS_VERTEX_AO)
+in float ambient_occlusion;
+#endif
 
 struct PointLight {
   vec3 position;
@@ -24,14 +36,33 @@ struct PhongMaterial {
 uniform PointLight point_lights[MAX_LIGHTS];
 uniform uint point_light_count;
 uniform PhongMaterial material;
+#if defined(USE_UNIFORM_BLOCKS)
+// matrices streamed into uniform buffers once per frame
+layout(std140) uniform FrameBlock {
+  mat4 proj_matrix;
+  mat4 view_matrix;
+};
+layout(std140) uniform ObjectBlock {
+  mat4 mv_matrix;
+  mat4 norm_matrix;
+};
+#else
 uniform mat4 mv_matrix;
 uniform mat4 norm_matrix;
 uniform mat4 proj_matrix;
+#endif
+
+// the depth pre-pass and the lighting pass must produce bit-identical
+// depth values for GL_EQUAL depth testing
+invariant gl_Position;
 
 // output attributes
 out vec4 vertex_color;
+#if defined(HAS_TEXCOORDS)
+out vec2 v_texcoord;
+#endif
 
-vec3 Illuminate(vec3 vertex_position, uint i, vec3 view_vec, vec3 normal_vec)
+vec3 Illuminate(vec3 vertex_position, int i, vec3 view_vec, vec3 normal_vec)
 {
   // compute irradiance
   vec3 light_vec = point_lights[i].position - vertex_position;
@@ -42,6 +73,9 @@ vec3 Illuminate(vec3 vertex_position, uint i, vec3 view_vec, vec3 normal_vec)
 
   // ambient coefficient
   vec3 out_color = point_lights[i].ambient * material.ambient;
+#if defined(HAS_VERTEX_AO)
+  out_color *= ambient_occlusion;
+#endif
 
   // specular coefficient
   vec3 half_vec = normalize((light_vec + view_vec) * .5);
@@ -63,6 +97,15 @@ void main(void)
   vec3 normal_vec = normalize((norm_matrix * vec4(normal, 0)).xyz);
   vec3 view_vec = normalize(-mv_position.xyz);
   vertex_color = vec4(0, 0, 0, 1);
-  for (uint i = 0u; i < point_light_count; ++i)
+#if defined(POINT_LIGHT_COUNT)
+  // constant trip count: the driver can fully unroll the loop
+  for (int i = 0; i < POINT_LIGHT_COUNT; ++i)
+    vertex_color.xyz += Illuminate(mv_position.xyz, i, view_vec, normal_vec);
+#else
+  for (int i = 0; i < int(point_light_count); ++i)
     vertex_color.xyz += Illuminate(mv_position.xyz, i, view_vec, normal_vec);
+#endif
+#if defined(HAS_TEXCOORDS)
+  v_texcoord = texcoord;
+#endif
 }
@@ -2,15 +2,30 @@
 #define MAX_LIGHTS 10
 #define EPSILON 0.000001
 
+// optional compile-time switches (injected by GLShaderPermutations):
+//   POINT_LIGHT_COUNT  -- number of point lights; unrolls the light loop
+//   POSITION_ONLY      -- depth-only pass; no shading
+//   HAS_TEXCOORDS      -- texture coordinates are available
+//   HAS_VERTEX_AO      -- baked per-vertex ambient occlusion is available
+//   HAS_DIFFUSE_MAP    -- diffuse_map modulates the diffuse and ambient
+//                         coefficients (with HAS_TEXCOORDS only)
+
 // output frag color
 out vec4 FragColor;
 
+#if !defined(POSITION_ONLY)
 // input from vertex shader
 in vec4 vertex_color;
 in vec3 v_position;
 in vec3 v_normal;
 in vec3 view_vec;
 in vec3 normal_vec;
+#if defined(HAS_TEXCOORDS)
+in vec2 v_texcoord;
+#endif
+#if defined(HAS_VERTEX_AO)
+in float v_ambient_occlusion;
+#endif
 
 
 struct PointLight {
@@ -30,9 +45,15 @@ struct PhongMaterial {
 uniform PointLight point_lights[MAX_LIGHTS];
 uniform uint point_light_count;
 uniform PhongMaterial material;
+#if defined(HAS_DIFFUSE_MAP)
+uniform sampler2D diffuse_map;
+#endif
+
+// diffuse texel, sampled once per fragment in main
+vec3 diffuse_texel = vec3(1);
 
 
-vec3 Illuminate(vec3 vertex_position, uint i, vec3 view_vec, vec3 normal_vec)
+vec3 Illuminate(vec3 vertex_position, int i, vec3 view_vec, vec3 normal_vec)
 {
   // compute irradiance
   vec3 light_vec = point_lights[i].position - vertex_position;
@@ -42,7 +63,10 @@ vec3 Illuminate(vec3 vertex_position, uint i, vec3 view_vec, vec3 normal_vec)
 					     / dist2);
 
   // ambient coefficient
-  vec3 out_color = point_lights[i].ambient * material.ambient;
+  vec3 out_color = point_lights[i].ambient * material.ambient * diffuse_texel;
+#if defined(HAS_VERTEX_AO)
+  out_color *= v_ambient_occlusion;
+#endif
 
   // specular coefficient
   vec3 half_vec = normalize((light_vec + view_vec) * .5);
@@ -52,15 +76,27 @@ vec3 Illuminate(vec3 vertex_position, uint i, vec3 view_vec, vec3 normal_vec)
     specular_coeff = material.specular*pow(half_dot_normal, material.shininess);
 
   // compute out color
-  out_color += (material.diffuse + specular_coeff) * irradiance;
+  out_color += (material.diffuse * diffuse_texel + specular_coeff) * irradiance;
   return out_color;
 }
+#endif
 
 void main(void)
 {
+#if defined(POSITION_ONLY)
+  FragColor = vec4(0, 0, 0, 1);
+#else
   FragColor = vertex_color;
-  for (uint i = 0u; i < point_light_count; ++i)
+#if defined(HAS_DIFFUSE_MAP)
+  diffuse_texel = texture(diffuse_map, v_texcoord).rgb;
+#endif
+#if defined(POINT_LIGHT_COUNT)
+  // constant trip count: the driver can fully unroll the loop
+  for (int i = 0; i < POINT_LIGHT_COUNT; ++i)
     FragColor.xyz += Illuminate(v_position, i, view_vec, normal_vec);
-
-
-}
\ No newline at end of file
+#else
+  for (int i = 0; i < int(point_light_count); ++i)
+    FragColor.xyz += Illuminate(v_position, i, view_vec, normal_vec);
+#endif
+#endif
+}
@@ -3,32 +3,77 @@
 #define MAX_LIGHTS 10
 #define EPSILON 0.000001
 
+// optional compile-time switches (injected by GLShaderPermutations):
+//   POSITION_ONLY      -- vertex stream contains positions only (depth pass)
+//   HAS_TEXCOORDS      -- vertex stream contains texture coordinates
+//   HAS_VERTEX_AO      -- per-vertex ambient occlusion attribute
+//   USE_UNIFORM_BLOCKS -- read matrices from FrameBlock/ObjectBlock
+
 // input vertex attributes
 in vec3 position;
+#if !defined(POSITION_ONLY)
 in vec3 normal;
+#endif
+#if defined(HAS_TEXCOORDS)
+in vec2 texcoord;
+#endif
+#if defined(HAS_VERTEX_AO)
+in float ambient_occlusion;
+#endif
 
+#if defined(USE_UNIFORM_BLOCKS)
+// matrices streamed into uniform buffers once per frame
+layout(std140) uniform FrameBlock {
+  mat4 proj_matrix;
+  mat4 view_matrix;
+};
+layout(std140) uniform ObjectBlock {
+  mat4 mv_matrix;
+  mat4 norm_matrix;
+};
+#else
 uniform mat4 mv_matrix;
 uniform mat4 norm_matrix;
 uniform mat4 proj_matrix;
+#endif
+
+// the depth pre-pass and the lighting pass must produce bit-identical
+// depth values for GL_EQUAL depth testing
+invariant gl_Position;
 
 // output attributes
+#if !defined(POSITION_ONLY)
 out vec4 vertex_color;
 out vec3 v_position;
 out vec3 v_normal;
 out vec3 view_vec;
 out vec3 normal_vec;
+#endif
+#if defined(HAS_TEXCOORDS)
+out vec2 v_texcoord;
+#endif
+#if defined(HAS_VERTEX_AO)
+out float v_ambient_occlusion;
+#endif
 
 void main(void)
 {
-  v_position = vec3(mv_matrix * vec4(position,1));
   vec4 mv_position = mv_matrix * vec4(position, 1);
   gl_Position = proj_matrix * mv_position;
 
+#if !defined(POSITION_ONLY)
+  v_position = mv_position.xyz;
   normal_vec = normalize((norm_matrix * vec4(normal, 0)).xyz);
   view_vec = normalize(-mv_position.xyz);
   // assign color to red 
   vertex_color = vec4(0, 0, 0, 1);
   // assign v_normal to vertex normal
   v_normal = normal;
-
-}
\ No newline at end of file
+#endif
+#if defined(HAS_TEXCOORDS)
+  v_texcoord = texcoord;
+#endif
+#if defined(HAS_VERTEX_AO)
+  v_ambient_occlusion = ambient_occlusion;
+#endif
+}
@@ -0,0 +1,205 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       ambient_occlusion.cc
+//! \brief      Per-vertex ambient occlusion baked (in parallel) by
+//!             casting hemisphere rays against a BVH
+//! \author     Hadi Fadaifard, 2022
+
+#include "ambient_occlusion.h"
+#include <cmath>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+namespace olio {
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace {
+constexpr char kCacheMagic[8] = {'O', 'L', 'I', 'O', 'A', 'O', 'V', '1'};
+constexpr size_t kVertexGrainSize = 64;
+
+//! 64-bit mix (splitmix64 finalizer)
+uint64_t
+Mix(uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+
+//! uniform float in [0, 1) from the top 24 bits
+float
+ToUnitFloat(uint64_t x)
+{
+  return static_cast<float>(x >> 40) * (1.0f / 16777216.0f);
+}
+
+
+//! radical inverse in base 2
+float
+RadicalInverse(uint32_t i)
+{
+  i = (i << 16) | (i >> 16);
+  i = ((i & 0x55555555u) << 1) | ((i & 0xaaaaaaaau) >> 1);
+  i = ((i & 0x33333333u) << 2) | ((i & 0xccccccccu) >> 2);
+  i = ((i & 0x0f0f0f0fu) << 4) | ((i & 0xf0f0f0f0u) >> 4);
+  i = ((i & 0x00ff00ffu) << 8) | ((i & 0xff00ff00u) >> 8);
+  return static_cast<float>(i) * (1.0f / 4294967296.0f);
+}
+
+
+//! orthonormal basis (t, b) around unit n
+void
+BuildBasis(const Vec3f &n, Vec3f &t, Vec3f &b)
+{
+  float sign = std::copysign(1.0f, n[2]);
+  float a = -1.0f / (sign + n[2]);
+  float c = n[0] * n[1] * a;
+  t = Vec3f{1.0f + sign * n[0] * n[0] * a, sign * c, -sign * n[0]};
+  b = Vec3f{c, sign + n[1] * n[1] * a, -n[1]};
+}
+}  // namespace
+
+
+bool
+BakeAmbientOcclusion(const BVH &bvh, const Vec3r *points, const Vec3r *normals,
+                     size_t vertex_count, Real diagonal, const AOSettings &settings,
+                     vector<float> &occlusion, AOStats *stats)
+{
+  using Clock = chrono::steady_clock;
+  if (!points || !normals || !vertex_count || !settings.ray_count ||
+      !bvh.GetNodeCount() || diagonal <= 0) {
+    spdlog::error("BakeAmbientOcclusion: invalid input");
+    return false;
+  }
+
+  auto start = Clock::now();
+  auto max_distance = static_cast<float>(settings.max_distance * diagonal);
+  auto bias = static_cast<float>(settings.bias * diagonal);
+  auto ray_count = settings.ray_count;
+  auto inv_ray_count = 1.0f / static_cast<float>(ray_count);
+  constexpr float kTwoPi = 6.28318530717958647692f;
+
+  // every vertex uses the same hammersley point set, rotated by a
+  // per-vertex offset (cranley-patterson rotation): low variance, and
+  // independent of how vertices are split among threads
+  occlusion.resize(vertex_count);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, vertex_count, kVertexGrainSize),
+                    [&](const tbb::blocked_range<size_t> &r) {
+    Vec3f t, b;
+    Ray ray;
+    for (size_t i = r.begin(); i != r.end(); ++i) {
+      Vec3f n = normals[i].cast<float>();
+      float length = n.norm();
+      if (length == 0 || !std::isfinite(length)) {
+        occlusion[i] = 1.0f;
+        continue;
+      }
+      n /= length;
+      BuildBasis(n, t, b);
+      ray.origin = points[i].cast<float>() + bias * n;
+
+      auto hash = Mix(static_cast<uint64_t>(i) ^
+                      (static_cast<uint64_t>(settings.seed) << 32));
+      float offset0 = ToUnitFloat(hash);
+      float offset1 = ToUnitFloat(Mix(hash));
+      uint unoccluded = 0;
+      for (uint k = 0; k < ray_count; ++k) {
+        // cosine-weighted direction from the rotated sample
+        float u0 = (static_cast<float>(k) + 0.5f) * inv_ray_count + offset0;
+        float u1 = RadicalInverse(k) + offset1;
+        u0 -= std::floor(u0);
+        u1 -= std::floor(u1);
+        float radius = std::sqrt(u0);
+        float phi = kTwoPi * u1;
+        float x = radius * std::cos(phi);
+        float y = radius * std::sin(phi);
+        float z = std::sqrt(std::max(0.0f, 1.0f - u0));
+        ray.direction = x * t + y * b + z * n;
+        if (!bvh.Occluded(ray, max_distance))
+          ++unoccluded;
+      }
+      occlusion[i] = static_cast<float>(unoccluded) * inv_ray_count;
+    }
+  });
+
+  if (stats) {
+    stats->rays = static_cast<uint64_t>(vertex_count) * ray_count;
+    stats->seconds = chrono::duration<double>(Clock::now() - start).count();
+  }
+  return true;
+}
+
+
+bool
+SaveAmbientOcclusion(const fs::path &path, uint64_t source_stamp,
+                     const AOSettings &settings, const vector<float> &occlusion)
+{
+  ofstream out(path.string(), ios::binary);
+  if (!out) {
+    spdlog::error("ambient occlusion: could not write {}", path.string());
+    return false;
+  }
+  uint64_t header[3] = {source_stamp, occlusion.size(), settings.ray_count};
+  float parameters[2] = {settings.max_distance, settings.bias};
+  uint32_t seed = settings.seed;
+  out.write(kCacheMagic, sizeof(kCacheMagic));
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(parameters), sizeof(parameters));
+  out.write(reinterpret_cast<const char*>(&seed), sizeof(seed));
+  out.write(reinterpret_cast<const char*>(occlusion.data()),
+            static_cast<streamsize>(occlusion.size() * sizeof(float)));
+  if (!out) {
+    spdlog::error("ambient occlusion: could not write {}", path.string());
+    return false;
+  }
+  return true;
+}
+
+
+bool
+LoadAmbientOcclusion(const fs::path &path, uint64_t source_stamp,
+                     const AOSettings &settings, size_t vertex_count,
+                     vector<float> &occlusion)
+{
+  ifstream in(path.string(), ios::binary);
+  if (!in)
+    return false;
+  char magic[sizeof(kCacheMagic)];
+  uint64_t header[3];
+  float parameters[2];
+  uint32_t seed;
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(header), sizeof(header));
+  in.read(reinterpret_cast<char*>(parameters), sizeof(parameters));
+  in.read(reinterpret_cast<char*>(&seed), sizeof(seed));
+  if (!in || memcmp(magic, kCacheMagic, sizeof(magic)) != 0 ||
+      header[0] != source_stamp || header[1] != vertex_count ||
+      header[2] != settings.ray_count || parameters[0] != settings.max_distance ||
+      parameters[1] != settings.bias || seed != settings.seed)
+    return false;
+
+  occlusion.resize(vertex_count);
+  in.read(reinterpret_cast<char*>(occlusion.data()),
+          static_cast<streamsize>(occlusion.size() * sizeof(float)));
+  if (!in) {
+    spdlog::warn("ambient occlusion: truncated cache file {}", path.string());
+    occlusion.clear();
+    return false;
+  }
+  return true;
+}
+
+}  // namespace olio
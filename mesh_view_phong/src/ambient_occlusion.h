@@ -0,0 +1,84 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       ambient_occlusion.h
+//! \brief      Per-vertex ambient occlusion baked (in parallel) by
+//!             casting hemisphere rays against a BVH
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+#include "types.h"
+#include "bvh.h"
+
+namespace olio {
+
+//! \struct AOSettings
+//! \brief Ambient occlusion baking parameters
+struct AOSettings {
+  uint ray_count{64};         //!< hemisphere rays per vertex
+  float max_distance{0.25f};  //!< occluder range (fraction of bbox diagonal)
+  float bias{1e-4f};          //!< ray origin offset (fraction of bbox diagonal)
+  uint32_t seed{0};           //!< rotates the per-vertex sample pattern
+};
+
+
+//! \struct AOStats
+//! \brief Timing of the last bake
+struct AOStats {
+  uint64_t rays{0};           //!< number of rays cast
+  double seconds{0};          //!< wall-clock bake time
+  double GetRaysPerSecond() const {
+    return seconds > 0 ? static_cast<double>(rays) / seconds : 0;
+  }
+};
+
+
+//! \brief Bake ambient occlusion for every vertex. Rays are
+//!        cosine-distributed over the hemisphere around the vertex
+//!        normal; the result is the fraction of rays that escape
+//!        (1: unoccluded, 0: fully occluded). Results don't depend on
+//!        the number of threads
+//! \param[in] bvh bvh over the mesh triangles
+//! \param[in] points vertex positions
+//! \param[in] normals unit vertex normals
+//! \param[in] vertex_count number of vertices
+//! \param[in] diagonal length of the mesh bounding box diagonal
+//! \param[in] settings baking parameters
+//! \param[out] occlusion vertex_count ambient occlusion values
+//! \param[out] stats rays cast and bake time (optional)
+//! \return true on success
+bool BakeAmbientOcclusion(const BVH &bvh, const Vec3r *points, const Vec3r *normals,
+                          size_t vertex_count, Real diagonal,
+                          const AOSettings &settings, std::vector<float> &occlusion,
+                          AOStats *stats=nullptr);
+
+//! \brief Write baked ambient occlusion to a cache file
+//! \param[in] path cache file
+//! \param[in] source_stamp identifies the source mesh version
+//! \param[in] settings settings used for baking
+//! \param[in] occlusion per-vertex values
+//! \return true on success
+bool SaveAmbientOcclusion(const boost::filesystem::path &path, uint64_t source_stamp,
+                          const AOSettings &settings,
+                          const std::vector<float> &occlusion);
+
+//! \brief Read baked ambient occlusion from a cache file
+//! \param[in] path cache file
+//! \param[in] source_stamp expected source mesh version
+//! \param[in] settings expected baking settings
+//! \param[in] vertex_count expected number of vertices
+//! \param[out] occlusion per-vertex values
+//! \return true on success (false if missing or stale)
+bool LoadAmbientOcclusion(const boost::filesystem::path &path, uint64_t source_stamp,
+                          const AOSettings &settings, size_t vertex_count,
+                          std::vector<float> &occlusion);
+
+}  // namespace olio
@@ -0,0 +1,475 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       bvh.cc
+//! \brief      Triangle bounding volume hierarchy (SAH binned, built in
+//!             parallel) for ray queries
+//! \author     Hadi Fadaifard, 2022
+
+#include "bvh.h"
+#include <atomic>
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+#include <tbb/parallel_invoke.h>
+#include <tbb/parallel_reduce.h>
+#include <tbb/blocked_range.h>
+
+namespace olio {
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace {
+constexpr int kBinCount = 16;             // sah bins per axis
+constexpr uint32_t kMaxLeafSize = 8;      // forced split above this
+constexpr uint32_t kParallelBuildSize = 4096;  // spawn subtrees above this
+constexpr uint32_t kMaxDepth = 60;        // bounds the traversal stack
+constexpr float kTraversalCost = 1.0f;    // sah cost of a node visit
+constexpr float kIntersectionCost = 1.0f; // sah cost of a triangle test
+constexpr char kCacheMagic[8] = {'O', 'L', 'I', 'O', 'B', 'V', 'H', '1'};
+
+//! axis aligned box
+struct AABB {
+  Vec3f bmin{Vec3f::Constant(std::numeric_limits<float>::max())};
+  Vec3f bmax{Vec3f::Constant(-std::numeric_limits<float>::max())};
+  void Grow(const Vec3f &p) {bmin = bmin.cwiseMin(p); bmax = bmax.cwiseMax(p);}
+  void Grow(const AABB &b) {bmin = bmin.cwiseMin(b.bmin); bmax = bmax.cwiseMax(b.bmax);}
+  float HalfArea() const {
+    if (bmin[0] > bmax[0])
+      return 0;
+    Vec3f d = bmax - bmin;
+    return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+  }
+};
+
+//! bounds and centroid bounds of a range of triangles
+struct RangeBounds {
+  AABB bounds;
+  AABB centroid_bounds;
+  void Join(const RangeBounds &rhs) {
+    bounds.Grow(rhs.bounds);
+    centroid_bounds.Grow(rhs.centroid_bounds);
+  }
+};
+
+//! per-axis sah bins of a range of triangles
+struct Bins {
+  AABB bounds[3][kBinCount];
+  uint32_t counts[3][kBinCount] = {};
+  void Join(const Bins &rhs) {
+    for (int axis = 0; axis < 3; ++axis)
+      for (int b = 0; b < kBinCount; ++b) {
+        bounds[axis][b].Grow(rhs.bounds[axis][b]);
+        counts[axis][b] += rhs.counts[axis][b];
+      }
+  }
+};
+
+// ray/triangle intersection (Moller-Trumbore)
+inline bool
+IntersectTriangle(const Ray &ray, const Vec3f &p0, const Vec3f &p1,
+                  const Vec3f &p2, float t_max, float &t, float &u, float &v)
+{
+  Vec3f e1 = p1 - p0;
+  Vec3f e2 = p2 - p0;
+  Vec3f pvec = ray.direction.cross(e2);
+  float det = e1.dot(pvec);
+  if (std::abs(det) < 1e-12f)
+    return false;
+  float inv_det = 1.0f / det;
+  Vec3f tvec = ray.origin - p0;
+  u = tvec.dot(pvec) * inv_det;
+  if (u < 0 || u > 1)
+    return false;
+  Vec3f qvec = tvec.cross(e1);
+  v = ray.direction.dot(qvec) * inv_det;
+  if (v < 0 || u + v > 1)
+    return false;
+  t = e2.dot(qvec) * inv_det;
+  return t > 0 && t < t_max;
+}
+
+// ray/box slab test; returns entry distance in t_near
+inline bool
+IntersectNode(const BVH::Node &node, const Vec3f &origin, const Vec3f &inv_dir,
+              float t_max, float &t_near)
+{
+  float t0 = 0, t1 = t_max;
+  for (int axis = 0; axis < 3; ++axis) {
+    float t_enter = (node.bmin[axis] - origin[axis]) * inv_dir[axis];
+    float t_exit = (node.bmax[axis] - origin[axis]) * inv_dir[axis];
+    if (t_enter > t_exit)
+      std::swap(t_enter, t_exit);
+    t0 = t_enter > t0 ? t_enter : t0;
+    t1 = t_exit < t1 ? t_exit : t1;
+    if (t0 > t1)
+      return false;
+  }
+  t_near = t0;
+  return true;
+}
+}  // namespace
+
+
+//! \brief Data shared by the (parallel) node builds
+struct BVH::BuildData {
+  vector<AABB> prim_bounds;
+  vector<Vec3f> prim_centroids;
+  vector<uint32_t> prim_order;
+  std::atomic<uint32_t> node_count{1};
+};
+
+
+bool
+BVH::Build(const Vec3r *points, const uint32_t *indices, size_t face_count)
+{
+  nodes_.clear();
+  face_ids_.clear();
+  triangles_.clear();
+  if (!face_count)
+    return false;
+  if (face_count >= std::numeric_limits<uint32_t>::max() / 2) {
+    spdlog::error("bvh: too many triangles ({})", face_count);
+    return false;
+  }
+
+  // triangle bounds and centroids
+  BuildData data;
+  data.prim_bounds.resize(face_count);
+  data.prim_centroids.resize(face_count);
+  data.prim_order.resize(face_count);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, face_count, 4096),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t f = range.begin(); f != range.end(); ++f) {
+      AABB bounds;
+      for (size_t k = 0; k < 3; ++k)
+        bounds.Grow(points[indices[3 * f + k]].cast<float>());
+      data.prim_bounds[f] = bounds;
+      data.prim_centroids[f] = 0.5f * (bounds.bmin + bounds.bmax);
+      data.prim_order[f] = static_cast<uint32_t>(f);
+    }
+  });
+
+  // a binary tree with one-triangle leaves has 2n - 1 nodes
+  nodes_.resize(2 * face_count - 1);
+  BuildNode(data, 0, 0, static_cast<uint32_t>(face_count), 0);
+  nodes_.resize(data.node_count);
+  nodes_.shrink_to_fit();
+
+  // copy the triangles in leaf order, so leaves read contiguous memory
+  face_ids_.swap(data.prim_order);
+  triangles_.resize(3 * face_count);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, face_count, 4096),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t i = range.begin(); i != range.end(); ++i)
+      for (size_t k = 0; k < 3; ++k)
+        triangles_[3 * i + k] = points[indices[3 * face_ids_[i] + k]].cast<float>();
+  });
+  return true;
+}
+
+
+void
+BVH::BuildNode(BuildData &data, uint32_t node_index, uint32_t begin, uint32_t end,
+               uint32_t depth)
+{
+  auto count = end - begin;
+
+  // node bounds and centroid bounds
+  auto range_bounds = tbb::parallel_reduce(
+    tbb::blocked_range<uint32_t>(begin, end, kParallelBuildSize), RangeBounds{},
+    [&](const tbb::blocked_range<uint32_t> &range, RangeBounds bounds) {
+      for (auto i = range.begin(); i != range.end(); ++i) {
+        auto prim = data.prim_order[i];
+        bounds.bounds.Grow(data.prim_bounds[prim]);
+        bounds.centroid_bounds.Grow(data.prim_centroids[prim]);
+      }
+      return bounds;
+    },
+    [](RangeBounds lhs, const RangeBounds &rhs) {lhs.Join(rhs); return lhs;});
+
+  auto &node = nodes_[node_index];
+  for (int axis = 0; axis < 3; ++axis) {
+    node.bmin[axis] = range_bounds.bounds.bmin[axis];
+    node.bmax[axis] = range_bounds.bounds.bmax[axis];
+  }
+  auto MakeLeaf = [&]() {
+    node.offset = begin;
+    node.count = count;
+  };
+  if (count <= 2 || depth >= kMaxDepth) {
+    MakeLeaf();
+    return;
+  }
+
+  // bin the centroids along every axis
+  const auto &cbounds = range_bounds.centroid_bounds;
+  Vec3f extent = cbounds.bmax - cbounds.bmin;
+  Vec3f bin_scale;
+  for (int axis = 0; axis < 3; ++axis)
+    bin_scale[axis] = extent[axis] > 0 ? kBinCount / extent[axis] : 0;
+  auto BinIndex = [&](const Vec3f &centroid, int axis) {
+    auto b = static_cast<int>((centroid[axis] - cbounds.bmin[axis]) * bin_scale[axis]);
+    return std::min(std::max(b, 0), kBinCount - 1);
+  };
+  auto bins = tbb::parallel_reduce(
+    tbb::blocked_range<uint32_t>(begin, end, kParallelBuildSize), Bins{},
+    [&](const tbb::blocked_range<uint32_t> &range, Bins local) {
+      for (auto i = range.begin(); i != range.end(); ++i) {
+        auto prim = data.prim_order[i];
+        for (int axis = 0; axis < 3; ++axis) {
+          auto b = BinIndex(data.prim_centroids[prim], axis);
+          local.bounds[axis][b].Grow(data.prim_bounds[prim]);
+          ++local.counts[axis][b];
+        }
+      }
+      return local;
+    },
+    [](Bins lhs, const Bins &rhs) {lhs.Join(rhs); return lhs;});
+
+  // evaluate the sah cost of every bin boundary
+  float best_cost = std::numeric_limits<float>::max();
+  int best_axis = -1, best_split = 0;
+  for (int axis = 0; axis < 3; ++axis) {
+    if (extent[axis] <= 0)
+      continue;
+    float right_area[kBinCount];
+    uint32_t right_count[kBinCount];
+    AABB right;
+    uint32_t right_total = 0;
+    for (int b = kBinCount - 1; b > 0; --b) {
+      right.Grow(bins.bounds[axis][b]);
+      right_total += bins.counts[axis][b];
+      right_area[b] = right.HalfArea();
+      right_count[b] = right_total;
+    }
+    AABB left;
+    uint32_t left_total = 0;
+    for (int b = 1; b < kBinCount; ++b) {
+      left.Grow(bins.bounds[axis][b - 1]);
+      left_total += bins.counts[axis][b - 1];
+      if (!left_total || !right_count[b])
+        continue;
+      float cost = left.HalfArea() * static_cast<float>(left_total) +
+        right_area[b] * static_cast<float>(right_count[b]);
+      if (cost < best_cost) {
+        best_cost = cost;
+        best_axis = axis;
+        best_split = b;
+      }
+    }
+  }
+
+  // compare with the cost of keeping the triangles in a leaf
+  float node_area = range_bounds.bounds.HalfArea();
+  float leaf_cost = kIntersectionCost * static_cast<float>(count);
+  float split_cost = kTraversalCost +
+    (node_area > 0 ? kIntersectionCost * best_cost / node_area : leaf_cost);
+  uint32_t middle = begin + count / 2;
+  if (best_axis >= 0) {
+    if (count <= kMaxLeafSize && leaf_cost <= split_cost) {
+      MakeLeaf();
+      return;
+    }
+    auto it = std::partition(data.prim_order.begin() + begin,
+                             data.prim_order.begin() + end, [&](uint32_t prim) {
+      return BinIndex(data.prim_centroids[prim], best_axis) < best_split;
+    });
+    middle = static_cast<uint32_t>(it - data.prim_order.begin());
+  } else if (count <= kMaxLeafSize) {
+    // all centroids coincide
+    MakeLeaf();
+    return;
+  }
+
+  // children are allocated in pairs
+  auto left_index = data.node_count.fetch_add(2);
+  node.offset = left_index;
+  node.count = 0;
+  auto BuildLeft = [&]() {BuildNode(data, left_index, begin, middle, depth + 1);};
+  auto BuildRight = [&]() {BuildNode(data, left_index + 1, middle, end, depth + 1);};
+  if (count > kParallelBuildSize) {
+    tbb::parallel_invoke(BuildLeft, BuildRight);
+  } else {
+    BuildLeft();
+    BuildRight();
+  }
+}
+
+
+template <bool kAnyHit>
+bool
+BVH::Traverse(const Ray &ray, RayHit &hit, float t_max) const
+{
+  if (nodes_.empty())
+    return false;
+  Vec3f inv_dir;
+  for (int axis = 0; axis < 3; ++axis)
+    inv_dir[axis] = ray.direction[axis] != 0 ? 1.0f / ray.direction[axis] :
+      std::numeric_limits<float>::max();
+
+  // tree depth is at most kMaxDepth, and every level adds at most one
+  // entry to the stack
+  uint32_t stack[kMaxDepth + 2];
+  int stack_size = 0;
+  float t_near = 0;
+  bool found = false;
+  if (!IntersectNode(nodes_[0], ray.origin, inv_dir, t_max, t_near))
+    return false;
+  stack[stack_size++] = 0;
+  while (stack_size) {
+    const auto &node = nodes_[stack[--stack_size]];
+    if (node.count) {
+      // leaf
+      for (uint32_t i = node.offset; i < node.offset + node.count; ++i) {
+        float t, u, v;
+        if (!IntersectTriangle(ray, triangles_[3 * i], triangles_[3 * i + 1],
+                               triangles_[3 * i + 2], t_max, t, u, v))
+          continue;
+        if (kAnyHit)
+          return true;
+        t_max = t;
+        hit.face = face_ids_[i];
+        hit.t = t;
+        hit.u = u;
+        hit.v = v;
+        found = true;
+      }
+      continue;
+    }
+
+    // visit the nearer child first
+    float t_left = 0, t_right = 0;
+    bool left = IntersectNode(nodes_[node.offset], ray.origin, inv_dir, t_max, t_left);
+    bool right = IntersectNode(nodes_[node.offset + 1], ray.origin, inv_dir, t_max,
+                               t_right);
+    if (left && right) {
+      bool left_first = t_left <= t_right;
+      stack[stack_size++] = left_first ? node.offset + 1 : node.offset;
+      stack[stack_size++] = left_first ? node.offset : node.offset + 1;
+    } else if (left) {
+      stack[stack_size++] = node.offset;
+    } else if (right) {
+      stack[stack_size++] = node.offset + 1;
+    }
+  }
+  return found;
+}
+
+
+bool
+BVH::Intersect(const Ray &ray, RayHit &hit, float t_max) const
+{
+  hit = RayHit{};
+  return Traverse<false>(ray, hit, t_max);
+}
+
+
+bool
+BVH::Occluded(const Ray &ray, float t_max) const
+{
+  RayHit hit;
+  return Traverse<true>(ray, hit, t_max);
+}
+
+
+size_t
+BVH::GetMemoryBytes() const
+{
+  return nodes_.capacity() * sizeof(Node) + face_ids_.capacity() * sizeof(uint32_t) +
+    triangles_.capacity() * sizeof(Vec3f);
+}
+
+
+bool
+BVH::Save(const fs::path &path, uint64_t source_stamp) const
+{
+  ofstream out(path.string(), ios::binary);
+  if (!out) {
+    spdlog::error("bvh: could not write {}", path.string());
+    return false;
+  }
+  uint64_t header[3] = {source_stamp, face_ids_.size(), nodes_.size()};
+  out.write(kCacheMagic, sizeof(kCacheMagic));
+  out.write(reinterpret_cast<const char*>(header), sizeof(header));
+  out.write(reinterpret_cast<const char*>(nodes_.data()),
+            static_cast<streamsize>(nodes_.size() * sizeof(Node)));
+  out.write(reinterpret_cast<const char*>(face_ids_.data()),
+            static_cast<streamsize>(face_ids_.size() * sizeof(uint32_t)));
+  out.write(reinterpret_cast<const char*>(triangles_.data()),
+            static_cast<streamsize>(triangles_.size() * sizeof(Vec3f)));
+  if (!out) {
+    spdlog::error("bvh: could not write {}", path.string());
+    return false;
+  }
+  return true;
+}
+
+
+bool
+BVH::Load(const fs::path &path, uint64_t source_stamp, size_t face_count)
+{
+  ifstream in(path.string(), ios::binary);
+  if (!in)
+    return false;
+  char magic[sizeof(kCacheMagic)];
+  uint64_t header[3];
+  in.read(magic, sizeof(magic));
+  in.read(reinterpret_cast<char*>(header), sizeof(header));
+  if (!in || memcmp(magic, kCacheMagic, sizeof(magic)) != 0 ||
+      header[0] != source_stamp || header[1] != face_count ||
+      !header[2] || header[2] > 2 * face_count)
+    return false;
+
+  nodes_.resize(header[2]);
+  face_ids_.resize(face_count);
+  triangles_.resize(3 * face_count);
+  in.read(reinterpret_cast<char*>(nodes_.data()),
+          static_cast<streamsize>(nodes_.size() * sizeof(Node)));
+  in.read(reinterpret_cast<char*>(face_ids_.data()),
+          static_cast<streamsize>(face_ids_.size() * sizeof(uint32_t)));
+  in.read(reinterpret_cast<char*>(triangles_.data()),
+          static_cast<streamsize>(triangles_.size() * sizeof(Vec3f)));
+  auto InvalidCache = [&](const char *reason) {
+    spdlog::error("bvh: {}: {}", path.string(), reason);
+    nodes_.clear();
+    face_ids_.clear();
+    triangles_.clear();
+    return false;
+  };
+  if (!in)
+    return InvalidCache("truncated cache file");
+
+  // children are allocated after their parent, so requiring offset > index
+  // also rules out cycles during traversal, and lets one forward pass
+  // compute node depths (which bound the traversal stack)
+  vector<uint32_t> depths(nodes_.size(), 0);
+  for (size_t i = 0; i < nodes_.size(); ++i) {
+    const auto &node = nodes_[i];
+    bool valid = node.count ?
+      uint64_t(node.offset) + node.count <= face_count :
+      node.offset > i && uint64_t(node.offset) + 1 < nodes_.size();
+    if (!valid)
+      return InvalidCache("invalid node");
+    if (depths[i] > kMaxDepth)
+      return InvalidCache("tree too deep");
+    if (!node.count) {
+      for (uint32_t child = node.offset; child <= node.offset + 1; ++child)
+        depths[child] = std::max(depths[child], depths[i] + 1);
+    }
+  }
+  for (auto face : face_ids_) {
+    if (face >= face_count)
+      return InvalidCache("invalid face index");
+  }
+  return true;
+}
+
+}  // namespace olio
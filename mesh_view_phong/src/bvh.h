@@ -0,0 +1,112 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       bvh.h
+//! \brief      Triangle bounding volume hierarchy (SAH binned, built in
+//!             parallel) for ray queries
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <limits>
+#include <cstdint>
+#include <boost/filesystem.hpp>
+#include "types.h"
+
+namespace olio {
+
+//! \struct Ray
+//! \brief Ray with origin and (not necessarily unit) direction
+struct Ray {
+  Vec3f origin{0, 0, 0};
+  Vec3f direction{0, 0, -1};
+};
+
+
+//! \struct RayHit
+//! \brief Closest intersection of a ray with a triangle. The hit point
+//!        is (1 - u - v) * p0 + u * p1 + v * p2
+struct RayHit {
+  static constexpr uint32_t kInvalidFace = std::numeric_limits<uint32_t>::max();
+  uint32_t face{kInvalidFace};  //!< face index in the source mesh
+  float t{std::numeric_limits<float>::max()};  //!< ray parameter
+  float u{0};                   //!< barycentric coordinate of p1
+  float v{0};                   //!< barycentric coordinate of p2
+  bool IsValid() const {return face != kInvalidFace;}
+};
+
+
+//! \class BVH
+//! \brief Bounding volume hierarchy over the triangles of a mesh. The
+//!        BVH keeps its own (single precision) copy of the triangles,
+//!        so it stays usable after the mesh releases its topology
+class BVH {
+public:
+  using Ptr = std::shared_ptr<BVH>;
+
+  //! \brief BVH node (32 bytes). Interior nodes have count == 0 and
+  //!        their children at offset and offset + 1; leaves hold
+  //!        count triangles starting at offset
+  struct Node {
+    float bmin[3];
+    uint32_t offset;
+    float bmax[3];
+    uint32_t count;
+  };
+
+  //! \brief Build the BVH
+  //! \param[in] points vertex positions
+  //! \param[in] indices triangle vertex indices (3 * face_count)
+  //! \param[in] face_count number of triangles
+  //! \return true on success
+  bool Build(const Vec3r *points, const uint32_t *indices, size_t face_count);
+
+  //! \brief Find the closest intersection with t in (0, t_max)
+  //! \param[in] ray query ray
+  //! \param[out] hit closest hit
+  //! \param[in] t_max maximum ray parameter
+  //! \return true if the ray hit a triangle
+  bool Intersect(const Ray &ray, RayHit &hit,
+                 float t_max=std::numeric_limits<float>::max()) const;
+
+  //! \brief Whether any triangle intersects the ray with t in (0, t_max)
+  bool Occluded(const Ray &ray, float t_max=std::numeric_limits<float>::max()) const;
+
+  //! \brief Write the BVH to a cache file
+  //! \param[in] path cache file
+  //! \param[in] source_stamp identifies the source mesh version
+  //! \return true on success
+  bool Save(const boost::filesystem::path &path, uint64_t source_stamp) const;
+
+  //! \brief Read the BVH from a cache file
+  //! \param[in] path cache file
+  //! \param[in] source_stamp expected source mesh version
+  //! \param[in] face_count expected number of triangles
+  //! \return true on success (false if missing or stale)
+  bool Load(const boost::filesystem::path &path, uint64_t source_stamp,
+            size_t face_count);
+
+  size_t GetNodeCount() const {return nodes_.size();}
+  size_t GetFaceCount() const {return face_ids_.size();}
+
+  //! \brief Bytes held by the BVH (nodes and triangle copies)
+  size_t GetMemoryBytes() const;
+protected:
+  struct BuildData;
+  void BuildNode(BuildData &data, uint32_t node_index, uint32_t begin,
+                 uint32_t end, uint32_t depth);
+  template <bool kAnyHit>
+  bool Traverse(const Ray &ray, RayHit &hit, float t_max) const;
+
+  std::vector<Node> nodes_;
+  std::vector<uint32_t> face_ids_;  //!< source face of each bvh triangle
+  std::vector<Vec3f> triangles_;    //!< 3 vertices per triangle (bvh order)
+};
+
+}  // namespace olio
@@ -13,6 +13,7 @@
 #include <iostream>
 #include <sstream>
 #include <memory>
+#include <chrono>
 #include <boost/program_options.hpp>
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
@@ -22,11 +23,23 @@
 #include "types.h"
 #include "utils/utils.h"
 #include "utils/glshader.h"
+#include "utils/glshader_permutations.h"
+#include "utils/glstate.h"
+#include "utils/gldebug.h"
 #include "utils/gldrawdata.h"
+#include "utils/glrenderqueue.h"
+#include "utils/glquery.h"
+#include "utils/glstreambuffer.h"
+#include "utils/gltexture.h"
 #include "utils/material.h"
+#include "utils/material_library.h"
+#include "utils/memory_stats.h"
+#include "utils/allocator.h"
 #include "utils/light.h"
 #include "sphere.h"
 #include "trimesh.h"
+#include "octree_mesh.h"
+#include "scene_graph.h"
 
 using namespace std;
 using namespace olio;
@@ -49,19 +62,197 @@ int release = 0;
 Sphere::Ptr sphere_g;
 Material::Ptr sphere_material_g;
 Mat4r sphere_xform_g{Mat4r::Identity()};
-bool reset = 0;
 
 // mesh models and material and xform
 std::vector<TriMesh::Ptr> meshlist_g;
 TriMesh::Ptr mesh_g;
+// out-of-core meshes (.octree files), drawn after meshlist_g
+std::vector<OctreeMesh::Ptr> octree_meshes_g;
 Material::Ptr mesh_material_g;
-// std::vector<Mat4r> meshlist_xform_g;
-Mat4r mesh_xform_g{Mat4r::Identity()};
-Mat4r rotate_y_xform{Mat4r::Identity()};
+// per-mesh materials, parallel to meshlist_g (nullptr: mesh_material_g),
+// deduplicated by material_library_g
+std::vector<PhongMaterial::Ptr> mesh_materials_g;
+MaterialLibrary::Ptr material_library_g;
+// mesh draws of the depth pre-pass and lighting pass, sorted by state
+// and depth
+GLRenderQueue render_queue_g;
+// textures are decoded on worker threads and uploaded a few
+// milliseconds per frame
+std::unique_ptr<GLTextureCache> texture_cache_g;
+double texture_budget_ms_g = 2;
+// scene hierarchy: a root node rotated with the mouse and one child
+// per mesh, then per octree mesh (see BuildScene)
+SceneGraph scene_g;
+SceneGraph::NodeID scene_root_g = SceneGraph::kNoParent;
+vector<SceneGraph::NodeID> mesh_nodes_g;
 
 // scene lights
 vector<Light::Ptr> lights_g;
 
+// per-frame scratch, reused so steady-state frames don't allocate.
+// GLDrawData is reset by copy-assigning default_draw_data, which keeps
+// the lights' storage
+struct FrameScratch {
+  const GLDrawData default_draw_data{};
+  GLDrawData draw_data;
+  GLDrawData pass_data;
+  GLDrawData depth_draw_data;
+  GLDrawData depth_pass_data;
+  vector<GLintptr> object_offsets;
+  vector<GLDrawGeometry> mesh_geometries;
+  vector<float> mesh_depths;
+};
+FrameScratch frame_scratch_g;
+
+// cursor position (in screen coordinates), used for picking
+double cursor_x_g = 0, cursor_y_g = 0;
+
+// specialized shader variants and the shading model used for drawing
+GLShaderPermutations::Ptr shader_permutations_g;
+GLShaderKey::Shading shading_g{GLShaderKey::Shading::kPhong};
+
+// optional depth pre-pass, and GPU queries for comparing the lighting
+// pass with and without it (stats are indexed by depth_prepass_g)
+bool depth_prepass_g = false;
+std::unique_ptr<GLQueryRing> shaded_samples_query_g;
+std::unique_ptr<GLQueryRing> gpu_time_query_g;
+struct LightingPassStats {
+  uint64_t shaded_samples{0};
+  size_t sample_frames{0};
+  uint64_t gpu_time_ns{0};
+  size_t time_frames{0};
+};
+LightingPassStats lighting_pass_stats_g[2];
+size_t frame_count_g = 0;
+
+// streaming uniform buffer for per-frame matrices. when a frame's
+// matrices were streamed, shaders read them from uniform blocks
+std::unique_ptr<GLStreamBuffer> transforms_stream_g;
+size_t uniform_buffer_alignment_g = 256;
+bool streamed_transforms_g = false;
+
+// driver debug messages (lowest severity logged; 0: disabled)
+GLenum gl_debug_severity_g = GL_DEBUG_SEVERITY_MEDIUM;
+std::unique_ptr<GLDebugOutput> gl_debug_output_g;
+
+//! \brief Create the shader variant cache for the phong and gouraud
+//!        shaders
+//! \return shader variant cache
+GLShaderPermutations::Ptr
+CreateShaderPermutations()
+{
+  auto permutations = make_shared<GLShaderPermutations>();
+  permutations->SetShaderSources(GLShaderKey::Shading::kPhong,
+                                 "../shaders/phong_vert.glsl",
+                                 "../shaders/phong_frag.glsl");
+  permutations->SetShaderSources(GLShaderKey::Shading::kGouraud,
+                                 "../shaders/gouraud_vert.glsl",
+                                 "../shaders/gouraud_frag.glsl");
+  return permutations;
+}
+
+//! \brief Select the shader variant for drawing with the current
+//!        lights and shading model
+//! \param[in] has_texcoords whether the drawn geometry has texcoords
+//! \param[in] has_vertex_ao whether the drawn geometry has baked
+//!                          ambient occlusion
+//! \param[in] has_diffuse_map whether the material's diffuse map is
+//!                            ready to be sampled
+//! \return shader variant (compiled on first use)
+GLShader::Ptr
+GetShaderVariant(bool has_texcoords, bool has_vertex_ao=false,
+                 bool has_diffuse_map=false)
+{
+  if (!shader_permutations_g)
+    return nullptr;
+  GLShaderKey key;
+  key.shading = shading_g;
+  key.point_light_count = static_cast<uint>(lights_g.size());
+  key.has_texcoords = has_texcoords;
+  key.has_vertex_ao = has_vertex_ao;
+  key.has_diffuse_map = has_diffuse_map;
+  key.uniform_blocks = streamed_transforms_g;
+  return shader_permutations_g->Get(key);
+}
+
+
+//! \brief Create the streaming uniform buffer for per-frame matrices
+//! \param[in] object_count number of objects drawn per frame
+void
+CreateTransformsStream(size_t object_count)
+{
+  GLint alignment = 0;
+  glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+  if (alignment > 0)
+    uniform_buffer_alignment_g = static_cast<size_t>(alignment);
+  auto AlignUp = [](size_t size, size_t alignment) {
+    return (size + alignment - 1) / alignment * alignment;
+  };
+  size_t frame_size = AlignUp(sizeof(GLFrameBlock), uniform_buffer_alignment_g) +
+    object_count * AlignUp(sizeof(GLObjectBlock), uniform_buffer_alignment_g);
+  transforms_stream_g = unique_ptr<GLStreamBuffer>(
+      new GLStreamBuffer(GL_UNIFORM_BUFFER, frame_size));
+}
+
+
+//! \brief Write this frame's view/projection matrices and every
+//!        object's mv/normal matrices into the streaming uniform buffer.
+//!        Model and normal matrices come from the scene graph's caches
+//! \param[in] view_matrix view matrix
+//! \param[in] proj_matrix projection matrix
+//! \param[in] nodes scene node of each object
+//! \param[out] object_offsets buffer offset of each object's ObjectBlock
+//! \return true if the matrices were streamed (EndFrame must then be
+//!         called on transforms_stream_g after drawing)
+bool
+StreamTransforms(const glm::mat4 &view_matrix, const glm::mat4 &proj_matrix,
+                 const vector<SceneGraph::NodeID> &nodes,
+                 vector<GLintptr> &object_offsets)
+{
+  if (!transforms_stream_g || !transforms_stream_g->BeginFrame())
+    return false;
+
+  GLintptr frame_offset = 0;
+  auto frame_block = static_cast<GLFrameBlock*>(
+      transforms_stream_g->Allocate(sizeof(GLFrameBlock),
+                                    uniform_buffer_alignment_g, frame_offset));
+  if (frame_block) {
+    frame_block->proj_matrix = proj_matrix;
+    frame_block->view_matrix = view_matrix;
+  }
+  bool success = frame_block != nullptr;
+
+  // the inverse transpose of view * model is that of the view times
+  // the cached one of the model, so no per-object inverse is needed
+  glm::mat3 view_normal_matrix = glm::transpose(glm::inverse(glm::mat3(view_matrix)));
+  object_offsets.resize(nodes.size());
+  for (size_t i = 0; success && i < nodes.size(); ++i) {
+    auto object_block = static_cast<GLObjectBlock*>(
+        transforms_stream_g->Allocate(sizeof(GLObjectBlock),
+                                      uniform_buffer_alignment_g,
+                                      object_offsets[i]));
+    if (!object_block) {
+      success = false;
+      break;
+    }
+    object_block->mv_matrix = view_matrix * scene_g.GetWorldMatrix(nodes[i]);
+    object_block->norm_matrix = glm::mat4(view_normal_matrix *
+                                          scene_g.GetNormalMatrix(nodes[i]));
+  }
+  transforms_stream_g->FinishWrites();
+  if (!success) {
+    spdlog::error("StreamTransforms: streaming buffer too small");
+    transforms_stream_g->EndFrame();
+    return false;
+  }
+
+  // per-frame block is bound once for all draws
+  GLState::Get().BindBufferRange(GL_UNIFORM_BUFFER, GLShader::kFrameBlockBinding,
+                                 transforms_stream_g->GetBufferID(), frame_offset,
+                                 sizeof(GLFrameBlock));
+  return true;
+}
+
 //! \brief compute view and projection matrices based on current
 //! window dimensions
 //! \param[out] view_matrix view matrix
@@ -77,117 +268,74 @@ GetViewAndProjectionMatrices(glm::mat4 &view_matrix, glm::mat4 &proj_matrix)
                                  0.01f, 50.0f);
 }
 
-Mat4r
-TransformMesh(int index, TriMesh::Ptr m)
+//! \brief Transform that scales an object to fit its slot in a row of
+//!        objects along the x-axis, centered at the origin
+//! \param[in] index object's slot
+//! \param[in] object_count number of objects (slots)
+//! \param[in] bmin object's bounding box min
+//! \param[in] bmax object's bounding box max
+//! \return object's layout transform
+glm::mat4
+GetMeshLayoutTransform(size_t index, size_t object_count, const Vec3r &bmin,
+                       const Vec3r &bmax)
 {
-  // scale to fit inside unit cube
-  Mat4r scale_xform{Mat4r::Identity()};
-  int i = 0;
-  TriMesh::Ptr mesh = m;
-  // find current mesh by index
-  for(auto m_it = meshlist_g.begin(); m_it != meshlist_g.end(); ++m_it, ++i){
-    ;
-  }
-
-  // at end of loop, i = number of total objects
-
-  Vec3r bmin, bmax;
-  mesh->GetBoundingBox(bmin, bmax);
-  Real xdim = bmax[0]-bmin[0];
-  Real ydim = bmax[1]-bmin[1];
-  Real zdim = bmax[2]-bmin[2];
-  // // scale so that the maximum dimension = 1;
-  auto maxdim = std::max(xdim,ydim);
-  maxdim = std::max(maxdim, zdim);
-  Real scale = 2.0 / maxdim;
-  
-  scale /= i;
-  scale_xform.diagonal() = Vec4r{scale, scale, scale, 1};
-
-  // else{
-  //   scale /= (i-2);
-  //   scale_xform.diagonal() = Vec4r{scale, scale, scale, 1};
-  // }
-  // calculate horizontal translation
-  // find offset from origin
-  Vec3r center = scale*(bmin + 0.5*(bmax-bmin)); // midpoint of longest line
-  double size = 2.0; // objects must fit within 2x2x2 box
-  double xshift = index*(size/i) + size/(i*2) - size/2; // placement of object along x-axis
-  Mat4r translate_xform{Mat4r::Identity()};
-  
-  translate_xform(0,3) = -(center[0]) + xshift;
-  translate_xform(1,3) = -(center[1]);
-  translate_xform(2,3) = -(center[2]);
-
-  Mat4r rotate_y_xform{Mat4r::Identity()};
-  Real rotate_y_angle = delta_x;
-  Real c = cos(rotate_y_angle * kDEGtoRAD);
-  Real s = sin(rotate_y_angle * kDEGtoRAD);
-  rotate_y_xform(0, 0) = c;
-  rotate_y_xform(0, 2) = s;
-  rotate_y_xform(2, 0) = -s;
-  rotate_y_xform(2, 2) = c;  
-
-
-  Mat4r rotate_x_xform{Mat4r::Identity()};
-  Real rotate_x_angle = delta_y;
-  c = cos(rotate_x_angle * kDEGtoRAD);
-  s = sin(rotate_x_angle * kDEGtoRAD);
-  rotate_x_xform(1, 1) = c;
-  rotate_x_xform(2, 1) = s;
-  rotate_x_xform(1, 2) = -s;
-  rotate_x_xform(2, 2) = c;
-  
-
-  mesh_xform_g = translate_xform *  rotate_y_xform * rotate_x_xform * scale_xform ;
-
+  // scale so that the maximum dimension fits the slot
+  Vec3r extent = bmax - bmin;
+  Real scale = Real(2) / extent.maxCoeff();
+  scale /= static_cast<Real>(object_count);
+
+  // center the object in its slot
+  Vec3r center = scale * (bmin + Real(0.5) * extent);
+  Real size = 2.0;  // objects must fit within 2x2x2 box
+  Real slot_size = size / static_cast<Real>(object_count);
+  Real xshift = static_cast<Real>(index) * slot_size + slot_size / 2 - size / 2;
+  glm::vec3 translation{static_cast<float>(xshift - center[0]),
+                        static_cast<float>(-center[1]), static_cast<float>(-center[2])};
+  auto scale_f = static_cast<float>(scale);
+  return glm::scale(glm::translate(glm::mat4(1), translation),
+                    glm::vec3{scale_f, scale_f, scale_f});
+}
 
-  return (rotate_y_xform * rotate_x_xform * translate_xform * scale_xform );
-  // meshlist_xform_g.push_back(mesh_xform_g);
-  
 
+//! \brief Rotate the scene root by the last mouse drag (degrees around
+//!        the y-axis for x movement, around the x-axis for y movement)
+void
+UpdateSceneRotation()
+{
+  if (scene_root_g == SceneGraph::kNoParent)
+    return;
+  auto rotation = glm::rotate(glm::mat4(1), static_cast<float>(delta_x * kDEGtoRAD),
+                              glm::vec3{0, 1, 0});
+  rotation = glm::rotate(rotation, static_cast<float>(delta_y * kDEGtoRAD),
+                         glm::vec3{1, 0, 0});
+  scene_g.SetLocalTransform(scene_root_g, rotation);
 }
 
-Mat4r
-ResetMesh(int index, TriMesh::Ptr m)
+
+//! \brief Build the scene hierarchy: a root node, rotated with the
+//!        mouse, with one child per mesh and octree mesh (in drawing
+//!        order) that places it in its slot
+void
+BuildScene()
 {
-    int i = 0;
-    TriMesh::Ptr mesh = m;
-    // find current mesh by index
-    for(auto m_it = meshlist_g.begin(); m_it != meshlist_g.end(); ++m_it, ++i){
-      ;
-    }
-    if(index >= i){
-      reset = 0;
-    }
-    delta_x = 0;
-    delta_y = 0;
-
-    Mat4r total_rotate_x_xform{Mat4r::Identity()};
-    Real rotate_x_angle = net_y_transform;
-    Real c = cos(rotate_x_angle * kDEGtoRAD);
-    Real s = sin(rotate_x_angle * kDEGtoRAD);
-    total_rotate_x_xform(1, 1) = c;
-    total_rotate_x_xform(2, 1) = s;
-    total_rotate_x_xform(1, 2) = -s;
-    total_rotate_x_xform(2, 2) = c;
-
-    Mat4r total_rotate_y_xform{Mat4r::Identity()};
-    Real rotate_y_angle = net_x_transform;
-    c = cos(rotate_y_angle * kDEGtoRAD);
-    s = sin(rotate_y_angle * kDEGtoRAD);
-    total_rotate_y_xform(0, 0) = c;
-    total_rotate_y_xform(0, 2) = s;
-    total_rotate_y_xform(2, 0) = -s;
-    total_rotate_y_xform(2, 2) = c; 
-
-    Mat4r inv_rotate_x_xform = total_rotate_x_xform.inverse();
-    Mat4r inv_rotate_y_xform = total_rotate_y_xform.inverse();
-
-    return (inv_rotate_y_xform * inv_rotate_x_xform);
-    
+  scene_g.Clear();
+  mesh_nodes_g.clear();
+  scene_root_g = scene_g.AddNode();
+  UpdateSceneRotation();
+
+  auto object_count = meshlist_g.size() + octree_meshes_g.size();
+  for (size_t i = 0; i < object_count; ++i) {
+    Vec3r bmin, bmax;
+    if (i < meshlist_g.size())
+      meshlist_g[i]->GetBoundingBox(bmin, bmax);
+    else
+      octree_meshes_g[i - meshlist_g.size()]->GetBoundingBox(bmin, bmax);
+    mesh_nodes_g.push_back(scene_g.AddNode(
+        scene_root_g, GetMeshLayoutTransform(i, object_count, bmin, bmax)));
+  }
 }
 
+
 //! \brief Update sphere and its transformation matrix based on
 //! current time
 //! \param[in] glfw_time current time
@@ -225,12 +373,91 @@ UpdateSphere(Real glfw_time)
 }
 
 
+//! \brief Gather finished GPU query results for the lighting pass
+void
+CollectLightingPassStats()
+{
+  uint64_t value;
+  int prepass;
+  while (shaded_samples_query_g &&
+         shaded_samples_query_g->Collect(value, &prepass)) {
+    lighting_pass_stats_g[prepass].shaded_samples += value;
+    ++lighting_pass_stats_g[prepass].sample_frames;
+  }
+  while (gpu_time_query_g && gpu_time_query_g->Collect(value, &prepass)) {
+    lighting_pass_stats_g[prepass].gpu_time_ns += value;
+    ++lighting_pass_stats_g[prepass].time_frames;
+  }
+}
+
+
+//! \brief Print average shaded samples and GPU time per frame, with and
+//!        without the depth pre-pass
+void
+PrintLightingPassStats()
+{
+  for (int prepass = 0; prepass < 2; ++prepass) {
+    const auto &stats = lighting_pass_stats_g[prepass];
+    if (!stats.sample_frames)
+      continue;
+    auto samples = static_cast<double>(stats.shaded_samples) /
+      static_cast<double>(stats.sample_frames);
+    if (stats.time_frames) {
+      auto gpu_ms = 1e-6 * static_cast<double>(stats.gpu_time_ns) /
+        static_cast<double>(stats.time_frames);
+      spdlog::info("depth pre-pass {}: {:.0f} shaded samples/frame, "
+                   "{:.3f} ms GPU/frame ({} frames)", prepass ? "on" : "off",
+                   samples, gpu_ms, stats.sample_frames);
+    } else {
+      spdlog::info("depth pre-pass {}: {:.0f} shaded samples/frame "
+                   "({} frames, no timer queries)", prepass ? "on" : "off",
+                   samples, stats.sample_frames);
+    }
+  }
+}
+
+
+//! \brief Collect the memory held by every scene resource
+//! \return per-resource memory report
+MemoryReport
+GetSceneMemoryReport()
+{
+  MemoryReport report;
+  for (size_t i = 0; i < meshlist_g.size(); ++i)
+    report.Add(fmt::format("mesh {} ({})", i,
+                           meshlist_g[i]->GetFilePath().filename().string()),
+               meshlist_g[i]->GetMemoryStats());
+  for (size_t i = 0; i < octree_meshes_g.size(); ++i)
+    report.Add(fmt::format("octree {} ({})", i,
+                           octree_meshes_g[i]->GetFilePath().filename().string()),
+               octree_meshes_g[i]->GetMemoryStats());
+  // sphere geometry is shared through the cache
+  auto &sphere_cache = SphereGeometryCache::Get();
+  if (sphere_cache.GetEntryCount())
+    report.Add(fmt::format("sphere geometry ({} grid sizes)", sphere_cache.GetEntryCount()),
+               sphere_cache.GetMemoryStats());
+  if (shader_permutations_g)
+    report.Add(fmt::format("shaders ({} variants)",
+                           shader_permutations_g->GetVariantCount()),
+               shader_permutations_g->GetMemoryStats());
+  if (transforms_stream_g)
+    report.Add("transforms stream", transforms_stream_g->GetMemoryStats());
+  if (texture_cache_g)
+    report.Add(fmt::format("textures ({})", texture_cache_g->GetTextureCount()),
+               texture_cache_g->GetMemoryStats());
+  return report;
+}
+
+
 void
 Display()
 {
    
  
 
+  // count this frame's gl state changes
+  GLState::Get().BeginFrame();
+
   // clear window
   glClearColor(0, 0, 0, 1);
   glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
@@ -238,6 +465,10 @@ Display()
   // make sure we have a valid mesh list object
   // if (!meshes_g)
   //   return;
+
+  // upload decoded textures within this frame's budget
+  if (texture_cache_g)
+    texture_cache_g->Update(texture_budget_ms_g);
    
 
   // get view and projection matrices
@@ -245,30 +476,158 @@ Display()
   GetViewAndProjectionMatrices(view_matrix, proj_matrix);
 
   // fill GLDraw data for trimesh
-    
-  GLDrawData draw_data;
+  auto &scratch = frame_scratch_g;
+  auto &draw_data = scratch.draw_data;
+  draw_data = scratch.default_draw_data;
   draw_data.SetViewMatrix(view_matrix);
   draw_data.SetProjectionMatrix(proj_matrix);
   draw_data.SetMaterial(mesh_material_g);
   draw_data.SetLights(lights_g);
-  // draw mesh
-  // mesh_g->DrawGL(draw_data);
-  int i = 0;
-  for(auto mesh_it = meshlist_g.begin(); mesh_it != meshlist_g.end(); ++mesh_it, ++i){
-    // update mesh transformation matrices
-    Mat4r xform{Mat4r::Identity()};
-    if(reset == 0){
-      xform = TransformMesh(i, *mesh_it);
-    }
-    else{
-      xform = ResetMesh(i, *mesh_it) * TransformMesh(i, *mesh_it);
-    }
 
-    draw_data.SetModelMatrix(EigenToGLM(xform));
-    mesh_g = *mesh_it;
-    mesh_g->DrawGL(draw_data);
+  // update mesh transformation matrices (only those below changed
+  // scene nodes are recomputed; the rest stay cached in scene_g)
+  scene_g.Update();
+  auto GetModelMatrix = [](size_t mesh_index) -> const glm::mat4& {
+    return scene_g.GetWorldMatrix(mesh_nodes_g[mesh_index]);
+  };
+
+  // octree meshes follow the meshes; select their nodes for this view
+  // (and stream in missing chunks)
+  for (size_t octree_index = 0; octree_index < octree_meshes_g.size(); ++octree_index)
+    octree_meshes_g[octree_index]->Update(GetModelMatrix(meshlist_g.size() + octree_index),
+                                          view_matrix, proj_matrix, window_size_g);
+
+  // stream all matrices once; draws then only bind buffer ranges
+  auto &object_offsets = scratch.object_offsets;
+  streamed_transforms_g = StreamTransforms(view_matrix, proj_matrix,
+                                           mesh_nodes_g, object_offsets);
+  auto SetTransforms = [&](GLDrawData &data, size_t mesh_index) {
+    data.SetModelMatrix(GetModelMatrix(mesh_index));
+    if (streamed_transforms_g)
+      data.SetObjectBlock(transforms_stream_g->GetBufferID(),
+                          object_offsets[mesh_index], sizeof(GLObjectBlock));
+  };
+
+  // mesh buffers and view depths (of the bounding box centers), for
+  // the render queue
+  auto &mesh_geometries = scratch.mesh_geometries;
+  auto &mesh_depths = scratch.mesh_depths;
+  mesh_geometries.resize(meshlist_g.size());
+  mesh_depths.resize(meshlist_g.size());
+  for (size_t mesh_index = 0; mesh_index < meshlist_g.size(); ++mesh_index) {
+    mesh_geometries[mesh_index] = GLDrawGeometry{};
+    meshlist_g[mesh_index]->GetGLDrawGeometry(mesh_geometries[mesh_index]);
+    Vec3r bmin, bmax;
+    meshlist_g[mesh_index]->GetBoundingBox(bmin, bmax);
+    Vec3r center = (bmin + bmax) / 2;
+    glm::vec4 view_center = view_matrix * GetModelMatrix(mesh_index) *
+      glm::vec4(center[0], center[1], center[2], 1);
+    mesh_depths[mesh_index] = -view_center.z;
+  }
+  auto GetObjectOffset = [&](size_t mesh_index) {
+    return streamed_transforms_g ? object_offsets[mesh_index] : GLintptr{0};
+  };
+  auto &pass_data = scratch.pass_data;
+  pass_data = draw_data;
+  if (streamed_transforms_g)
+    pass_data.SetObjectBlock(transforms_stream_g->GetBufferID(), 0, sizeof(GLObjectBlock));
+
+  int prepass = depth_prepass_g ? 1 : 0;
+  if (gpu_time_query_g)
+    gpu_time_query_g->Begin(prepass);
+
+  // depth pre-pass: lay down depth from the position-only streams with
+  // color writes off, so the lighting pass below shades each pixel once
+  if (depth_prepass_g) {
+    auto &depth_draw_data = scratch.depth_draw_data;
+    depth_draw_data = draw_data;
+    GLShaderKey depth_key;
+    depth_key.vertex_format = GLShaderKey::VertexFormat::kPositionOnly;
+    depth_key.uniform_blocks = streamed_transforms_g;
+    depth_draw_data.SetGLShader(shader_permutations_g->Get(depth_key));
+    depth_draw_data.SetPositionsOnly(true);
+    depth_draw_data.SetDepthFunc(GL_LESS);
+    GLState::Get().ColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    auto &depth_pass_data = scratch.depth_pass_data;
+    depth_pass_data = pass_data;
+    depth_pass_data.SetPositionsOnly(true);
+    depth_pass_data.SetDepthFunc(GL_LESS);
+    render_queue_g.Begin(depth_pass_data);
+    for (size_t mesh_index = 0; mesh_index < meshlist_g.size(); ++mesh_index)
+      render_queue_g.Add(0, depth_draw_data.GetGLShader(), nullptr,
+                         mesh_geometries[mesh_index], GetModelMatrix(mesh_index),
+                         GetObjectOffset(mesh_index), mesh_depths[mesh_index]);
+    render_queue_g.Submit();
+    for (size_t octree_index = 0; octree_index < octree_meshes_g.size(); ++octree_index) {
+      SetTransforms(depth_draw_data, meshlist_g.size() + octree_index);
+      octree_meshes_g[octree_index]->DrawGL(depth_draw_data);
+    }
+    GLState::Get().ColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+    GLState::Get().DepthMask(GL_FALSE);
+    draw_data.SetDepthFunc(GL_EQUAL);
+    pass_data.SetDepthFunc(GL_EQUAL);
   }
 
+  // lighting pass
+  if (shaded_samples_query_g)
+    shaded_samples_query_g->Begin(prepass);
+  render_queue_g.Begin(pass_data);
+  for (size_t mesh_index = 0; mesh_index < meshlist_g.size(); ++mesh_index) {
+    const auto &mesh = meshlist_g[mesh_index];
+
+    // textured meshes sample their diffuse map once it has a level
+    // uploaded
+    PhongMaterial::Ptr mesh_material;
+    if (mesh_index < mesh_materials_g.size())
+      mesh_material = mesh_materials_g[mesh_index];
+    bool has_diffuse_map = mesh_material && mesh_material->GetDiffuseMap() &&
+      mesh_material->GetDiffuseMap()->IsReady();
+    auto shader = GetShaderVariant(mesh->HasTexCoords(), mesh->HasAmbientOcclusion(),
+                                   has_diffuse_map);
+    Material::Ptr material = mesh_material;
+    if (!material)
+      material = mesh_material_g;
+    render_queue_g.Add(0, shader, material, mesh_geometries[mesh_index],
+                       GetModelMatrix(mesh_index), GetObjectOffset(mesh_index),
+                       mesh_depths[mesh_index]);
+  }
+  render_queue_g.Submit();
+  for (size_t octree_index = 0; octree_index < octree_meshes_g.size(); ++octree_index) {
+    SetTransforms(draw_data, meshlist_g.size() + octree_index);
+    draw_data.SetGLShader(GetShaderVariant(false));
+    octree_meshes_g[octree_index]->DrawGL(draw_data);
+  }
+  if (shaded_samples_query_g)
+    shaded_samples_query_g->End();
+  if (gpu_time_query_g)
+    gpu_time_query_g->End();
+  if (streamed_transforms_g)
+    transforms_stream_g->EndFrame();
+
+  // restore depth writes (needed by glClear)
+  GLState::Get().DepthMask(GL_TRUE);
+
+  // report lighting pass cost every few seconds
+  CollectLightingPassStats();
+  if (++frame_count_g % 300 == 0) {
+    PrintLightingPassStats();
+    auto queue_stats = render_queue_g.GetStats();
+    spdlog::info("lighting pass: {} mesh draws, {} program, {} material and "
+                 "{} geometry changes", queue_stats.draws, queue_stats.program_changes,
+                 queue_stats.material_changes, queue_stats.geometry_changes);
+    auto state_stats = GLState::Get().GetFrameStats();
+    spdlog::info("gl state: {} calls, {} redundant (dropped)", state_stats.calls,
+                 state_stats.redundant_calls);
+    for (const auto &octree : octree_meshes_g) {
+      auto stats = octree->GetStats();
+      auto memory = octree->GetMemoryStats();
+      spdlog::info("{}: drawing {} triangles in {} nodes, {} resident ({}), "
+                   "{} requested, {} evicted", octree->GetFilePath().filename().string(),
+                   stats.drawn_triangles, stats.drawn_nodes, stats.resident_nodes,
+                   FormatBytes(memory.gpu_bytes), stats.requested_nodes,
+                   stats.evicted_nodes);
+    }
+  }
 }
 
 
@@ -299,6 +658,7 @@ Display(Real glfw_time)
   draw_data.SetProjectionMatrix(proj_matrix);
   draw_data.SetMaterial(sphere_material_g);
   draw_data.SetLights(lights_g);
+  draw_data.SetGLShader(GetShaderVariant(false));
 
   // draw the sphere
   sphere_g->DrawGL(draw_data);
@@ -321,7 +681,77 @@ WindowResizeCallback(GLFWwindow */*window*/, int width, int height)
 static void 
 cursor_position_callback(GLFWwindow* window, double xpos, double ypos)
 {
+  cursor_x_g = xpos;
+  cursor_y_g = ypos;
+}
+
+
+//! \brief Result of picking a mesh under the cursor
+struct PickResult {
+  int mesh_index{-1};           //!< index in meshlist_g
+  uint32_t face{0};             //!< face index in the mesh
+  Vec3r barycentric{0, 0, 0};   //!< barycentric coordinates of the hit
+  Vec3r position{0, 0, 0};      //!< world space hit position
+  Real distance{0};             //!< distance from the near plane
+};
+
+
+//! \brief Find the closest mesh triangle under a cursor position
+//! \param[in] window glfw window
+//! \param[in] xpos cursor x position (screen coordinates)
+//! \param[in] ypos cursor y position (screen coordinates)
+//! \param[out] result pick result
+//! \return true if a mesh was hit
+bool
+PickMesh(GLFWwindow *window, double xpos, double ypos, PickResult &result)
+{
+  // picks use the world matrices of the last drawn frame
+  if (!scene_g.GetStats().updates || mesh_nodes_g.size() < meshlist_g.size())
+    return false;
+
+  // cursor positions are in screen coordinates, the viewport in pixels
+  int width, height;
+  glfwGetWindowSize(window, &width, &height);
+  if (width <= 0 || height <= 0)
+    return false;
+  auto x = static_cast<float>(xpos * window_size_g[0] / width);
+  auto y = static_cast<float>(window_size_g[1] - ypos * window_size_g[1] / height);
 
+  // world space ray from the near to the far plane
+  glm::mat4 view_matrix, proj_matrix;
+  GetViewAndProjectionMatrices(view_matrix, proj_matrix);
+  glm::vec4 viewport{0, 0, static_cast<float>(window_size_g[0]),
+                     static_cast<float>(window_size_g[1])};
+  auto near_point = glm::unProject(glm::vec3{x, y, 0}, view_matrix, proj_matrix, viewport);
+  auto far_point = glm::unProject(glm::vec3{x, y, 1}, view_matrix, proj_matrix, viewport);
+
+  // intersect in each mesh's object space. affine transforms keep the
+  // ray parameter, so hits in different meshes compare directly
+  float t_max = 1;
+  for (size_t i = 0; i < meshlist_g.size(); ++i) {
+    auto bvh = meshlist_g[i]->GetBVH();
+    if (!bvh)
+      continue;
+    auto inverse_model = glm::inverse(scene_g.GetWorldMatrix(mesh_nodes_g[i]));
+    glm::vec4 origin = inverse_model * glm::vec4{near_point, 1};
+    glm::vec4 direction = inverse_model * glm::vec4{far_point - near_point, 0};
+    Ray ray;
+    ray.origin = Vec3f{origin[0], origin[1], origin[2]};
+    ray.direction = Vec3f{direction[0], direction[1], direction[2]};
+    RayHit hit;
+    if (!bvh->Intersect(ray, hit, t_max))
+      continue;
+    t_max = hit.t;
+    result.mesh_index = static_cast<int>(i);
+    result.face = hit.face;
+    result.barycentric = Vec3r{Real(1) - hit.u - hit.v, hit.u, hit.v};
+  }
+  if (result.mesh_index < 0)
+    return false;
+  auto position = near_point + t_max * (far_point - near_point);
+  result.position = Vec3r{position[0], position[1], position[2]};
+  result.distance = t_max * glm::length(far_point - near_point);
+  return true;
 }
 
 void 
@@ -342,10 +772,27 @@ mouse_button_callback(GLFWwindow* window, int button, int action, int mods)
        release = 0;
        // cout << "Cursor Position at (" << xf << " : " << yf << endl;
     }
+    // pick the mesh under the cursor
+    if (button == GLFW_MOUSE_BUTTON_RIGHT && action == GLFW_PRESS && !meshlist_g.empty()) {
+      auto start = std::chrono::steady_clock::now();
+      PickResult pick;
+      bool picked = PickMesh(window, cursor_x_g, cursor_y_g, pick);
+      auto us = std::chrono::duration<double, std::micro>(
+          std::chrono::steady_clock::now() - start).count();
+      if (picked)
+        spdlog::info("picked mesh {}, face {}, barycentric ({:.3f}, {:.3f}, {:.3f}), "
+                     "distance {:.4f} ({:.1f} us)", pick.mesh_index, pick.face,
+                     pick.barycentric[0], pick.barycentric[1], pick.barycentric[2],
+                     pick.distance, us);
+      else
+        spdlog::info("nothing picked ({:.1f} us)", us);
+      return;
+    }
     delta_x = xf - xi;
     net_x_transform += delta_x;
     delta_y = yf - yi;
     net_y_transform += delta_y;
+    UpdateSceneRotation();
 
 }
 
@@ -375,19 +822,38 @@ KeyboardCallback(GLFWwindow */*window*/, int key, int /*scancode*/, int action,
           // reset
           case GLFW_KEY_SPACE:
             camera_z_pos = 2;
-            reset = 1;
+            delta_x = 0;
+            delta_y = 0;
             net_x_transform = 0;
             net_y_transform = 0;
-            
-
-        }   
+            UpdateSceneRotation();
+            break;
+          // toggle depth pre-pass
+          case GLFW_KEY_P:
+            depth_prepass_g = !depth_prepass_g;
+            spdlog::info("depth pre-pass {}", depth_prepass_g ? "on" : "off");
+            break;
+          // toggle between phong and gouraud shading
+          case GLFW_KEY_G:
+            shading_g = shading_g == GLShaderKey::Shading::kPhong ?
+              GLShaderKey::Shading::kGouraud : GLShaderKey::Shading::kPhong;
+            break;
+          // print memory used by the scene
+          case GLFW_KEY_M:
+            GetSceneMemoryReport().Print("scene memory");
+            break;
+        }
       }
+      return;
   }
     
   if (action == GLFW_PRESS || action == GLFW_REPEAT) {
     uint grid_nx, grid_ny;
     sphere_g->GetGridSize(grid_nx, grid_ny);
     switch (key) {
+    case GLFW_KEY_M:            // print memory used by the scene
+      GetSceneMemoryReport().Print("scene memory");
+      break;
     case GLFW_KEY_0:            // increase number of subdivisions (grid_nx)
       sphere_g->SetGridSize(grid_nx + 1, grid_ny);
       break;
@@ -435,6 +901,11 @@ CreateGLFWWindow(int width, int height, const std::string &window_name)
   glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
 #endif
 
+#ifdef OLIO_SYNC_GL_ERRORS
+  // debug contexts report all driver messages
+  glfwWindowHint(GLFW_OPENGL_DEBUG_CONTEXT, GL_TRUE);
+#endif
+
   // // enable antialiasing (with 5 samples per pixel)
   // glfwWindowHint(GLFW_SAMPLES, 5);
 
@@ -454,6 +925,16 @@ CreateGLFWWindow(int width, int height, const std::string &window_name)
     return nullptr;
   }
 
+  // report gl errors through debug output rather than glGetError
+  if (gl_debug_severity_g) {
+    GLDebugOutput::Options debug_options;
+    debug_options.min_severity = gl_debug_severity_g;
+#ifdef OLIO_SYNC_GL_ERRORS
+    debug_options.synchronous = true;
+#endif
+    gl_debug_output_g = unique_ptr<GLDebugOutput>(new GLDebugOutput(debug_options));
+  }
+
   // enable vsync
   glfwSwapInterval(1);
 
@@ -476,16 +957,49 @@ CreateGLFWWindow(int width, int height, const std::string &window_name)
 
 
 bool
-ParseArguments(int argc, char **argv, std::vector<std::string> *mesh_names)
+ParseArguments(int argc, char **argv, std::vector<std::string> *mesh_names,
+               bool *depth_prepass, TriMesh::Retention *retention,
+               uint *ao_ray_count, OctreeMesh::Budget *octree_budget,
+               std::vector<std::string> *diffuse_maps, double *texture_budget_ms,
+               GLenum *gl_debug_severity)
 {
   namespace po = boost::program_options;
   po::options_description desc("options");
+  std::string retention_name, gl_debug_name;
+  size_t cpu_budget_mb = 0, gpu_budget_mb = 0;
+  bool shared_arenas = false;
   try {
     desc.add_options()
       ("help,h", "print usage")
       ("mesh_name,m",
        po::value<vector<std::string>>(mesh_names)->multitoken(),
-       "Mesh filenames");
+       "Mesh filenames")
+      ("depth_prepass,d", po::bool_switch(depth_prepass),
+       "Render a depth pre-pass before the lighting pass")
+      ("retention,r", po::value<std::string>(&retention_name)->default_value("compact"),
+       "Mesh data kept after upload: full, compact, or none")
+      ("ambient_occlusion,a", po::value<uint>(ao_ray_count)->default_value(0),
+       "Bake per-vertex ambient occlusion with this many rays per vertex "
+       "(0: disabled)")
+      ("cpu_budget", po::value<size_t>(&cpu_budget_mb)->default_value(
+          octree_budget->cpu_bytes >> 20),
+       "Octree meshes: MB of loaded chunks awaiting upload")
+      ("gpu_budget", po::value<size_t>(&gpu_budget_mb)->default_value(
+          octree_budget->gpu_bytes >> 20),
+       "Octree meshes: MB of resident chunks")
+      ("pixel_error", po::value<float>(&octree_budget->pixel_error)->default_value(
+          octree_budget->pixel_error),
+       "Octree meshes: target screen space error in pixels")
+      ("diffuse_map,t",
+       po::value<vector<std::string>>(diffuse_maps)->multitoken(),
+       "Diffuse textures, one per mesh_name (meshes need texcoords)")
+      ("texture_budget", po::value<double>(texture_budget_ms)->default_value(2.0),
+       "Milliseconds per frame spent uploading textures")
+      ("gl_debug", po::value<std::string>(&gl_debug_name)->default_value("medium"),
+       "Lowest severity of gl debug messages logged: high, medium, low, "
+       "notification, or off")
+      ("shared_arenas", po::bool_switch(&shared_arenas),
+       "Loader threads share jemalloc's arenas instead of getting one each");
 
     // parse arguments
     po::variables_map vm;
@@ -495,6 +1009,24 @@ ParseArguments(int argc, char **argv, std::vector<std::string> *mesh_names)
       return false;
     }
     po::notify(vm);
+
+    if (retention_name == "full")
+      *retention = TriMesh::Retention::kFull;
+    else if (retention_name == "compact")
+      *retention = TriMesh::Retention::kCompact;
+    else if (retention_name == "none")
+      *retention = TriMesh::Retention::kNone;
+    else
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "retention", retention_name);
+    if (gl_debug_name == "off")
+      *gl_debug_severity = 0;
+    else if (!GLDebugOutput::ParseSeverity(gl_debug_name, *gl_debug_severity))
+      throw po::validation_error(po::validation_error::invalid_option_value,
+                                 "gl_debug", gl_debug_name);
+    octree_budget->cpu_bytes = cpu_budget_mb << 20;
+    octree_budget->gpu_bytes = gpu_budget_mb << 20;
+    SetThreadArenasEnabled(!shared_arenas);
   } catch(std::exception &e) {
     cout << desc << endl;
     spdlog::error("{}", e.what());
@@ -513,14 +1045,20 @@ int
 main(int argc, char **argv)
 {
   std::vector<string> mesh_names;
-  if (!ParseArguments(argc, argv, &mesh_names))
+  auto retention = TriMesh::Retention::kCompact;
+  uint ao_ray_count = 0;
+  OctreeMesh::Budget octree_budget;
+  std::vector<string> diffuse_maps;
+  if (!ParseArguments(argc, argv, &mesh_names, &depth_prepass_g, &retention,
+                      &ao_ray_count, &octree_budget, &diffuse_maps,
+                      &texture_budget_ms_g, &gl_debug_severity_g))
     return -1;
 
   // for(int i = 0; i<argc; ++i){
   //   cout << mesh_names[i];
   // }
   
-  if (argc <= 1){
+  if (mesh_names.empty()){
     // create the main GLFW window
     auto window = CreateGLFWWindow(1280, 720, "Olio - Sphere");
     if (!window)
@@ -528,7 +1066,7 @@ main(int argc, char **argv)
 
     // create VAO
     glGenVertexArrays(1, &vao_);
-    glBindVertexArray(vao_);
+    GLState::Get().BindVertexArray(vao_);
 
     // create a Sphere instance
     sphere_g = std::make_shared<Sphere>();
@@ -539,10 +1077,11 @@ main(int argc, char **argv)
     ambient = diffuse;
     auto material = std::make_shared<PhongMaterial>(ambient, diffuse, specular, shininess);
 
-    // create gl shader object and load vertex and fragment shaders
-    auto glshader = make_shared<GLPhongShader>();
-    if (!glshader->LoadShaders("../shaders/phong_vert.glsl",
-                              "../shaders/phong_frag.glsl")) {
+    // create shader variant cache and compile the default variant
+    // (the material's fallback shader)
+    shader_permutations_g = CreateShaderPermutations();
+    auto glshader = GetShaderVariant(false);
+    if (!glshader) {
       spdlog::error("Failed to load shaders.");
       return -1;
     }
@@ -579,6 +1118,17 @@ main(int argc, char **argv)
     }
 
     // clean up stuff
+    shader_permutations_g->PrintStats();
+    GetSceneMemoryReport().Print("scene memory");
+    if (gl_debug_output_g)
+      gl_debug_output_g->PrintStats();
+    auto sphere_cache_stats = SphereGeometryCache::Get().GetStats();
+    spdlog::info("sphere geometry cache: {} hits, {} misses, {} evictions",
+                 sphere_cache_stats.hits, sphere_cache_stats.misses,
+                 sphere_cache_stats.evictions);
+    sphere_g.reset();
+    SphereGeometryCache::Get().Clear();
+    gl_debug_output_g.reset();
     glfwDestroyWindow(window);
     glfwTerminate();
   }
@@ -593,31 +1143,102 @@ main(int argc, char **argv)
 
     // create VAO
     glGenVertexArrays(1, &vao_);
-    glBindVertexArray(vao_);
-
-    // make trimesh instance(s)
-    // need to update this to handle more than one obj at a time
+    GLState::Get().BindVertexArray(vao_);
+
+    // create GPU queries for measuring the lighting pass
+    shaded_samples_query_g = unique_ptr<GLQueryRing>(new GLQueryRing(GL_SAMPLES_PASSED));
+    gpu_time_query_g = unique_ptr<GLQueryRing>(new GLQueryRing(GL_TIME_ELAPSED));
+
+    // queue the textures first, so they decode while the meshes load
+    texture_cache_g = unique_ptr<GLTextureCache>(new GLTextureCache);
+    vector<GLTexture::Ptr> mesh_textures;
+    for (const auto &diffuse_map : diffuse_maps)
+      mesh_textures.push_back(texture_cache_g->Get(diffuse_map));
+    mesh_textures.resize(mesh_names.size());
+    vector<GLTexture::Ptr> meshlist_textures;
+
+    // materials referenced by obj files (their textures decode while
+    // the meshes load, too)
+    material_library_g = make_shared<MaterialLibrary>(texture_cache_g.get());
+    vector<PhongMaterial::Ptr> meshlist_materials;
+
+    // make trimesh instance(s) and upload them, keeping track of the
+    // peak memory use and the allocator's activity while loading
+    PeakMemoryTracker load_tracker;
+    load_tracker.Begin("load/upload");
+    AllocatorPhase load_phase("load"), upload_phase("upload");
+    size_t loaded_bytes = 0;
     for(auto name_it = mesh_names.begin(); name_it != mesh_names.end() ; ++name_it){
+      // preprocessed meshes are streamed (see olio_octree)
+      if (boost::filesystem::path{*name_it}.extension() == ".octree") {
+        auto octree = std::make_shared<OctreeMesh>();
+        if (!octree->Open(*name_it))
+          continue;
+        octree->SetBudget(octree_budget);
+        octree_meshes_g.push_back(octree);
+        continue;
+      }
       auto mesh = std::make_shared<TriMesh>();
       mesh->SetFilePath(*name_it);
+      mesh->SetRetention(retention);
+      load_phase.Begin();
       mesh->Load(*name_it);
+      mesh->UpdateBVH();
+      if (ao_ray_count) {
+        AOSettings ao_settings;
+        ao_settings.ray_count = ao_ray_count;
+        mesh->UpdateAmbientOcclusion(ao_settings);
+      }
+      load_phase.End();
+      load_tracker.Sample(loaded_bytes + mesh->GetMemoryStats().GetCPUBytes());
+
+      // check for texcoords while the loaded topology is still
+      // resident (compact and none retention release it on upload)
+      auto &texture = mesh_textures[static_cast<size_t>(name_it - mesh_names.begin())];
+      if (texture && !mesh->HasTexCoords()) {
+        spdlog::warn("{} has no texcoords -- ignoring {}", *name_it,
+                     texture->GetPath().string());
+        texture = nullptr;
+      }
+      meshlist_textures.push_back(texture);
+
+      upload_phase.Begin();
+      mesh->UpdateGLBuffers();
+      upload_phase.End();
+      auto stats = mesh->GetMemoryStats();
+      load_tracker.Sample(loaded_bytes + stats.GetTotalBytes() + stats.upload_bytes);
+      loaded_bytes += stats.GetTotalBytes();
       meshlist_g.push_back(mesh);
+      if (boost::filesystem::path{*name_it}.extension() == ".obj")
+        meshlist_materials.push_back(material_library_g->LoadOBJMaterial(*name_it));
+      else
+        meshlist_materials.push_back(nullptr);
     }
+    load_tracker.End();
+    load_phase.Print(meshlist_g.size(), "mesh");
+    upload_phase.Print(meshlist_g.size(), "mesh");
 
     // mesh_g = std::make_shared<TriMesh>();
     // mesh_g->SetFilePath(mesh_names[0]);
     // mesh_g->Load(mesh_names[0]);
 
+    // place the meshes in the scene
+    BuildScene();
+
+    // create streaming buffer for the meshes' per-frame matrices
+    CreateTransformsStream(meshlist_g.size() + octree_meshes_g.size());
+
     // create phong material for the mesh
     Vec3r ambient{0, 0, 0}, diffuse{.8, .8, 0}, specular{.5, .5, .5};
     Real shininess{50};
     ambient = diffuse;
     auto material = std::make_shared<PhongMaterial>(ambient, diffuse, specular, shininess);
 
-    // create gl shader object and load vertex and fragment shaders
-    auto glshader = make_shared<GLPhongShader>();
-    if (!glshader->LoadShaders("../shaders/phong_vert.glsl",
-                              "../shaders/phong_frag.glsl")) {
+    // create shader variant cache and compile the default variant
+    // (the material's fallback shader)
+    shader_permutations_g = CreateShaderPermutations();
+    auto glshader = GetShaderVariant(false);
+    if (!glshader) {
       spdlog::error("Failed to load shaders.");
       return -1;
     }
@@ -626,6 +1247,23 @@ main(int argc, char **argv)
     material->SetGLShader(glshader);
     mesh_material_g = material;
 
+    // meshes use their obj material (or the default one), with the
+    // diffuse map from the command line if there is one
+    for (size_t mesh_index = 0; mesh_index < meshlist_g.size(); ++mesh_index) {
+      auto mesh_material = meshlist_materials[mesh_index];
+      const auto &texture = meshlist_textures[mesh_index];
+      if (texture) {
+        auto textured_material = std::make_shared<PhongMaterial>(
+            mesh_material ? *mesh_material : *material);
+        textured_material->SetDiffuseMap(texture);
+        mesh_material = material_library_g->Deduplicate(textured_material);
+      }
+      mesh_materials_g.push_back(mesh_material);
+    }
+    for (const auto &library_material : material_library_g->GetMaterials())
+      library_material->SetGLShader(glshader);
+    spdlog::info("{} unique materials", material_library_g->GetMaterials().size());
+
     // add point light 1
     auto point_light1 = make_shared<PointLight>(Vec3r{2, 2, 4}, Vec3r{10, 10, 10},
                                                 Vec3r{0.01f, 0.01f, 0.01f});
@@ -641,17 +1279,45 @@ main(int argc, char **argv)
                                                 Vec3r{0.01f, 0.01f, 0.01f});
     lights_g.push_back(point_light3);
 
-    // main draw loop
+    // main draw loop. steady-state frames shouldn't allocate (texture
+    // and octree loads still may); the phase starts after the first
+    // frame, which compiles shader variants and sizes the scratch
+    // buffers
+    AllocatorPhase frame_phase("frames");
+    size_t frame_count = 0;
+    bool first_frame = true;
     while (!glfwWindowShouldClose(window)) {
       if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         break;
       Display();
       glfwSwapBuffers(window);
       glfwPollEvents();
+      if (first_frame) {
+        first_frame = false;
+        frame_phase.Begin();
+      } else {
+        ++frame_count;
+      }
       // glfwWaitEvents();
     }
+    frame_phase.End();
 
     // clean up stuff
+    frame_phase.Print(frame_count);
+    shader_permutations_g->PrintStats();
+    texture_cache_g->PrintStats();
+    PrintLightingPassStats();
+    GetSceneMemoryReport().Print("scene memory");
+    mesh_materials_g.clear();
+    material_library_g.reset();
+    texture_cache_g.reset();
+    shaded_samples_query_g.reset();
+    gpu_time_query_g.reset();
+    transforms_stream_g.reset();
+    octree_meshes_g.clear();
+    if (gl_debug_output_g)
+      gl_debug_output_g->PrintStats();
+    gl_debug_output_g.reset();
     glfwDestroyWindow(window);
     glfwTerminate();
 
@@ -0,0 +1,113 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       mesh_normals.cc
+//! \brief      Parallel face/vertex normal kernels over flat position
+//!             and triangle index arrays
+//! \author     Hadi Fadaifard, 2022
+
+#include "mesh_normals.h"
+#include <cmath>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+
+namespace olio {
+
+using namespace std;
+
+namespace {
+// elements per parallel task
+constexpr size_t kGrainSize = 4096;
+
+// normalize v, leaving degenerate (zero) vectors unchanged
+inline Vec3r
+SafeNormalized(const Vec3r &v)
+{
+  auto norm = v.norm();
+  return norm > 0 ? Vec3r{v / norm} : v;
+}
+}  // namespace
+
+
+void
+BuildVertexCorners(size_t vertex_count, const uint32_t *indices,
+                   size_t face_count, VertexCorners &adjacency)
+{
+  // counting sort of the corners by vertex. this is a single
+  // sequential pass, which keeps the corners of every vertex in
+  // increasing order
+  auto corner_count = 3 * face_count;
+  adjacency.offsets.assign(vertex_count + 1, 0);
+  for (size_t c = 0; c < corner_count; ++c)
+    ++adjacency.offsets[indices[c] + 1];
+  for (size_t v = 0; v < vertex_count; ++v)
+    adjacency.offsets[v + 1] += adjacency.offsets[v];
+
+  adjacency.corners.resize(corner_count);
+  vector<uint32_t> cursor(adjacency.offsets.begin(), adjacency.offsets.end() - 1);
+  for (size_t c = 0; c < corner_count; ++c)
+    adjacency.corners[cursor[indices[c]]++] = static_cast<uint32_t>(c);
+}
+
+
+void
+ComputeFaceNormals(const Vec3r *points, const uint32_t *indices,
+                   size_t face_count, Vec3r *face_normals)
+{
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, face_count, kGrainSize),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t f = range.begin(); f != range.end(); ++f) {
+      const auto *face = indices + 3 * f;
+      const auto &p0 = points[face[0]];
+      Vec3r face_normal = (points[face[1]] - p0).cross(points[face[2]] - p0);
+      face_normals[f] = SafeNormalized(face_normal);
+    }
+  });
+}
+
+
+void
+ComputeVertexNormals(const Vec3r *points, const uint32_t *indices,
+                     size_t /*face_count*/, const VertexCorners &adjacency,
+                     NormalWeighting weighting, Vec3r *vertex_normals)
+{
+  // every vertex gathers from its own corners (no atomics or
+  // scattered writes), in a fixed order
+  auto vertex_count = adjacency.offsets.size() - 1;
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, vertex_count, kGrainSize),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t v = range.begin(); v != range.end(); ++v) {
+      Vec3r vertex_normal{0, 0, 0};
+      for (auto i = adjacency.offsets[v]; i < adjacency.offsets[v + 1]; ++i) {
+        auto corner = adjacency.corners[i];
+        const auto *face = indices + 3 * (corner / 3);
+        auto k = corner % 3;
+        const auto &p0 = points[face[k]];
+        Vec3r e1 = points[face[(k + 1) % 3]] - p0;
+        Vec3r e2 = points[face[(k + 2) % 3]] - p0;
+        // |e1 x e2| is twice the face area
+        Vec3r face_normal = e1.cross(e2);
+        switch (weighting) {
+        case NormalWeighting::kUniform:
+          vertex_normal += SafeNormalized(face_normal);
+          break;
+        case NormalWeighting::kArea:
+          vertex_normal += face_normal;
+          break;
+        case NormalWeighting::kAngle: {
+          auto angle = std::atan2(face_normal.norm(), e1.dot(e2));
+          vertex_normal += angle * SafeNormalized(face_normal);
+          break;
+        }
+        }
+      }
+      vertex_normals[v] = SafeNormalized(vertex_normal);
+    }
+  });
+}
+
+}  // namespace olio
@@ -0,0 +1,65 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       mesh_normals.h
+//! \brief      Parallel face/vertex normal kernels over flat position
+//!             and triangle index arrays
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "types.h"
+
+namespace olio {
+
+//! \brief How face normals are weighted when averaged into vertex
+//!        normals
+enum class NormalWeighting {
+  kUniform = 0,   //!< every incident face counts the same
+  kArea,          //!< weighted by face area
+  kAngle          //!< weighted by the face's angle at the vertex
+};
+
+//! \brief Triangle corners incident to each vertex, in compressed
+//!        sparse row form. Corner c is vertex c % 3 of face c / 3.
+//!        Corners of a vertex are stored in increasing order, so sums
+//!        over them are deterministic
+struct VertexCorners {
+  std::vector<uint32_t> offsets;  //!< vertex_count + 1 offsets into corners
+  std::vector<uint32_t> corners;  //!< corner indices
+};
+
+//! \brief Build the vertex-to-corner adjacency of a triangle mesh
+//! \param[in] vertex_count number of vertices
+//! \param[in] indices triangle vertex indices (3 * face_count)
+//! \param[in] face_count number of triangles
+//! \param[out] adjacency vertex corners
+void BuildVertexCorners(size_t vertex_count, const uint32_t *indices,
+                        size_t face_count, VertexCorners &adjacency);
+
+//! \brief Compute unit face normals (zero for degenerate faces)
+//! \param[in] points vertex positions
+//! \param[in] indices triangle vertex indices (3 * face_count)
+//! \param[in] face_count number of triangles
+//! \param[out] face_normals face_count normals
+void ComputeFaceNormals(const Vec3r *points, const uint32_t *indices,
+                        size_t face_count, Vec3r *face_normals);
+
+//! \brief Compute unit vertex normals from the incident faces
+//! \param[in] points vertex positions
+//! \param[in] indices triangle vertex indices (3 * face_count)
+//! \param[in] face_count number of triangles
+//! \param[in] adjacency vertex corners (see BuildVertexCorners)
+//! \param[in] weighting face weighting
+//! \param[out] vertex_normals normals, one per vertex of adjacency
+void ComputeVertexNormals(const Vec3r *points, const uint32_t *indices,
+                          size_t face_count, const VertexCorners &adjacency,
+                          NormalWeighting weighting, Vec3r *vertex_normals);
+
+}  // namespace olio
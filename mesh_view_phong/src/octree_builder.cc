@@ -0,0 +1,637 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       octree_builder.cc
+//! \brief      Out-of-core partitioning of a mesh into an on-disk octree
+//!             of chunks (see octree_format.h)
+//! \author     Hadi Fadaifard, 2022
+
+#include "octree_builder.h"
+#include <array>
+#include <cmath>
+#include <chrono>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <limits>
+#include <algorithm>
+#include <unordered_map>
+#include <unordered_set>
+#include <spdlog/spdlog.h>
+#include "octree_format.h"
+#include "mesh_normals.h"
+#include "trimesh.h"
+#include "utils/mapped_file.h"
+
+namespace olio {
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace {
+constexpr size_t kTriangleFloats = 9;             // 3 positions per triangle
+constexpr size_t kStreamBlockTriangles = 1 << 16; // triangles per file read
+
+//! axis aligned box
+struct Box {
+  Vec3f bmin{Vec3f::Constant(std::numeric_limits<float>::max())};
+  Vec3f bmax{Vec3f::Constant(std::numeric_limits<float>::lowest())};
+  void Extend(const float *p) {
+    for (int i = 0; i < 3; ++i) {
+      bmin[i] = std::min(bmin[i], p[i]);
+      bmax[i] = std::max(bmax[i], p[i]);
+    }
+  }
+  bool IsValid() const {return (bmin.array() <= bmax.array()).all();}
+};
+
+
+//! key of a position (bitwise, for welding identical vertices)
+struct PositionKey {
+  uint32_t bits[3];
+  bool operator==(const PositionKey &rhs) const {
+    return bits[0] == rhs.bits[0] && bits[1] == rhs.bits[1] && bits[2] == rhs.bits[2];
+  }
+};
+struct PositionKeyHash {
+  size_t operator()(const PositionKey &key) const {
+    uint64_t h = key.bits[0] * 0x9e3779b97f4a7c15ull;
+    h ^= (h >> 29) ^ key.bits[1] * 0xbf58476d1ce4e5b9ull;
+    h ^= (h >> 32) ^ key.bits[2] * 0x94d049bb133111ebull;
+    return static_cast<size_t>(h ^ (h >> 31));
+  }
+};
+
+
+//! append triangles (9 floats each) to a file
+bool
+WriteTriangles(ofstream &out, const float *triangles, size_t count)
+{
+  out.write(reinterpret_cast<const char*>(triangles),
+            static_cast<streamsize>(count * kTriangleFloats * sizeof(float)));
+  return static_cast<bool>(out);
+}
+
+
+//! parse a (possibly negative, 1-based) obj vertex reference
+bool
+ParseOBJIndex(const char *&cursor, uint64_t seen_vertices, uint64_t &index)
+{
+  char *end = nullptr;
+  auto value = strtoll(cursor, &end, 10);
+  if (end == cursor || value == 0)
+    return false;
+  // skip texcoord/normal references
+  cursor = end;
+  while (*cursor && !isspace(static_cast<unsigned char>(*cursor)))
+    ++cursor;
+  if (value < 0) {
+    if (static_cast<uint64_t>(-value) > seen_vertices)
+      return false;
+    index = seen_vertices - static_cast<uint64_t>(-value);
+  } else {
+    index = static_cast<uint64_t>(value - 1);
+  }
+  return true;
+}
+
+
+//! stream the triangles of an obj file into a triangle file: the
+//! first pass writes the vertices to a temporary file, which is memory
+//! mapped while the second pass reads the faces
+bool
+StreamOBJTriangles(const fs::path &input, const fs::path &vertices_path,
+                   ofstream &triangles_out, uint64_t &triangle_count, Box &bounds)
+{
+  // pass 1: vertices
+  ifstream in(input.string());
+  if (!in) {
+    spdlog::error("BuildOctreeMesh: could not open {}", input.string());
+    return false;
+  }
+  uint64_t vertex_count = 0;
+  {
+    ofstream vertices_out(vertices_path.string(), ios::binary);
+    if (!vertices_out) {
+      spdlog::error("BuildOctreeMesh: could not write {}", vertices_path.string());
+      return false;
+    }
+    string line;
+    while (getline(in, line)) {
+      if (line.size() < 2 || line[0] != 'v' || !isspace(static_cast<unsigned char>(line[1])))
+        continue;
+      float p[3];
+      const char *cursor = line.c_str() + 1;
+      for (int i = 0; i < 3; ++i) {
+        char *end = nullptr;
+        p[i] = strtof(cursor, &end);
+        cursor = end;
+      }
+      vertices_out.write(reinterpret_cast<const char*>(p), sizeof(p));
+      bounds.Extend(p);
+      ++vertex_count;
+    }
+    if (!vertices_out) {
+      spdlog::error("BuildOctreeMesh: could not write {}", vertices_path.string());
+      return false;
+    }
+  }
+  if (!vertex_count) {
+    spdlog::error("BuildOctreeMesh: no vertices in {}", input.string());
+    return false;
+  }
+  spdlog::info("BuildOctreeMesh: read {} vertices", vertex_count);
+
+  // pass 2: faces (fan triangulated)
+  MappedFile vertices_file;
+  if (!vertices_file.Open(vertices_path))
+    return false;
+  const auto *positions = reinterpret_cast<const float*>(vertices_file.GetData());
+  in.clear();
+  in.seekg(0);
+  vector<float> block;
+  block.reserve(kStreamBlockTriangles * kTriangleFloats);
+  uint64_t seen_vertices = 0, skipped_faces = 0;
+  vector<uint64_t> face;
+  string line;
+  while (getline(in, line)) {
+    if (line.size() < 2 || !isspace(static_cast<unsigned char>(line[1])))
+      continue;
+    if (line[0] == 'v') {
+      ++seen_vertices;
+      continue;
+    }
+    if (line[0] != 'f')
+      continue;
+    face.clear();
+    const char *cursor = line.c_str() + 1;
+    bool valid = true;
+    while (true) {
+      while (*cursor && isspace(static_cast<unsigned char>(*cursor)))
+        ++cursor;
+      if (!*cursor)
+        break;
+      uint64_t index;
+      if (!ParseOBJIndex(cursor, seen_vertices, index) || index >= vertex_count) {
+        valid = false;
+        break;
+      }
+      face.push_back(index);
+    }
+    if (!valid || face.size() < 3) {
+      ++skipped_faces;
+      continue;
+    }
+    for (size_t i = 1; i + 1 < face.size(); ++i) {
+      for (auto v : {face[0], face[i], face[i + 1]})
+        block.insert(block.end(), positions + 3 * v, positions + 3 * v + 3);
+      ++triangle_count;
+    }
+    if (block.size() >= kStreamBlockTriangles * kTriangleFloats) {
+      if (!WriteTriangles(triangles_out, block.data(), block.size() / kTriangleFloats))
+        return false;
+      block.clear();
+    }
+  }
+  if (!block.empty() &&
+      !WriteTriangles(triangles_out, block.data(), block.size() / kTriangleFloats))
+    return false;
+  if (skipped_faces)
+    spdlog::warn("BuildOctreeMesh: skipped {} invalid faces", skipped_faces);
+  return true;
+}
+
+
+//! write the triangles of a mesh loaded with OpenMesh (in core)
+bool
+WriteMeshTriangles(const fs::path &input, ofstream &triangles_out,
+                   uint64_t &triangle_count, Box &bounds)
+{
+  TriMesh mesh;
+  if (!mesh.Load(input))
+    return false;
+  vector<GLuint> indices(mesh.GetIndexBufferSize());
+  if (indices.empty())
+    return false;
+  mesh.PackIndices(&indices[0]);
+  const auto *points = mesh.points();
+  vector<float> block;
+  block.reserve(kStreamBlockTriangles * kTriangleFloats);
+  for (size_t c = 0; c < indices.size(); ++c) {
+    Vec3f p = points[indices[c]].cast<float>();
+    bounds.Extend(p.data());
+    block.insert(block.end(), p.data(), p.data() + 3);
+    if (block.size() == kStreamBlockTriangles * kTriangleFloats) {
+      if (!WriteTriangles(triangles_out, block.data(), kStreamBlockTriangles))
+        return false;
+      block.clear();
+    }
+  }
+  triangle_count = indices.size() / 3;
+  return block.empty() ||
+    WriteTriangles(triangles_out, block.data(), block.size() / kTriangleFloats);
+}
+
+
+//! recursive octree construction over triangle files
+class OctreeFileBuilder {
+public:
+  OctreeFileBuilder(const OctreeBuildSettings &settings, ofstream &out,
+                    const fs::path &temp_prefix)
+      : settings_(settings), out_(out), temp_prefix_(temp_prefix) {}
+
+  //! build the subtree of the triangles in bucket (which is removed)
+  //! \return node index, or kOctreeInvalidNode on failure
+  uint32_t BuildNode(const fs::path &bucket, uint64_t triangle_count,
+                     const Box &cube, uint depth, vector<float> &representative);
+
+  fs::path GetTempPath() {
+    return fs::path{temp_prefix_.string() + ".tmp" + to_string(temp_counter_++)};
+  }
+  const vector<OctreeFileNode>& GetNodes() const {return nodes_;}
+  uint64_t GetOffset() const {return offset_;}
+  uint GetMaxDepth() const {return max_depth_;}
+protected:
+  uint32_t WriteChunk(const vector<float> &triangles, float error, uint depth,
+                      const uint32_t children[8]);
+  float Simplify(const vector<float> &triangles, const Box &cube,
+                 vector<float> &simplified) const;
+
+  const OctreeBuildSettings &settings_;
+  ofstream &out_;
+  fs::path temp_prefix_;
+  size_t temp_counter_{0};
+  uint64_t offset_{sizeof(OctreeFileHeader)};
+  uint max_depth_{0};
+  vector<OctreeFileNode> nodes_;
+};
+
+
+uint32_t
+OctreeFileBuilder::BuildNode(const fs::path &bucket, uint64_t triangle_count,
+                             const Box &cube, uint depth, vector<float> &representative)
+{
+  boost::system::error_code ec;
+  uint32_t children[8];
+  std::fill(children, children + 8, kOctreeInvalidNode);
+
+  // small enough: read the bucket and write a leaf
+  if (triangle_count <= settings_.max_chunk_triangles || depth >= settings_.max_depth) {
+    vector<float> triangles(triangle_count * kTriangleFloats);
+    ifstream in(bucket.string(), ios::binary);
+    in.read(reinterpret_cast<char*>(triangles.data()),
+            static_cast<streamsize>(triangles.size() * sizeof(float)));
+    bool read = static_cast<bool>(in);
+    in.close();
+    fs::remove(bucket, ec);
+    if (!read) {
+      spdlog::error("BuildOctreeMesh: could not read {}", bucket.string());
+      return kOctreeInvalidNode;
+    }
+    max_depth_ = std::max(max_depth_, depth);
+    auto node = WriteChunk(triangles, 0, depth, children);
+    representative.swap(triangles);
+    return node;
+  }
+
+  // distribute the triangles into the octants by centroid
+  Vec3f center = 0.5f * (cube.bmin + cube.bmax);
+  array<fs::path, 8> child_paths;
+  array<unique_ptr<ofstream>, 8> child_files;
+  array<vector<float>, 8> child_blocks;
+  array<uint64_t, 8> child_counts;
+  child_counts.fill(0);
+  auto FlushChild = [&](int octant) {
+    auto &block = child_blocks[octant];
+    if (block.empty())
+      return true;
+    if (!child_files[octant]) {
+      child_paths[octant] = GetTempPath();
+      child_files[octant] = unique_ptr<ofstream>(
+          new ofstream(child_paths[octant].string(), ios::binary));
+    }
+    bool written = WriteTriangles(*child_files[octant], block.data(),
+                                  block.size() / kTriangleFloats);
+    block.clear();
+    return written;
+  };
+  {
+    ifstream in(bucket.string(), ios::binary);
+    vector<float> block;
+    uint64_t remaining = triangle_count;
+    while (remaining) {
+      auto count = static_cast<size_t>(std::min<uint64_t>(remaining, kStreamBlockTriangles));
+      block.resize(count * kTriangleFloats);
+      in.read(reinterpret_cast<char*>(block.data()),
+              static_cast<streamsize>(block.size() * sizeof(float)));
+      if (!in) {
+        spdlog::error("BuildOctreeMesh: could not read {}", bucket.string());
+        return kOctreeInvalidNode;
+      }
+      for (size_t t = 0; t < count; ++t) {
+        const float *triangle = &block[t * kTriangleFloats];
+        int octant = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+          float centroid = (triangle[axis] + triangle[3 + axis] + triangle[6 + axis]) / 3.0f;
+          if (centroid >= center[axis])
+            octant |= 1 << axis;
+        }
+        auto &child_block = child_blocks[octant];
+        child_block.insert(child_block.end(), triangle, triangle + kTriangleFloats);
+        ++child_counts[octant];
+        if (child_block.size() >= kStreamBlockTriangles * kTriangleFloats &&
+            !FlushChild(octant)) {
+          spdlog::error("BuildOctreeMesh: could not write temporary file");
+          return kOctreeInvalidNode;
+        }
+      }
+      remaining -= count;
+    }
+  }
+  fs::remove(bucket, ec);
+  for (int octant = 0; octant < 8; ++octant) {
+    if (!FlushChild(octant) || (child_files[octant] && !child_files[octant]->good())) {
+      spdlog::error("BuildOctreeMesh: could not write temporary file");
+      return kOctreeInvalidNode;
+    }
+    child_files[octant].reset();
+    vector<float>().swap(child_blocks[octant]);
+  }
+
+  // build the children and simplify their representatives
+  vector<float> gathered;
+  float child_error = 0;
+  for (int octant = 0; octant < 8; ++octant) {
+    if (!child_counts[octant])
+      continue;
+    Box child_cube;
+    for (int axis = 0; axis < 3; ++axis) {
+      bool upper = (octant >> axis) & 1;
+      child_cube.bmin[axis] = upper ? center[axis] : cube.bmin[axis];
+      child_cube.bmax[axis] = upper ? cube.bmax[axis] : center[axis];
+    }
+    vector<float> child_representative;
+    children[octant] = BuildNode(child_paths[octant], child_counts[octant],
+                                 child_cube, depth + 1, child_representative);
+    if (children[octant] == kOctreeInvalidNode)
+      return kOctreeInvalidNode;
+    child_error = std::max(child_error, nodes_[children[octant]].geometric_error);
+    gathered.insert(gathered.end(), child_representative.begin(),
+                    child_representative.end());
+  }
+  auto error = std::max(Simplify(gathered, cube, representative), child_error);
+  return WriteChunk(representative, error, depth, children);
+}
+
+
+float
+OctreeFileBuilder::Simplify(const vector<float> &triangles, const Box &cube,
+                            vector<float> &simplified) const
+{
+  // vertex clustering: vertices in the same grid cell are merged into
+  // their average, and triangles that collapse are dropped
+  auto resolution = std::max(settings_.cluster_resolution, 1u);
+  float cell_size = (cube.bmax - cube.bmin).maxCoeff() / static_cast<float>(resolution);
+  if (!(cell_size > 0)) {
+    simplified = triangles;
+    return 0;
+  }
+  unordered_map<uint64_t, uint32_t> cell_ids;
+  vector<Vec3d> sums;
+  vector<uint32_t> counts;
+  auto vertex_count = triangles.size() / 3;
+  vector<uint32_t> vertex_cells(vertex_count);
+  for (size_t v = 0; v < vertex_count; ++v) {
+    uint64_t key = 0;
+    for (int axis = 0; axis < 3; ++axis) {
+      auto cell = std::floor((triangles[3 * v + axis] - cube.bmin[axis]) / cell_size);
+      auto clamped = std::min(std::max(cell, 0.0f), static_cast<float>(resolution - 1));
+      key = (key << 21) | static_cast<uint64_t>(clamped);
+    }
+    auto inserted = cell_ids.emplace(key, static_cast<uint32_t>(sums.size()));
+    if (inserted.second) {
+      sums.push_back(Vec3d::Zero());
+      counts.push_back(0);
+    }
+    auto id = inserted.first->second;
+    sums[id] += Vec3d{triangles[3 * v], triangles[3 * v + 1], triangles[3 * v + 2]};
+    ++counts[id];
+    vertex_cells[v] = id;
+  }
+
+  // keep one copy of every non-degenerate cell triangle
+  simplified.clear();
+  unordered_set<uint64_t> kept;
+  for (size_t t = 0; t + 2 < vertex_count; t += 3) {
+    uint32_t ids[3] = {vertex_cells[t], vertex_cells[t + 1], vertex_cells[t + 2]};
+    if (ids[0] == ids[1] || ids[1] == ids[2] || ids[0] == ids[2])
+      continue;
+    uint32_t sorted[3] = {ids[0], ids[1], ids[2]};
+    std::sort(sorted, sorted + 3);
+    uint64_t key = (static_cast<uint64_t>(sorted[0]) * 0x9e3779b97f4a7c15ull) ^
+      (static_cast<uint64_t>(sorted[1]) << 21) ^ (static_cast<uint64_t>(sorted[2]) << 42);
+    if (!kept.insert(key).second)
+      continue;
+    for (auto id : ids) {
+      Vec3d p = sums[id] / static_cast<double>(counts[id]);
+      for (int axis = 0; axis < 3; ++axis)
+        simplified.push_back(static_cast<float>(p[axis]));
+    }
+  }
+  return cell_size * std::sqrt(3.0f);
+}
+
+
+uint32_t
+OctreeFileBuilder::WriteChunk(const vector<float> &triangles, float error, uint depth,
+                              const uint32_t children[8])
+{
+  // weld identical positions
+  unordered_map<PositionKey, uint32_t, PositionKeyHash> welded;
+  vector<Vec3r> points;
+  vector<uint32_t> indices;
+  indices.reserve(triangles.size() / 3);
+  for (size_t t = 0; t + kTriangleFloats <= triangles.size(); t += kTriangleFloats) {
+    uint32_t face[3];
+    for (int corner = 0; corner < 3; ++corner) {
+      const float *p = &triangles[t + 3 * corner];
+      PositionKey key;
+      memcpy(key.bits, p, sizeof(key.bits));
+      auto inserted = welded.emplace(key, static_cast<uint32_t>(points.size()));
+      if (inserted.second)
+        points.push_back(Vec3r{p[0], p[1], p[2]});
+      face[corner] = inserted.first->second;
+    }
+    if (face[0] == face[1] || face[1] == face[2] || face[0] == face[2])
+      continue;
+    indices.insert(indices.end(), face, face + 3);
+  }
+
+  // area weighted vertex normals
+  auto face_count = indices.size() / 3;
+  vector<Vec3r> normals(points.size(), Vec3r::Zero());
+  if (face_count) {
+    VertexCorners adjacency;
+    BuildVertexCorners(points.size(), indices.data(), face_count, adjacency);
+    ComputeVertexNormals(points.data(), indices.data(), face_count, adjacency,
+                         NormalWeighting::kArea, normals.data());
+  }
+
+  // interleave and append to the file
+  OctreeFileNode node;
+  memset(&node, 0, sizeof(node));
+  Box bounds;
+  vector<float> vertices(points.size() * kOctreeVertexStride);
+  for (size_t v = 0; v < points.size(); ++v) {
+    float *vertex = &vertices[v * kOctreeVertexStride];
+    for (int axis = 0; axis < 3; ++axis) {
+      vertex[axis] = static_cast<float>(points[v][axis]);
+      vertex[3 + axis] = static_cast<float>(normals[v][axis]);
+    }
+    bounds.Extend(vertex);
+  }
+  if (!bounds.IsValid())
+    bounds.bmin = bounds.bmax = Vec3f::Zero();
+  for (int axis = 0; axis < 3; ++axis) {
+    node.bmin[axis] = bounds.bmin[axis];
+    node.bmax[axis] = bounds.bmax[axis];
+  }
+  // interior bounds cover the children (the simplified geometry can
+  // be slightly smaller)
+  for (int octant = 0; octant < 8; ++octant) {
+    node.children[octant] = children[octant];
+    if (children[octant] == kOctreeInvalidNode)
+      continue;
+    const auto &child = nodes_[children[octant]];
+    for (int axis = 0; axis < 3; ++axis) {
+      node.bmin[axis] = std::min(node.bmin[axis], child.bmin[axis]);
+      node.bmax[axis] = std::max(node.bmax[axis], child.bmax[axis]);
+    }
+  }
+  node.geometric_error = error;
+  node.depth = depth;
+  node.data_offset = offset_;
+  node.vertex_count = static_cast<uint32_t>(points.size());
+  node.index_count = static_cast<uint32_t>(indices.size());
+  out_.write(reinterpret_cast<const char*>(vertices.data()),
+             static_cast<streamsize>(vertices.size() * sizeof(float)));
+  out_.write(reinterpret_cast<const char*>(indices.data()),
+             static_cast<streamsize>(indices.size() * sizeof(uint32_t)));
+  if (!out_) {
+    spdlog::error("BuildOctreeMesh: could not write chunk");
+    return kOctreeInvalidNode;
+  }
+  offset_ += node.GetDataSize();
+  nodes_.push_back(node);
+  if (nodes_.size() % 1000 == 0)
+    spdlog::info("BuildOctreeMesh: {} nodes written", nodes_.size());
+  return static_cast<uint32_t>(nodes_.size() - 1);
+}
+}  // namespace
+
+
+bool
+BuildOctreeMesh(const fs::path &input, const fs::path &output,
+                const OctreeBuildSettings &settings, OctreeBuildStats *stats)
+{
+  using Clock = std::chrono::steady_clock;
+  auto start = Clock::now();
+  boost::system::error_code ec;
+
+  // temporary files live next to the output unless requested otherwise
+  auto temp_dir = settings.temp_dir.empty() ? output.parent_path() : settings.temp_dir;
+  if (temp_dir.empty())
+    temp_dir = ".";
+  auto temp_prefix = temp_dir / output.filename();
+
+  ofstream out(output.string(), ios::binary);
+  if (!out) {
+    spdlog::error("BuildOctreeMesh: could not write {}", output.string());
+    return false;
+  }
+  OctreeFileHeader header;
+  memset(&header, 0, sizeof(header));
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+  // gather the source triangles in the root bucket
+  OctreeFileBuilder builder(settings, out, temp_prefix);
+  auto root_bucket = builder.GetTempPath();
+  uint64_t triangle_count = 0;
+  Box bounds;
+  bool read = false;
+  {
+    ofstream triangles_out(root_bucket.string(), ios::binary);
+    if (!triangles_out) {
+      spdlog::error("BuildOctreeMesh: could not write {}", root_bucket.string());
+      return false;
+    }
+    auto extension = input.extension().string();
+    std::transform(extension.begin(), extension.end(), extension.begin(), ::tolower);
+    if (extension == ".obj") {
+      auto vertices_path = builder.GetTempPath();
+      read = StreamOBJTriangles(input, vertices_path, triangles_out, triangle_count, bounds);
+      fs::remove(vertices_path, ec);
+    } else {
+      read = WriteMeshTriangles(input, triangles_out, triangle_count, bounds);
+    }
+    read = read && triangles_out.good();
+  }
+  if (!read || !triangle_count || !bounds.IsValid()) {
+    spdlog::error("BuildOctreeMesh: no triangles read from {}", input.string());
+    fs::remove(root_bucket, ec);
+    return false;
+  }
+  spdlog::info("BuildOctreeMesh: partitioning {} triangles", triangle_count);
+
+  // octants are cubes around the bounding box
+  Box cube;
+  Vec3f center = 0.5f * (bounds.bmin + bounds.bmax);
+  float half_size = 0.5f * (bounds.bmax - bounds.bmin).maxCoeff() * 1.001f + 1e-6f;
+  cube.bmin = center - Vec3f::Constant(half_size);
+  cube.bmax = center + Vec3f::Constant(half_size);
+  vector<float> representative;
+  auto root = builder.BuildNode(root_bucket, triangle_count, cube, 0, representative);
+  if (root == kOctreeInvalidNode)
+    return false;
+
+  // node table, then the header
+  const auto &nodes = builder.GetNodes();
+  memcpy(header.magic, kOctreeFileMagic, sizeof(header.magic));
+  header.node_count = static_cast<uint32_t>(nodes.size());
+  header.root = root;
+  header.node_table_offset = builder.GetOffset();
+  header.triangle_count = triangle_count;
+  for (int axis = 0; axis < 3; ++axis) {
+    header.bmin[axis] = bounds.bmin[axis];
+    header.bmax[axis] = bounds.bmax[axis];
+  }
+  header.max_depth = builder.GetMaxDepth();
+  out.write(reinterpret_cast<const char*>(nodes.data()),
+            static_cast<streamsize>(nodes.size() * sizeof(OctreeFileNode)));
+  out.seekp(0);
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  out.close();
+  if (!out) {
+    spdlog::error("BuildOctreeMesh: could not write {}", output.string());
+    return false;
+  }
+
+  if (stats) {
+    stats->triangle_count = triangle_count;
+    stats->node_count = nodes.size();
+    stats->leaf_count = static_cast<uint64_t>(
+        std::count_if(nodes.begin(), nodes.end(),
+                      [](const OctreeFileNode &node) {return node.IsLeaf();}));
+    stats->max_depth = header.max_depth;
+    stats->file_bytes = header.node_table_offset + nodes.size() * sizeof(OctreeFileNode);
+    stats->seconds = std::chrono::duration<double>(Clock::now() - start).count();
+  }
+  return true;
+}
+
+}  // namespace olio
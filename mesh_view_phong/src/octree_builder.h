@@ -0,0 +1,61 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       octree_builder.h
+//! \brief      Out-of-core partitioning of a mesh into an on-disk octree
+//!             of chunks (see octree_format.h)
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <cstdint>
+#include <boost/filesystem.hpp>
+#include "types.h"
+
+namespace olio {
+
+//! \struct OctreeBuildSettings
+//! \brief Octree preprocessing parameters
+struct OctreeBuildSettings {
+  uint32_t max_chunk_triangles{65536};  //!< leaves are split above this
+  uint cluster_resolution{64};          //!< simplification cells per node axis
+  uint max_depth{16};                   //!< nodes at this depth are leaves
+  boost::filesystem::path temp_dir;     //!< temporary files (empty: next to output)
+};
+
+
+//! \struct OctreeBuildStats
+//! \brief Summary of an octree build
+struct OctreeBuildStats {
+  uint64_t triangle_count{0};   //!< source triangles
+  uint64_t node_count{0};
+  uint64_t leaf_count{0};
+  uint max_depth{0};
+  uint64_t file_bytes{0};
+  double seconds{0};
+};
+
+
+//! \brief Partition a mesh into an octree of chunks with simplified
+//!        interior nodes and write it to an .octree file. OBJ files
+//!        are streamed from disk in two passes (vertices, then faces)
+//!        and triangles are distributed into per-node temporary files,
+//!        so only one leaf's worth of triangles (plus the simplified
+//!        nodes on the current path) is in memory at a time. Other
+//!        formats are loaded with OpenMesh first and must fit in
+//!        memory
+//! \param[in] input source mesh
+//! \param[in] output .octree file
+//! \param[in] settings build parameters
+//! \param[out] stats build summary (optional)
+//! \return true on success
+bool BuildOctreeMesh(const boost::filesystem::path &input,
+                     const boost::filesystem::path &output,
+                     const OctreeBuildSettings &settings=OctreeBuildSettings{},
+                     OctreeBuildStats *stats=nullptr);
+
+}  // namespace olio
@@ -0,0 +1,73 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       octree_format.h
+//! \brief      On-disk layout of chunked octree meshes (.octree files)
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <cstdint>
+
+namespace olio {
+
+//! \brief Layout of an .octree file:
+//!
+//!   OctreeFileHeader
+//!   chunk data (per node: vertex_count interleaved position/normal
+//!               vertices of 6 floats, then index_count uint32 indices)
+//!   OctreeFileNode table (node_count nodes, at node_table_offset)
+//!
+//! Nodes are stored in post order, so the root is the last node.
+//! Leaves hold the source triangles; interior nodes hold a simplified
+//! version of their children. All values are little endian
+constexpr char kOctreeFileMagic[8] = {'O', 'L', 'I', 'O', 'O', 'C', 'T', '1'};
+constexpr uint32_t kOctreeVertexStride = 6;  //!< floats per vertex
+constexpr uint32_t kOctreeInvalidNode = 0xffffffffu;
+
+//! \struct OctreeFileHeader
+//! \brief .octree file header (64 bytes)
+struct OctreeFileHeader {
+  char magic[8];
+  uint32_t node_count;
+  uint32_t root;
+  uint64_t node_table_offset;
+  uint64_t triangle_count;        //!< source triangles (sum over leaves)
+  float bmin[3];
+  float bmax[3];
+  uint32_t max_depth;
+  uint32_t reserved;
+};
+static_assert(sizeof(OctreeFileHeader) == 64, "unexpected OctreeFileHeader size");
+
+
+//! \struct OctreeFileNode
+//! \brief Octree node (80 bytes)
+struct OctreeFileNode {
+  float bmin[3];                  //!< tight bounds of the node's geometry
+  float geometric_error;          //!< object space error (0 for leaves)
+  float bmax[3];
+  uint32_t depth;
+  uint32_t children[8];           //!< kOctreeInvalidNode if empty
+  uint64_t data_offset;           //!< vertices, followed by indices
+  uint32_t vertex_count;
+  uint32_t index_count;
+
+  uint64_t GetDataSize() const {
+    return static_cast<uint64_t>(vertex_count) * kOctreeVertexStride * sizeof(float) +
+      static_cast<uint64_t>(index_count) * sizeof(uint32_t);
+  }
+  bool IsLeaf() const {
+    for (auto child : children)
+      if (child != kOctreeInvalidNode)
+        return false;
+    return true;
+  }
+};
+static_assert(sizeof(OctreeFileNode) == 80, "unexpected OctreeFileNode size");
+
+}  // namespace olio
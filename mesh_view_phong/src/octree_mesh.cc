@@ -0,0 +1,610 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       octree_mesh.cc
+//! \brief      Out-of-core mesh drawn from a memory mapped .octree file,
+//!             streaming chunks by view-dependent priority within CPU
+//!             and GPU memory budgets
+//! \author     Hadi Fadaifard, 2022
+
+#include "octree_mesh.h"
+#include <cstring>
+#include <limits>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "utils/utils.h"
+#include "utils/allocator.h"
+#include "utils/gldrawdata.h"
+#include "utils/glshader.h"
+#include "utils/glstate.h"
+#include "utils/material.h"
+
+namespace olio {
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+//! camera data used for node selection
+struct OctreeMesh::View {
+  glm::vec4 planes[6];    // frustum planes in object space
+  glm::mat4 mv_matrix;
+  float scale;            // largest scale of the model matrix
+  float lod_scale;        // pixels per unit at unit distance
+  float pixel_error;      // target screen space error
+};
+
+
+OctreeMesh::~OctreeMesh()
+{
+  Close();
+}
+
+
+bool
+OctreeMesh::Open(const fs::path &filepath)
+{
+  Close();
+  if (!file_.Open(filepath))
+    return false;
+
+  // header and node table
+  auto InvalidFile = [&](const char *reason) {
+    spdlog::error("OctreeMesh: {}: {}", filepath.string(), reason);
+    file_.Close();
+    nodes_.clear();
+    return false;
+  };
+  auto file_size = file_.GetSize();
+  if (file_size < sizeof(OctreeFileHeader))
+    return InvalidFile("truncated header");
+  memcpy(&header_, file_.GetData(), sizeof(header_));
+  if (memcmp(header_.magic, kOctreeFileMagic, sizeof(header_.magic)) != 0)
+    return InvalidFile("not an octree file");
+  auto table_size = static_cast<uint64_t>(header_.node_count) * sizeof(OctreeFileNode);
+  if (!header_.node_count || header_.root != header_.node_count - 1 ||
+      header_.node_table_offset < sizeof(OctreeFileHeader) ||
+      header_.node_table_offset > file_size ||
+      table_size > file_size - header_.node_table_offset)
+    return InvalidFile("invalid node table");
+  nodes_.resize(header_.node_count);
+  memcpy(nodes_.data(), file_.GetData() + header_.node_table_offset,
+         static_cast<size_t>(table_size));
+  // nodes are stored in post order, so children come before their
+  // parent; this also rules out cycles in SelectNodes
+  for (uint32_t i = 0; i < header_.node_count; ++i) {
+    const auto &node = nodes_[i];
+    bool valid = node.data_offset >= sizeof(OctreeFileHeader) &&
+      node.data_offset <= header_.node_table_offset &&
+      node.GetDataSize() <= header_.node_table_offset - node.data_offset &&
+      node.index_count % 3 == 0 && node.data_offset % sizeof(float) == 0;
+    for (auto child : node.children)
+      valid = valid && (child == kOctreeInvalidNode || child < i);
+    if (!valid)
+      return InvalidFile("invalid node");
+  }
+
+  filepath_ = filepath;
+  node_states_.assign(nodes_.size(), NodeState{});
+  frame_ = 0;
+  gpu_bytes_ = 0;
+  stats_ = Stats{};
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = false;
+    cpu_bytes_ = 0;
+  }
+  loader_ = thread(&OctreeMesh::LoaderLoop, this);
+  spdlog::info("{}: {} triangles in {} nodes (depth {})", filepath.filename().string(),
+               header_.triangle_count, header_.node_count, header_.max_depth);
+  return true;
+}
+
+
+void
+OctreeMesh::Close()
+{
+  if (loader_.joinable()) {
+    {
+      lock_guard<mutex> lock(mutex_);
+      stop_ = true;
+    }
+    loader_cv_.notify_all();
+    loader_.join();
+  }
+  DeleteGLBuffers();
+  {
+    lock_guard<mutex> lock(mutex_);
+    pending_.clear();
+    loading_.clear();
+    completed_.clear();
+    failed_.clear();
+    cpu_bytes_ = 0;
+  }
+  nodes_.clear();
+  node_states_.clear();
+  selected_nodes_.clear();
+  loaded_nodes_.clear();
+  file_.Close();
+}
+
+
+void
+OctreeMesh::SetBudget(const Budget &budget)
+{
+  {
+    lock_guard<mutex> lock(mutex_);
+    budget_ = budget;
+  }
+  loader_cv_.notify_all();
+}
+
+
+OctreeMesh::Budget
+OctreeMesh::GetBudget() const
+{
+  lock_guard<mutex> lock(mutex_);
+  return budget_;
+}
+
+
+void
+OctreeMesh::GetBoundingBox(Vec3r &bmin, Vec3r &bmax) const
+{
+  bmin = Vec3r{header_.bmin[0], header_.bmin[1], header_.bmin[2]};
+  bmax = Vec3r{header_.bmax[0], header_.bmax[1], header_.bmax[2]};
+}
+
+
+void
+OctreeMesh::Update(const glm::mat4 &model_matrix, const glm::mat4 &view_matrix,
+                   const glm::mat4 &proj_matrix, const Vec2i &viewport_size)
+{
+  if (!file_.IsOpen())
+    return;
+  ++frame_;
+  frame_budget_ = GetBudget();
+
+  // frustum planes in object space (rows of the clip matrix)
+  View view;
+  glm::mat4 clip_matrix = proj_matrix * view_matrix * model_matrix;
+  glm::vec4 rows[4];
+  for (int i = 0; i < 4; ++i)
+    rows[i] = glm::vec4(clip_matrix[0][i], clip_matrix[1][i], clip_matrix[2][i],
+                        clip_matrix[3][i]);
+  for (int i = 0; i < 3; ++i) {
+    view.planes[2 * i] = rows[3] + rows[i];
+    view.planes[2 * i + 1] = rows[3] - rows[i];
+  }
+  view.mv_matrix = view_matrix * model_matrix;
+  view.scale = std::max(glm::length(glm::vec3(model_matrix[0])),
+                        std::max(glm::length(glm::vec3(model_matrix[1])),
+                                 glm::length(glm::vec3(model_matrix[2]))));
+  view.lod_scale = proj_matrix[1][1] * 0.5f * static_cast<float>(viewport_size[1]);
+  view.pixel_error = frame_budget_.pixel_error;
+
+  // chunks finished by the loader (which are no longer in flight)
+  vector<uint32_t> completed, failed;
+  {
+    lock_guard<mutex> lock(mutex_);
+    completed.swap(completed_);
+    failed.swap(failed_);
+    auto IsCollected = [&](uint32_t node_index) {
+      return find(completed.begin(), completed.end(), node_index) != completed.end() ||
+        find(failed.begin(), failed.end(), node_index) != failed.end();
+    };
+    loading_.erase(remove_if(loading_.begin(), loading_.end(), IsCollected),
+                   loading_.end());
+  }
+  size_t stale_bytes = 0;
+  for (auto node_index : completed) {
+    // only nodes still in flight are uploaded; a chunk read for any
+    // other node is dropped rather than uploaded twice
+    auto &state = node_states_[node_index];
+    if (state.state != State::kRequested && state.state != State::kLoading) {
+      const auto &node = nodes_[node_index];
+      file_.Release(node.data_offset, static_cast<size_t>(node.GetDataSize()));
+      stale_bytes += static_cast<size_t>(node.GetDataSize());
+      continue;
+    }
+    state.state = State::kLoaded;
+    loaded_nodes_.push_back(node_index);
+  }
+  if (stale_bytes) {
+    lock_guard<mutex> lock(mutex_);
+    cpu_bytes_ -= std::min(cpu_bytes_, stale_bytes);
+  }
+  for (auto node_index : failed) {
+    node_states_[node_index].state = State::kFailed;
+    spdlog::error("{}: invalid chunk {}", filepath_.filename().string(), node_index);
+  }
+
+  // select the nodes to draw, and request what's missing
+  selected_nodes_.clear();
+  vector<Request> requests;
+  SelectNodes(view, header_.root, requests);
+  SubmitRequests(requests);
+  UploadLoadedNodes();
+
+  stats_.drawn_nodes = selected_nodes_.size();
+  stats_.drawn_triangles = 0;
+  for (auto node_index : selected_nodes_)
+    stats_.drawn_triangles += nodes_[node_index].index_count / 3;
+}
+
+
+bool
+OctreeMesh::IsVisible(const View &view, const OctreeFileNode &node) const
+{
+  // box is outside if its corner furthest along a plane's normal is
+  // behind the plane
+  for (const auto &plane : view.planes) {
+    glm::vec3 corner{plane.x >= 0 ? node.bmax[0] : node.bmin[0],
+                     plane.y >= 0 ? node.bmax[1] : node.bmin[1],
+                     plane.z >= 0 ? node.bmax[2] : node.bmin[2]};
+    if (glm::dot(glm::vec3(plane), corner) + plane.w < 0)
+      return false;
+  }
+  return true;
+}
+
+
+float
+OctreeMesh::GetScreenError(const View &view, const OctreeFileNode &node) const
+{
+  // projected geometric error at the closest point of the node's
+  // bounding sphere
+  glm::vec3 bmin{node.bmin[0], node.bmin[1], node.bmin[2]};
+  glm::vec3 bmax{node.bmax[0], node.bmax[1], node.bmax[2]};
+  auto radius = 0.5f * glm::length(bmax - bmin) * view.scale;
+  auto center = view.mv_matrix * glm::vec4(0.5f * (bmin + bmax), 1.0f);
+  auto distance = glm::length(glm::vec3(center)) - radius;
+  if (distance <= 1e-6f)
+    return std::numeric_limits<float>::max();
+  return node.geometric_error * view.scale * view.lod_scale / distance;
+}
+
+
+void
+OctreeMesh::SelectNodes(const View &view, uint32_t node_index, vector<Request> &requests)
+{
+  const auto &node = nodes_[node_index];
+  auto &state = node_states_[node_index];
+  if (state.state == State::kFailed || !IsVisible(view, node))
+    return;
+  state.last_used_frame = frame_;
+
+  // only the root can be visited before it's resident
+  if (state.state != State::kResident) {
+    requests.push_back(Request{node_index, std::numeric_limits<float>::max()});
+    return;
+  }
+  float error = GetScreenError(view, node);
+  if (node.IsLeaf() || error <= view.pixel_error) {
+    selected_nodes_.push_back(node_index);
+    return;
+  }
+
+  // refine once every visible child can be drawn; until then the
+  // node stands in for them
+  bool children_ready = true;
+  for (auto child : node.children) {
+    if (child == kOctreeInvalidNode)
+      continue;
+    const auto &child_state = node_states_[child];
+    if (child_state.state == State::kResident || !IsVisible(view, nodes_[child]))
+      continue;
+    children_ready = false;
+    if (child_state.state != State::kFailed)
+      requests.push_back(Request{child, error});
+  }
+  if (!children_ready) {
+    selected_nodes_.push_back(node_index);
+    return;
+  }
+  for (auto child : node.children)
+    if (child != kOctreeInvalidNode)
+      SelectNodes(view, child, requests);
+}
+
+
+void
+OctreeMesh::SubmitRequests(vector<Request> &requests)
+{
+  // replace the loader's queue. chunks the loader has popped are
+  // marked as loading under the same lock, so they are never queued
+  // again; loaded chunks aren't queued again either, but stay wanted
+  vector<Request> queued;
+  queued.reserve(requests.size());
+  {
+    lock_guard<mutex> lock(mutex_);
+    for (auto node_index : loading_)
+      if (node_states_[node_index].state == State::kRequested)
+        node_states_[node_index].state = State::kLoading;
+    for (const auto &request : requests) {
+      auto &state = node_states_[request.node];
+      state.priority = request.priority;
+      state.last_requested_frame = frame_;
+      if (state.state == State::kOnDisk || state.state == State::kRequested) {
+        state.state = State::kRequested;
+        queued.push_back(request);
+      }
+    }
+    stats_.requested_nodes = queued.size();
+    pending_.swap(queued);
+  }
+
+  // requests that weren't repeated are dropped
+  for (const auto &request : queued) {
+    auto &state = node_states_[request.node];
+    if (state.last_requested_frame != frame_ && state.state == State::kRequested)
+      state.state = State::kOnDisk;
+  }
+  loader_cv_.notify_one();
+}
+
+
+void
+OctreeMesh::UploadLoadedNodes()
+{
+  stats_.uploaded_nodes = 0;
+  if (loaded_nodes_.empty())
+    return;
+
+  // highest priority first
+  sort(loaded_nodes_.begin(), loaded_nodes_.end(), [this](uint32_t a, uint32_t b) {
+      return node_states_[a].priority > node_states_[b].priority;
+    });
+
+  size_t uploaded_bytes = 0, freed_bytes = 0;
+  vector<uint32_t> remaining;
+  for (auto node_index : loaded_nodes_) {
+    const auto &node = nodes_[node_index];
+    auto &state = node_states_[node_index];
+    auto size = static_cast<size_t>(node.GetDataSize());
+
+    // skip stale entries (the node was evicted, dropped or uploaded
+    // since it was loaded)
+    if (state.state != State::kLoaded)
+      continue;
+
+    // drop chunks that are no longer wanted
+    if (state.last_requested_frame != frame_) {
+      file_.Release(node.data_offset, size);
+      freed_bytes += size;
+      state.state = State::kOnDisk;
+      continue;
+    }
+
+    // stay within the per-frame upload and the gpu budgets (one
+    // upload always goes through, so large chunks aren't starved)
+    if (uploaded_bytes && uploaded_bytes + size > frame_budget_.upload_bytes) {
+      remaining.push_back(node_index);
+      continue;
+    }
+    EvictNodes(size);
+    if (gpu_bytes_ && gpu_bytes_ + size > frame_budget_.gpu_bytes) {
+      remaining.push_back(node_index);
+      continue;
+    }
+
+    // upload straight from the mapped file
+    auto vertices_size = static_cast<size_t>(node.vertex_count) *
+      kOctreeVertexStride * sizeof(float);
+    const auto *data = GetChunkData(node_index);
+    glGenBuffers(1, &state.vbo);
+    GLState::Get().BindBuffer(GL_ARRAY_BUFFER, state.vbo);
+    glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(vertices_size), data,
+                 GL_STATIC_DRAW);
+    glGenBuffers(1, &state.ebo);
+    GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, state.ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, static_cast<GLsizeiptr>(size - vertices_size),
+                 data + vertices_size, GL_STATIC_DRAW);
+    state.state = State::kResident;
+    gpu_bytes_ += size;
+    uploaded_bytes += size;
+    ++stats_.resident_nodes;
+    ++stats_.uploaded_nodes;
+
+    // the gpu has its own copy now
+    file_.Release(node.data_offset, size);
+    freed_bytes += size;
+  }
+  loaded_nodes_.swap(remaining);
+
+  if (freed_bytes) {
+    {
+      lock_guard<mutex> lock(mutex_);
+      cpu_bytes_ -= std::min(cpu_bytes_, freed_bytes);
+    }
+    loader_cv_.notify_one();
+  }
+}
+
+
+void
+OctreeMesh::EvictNodes(size_t required_bytes)
+{
+  if (gpu_bytes_ + required_bytes <= frame_budget_.gpu_bytes)
+    return;
+
+  // least recently used first, finer nodes before coarser ones. nodes
+  // used in this frame are never evicted
+  vector<uint32_t> candidates;
+  for (uint32_t i = 0; i < node_states_.size(); ++i)
+    if (node_states_[i].state == State::kResident &&
+        node_states_[i].last_used_frame != frame_)
+      candidates.push_back(i);
+  sort(candidates.begin(), candidates.end(), [this](uint32_t a, uint32_t b) {
+      const auto &state_a = node_states_[a], &state_b = node_states_[b];
+      if (state_a.last_used_frame != state_b.last_used_frame)
+        return state_a.last_used_frame < state_b.last_used_frame;
+      return nodes_[a].depth > nodes_[b].depth;
+    });
+  for (auto node_index : candidates) {
+    if (gpu_bytes_ + required_bytes <= frame_budget_.gpu_bytes)
+      break;
+    EvictNode(node_index);
+    ++stats_.evicted_nodes;
+  }
+}
+
+
+void
+OctreeMesh::EvictNode(uint32_t node_index)
+{
+  auto &state = node_states_[node_index];
+  if (state.state != State::kResident)
+    return;
+  GLState::Get().DeleteBuffers(1, &state.vbo);
+  GLState::Get().DeleteBuffers(1, &state.ebo);
+  state.vbo = state.ebo = 0;
+  state.state = State::kOnDisk;
+  gpu_bytes_ -= std::min(gpu_bytes_, static_cast<size_t>(nodes_[node_index].GetDataSize()));
+  --stats_.resident_nodes;
+}
+
+
+void
+OctreeMesh::DeleteGLBuffers()
+{
+  for (uint32_t i = 0; i < node_states_.size(); ++i)
+    EvictNode(i);
+  gpu_bytes_ = 0;
+  selected_nodes_.clear();
+}
+
+
+bool
+OctreeMesh::ValidateChunk(uint32_t node_index) const
+{
+  // indices must stay inside the chunk's vertices
+  const auto &node = nodes_[node_index];
+  auto vertices_size = static_cast<size_t>(node.vertex_count) *
+    kOctreeVertexStride * sizeof(float);
+  const auto *indices = reinterpret_cast<const uint32_t*>(GetChunkData(node_index) +
+                                                          vertices_size);
+  for (uint32_t i = 0; i < node.index_count; ++i)
+    if (indices[i] >= node.vertex_count)
+      return false;
+  return true;
+}
+
+
+void
+OctreeMesh::LoaderLoop()
+{
+  UseThreadArena();
+  unique_lock<mutex> lock(mutex_);
+  while (!stop_) {
+    if (pending_.empty()) {
+      loader_cv_.wait(lock);
+      continue;
+    }
+
+    // highest priority request that fits in the cpu budget (a single
+    // chunk is always allowed)
+    auto request = max_element(pending_.begin(), pending_.end(),
+                               [](const Request &a, const Request &b) {
+                                 return a.priority < b.priority;
+                               });
+    auto node_index = request->node;
+    const auto &node = nodes_[node_index];
+    auto size = static_cast<size_t>(node.GetDataSize());
+    if (cpu_bytes_ && cpu_bytes_ + size > budget_.cpu_bytes) {
+      loader_cv_.wait(lock);
+      continue;
+    }
+    pending_.erase(request);
+    loading_.push_back(node_index);
+    cpu_bytes_ += size;
+
+    // read the pages without holding the lock
+    lock.unlock();
+    bool valid = file_.Prefetch(node.data_offset, size) && ValidateChunk(node_index);
+    if (!valid)
+      file_.Release(node.data_offset, size);
+    lock.lock();
+    if (valid) {
+      completed_.push_back(node_index);
+    } else {
+      cpu_bytes_ -= size;
+      failed_.push_back(node_index);
+    }
+  }
+}
+
+
+void
+OctreeMesh::DrawGL(const GLDrawData &draw_data)
+{
+  if (selected_nodes_.empty())
+    return;
+
+  // check we have a valid material and shader
+  auto material = draw_data.GetMaterial();
+  if (!material)
+    return;
+  auto shader = draw_data.GetGLShader();
+  if (!shader)
+    shader = material->GetGLShader();
+  if (!shader || !shader->Use())
+    return;
+
+  // enable depth test
+  GLState::Get().SetEnabled(GL_DEPTH_TEST, true);
+  GLState::Get().DepthFunc(draw_data.GetDepthFunc());
+
+  // set up uniforms (only MVP matrices for the depth pre-pass)
+  bool positions_only = draw_data.GetPositionsOnly();
+  if (positions_only)
+    shader->SetTransforms(draw_data);
+  else
+    shader->SetupUniforms(draw_data);
+  auto positions_attr_index = glGetAttribLocation(shader->GetProgramID(), "position");
+  auto normals_attr_index = positions_only ? -1 :
+    glGetAttribLocation(shader->GetProgramID(), "normal");
+  if (positions_attr_index < 0)
+    return;
+
+  // every chunk has its own buffers
+  auto stride = static_cast<GLsizei>(kOctreeVertexStride * sizeof(GLfloat));
+  for (auto node_index : selected_nodes_) {
+    const auto &state = node_states_[node_index];
+    GLState::Get().BindBuffer(GL_ARRAY_BUFFER, state.vbo);
+    glVertexAttribPointer(static_cast<GLuint>(positions_attr_index), 3, GL_FLOAT,
+                          GL_FALSE, stride, (void*)(0));
+    glEnableVertexAttribArray(static_cast<GLuint>(positions_attr_index));
+    if (normals_attr_index >= 0) {
+      glVertexAttribPointer(static_cast<GLuint>(normals_attr_index), 3, GL_FLOAT,
+                            GL_FALSE, stride, (void*)(3 * sizeof(GLfloat)));
+      glEnableVertexAttribArray(static_cast<GLuint>(normals_attr_index));
+    }
+    GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, state.ebo);
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(nodes_[node_index].index_count),
+                   GL_UNSIGNED_INT, nullptr);
+  }
+
+  // check for gl errors
+  CheckOpenGLError();
+}
+
+
+MemoryStats
+OctreeMesh::GetMemoryStats() const
+{
+  MemoryStats stats;
+  stats.connectivity_bytes = nodes_.capacity() * sizeof(OctreeFileNode) +
+    node_states_.capacity() * sizeof(NodeState);
+  {
+    lock_guard<mutex> lock(mutex_);
+    stats.staging_bytes = cpu_bytes_;
+  }
+  stats.gpu_bytes = gpu_bytes_;
+  return stats;
+}
+
+}  // namespace olio
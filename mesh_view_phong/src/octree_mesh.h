@@ -0,0 +1,168 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       octree_mesh.h
+//! \brief      Out-of-core mesh drawn from a memory mapped .octree file,
+//!             streaming chunks by view-dependent priority within CPU
+//!             and GPU memory budgets
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <vector>
+#include <condition_variable>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include <boost/filesystem.hpp>
+#include "types.h"
+#include "octree_format.h"
+#include "utils/mapped_file.h"
+#include "utils/memory_stats.h"
+
+namespace olio {
+
+class GLDrawData;
+
+//! \class OctreeMesh
+//! \brief Mesh stored as an octree of chunks (see octree_builder.h).
+//!        Every frame, Update selects the coarsest nodes whose
+//!        projected error is within the pixel error target. Missing
+//!        chunks are requested from a loader thread, which faults
+//!        their pages of the mapped file in; the render thread only
+//!        uploads chunks that have been loaded, so it never waits on
+//!        the disk. Until its children are resident, a node is drawn
+//!        in place of them
+class OctreeMesh {
+public:
+  using Ptr = std::shared_ptr<OctreeMesh>;
+
+  //! \brief Memory and quality limits
+  struct Budget {
+    size_t cpu_bytes{size_t{256} << 20};   //!< loaded chunks awaiting upload
+    size_t gpu_bytes{size_t{512} << 20};   //!< resident chunk buffers
+    size_t upload_bytes{size_t{16} << 20}; //!< bytes uploaded per frame
+    float pixel_error{1.5f};               //!< target screen space error
+  };
+
+  //! \brief Per-frame streaming statistics
+  struct Stats {
+    size_t drawn_nodes{0};
+    size_t drawn_triangles{0};
+    size_t resident_nodes{0};    //!< nodes with gl buffers
+    size_t requested_nodes{0};   //!< requests passed to the loader
+    size_t uploaded_nodes{0};    //!< uploaded in the last frame
+    size_t evicted_nodes{0};     //!< evicted since opened
+  };
+
+  OctreeMesh() = default;
+  ~OctreeMesh();
+  OctreeMesh(const OctreeMesh &) = delete;
+  OctreeMesh& operator=(const OctreeMesh &) = delete;
+
+  //! \brief Map an .octree file and start the loader thread
+  //! \param[in] filepath octree file
+  //! \return true on success
+  bool Open(const boost::filesystem::path &filepath);
+
+  //! \brief Stop the loader, delete the gl buffers and unmap the file
+  void Close();
+
+  void SetBudget(const Budget &budget);
+  Budget GetBudget() const;
+
+  boost::filesystem::path GetFilePath() const {return filepath_;}
+  void GetBoundingBox(Vec3r &bmin, Vec3r &bmax) const;
+
+  //! \brief Number of triangles in the source mesh
+  uint64_t GetTriangleCount() const {return header_.triangle_count;}
+
+  //! \brief Select the nodes to draw, request missing chunks, upload
+  //!        loaded ones (within the per-frame upload budget) and
+  //!        evict unused ones (within the gpu budget). Must be called
+  //!        with the gl context current, before DrawGL
+  //! \param[in] model_matrix model matrix
+  //! \param[in] view_matrix view matrix
+  //! \param[in] proj_matrix projection matrix
+  //! \param[in] viewport_size viewport size in pixels
+  void Update(const glm::mat4 &model_matrix, const glm::mat4 &view_matrix,
+              const glm::mat4 &proj_matrix, const Vec2i &viewport_size);
+
+  //! \brief Draw the nodes selected by the last Update
+  void DrawGL(const GLDrawData &draw_data);
+
+  //! \brief Delete the gl buffers of all nodes
+  void DeleteGLBuffers();
+
+  //! \brief CPU (node table, loaded chunks) and GPU memory
+  MemoryStats GetMemoryStats() const;
+
+  Stats GetStats() const {return stats_;}
+protected:
+  enum class State : uchar {
+    kOnDisk = 0,    //!< not requested
+    kRequested,     //!< queued for the loader
+    kLoading,       //!< being read by the loader (never queued again)
+    kLoaded,        //!< pages faulted in, awaiting upload
+    kResident,      //!< gl buffers created
+    kFailed         //!< invalid chunk
+  };
+  struct NodeState {
+    GLuint vbo{0};
+    GLuint ebo{0};
+    State state{State::kOnDisk};
+    float priority{0};
+    size_t last_used_frame{0};
+    size_t last_requested_frame{0};
+  };
+  struct Request {
+    uint32_t node;
+    float priority;
+  };
+  struct View;
+
+  void SelectNodes(const View &view, uint32_t node_index, std::vector<Request> &requests);
+  bool IsVisible(const View &view, const OctreeFileNode &node) const;
+  float GetScreenError(const View &view, const OctreeFileNode &node) const;
+  void SubmitRequests(std::vector<Request> &requests);
+  void UploadLoadedNodes();
+  void EvictNodes(size_t required_bytes);
+  void EvictNode(uint32_t node_index);
+  bool ValidateChunk(uint32_t node_index) const;
+  void LoaderLoop();
+  const uchar* GetChunkData(uint32_t node_index) const {
+    return file_.GetData() + nodes_[node_index].data_offset;
+  }
+
+  boost::filesystem::path filepath_;
+  MappedFile file_;
+  OctreeFileHeader header_ = OctreeFileHeader();
+  std::vector<OctreeFileNode> nodes_;   //!< node table (copied from the file)
+  std::vector<NodeState> node_states_;  //!< render thread only
+  std::vector<uint32_t> selected_nodes_;
+  std::vector<uint32_t> loaded_nodes_;  //!< awaiting upload (render thread)
+  size_t frame_{0};
+  Budget frame_budget_;                 //!< budget_ as of the last Update
+  size_t gpu_bytes_{0};
+  Stats stats_;
+
+  // shared with the loader thread (guarded by mutex_)
+  mutable std::mutex mutex_;
+  std::condition_variable loader_cv_;
+  Budget budget_;
+  std::vector<Request> pending_;        //!< requests, replaced every frame
+  std::vector<uint32_t> loading_;       //!< popped by the loader, not yet collected
+  std::vector<uint32_t> completed_;     //!< loaded by the loader
+  std::vector<uint32_t> failed_;        //!< failed validation
+  size_t cpu_bytes_{0};                 //!< bytes of loaded, unuploaded chunks
+  bool stop_{false};
+  std::thread loader_;
+};
+
+}  // namespace olio
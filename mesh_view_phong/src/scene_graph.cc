@@ -0,0 +1,121 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       scene_graph.cc
+//! \brief      Transform hierarchy with cached world/normal matrices,
+//!             recomputed only below nodes that changed
+//! \author     Hadi Fadaifard, 2022
+
+#include "scene_graph.h"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace olio {
+
+using namespace std;
+
+constexpr SceneGraph::NodeID SceneGraph::kNoParent;
+
+SceneGraph::NodeID
+SceneGraph::AddNode(NodeID parent, const glm::mat4 &local_transform)
+{
+  auto node = static_cast<NodeID>(parents_.size());
+  if (parent != kNoParent && parent >= node) {
+    spdlog::error("SceneGraph::AddNode: invalid parent {}", parent);
+    parent = kNoParent;
+  }
+  parents_.push_back(parent);
+  first_children_.push_back(kNoParent);
+  next_siblings_.push_back(kNoParent);
+  if (parent != kNoParent) {
+    next_siblings_[node] = first_children_[parent];
+    first_children_[parent] = node;
+  }
+  local_.push_back(local_transform);
+  world_.emplace_back(1);
+  normal_.emplace_back(1);
+  update_stamps_.push_back(0);
+  dirty_flags_.push_back(1);
+  dirty_nodes_.push_back(node);
+  return node;
+}
+
+
+void
+SceneGraph::SetLocalTransform(NodeID node, const glm::mat4 &local_transform)
+{
+  local_[node] = local_transform;
+  if (dirty_flags_[node])
+    return;
+  dirty_flags_[node] = 1;
+  dirty_nodes_.push_back(node);
+}
+
+
+size_t
+SceneGraph::Update()
+{
+  ++stats_.updates;
+  stats_.updated_nodes = 0;
+  if (dirty_nodes_.empty())
+    return 0;
+
+  // ancestors have smaller ids: in id order, a changed node's subtree
+  // is updated before any changed descendant, which is then skipped
+  ++update_stamp_;
+  sort(dirty_nodes_.begin(), dirty_nodes_.end());
+  size_t updated_nodes = 0;
+  for (auto dirty_node : dirty_nodes_) {
+    dirty_flags_[dirty_node] = 0;
+    if (update_stamps_[dirty_node] == update_stamp_)
+      continue;
+    traversal_stack_.push_back(dirty_node);
+    while (!traversal_stack_.empty()) {
+      auto node = traversal_stack_.back();
+      traversal_stack_.pop_back();
+      UpdateNode(node);
+      ++updated_nodes;
+      for (auto child = first_children_[node]; child != kNoParent;
+           child = next_siblings_[child])
+        traversal_stack_.push_back(child);
+    }
+  }
+  dirty_nodes_.clear();
+  stats_.updated_nodes = updated_nodes;
+  stats_.total_updated_nodes += updated_nodes;
+  return updated_nodes;
+}
+
+
+void
+SceneGraph::Clear()
+{
+  parents_.clear();
+  first_children_.clear();
+  next_siblings_.clear();
+  local_.clear();
+  world_.clear();
+  normal_.clear();
+  update_stamps_.clear();
+  dirty_flags_.clear();
+  dirty_nodes_.clear();
+}
+
+
+void
+SceneGraph::UpdateNode(NodeID node)
+{
+  auto parent = parents_[node];
+  if (parent == kNoParent)
+    world_[node] = local_[node];
+  else
+    world_[node] = world_[parent] * local_[node];
+  normal_[node] = glm::transpose(glm::inverse(glm::mat3(world_[node])));
+  update_stamps_[node] = update_stamp_;
+}
+
+}  // namespace olio
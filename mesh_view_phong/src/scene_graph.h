@@ -0,0 +1,95 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       scene_graph.h
+//! \brief      Transform hierarchy with cached world/normal matrices,
+//!             recomputed only below nodes that changed
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include "types.h"
+
+namespace olio {
+
+//! \class SceneGraph
+//! \brief Hierarchy of transform nodes. Nodes store a local transform
+//!        (relative to their parent); world matrices (parent world *
+//!        local) and normal matrices (inverse transpose of the world
+//!        matrix) are cached in contiguous float arrays, indexed by
+//!        node id, and recomputed by Update only for nodes whose local
+//!        transform, or an ancestor's, changed since the last Update.
+//!        A parent is always added before its children, so parent ids
+//!        are smaller than their children's.
+class SceneGraph {
+public:
+  using NodeID = uint32_t;
+  static constexpr NodeID kNoParent = ~NodeID{0};
+
+  //! \brief Update counts
+  struct Stats {
+    size_t updated_nodes{0};  //!< world matrices computed by the last Update
+    size_t total_updated_nodes{0};
+    size_t updates{0};        //!< Update calls
+  };
+
+  //! \brief Add a node
+  //! \param[in] parent parent node (kNoParent for a root)
+  //! \param[in] local_transform transform relative to the parent
+  //! \return new node's id
+  NodeID AddNode(NodeID parent=kNoParent,
+                 const glm::mat4 &local_transform=glm::mat4(1));
+
+  //! \brief Set a node's local transform, marking it (and so its
+  //!        subtree) for update
+  void SetLocalTransform(NodeID node, const glm::mat4 &local_transform);
+  const glm::mat4& GetLocalTransform(NodeID node) const {return local_[node];}
+  NodeID GetParent(NodeID node) const {return parents_[node];}
+
+  //! \brief Recompute the world and normal matrices of the changed
+  //!        nodes and their descendants
+  //! \return number of nodes updated
+  size_t Update();
+
+  //! \brief World matrix as of the last Update
+  const glm::mat4& GetWorldMatrix(NodeID node) const {return world_[node];}
+  //! \brief Normal matrix (world space) as of the last Update
+  const glm::mat3& GetNormalMatrix(NodeID node) const {return normal_[node];}
+  //! \brief All world matrices, indexed by node id
+  const std::vector<glm::mat4>& GetWorldMatrices() const {return world_;}
+  //! \brief All normal matrices, indexed by node id
+  const std::vector<glm::mat3>& GetNormalMatrices() const {return normal_;}
+
+  size_t GetNodeCount() const {return parents_.size();}
+  bool IsDirty() const {return !dirty_nodes_.empty();}
+  Stats GetStats() const {return stats_;}
+
+  //! \brief Remove all nodes
+  void Clear();
+protected:
+  void UpdateNode(NodeID node);
+
+  // per-node arrays, indexed by node id
+  std::vector<NodeID> parents_;
+  std::vector<NodeID> first_children_;
+  std::vector<NodeID> next_siblings_;
+  std::vector<glm::mat4> local_;
+  std::vector<glm::mat4> world_;
+  std::vector<glm::mat3> normal_;
+  std::vector<uint32_t> update_stamps_;  //!< Update in which a node was last computed
+  std::vector<uint8_t> dirty_flags_;
+
+  std::vector<NodeID> dirty_nodes_;      //!< nodes whose local transform changed
+  std::vector<NodeID> traversal_stack_;
+  uint32_t update_stamp_{0};
+  Stats stats_;
+};
+
+}  // namespace olio
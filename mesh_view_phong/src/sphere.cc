@@ -10,11 +10,16 @@
 //! \author Hadi Fadaifard, 2022
 
 #include "sphere.h"
+#include <cmath>
 #include <vector>
+#include <limits>
 #include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include <spdlog/spdlog.h>
 #include "utils/gldrawdata.h"
 #include "utils/glshader.h"
+#include "utils/glstate.h"
 
 namespace olio {
 
@@ -34,7 +39,6 @@ void
 Sphere::SetCenter(const Vec3r &center)
 {
   center_ = center;
-  gl_buffers_dirty_ = true;
 }
 
 
@@ -42,15 +46,18 @@ void
 Sphere::SetRadius(Real radius)
 {
   radius_ = radius;
-  gl_buffers_dirty_ = true;
 }
 
 
 void
 Sphere::SetGridSize(uint grid_nx, uint grid_ny)
 {
-  grid_nx_ = std::max(grid_nx, 3u);
-  grid_ny_ = std::max(grid_ny, 3u);
+  grid_nx = std::max(grid_nx, 3u);
+  grid_ny = std::max(grid_ny, 3u);
+  if (grid_nx == grid_nx_ && grid_ny == grid_ny_)
+    return;
+  grid_nx_ = grid_nx;
+  grid_ny_ = grid_ny;
   gl_buffers_dirty_ = true;
 }
 
@@ -64,150 +71,288 @@ Sphere::~Sphere()
 void
 Sphere::DeleteGLBuffers()
 {
-  // delete vbos
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
-  if (positions_normals_vbo_) {
-    glDeleteBuffers(1, &positions_normals_vbo_);
-    positions_normals_vbo_ = 0;
-  }
+  // the cache deletes the buffers once no sphere uses them and they
+  // fall out of its budget
+  geometry_.reset();
+}
 
-  // delete ebos
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
-  if (faces_ebo_) {
-    glDeleteBuffers(1, &faces_ebo_);
-    faces_ebo_ = 0;
-  }
+
+MemoryStats
+Sphere::GetMemoryStats() const
+{
+  MemoryStats stats;
+  if (geometry_)
+    stats.gpu_bytes = geometry_->gpu_bytes;
+  return stats;
+}
+
+
+// sphere without seam: grid_ny - 1 rings of grid_nx vertices (ring r
+// at theta = (r + 1) * pi / grid_ny), then the bottom and top poles
+static constexpr size_t kRowGrainVertices = 16384;
+
+void
+GetWatertightSphereSize(uint grid_nx, uint grid_ny, size_t &vertex_count,
+                        size_t &index_count)
+{
+  size_t nx = grid_nx, rings = grid_ny - 1;
+  vertex_count = rings * nx + 2;
+  // two triangles per quad between rings, one per pole fan segment
+  index_count = 6 * (rings - 1) * nx + 2 * 3 * nx;
 }
 
 
-// sphere without seam
-bool
-BuildWatertightSphere(const Vec3r &center, Real radius, uint grid_nx,
-                      uint grid_ny, vector<Vec3r> &positions,
-                      vector<Vec3r> &normals,
-                      vector<int> &face_indices)
+//! \brief Rings per parallel task, so tasks have enough vertices
+static size_t
+GetRowGrainSize(uint grid_nx)
 {
-  if (grid_nx < 1 || grid_ny < 1)
-    return false;
+  return std::max<size_t>(1, kRowGrainVertices / grid_nx);
+}
+
 
-  // add mesh vertices
-  MatXi vertex_indices{grid_ny + 1, grid_nx};
-  Real phi_start = 0;
-  Real theta_start = 0;
+void
+BuildWatertightSphereVertices(const Vec3r &center, Real radius, uint grid_nx,
+                              uint grid_ny, GLfloat *vertices)
+{
+  // separable trig: phi per column, theta per ring
+  vector<Real> cos_phi(grid_nx), sin_phi(grid_nx);
   Real dphi = k2Pi / grid_nx;
+  for (uint i = 0; i < grid_nx; ++i) {
+    cos_phi[i] = cos(dphi * i);
+    sin_phi[i] = sin(dphi * i);
+  }
+  size_t rings = grid_ny - 1;
+  vector<Real> cos_theta(rings), sin_theta(rings);
   Real dtheta = kPi / grid_ny;
-  int vertex_id = 0;
-  positions.resize(0);
-  normals.resize(0);
-  positions.reserve((grid_ny +1) * grid_nx + 2);
-  normals.reserve((grid_ny +1) * grid_nx + 2);
-  for (uint j = 1; j < grid_ny; ++j) {
-    for (uint i = 0; i < grid_nx; ++i) {
-      Real cos_phi = cos(phi_start + dphi * i);
-      Real sin_phi = sin(phi_start + dphi * i);
-      Real cos_theta = cos(theta_start + j * dtheta);
-      Real sin_theta = sin(theta_start + j * dtheta);
-      Vec3r point{radius * cos_phi * sin_theta,
-                  radius * sin_phi * sin_theta,
-                  -radius * cos_theta};
-      positions.push_back(center + point);
-      normals.push_back(point.normalized());
-      vertex_indices(j, i) = vertex_id;
-      ++vertex_id;
-    }
+  for (size_t r = 0; r < rings; ++r) {
+    cos_theta[r] = cos(dtheta * static_cast<Real>(r + 1));
+    sin_theta[r] = sin(dtheta * static_cast<Real>(r + 1));
   }
 
-  // add mesh faces
-  face_indices.resize(0);
-  for (uint j = 1; j < grid_ny-1; ++j) {
-    for (uint i = 0; i < grid_nx; ++i) {
-      // add face 1
-      face_indices.push_back(vertex_indices(j, i));
-      face_indices.push_back(vertex_indices(j, (i+1)%grid_nx));
-      face_indices.push_back(vertex_indices(j+1, (i+1)%grid_nx));
-
-      // add face 2
-      face_indices.push_back(vertex_indices(j, i));
-      face_indices.push_back(vertex_indices(j+1, (i+1)%grid_nx));
-      face_indices.push_back(vertex_indices(j+1, i));
+  auto WriteVertex = [&](GLfloat *vertex, const Vec3r &normal) {
+    Vec3r position = center + radius * normal;
+    for (int k = 0; k < 3; ++k) {
+      vertex[k] = static_cast<GLfloat>(position[k]);
+      vertex[3 + k] = static_cast<GLfloat>(normal[k]);
     }
-  }
+  };
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, rings, GetRowGrainSize(grid_nx)),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t r = range.begin(); r != range.end(); ++r) {
+      auto *vertex = vertices + 6 * r * grid_nx;
+      for (uint i = 0; i < grid_nx; ++i, vertex += 6)
+        WriteVertex(vertex, Vec3r{cos_phi[i] * sin_theta[r], sin_phi[i] * sin_theta[r],
+                                  -cos_theta[r]});
+    }
+  });
 
-  // add bottom cap (triangle fan)
-  Vec3r bottom{0, 0, -radius};
-  int bottom_index = vertex_id;
-  positions.push_back(center + bottom);
-  normals.push_back(bottom.normalized());
-  ++vertex_id;
-  for (uint i = 0; i < grid_nx; ++i) {
-    face_indices.push_back(bottom_index);
-    face_indices.push_back(vertex_indices(1, (i+1)%grid_nx));
-    face_indices.push_back(vertex_indices(1, i));
-  }
+  // poles
+  WriteVertex(vertices + 6 * rings * grid_nx, Vec3r{0, 0, -1});
+  WriteVertex(vertices + 6 * (rings * grid_nx + 1), Vec3r{0, 0, 1});
+}
 
-  // add top cap (triangle fan)
-  Vec3r top{0, 0, radius};
-  int top_index = vertex_id;
-  positions.push_back(center + top);
-  normals.push_back(top.normalized());
-  ++vertex_id;
-  for (uint i = 0; i < grid_nx; ++i) {
-    face_indices.push_back(top_index);
-    face_indices.push_back(vertex_indices(grid_ny - 1, i));
-    face_indices.push_back(vertex_indices(grid_ny - 1, (i+1)%grid_nx));
+
+void
+BuildWatertightSphereIndices(uint grid_nx, uint grid_ny, GLuint *indices)
+{
+  size_t rings = grid_ny - 1;
+  auto VertexIndex = [grid_nx](size_t ring, uint i) {
+    return static_cast<GLuint>(ring * grid_nx + i % grid_nx);
+  };
+
+  // quads between consecutive rings
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, rings - 1, GetRowGrainSize(grid_nx)),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t r = range.begin(); r != range.end(); ++r) {
+      auto *face = indices + 6 * r * grid_nx;
+      for (uint i = 0; i < grid_nx; ++i, face += 6) {
+        face[0] = VertexIndex(r, i);
+        face[1] = VertexIndex(r, i + 1);
+        face[2] = VertexIndex(r + 1, i + 1);
+        face[3] = VertexIndex(r, i);
+        face[4] = VertexIndex(r + 1, i + 1);
+        face[5] = VertexIndex(r + 1, i);
+      }
+    }
+  });
+
+  // bottom and top caps (triangle fans)
+  auto bottom_index = static_cast<GLuint>(rings * grid_nx);
+  auto top_index = bottom_index + 1;
+  auto *face = indices + 6 * (rings - 1) * grid_nx;
+  for (uint i = 0; i < grid_nx; ++i, face += 3) {
+    face[0] = bottom_index;
+    face[1] = VertexIndex(0, i + 1);
+    face[2] = VertexIndex(0, i);
+  }
+  for (uint i = 0; i < grid_nx; ++i, face += 3) {
+    face[0] = top_index;
+    face[1] = VertexIndex(rings - 1, i);
+    face[2] = VertexIndex(rings - 1, i + 1);
   }
-  return true;
 }
 
 
 void
 Sphere::UpdateGLBuffers(bool force_update)
 {
-  if (!gl_buffers_dirty_ && !force_update)
+  if (!gl_buffers_dirty_ && !force_update && geometry_)
     return;
 
-  // delete existing VBOs
-  DeleteGLBuffers();
+  // release the old grid size first, so it can be evicted if needed
+  geometry_.reset();
+  geometry_ = SphereGeometryCache::Get().Acquire(grid_nx_, grid_ny_);
+  gl_buffers_dirty_ = false;
+}
+
+
+SphereGeometryCache::Geometry::~Geometry()
+{
+  if (vbo)
+    GLState::Get().DeleteBuffers(1, &vbo);
+  if (ebo)
+    GLState::Get().DeleteBuffers(1, &ebo);
+}
 
-  vector<Vec3r> positions, normals;
-  vector<int> face_indices;
-  BuildWatertightSphere(center_, radius_, grid_nx_, grid_ny_, positions, normals,
-                        face_indices);
-
-  // interleave positions and normals
-  vector<GLfloat> positions_normals;
-  for (size_t i = 0; i < positions.size(); ++i) {
-    // position
-    positions_normals.push_back(static_cast<GLfloat>(positions[i][0]));
-    positions_normals.push_back(static_cast<GLfloat>(positions[i][1]));
-    positions_normals.push_back(static_cast<GLfloat>(positions[i][2]));
-    // normal
-    positions_normals.push_back(static_cast<GLfloat>(normals[i][0]));
-    positions_normals.push_back(static_cast<GLfloat>(normals[i][1]));
-    positions_normals.push_back(static_cast<GLfloat>(normals[i][2]));
+
+SphereGeometryCache&
+SphereGeometryCache::Get()
+{
+  static SphereGeometryCache cache;
+  return cache;
+}
+
+
+SphereGeometryCache::GeometryPtr
+SphereGeometryCache::Acquire(uint grid_nx, uint grid_ny)
+{
+  ++use_counter_;
+  auto key = make_pair(grid_nx, grid_ny);
+  auto iter = entries_.find(key);
+  if (iter != entries_.end()) {
+    iter->second.last_used = use_counter_;
+    ++stats_.hits;
+    return iter->second.geometry;
   }
-  vertex_count_ = positions.size();
-  face_indices_count_ = face_indices.size();
-
-  // create VBO for positions and normals
-  glGenBuffers(1, &positions_normals_vbo_);
-  glBindBuffer(GL_ARRAY_BUFFER, positions_normals_vbo_);
-  glBufferData(GL_ARRAY_BUFFER, positions_normals.size() * sizeof(GLfloat),
-               &positions_normals[0], GL_STATIC_DRAW);
-
-  // create elements array
-  vector<GLuint> faces;
-  faces.reserve(face_indices.size());
-  for (auto index : face_indices)
-    faces.push_back(static_cast<GLuint>(index));
-
-  // create EBO for faces
-  glGenBuffers(1, &faces_ebo_);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_ebo_);
-  glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(GLuint),
-               &faces[0], GL_STATIC_DRAW);
 
-  gl_buffers_dirty_ = false;
+  ++stats_.misses;
+  size_t vertex_count, index_count;
+  GetWatertightSphereSize(grid_nx, grid_ny, vertex_count, index_count);
+  Evict((6 * vertex_count) * sizeof(GLfloat) + index_count * sizeof(GLuint));
+  auto geometry = Upload(grid_nx, grid_ny);
+  if (!geometry)
+    return nullptr;
+  gpu_bytes_ += geometry->gpu_bytes;
+  auto &entry = entries_[key];
+  entry.geometry = geometry;
+  entry.last_used = use_counter_;
+  return geometry;
+}
+
+
+void
+SphereGeometryCache::SetBudget(size_t gpu_bytes)
+{
+  budget_ = gpu_bytes;
+  Evict(0);
+}
+
+
+MemoryStats
+SphereGeometryCache::GetMemoryStats() const
+{
+  MemoryStats stats;
+  stats.gpu_bytes = gpu_bytes_;
+  return stats;
+}
+
+
+void
+SphereGeometryCache::Clear()
+{
+  for (auto iter = entries_.begin(); iter != entries_.end();) {
+    if (iter->second.geometry.use_count() > 1) {
+      ++iter;
+      continue;
+    }
+    gpu_bytes_ -= std::min(gpu_bytes_, iter->second.geometry->gpu_bytes);
+    iter = entries_.erase(iter);
+  }
+}
+
+
+SphereGeometryCache::GeometryPtr
+SphereGeometryCache::Upload(uint grid_nx, uint grid_ny)
+{
+  size_t vertex_count, index_count;
+  GetWatertightSphereSize(grid_nx, grid_ny, vertex_count, index_count);
+  if (vertex_count > std::numeric_limits<GLuint>::max()) {
+    spdlog::error("Sphere: {}x{} grid has too many vertices", grid_nx, grid_ny);
+    return nullptr;
+  }
+
+  // allocate the buffer's storage and map it for writing
+  auto CreateMappedBuffer = [](GLenum target, size_t size, GLuint &buffer) {
+    glGenBuffers(1, &buffer);
+    GLState::Get().BindBuffer(target, buffer);
+    glBufferData(target, static_cast<GLsizeiptr>(size), nullptr, GL_STATIC_DRAW);
+    return glMapBufferRange(target, 0, static_cast<GLsizeiptr>(size),
+                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  };
+  auto UnmapBuffer = [](GLenum target, void *data) {
+    if (data && glUnmapBuffer(target) == GL_TRUE)
+      return true;
+    spdlog::error("Sphere: failed to map gl buffer");
+    return false;
+  };
+
+  // tessellate a unit sphere straight into the mapped VBO (positions
+  // and normals) and EBO (faces). nothing is staged on the cpu
+  auto geometry = make_shared<Geometry>();
+  auto vertices_size = 6 * vertex_count * sizeof(GLfloat);
+  auto vertices = CreateMappedBuffer(GL_ARRAY_BUFFER, vertices_size, geometry->vbo);
+  if (vertices)
+    BuildWatertightSphereVertices(Vec3r{0, 0, 0}, 1, grid_nx, grid_ny,
+                                  static_cast<GLfloat*>(vertices));
+  if (!UnmapBuffer(GL_ARRAY_BUFFER, vertices))
+    return nullptr;
+  auto faces_size = index_count * sizeof(GLuint);
+  auto faces = CreateMappedBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_size, geometry->ebo);
+  if (faces)
+    BuildWatertightSphereIndices(grid_nx, grid_ny, static_cast<GLuint*>(faces));
+  if (!UnmapBuffer(GL_ELEMENT_ARRAY_BUFFER, faces))
+    return nullptr;
+
+  geometry->vertex_count = vertex_count;
+  geometry->index_count = index_count;
+  geometry->gpu_bytes = vertices_size + faces_size;
+  return geometry;
+}
+
+
+void
+SphereGeometryCache::Evict(size_t required_bytes)
+{
+  if (gpu_bytes_ + required_bytes <= budget_)
+    return;
+
+  // least recently used first. geometry a sphere is drawing with is
+  // never evicted
+  vector<std::map<pair<uint, uint>, Entry>::iterator> candidates;
+  for (auto iter = entries_.begin(); iter != entries_.end(); ++iter)
+    if (iter->second.geometry.use_count() == 1)
+      candidates.push_back(iter);
+  sort(candidates.begin(), candidates.end(), [](decltype(candidates)::value_type a,
+                                                decltype(candidates)::value_type b) {
+      return a->second.last_used < b->second.last_used;
+    });
+  for (auto iter : candidates) {
+    if (gpu_bytes_ + required_bytes <= budget_)
+      break;
+    gpu_bytes_ -= std::min(gpu_bytes_, iter->second.geometry->gpu_bytes);
+    entries_.erase(iter);
+    ++stats_.evictions;
+  }
 }
 
 
@@ -218,26 +363,31 @@ Sphere::DrawGL(const GLDrawData &draw_data)
   auto material = draw_data.GetMaterial();
   if (!material)
     return;
-  auto shader = material->GetGLShader();
+  auto shader = draw_data.GetGLShader();
+  if (!shader)
+    shader = material->GetGLShader();
   if (!shader || !shader->Use())
     return;
 
-  if (gl_buffers_dirty_ || !positions_normals_vbo_)
+  if (gl_buffers_dirty_ || !geometry_)
     UpdateGLBuffers(false);
-
-  if (!vertex_count_ || !face_indices_count_ ||
-      !positions_normals_vbo_ || !faces_ebo_)
+  if (!geometry_)
     return;
 
   // enable depth test
-  glEnable(GL_DEPTH_TEST);
-  glDepthFunc(GL_LEQUAL);
+  GLState::Get().SetEnabled(GL_DEPTH_TEST, true);
+  GLState::Get().DepthFunc(GL_LEQUAL);
 
-  // set up uniforms: MVP matrices, lights, material
-  shader->SetupUniforms(draw_data);
+  // set up uniforms: MVP matrices, lights, material. the unit sphere
+  // is placed by the model matrix
+  GLDrawData sphere_draw_data = draw_data;
+  glm::mat4 unit_sphere_xform{static_cast<float>(radius_)};
+  unit_sphere_xform[3] = glm::vec4(EigenToGLM(center_), 1);
+  sphere_draw_data.SetModelMatrix(draw_data.GetModelMatrix() * unit_sphere_xform);
+  shader->SetupUniforms(sphere_draw_data);
 
   // enable positions attribute and set pointer
-  glBindBuffer(GL_ARRAY_BUFFER, positions_normals_vbo_);
+  GLState::Get().BindBuffer(GL_ARRAY_BUFFER, geometry_->vbo);
   auto positions_attr_index = glGetAttribLocation(shader->GetProgramID(), "position");
   glVertexAttribPointer(positions_attr_index, 3, GL_FLOAT, GL_FALSE,
                         6 * sizeof(GLfloat), (void*)(0));
@@ -250,9 +400,9 @@ Sphere::DrawGL(const GLDrawData &draw_data)
   glEnableVertexAttribArray(normals_attr_index);
 
   // draw mesh
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_ebo_);
+  GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry_->ebo);
   // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
-  glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(face_indices_count_),
+  glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(geometry_->index_count),
                  GL_UNSIGNED_INT, nullptr);
 
   // check for gl errors
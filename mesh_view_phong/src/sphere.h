@@ -11,16 +11,109 @@
 
 #pragma once
 
+#include <map>
 #include <string>
 #include <memory>
+#include <utility>
 #include "types.h"
 #include "utils/utils.h"
 #include "utils/material.h"
+#include "utils/memory_stats.h"
 
 namespace olio {
 
 class GLDrawData;
 
+// watertight (seamless) sphere: grid_ny - 1 rings of grid_nx
+// vertices, then the bottom and top poles. vertices are interleaved
+// positions/normals (6 floats each)
+
+//! \brief Vertex and index counts of a watertight sphere
+//! \param[in] grid_nx number of subdivisions along phi
+//! \param[in] grid_ny number of subdivisions along theta
+//! \param[out] vertex_count number of vertices
+//! \param[out] index_count number of triangle indices
+void GetWatertightSphereSize(uint grid_nx, uint grid_ny, size_t &vertex_count,
+                             size_t &index_count);
+
+//! \brief Write a watertight sphere's vertices (rings in parallel)
+//! \param[out] vertices 6 * vertex_count floats
+void BuildWatertightSphereVertices(const Vec3r &center, Real radius, uint grid_nx,
+                                   uint grid_ny, GLfloat *vertices);
+
+//! \brief Write a watertight sphere's triangle indices
+//! \param[out] indices index_count indices
+void BuildWatertightSphereIndices(uint grid_nx, uint grid_ny, GLuint *indices);
+
+
+//! \class SphereGeometryCache
+//! \brief GPU geometry of unit spheres (centered at the origin), keyed
+//!        by grid size and shared by all Sphere instances. When the
+//!        cached geometry exceeds the gpu budget, the least recently
+//!        used entries that no sphere is drawing with are deleted. Must
+//!        be cleared while the gl context is still current.
+class SphereGeometryCache {
+public:
+  //! \brief VBO (interleaved positions/normals) and EBO of one grid size
+  struct Geometry {
+    GLuint vbo{0};
+    GLuint ebo{0};
+    size_t vertex_count{0};
+    size_t index_count{0};
+    size_t gpu_bytes{0};
+    ~Geometry();
+  };
+  using GeometryPtr = std::shared_ptr<const Geometry>;
+
+  //! \brief Lookup counts
+  struct Stats {
+    size_t hits{0};
+    size_t misses{0};           //!< geometry generated and uploaded
+    size_t evictions{0};
+  };
+
+  //! \brief Cache shared by all spheres
+  static SphereGeometryCache& Get();
+
+  //! \brief Get the geometry for a grid size, generating and uploading
+  //!        it on a miss
+  //! \param[in] grid_nx number of subdivisions along phi
+  //! \param[in] grid_ny number of subdivisions along theta
+  //! \return geometry (nullptr on failure)
+  GeometryPtr Acquire(uint grid_nx, uint grid_ny);
+
+  //! \brief Set the gpu budget (in bytes) of the cached geometry
+  void SetBudget(size_t gpu_bytes);
+  size_t GetBudget() const {return budget_;}
+
+  size_t GetEntryCount() const {return entries_.size();}
+  Stats GetStats() const {return stats_;}
+
+  //! \brief GPU memory held by all cached geometry
+  MemoryStats GetMemoryStats() const;
+
+  //! \brief Delete all geometry that no sphere is drawing with
+  void Clear();
+protected:
+  SphereGeometryCache() = default;
+  GeometryPtr Upload(uint grid_nx, uint grid_ny);
+  void Evict(size_t required_bytes);
+
+  struct Entry {
+    GeometryPtr geometry;
+    uint64_t last_used{0};      //!< Acquire in which it was last requested
+  };
+  std::map<std::pair<uint, uint>, Entry> entries_;
+  size_t budget_{64 << 20};
+  size_t gpu_bytes_{0};
+  uint64_t use_counter_{0};
+  Stats stats_;
+};
+
+
+//! \class Sphere
+//! \brief Sphere drawn with the cached unit sphere geometry of its
+//!        grid size, scaled and translated in the vertex shader
 class Sphere {
 public:
   EIGEN_MAKE_ALIGNED_OPERATOR_NEW
@@ -44,6 +137,11 @@ public:
     grid_ny = grid_ny_;
   }
 
+  //! \brief GPU memory of the geometry the sphere draws with (shared
+  //!        with other spheres of the same grid size, and also counted
+  //!        by SphereGeometryCache)
+  MemoryStats GetMemoryStats() const;
+
   // opengl
   void DeleteGLBuffers();
   void UpdateGLBuffers(bool force_update=false);
@@ -53,13 +151,10 @@ protected:
   Real radius_ = 1.0f;
   uint grid_nx_ = 10;
   uint grid_ny_ = 10;
-  size_t vertex_count_ = 0;
-  size_t face_indices_count_ = 0;
 
   // opengl
   bool gl_buffers_dirty_ = false;
-  GLuint positions_normals_vbo_{0};
-  GLuint faces_ebo_{0};
+  SphereGeometryCache::GeometryPtr geometry_;
 };
 
 }  // namespace olio
@@ -0,0 +1,369 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       transform_kernels.cc
+//! \brief      Batched SIMD transforms of points, vectors and normals
+//!             stored as structure of arrays
+//! \author     Hadi Fadaifard, 2022
+
+#include "transform_kernels.h"
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
+#if defined(__AVX__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace olio {
+
+using namespace std;
+
+// inputs smaller than this are transformed on the calling thread
+constexpr size_t kParallelThreshold = 65536;
+constexpr size_t kGrainSize = 16384;
+
+// ======================================================================
+// vector operations: one lane (ScalarOps) and the widest lanes the
+// compiler targets (SimdOps). the kernels are written once against
+// these and run with SimdOps, then ScalarOps for the remainder
+
+template <typename T>
+struct ScalarOps {
+  using V = T;
+  static constexpr size_t kWidth = 1;
+  static V Set(T a) {return a;}
+  static V Load(const T *p) {return *p;}
+  static void Store(T *p, V v) {*p = v;}
+  static V Add(V a, V b) {return a + b;}
+  static V Mul(V a, V b) {return a * b;}
+  static V Div(V a, V b) {return a / b;}
+  static V Max(V a, V b) {return std::max(a, b);}
+  static V Sqrt(V a) {return std::sqrt(a);}
+};
+
+#if defined(__AVX__)
+static const char *kISAName = "avx";
+
+struct AVXFloatOps {
+  using V = __m256;
+  static constexpr size_t kWidth = 8;
+  static V Set(float a) {return _mm256_set1_ps(a);}
+  static V Load(const float *p) {return _mm256_loadu_ps(p);}
+  static void Store(float *p, V v) {_mm256_storeu_ps(p, v);}
+  static V Add(V a, V b) {return _mm256_add_ps(a, b);}
+  static V Mul(V a, V b) {return _mm256_mul_ps(a, b);}
+  static V Div(V a, V b) {return _mm256_div_ps(a, b);}
+  static V Max(V a, V b) {return _mm256_max_ps(a, b);}
+  static V Sqrt(V a) {return _mm256_sqrt_ps(a);}
+};
+
+struct AVXDoubleOps {
+  using V = __m256d;
+  static constexpr size_t kWidth = 4;
+  static V Set(double a) {return _mm256_set1_pd(a);}
+  static V Load(const double *p) {return _mm256_loadu_pd(p);}
+  static void Store(double *p, V v) {_mm256_storeu_pd(p, v);}
+  static V Add(V a, V b) {return _mm256_add_pd(a, b);}
+  static V Mul(V a, V b) {return _mm256_mul_pd(a, b);}
+  static V Div(V a, V b) {return _mm256_div_pd(a, b);}
+  static V Max(V a, V b) {return _mm256_max_pd(a, b);}
+  static V Sqrt(V a) {return _mm256_sqrt_pd(a);}
+};
+
+template <typename T> struct SimdOps;
+template <> struct SimdOps<float> : AVXFloatOps {};
+template <> struct SimdOps<double> : AVXDoubleOps {};
+#elif defined(__SSE2__)
+static const char *kISAName = "sse2";
+
+struct SSEFloatOps {
+  using V = __m128;
+  static constexpr size_t kWidth = 4;
+  static V Set(float a) {return _mm_set1_ps(a);}
+  static V Load(const float *p) {return _mm_loadu_ps(p);}
+  static void Store(float *p, V v) {_mm_storeu_ps(p, v);}
+  static V Add(V a, V b) {return _mm_add_ps(a, b);}
+  static V Mul(V a, V b) {return _mm_mul_ps(a, b);}
+  static V Div(V a, V b) {return _mm_div_ps(a, b);}
+  static V Max(V a, V b) {return _mm_max_ps(a, b);}
+  static V Sqrt(V a) {return _mm_sqrt_ps(a);}
+};
+
+struct SSEDoubleOps {
+  using V = __m128d;
+  static constexpr size_t kWidth = 2;
+  static V Set(double a) {return _mm_set1_pd(a);}
+  static V Load(const double *p) {return _mm_loadu_pd(p);}
+  static void Store(double *p, V v) {_mm_storeu_pd(p, v);}
+  static V Add(V a, V b) {return _mm_add_pd(a, b);}
+  static V Mul(V a, V b) {return _mm_mul_pd(a, b);}
+  static V Div(V a, V b) {return _mm_div_pd(a, b);}
+  static V Max(V a, V b) {return _mm_max_pd(a, b);}
+  static V Sqrt(V a) {return _mm_sqrt_pd(a);}
+};
+
+template <typename T> struct SimdOps;
+template <> struct SimdOps<float> : SSEFloatOps {};
+template <> struct SimdOps<double> : SSEDoubleOps {};
+#else
+static const char *kISAName = "scalar";
+
+template <typename T> struct SimdOps : ScalarOps<T> {};
+#endif
+
+
+//! \brief a * x + b * y + c * z
+template <typename Ops>
+inline typename Ops::V
+Dot3(typename Ops::V a, typename Ops::V b, typename Ops::V c,
+     typename Ops::V x, typename Ops::V y, typename Ops::V z)
+{
+  return Ops::Add(Ops::Add(Ops::Mul(a, x), Ops::Mul(b, y)), Ops::Mul(c, z));
+}
+
+
+//! \brief Transform points [begin, end) in steps of Ops::kWidth
+//! \param[in] m row-major 4x4 matrix
+//! \return end of the points transformed (the rest don't fill a step)
+template <typename Ops, typename T>
+size_t
+TransformPointsRange(const T *m, bool projective, const T *x, const T *y, const T *z,
+                     T *out_x, T *out_y, T *out_z, size_t begin, size_t end)
+{
+  using V = typename Ops::V;
+  V m00 = Ops::Set(m[0]), m01 = Ops::Set(m[1]), m02 = Ops::Set(m[2]), m03 = Ops::Set(m[3]);
+  V m10 = Ops::Set(m[4]), m11 = Ops::Set(m[5]), m12 = Ops::Set(m[6]), m13 = Ops::Set(m[7]);
+  V m20 = Ops::Set(m[8]), m21 = Ops::Set(m[9]), m22 = Ops::Set(m[10]), m23 = Ops::Set(m[11]);
+  V m30 = Ops::Set(m[12]), m31 = Ops::Set(m[13]), m32 = Ops::Set(m[14]), m33 = Ops::Set(m[15]);
+  size_t i = begin;
+  for (; i + Ops::kWidth <= end; i += Ops::kWidth) {
+    V px = Ops::Load(x + i), py = Ops::Load(y + i), pz = Ops::Load(z + i);
+    V rx = Ops::Add(Dot3<Ops>(m00, m01, m02, px, py, pz), m03);
+    V ry = Ops::Add(Dot3<Ops>(m10, m11, m12, px, py, pz), m13);
+    V rz = Ops::Add(Dot3<Ops>(m20, m21, m22, px, py, pz), m23);
+    if (projective) {
+      V w = Ops::Add(Dot3<Ops>(m30, m31, m32, px, py, pz), m33);
+      rx = Ops::Div(rx, w);
+      ry = Ops::Div(ry, w);
+      rz = Ops::Div(rz, w);
+    }
+    Ops::Store(out_x + i, rx);
+    Ops::Store(out_y + i, ry);
+    Ops::Store(out_z + i, rz);
+  }
+  return i;
+}
+
+
+//! \brief Multiply vectors [begin, end) by a 3x3 matrix (optionally
+//!        normalizing the results) in steps of Ops::kWidth
+//! \param[in] m row-major 3x3 matrix
+//! \return end of the vectors transformed
+template <typename Ops, typename T>
+size_t
+TransformLinearRange(const T *m, bool normalize, const T *x, const T *y, const T *z,
+                     T *out_x, T *out_y, T *out_z, size_t begin, size_t end)
+{
+  using V = typename Ops::V;
+  V m00 = Ops::Set(m[0]), m01 = Ops::Set(m[1]), m02 = Ops::Set(m[2]);
+  V m10 = Ops::Set(m[3]), m11 = Ops::Set(m[4]), m12 = Ops::Set(m[5]);
+  V m20 = Ops::Set(m[6]), m21 = Ops::Set(m[7]), m22 = Ops::Set(m[8]);
+  // zero vectors times a large finite scale stay zero (no branches)
+  V one = Ops::Set(1), min_length2 = Ops::Set(std::numeric_limits<T>::min());
+  size_t i = begin;
+  for (; i + Ops::kWidth <= end; i += Ops::kWidth) {
+    V vx = Ops::Load(x + i), vy = Ops::Load(y + i), vz = Ops::Load(z + i);
+    V rx = Dot3<Ops>(m00, m01, m02, vx, vy, vz);
+    V ry = Dot3<Ops>(m10, m11, m12, vx, vy, vz);
+    V rz = Dot3<Ops>(m20, m21, m22, vx, vy, vz);
+    if (normalize) {
+      V length2 = Dot3<Ops>(rx, ry, rz, rx, ry, rz);
+      V scale = Ops::Div(one, Ops::Sqrt(Ops::Max(length2, min_length2)));
+      rx = Ops::Mul(rx, scale);
+      ry = Ops::Mul(ry, scale);
+      rz = Ops::Mul(rz, scale);
+    }
+    Ops::Store(out_x + i, rx);
+    Ops::Store(out_y + i, ry);
+    Ops::Store(out_z + i, rz);
+  }
+  return i;
+}
+
+
+//! \brief Call func(begin, end) over [0, count), split across threads
+//!        for large counts
+template <typename Func>
+void
+ForEachRange(size_t count, const Func &func)
+{
+  if (count < kParallelThreshold) {
+    func(size_t{0}, count);
+    return;
+  }
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, count, kGrainSize),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    func(range.begin(), range.end());
+  });
+}
+
+
+template <typename T>
+void
+ToSoAT(const Vec3r *points, size_t count, SoAPoints<T> &soa)
+{
+  soa.resize(count);
+  for (size_t i = 0; i < count; ++i) {
+    soa.x[i] = static_cast<T>(points[i][0]);
+    soa.y[i] = static_cast<T>(points[i][1]);
+    soa.z[i] = static_cast<T>(points[i][2]);
+  }
+}
+
+
+template <typename T>
+void
+FromSoAT(const SoAPoints<T> &soa, Vec3r *points)
+{
+  for (size_t i = 0; i < soa.size(); ++i)
+    points[i] = Vec3r{static_cast<Real>(soa.x[i]), static_cast<Real>(soa.y[i]),
+                      static_cast<Real>(soa.z[i])};
+}
+
+
+template <typename T>
+void
+TransformPointsT(const Mat4r &xform, const SoAPoints<T> &input, SoAPoints<T> &output)
+{
+  T m[16];
+  for (int row = 0; row < 4; ++row)
+    for (int col = 0; col < 4; ++col)
+      m[4 * row + col] = static_cast<T>(xform(row, col));
+  bool projective = xform(3, 0) != 0 || xform(3, 1) != 0 || xform(3, 2) != 0 ||
+    xform(3, 3) != 1;
+
+  auto count = input.size();
+  output.resize(count);
+  const T *x = input.x.data(), *y = input.y.data(), *z = input.z.data();
+  T *out_x = output.x.data(), *out_y = output.y.data(), *out_z = output.z.data();
+  ForEachRange(count, [&](size_t begin, size_t end) {
+    auto rest = TransformPointsRange<SimdOps<T>>(m, projective, x, y, z,
+                                                 out_x, out_y, out_z, begin, end);
+    TransformPointsRange<ScalarOps<T>>(m, projective, x, y, z,
+                                       out_x, out_y, out_z, rest, end);
+  });
+}
+
+
+template <typename T>
+void
+TransformLinearT(const Mat3r &matrix, bool normalize, const SoAPoints<T> &input,
+                 SoAPoints<T> &output)
+{
+  T m[9];
+  for (int row = 0; row < 3; ++row)
+    for (int col = 0; col < 3; ++col)
+      m[3 * row + col] = static_cast<T>(matrix(row, col));
+
+  auto count = input.size();
+  output.resize(count);
+  const T *x = input.x.data(), *y = input.y.data(), *z = input.z.data();
+  T *out_x = output.x.data(), *out_y = output.y.data(), *out_z = output.z.data();
+  ForEachRange(count, [&](size_t begin, size_t end) {
+    auto rest = TransformLinearRange<SimdOps<T>>(m, normalize, x, y, z,
+                                                 out_x, out_y, out_z, begin, end);
+    TransformLinearRange<ScalarOps<T>>(m, normalize, x, y, z,
+                                       out_x, out_y, out_z, rest, end);
+  });
+}
+
+
+// ======================================================================
+// public interface
+void
+ToSoA(const Vec3r *points, size_t count, SoAPointsf &soa)
+{
+  ToSoAT(points, count, soa);
+}
+
+
+void
+ToSoA(const Vec3r *points, size_t count, SoAPointsd &soa)
+{
+  ToSoAT(points, count, soa);
+}
+
+
+void
+FromSoA(const SoAPointsf &soa, Vec3r *points)
+{
+  FromSoAT(soa, points);
+}
+
+
+void
+FromSoA(const SoAPointsd &soa, Vec3r *points)
+{
+  FromSoAT(soa, points);
+}
+
+
+void
+TransformPoints(const Mat4r &xform, const SoAPointsf &input, SoAPointsf &output)
+{
+  TransformPointsT(xform, input, output);
+}
+
+
+void
+TransformPoints(const Mat4r &xform, const SoAPointsd &input, SoAPointsd &output)
+{
+  TransformPointsT(xform, input, output);
+}
+
+
+void
+TransformVectors(const Mat4r &xform, const SoAPointsf &input, SoAPointsf &output)
+{
+  TransformLinearT(Mat3r(xform.topLeftCorner<3, 3>()), false, input, output);
+}
+
+
+void
+TransformVectors(const Mat4r &xform, const SoAPointsd &input, SoAPointsd &output)
+{
+  TransformLinearT(Mat3r(xform.topLeftCorner<3, 3>()), false, input, output);
+}
+
+
+void
+TransformNormals(const Mat4r &xform, const SoAPointsf &input, SoAPointsf &output)
+{
+  Mat3r normal_matrix = xform.topLeftCorner<3, 3>().inverse().transpose();
+  TransformLinearT(normal_matrix, true, input, output);
+}
+
+
+void
+TransformNormals(const Mat4r &xform, const SoAPointsd &input, SoAPointsd &output)
+{
+  Mat3r normal_matrix = xform.topLeftCorner<3, 3>().inverse().transpose();
+  TransformLinearT(normal_matrix, true, input, output);
+}
+
+
+const char*
+GetTransformKernelsISA()
+{
+  return kISAName;
+}
+
+}  // namespace olio
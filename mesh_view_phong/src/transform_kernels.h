@@ -0,0 +1,76 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       transform_kernels.h
+//! \brief      Batched SIMD transforms of points, vectors and normals
+//!             stored as structure of arrays
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <vector>
+#include "types.h"
+
+namespace olio {
+
+//! \struct SoAPoints
+//! \brief 3D points (or vectors) as structure of arrays: element i is
+//!        (x[i], y[i], z[i])
+template <typename T>
+struct SoAPoints {
+  std::vector<T> x;
+  std::vector<T> y;
+  std::vector<T> z;
+
+  size_t size() const {return x.size();}
+  void resize(size_t count) {x.resize(count); y.resize(count); z.resize(count);}
+};
+using SoAPointsf = SoAPoints<float>;
+using SoAPointsd = SoAPoints<double>;
+
+//! \brief Copy points into a structure of arrays
+//! \param[in] points input points
+//! \param[in] count number of points
+//! \param[out] soa output (resized to count)
+void ToSoA(const Vec3r *points, size_t count, SoAPointsf &soa);
+void ToSoA(const Vec3r *points, size_t count, SoAPointsd &soa);
+
+//! \brief Copy points out of a structure of arrays
+//! \param[in] soa input
+//! \param[out] points soa.size() output points
+void FromSoA(const SoAPointsf &soa, Vec3r *points);
+void FromSoA(const SoAPointsd &soa, Vec3r *points);
+
+//! \brief Transform points (see XformPoint), dividing by w only if the
+//!        transform is projective. Large inputs are split across
+//!        threads.
+//! \param[in] xform transformation matrix
+//! \param[in] input input points
+//! \param[out] output transformed points (resized; may be input)
+void TransformPoints(const Mat4r &xform, const SoAPointsf &input, SoAPointsf &output);
+void TransformPoints(const Mat4r &xform, const SoAPointsd &input, SoAPointsd &output);
+
+//! \brief Transform vectors by the upper 3x3 of xform (see XformVector)
+//! \param[in] xform transformation matrix
+//! \param[in] input input vectors
+//! \param[out] output transformed vectors (resized; may be input)
+void TransformVectors(const Mat4r &xform, const SoAPointsf &input, SoAPointsf &output);
+void TransformVectors(const Mat4r &xform, const SoAPointsd &input, SoAPointsd &output);
+
+//! \brief Transform normals by the inverse transpose of the upper 3x3
+//!        of xform, and normalize them (zero normals stay zero)
+//! \param[in] xform transformation matrix (of the points)
+//! \param[in] input input normals
+//! \param[out] output transformed unit normals (resized; may be input)
+void TransformNormals(const Mat4r &xform, const SoAPointsf &input, SoAPointsf &output);
+void TransformNormals(const Mat4r &xform, const SoAPointsd &input, SoAPointsd &output);
+
+//! \brief Instruction set the kernels were compiled for ("avx",
+//!        "sse2" or "scalar")
+const char* GetTransformKernelsISA();
+
+}  // namespace olio
@@ -1,9 +1,16 @@
 #include "trimesh.h"
 #include <vector>
 #include <algorithm>
+#include <limits>
+#include <chrono>
+#include <mutex>
 #include <spdlog/spdlog.h>
+#include <tbb/parallel_for.h>
+#include <tbb/blocked_range.h>
 #include "utils/gldrawdata.h"
+#include "utils/glrenderqueue.h"
 #include "utils/glshader.h"
+#include "utils/glstate.h"
 
 
 
@@ -27,20 +34,133 @@ TriMesh::TriMesh(const std::string &name) :
 
 
 // fill in vec3r bmin and bmax with the bottom left close corner 
-// and top right far corner coordinates
+// and top right far corner coordinates. bounds are cached, so they
+// stay available after the topology is released
 void
 TriMesh::GetBoundingBox(Vec3r &bmin, Vec3r &bmax)
 {
+  if (!bounds_valid_)
+    UpdateBounds();
+  bmin = bmin_;
+  bmax = bmax_;
+}
+
+
+void
+TriMesh::UpdateBounds()
+{
+  bmin_ = Vec3r{0, 0, 0};
+  bmax_ = Vec3r{0, 0, 0};
+  if (!n_vertices())
+    return;
+  bmin_ = Vec3r::Constant(std::numeric_limits<Real>::max());
+  bmax_ = Vec3r::Constant(std::numeric_limits<Real>::lowest());
     // iterate over every vertex
     for (auto vit =  vertices_begin(); vit != vertices_end(); ++vit){
-      Vec3r point = this->point(*vit);
-      bmin[0] = std::min(bmin[0], point[0]);
-      bmin[1] = std::min(bmin[1], point[1]);
-      bmin[2] = std::min(bmin[2], point[2]);
-      bmax[0] = std::max(bmax[0], point[0]);
-      bmax[1] = std::max(bmax[1], point[1]);
-      bmax[2] = std::max(bmax[2], point[2]);
+      const Vec3r &point = this->point(*vit);
+      bmin_ = bmin_.cwiseMin(point);
+      bmax_ = bmax_.cwiseMax(point);
     }
+  bounds_valid_ = true;
+}
+
+
+bool
+TriMesh::RequireTopology()
+{
+  if (retention_ != Retention::kFull) {
+    spdlog::info("{}: switching to full retention for editing", name_);
+    retention_ = Retention::kFull;
+  }
+  return RebuildTopology();
+}
+
+
+bool
+TriMesh::RebuildTopology()
+{
+  if (!topology_released_)
+    return true;
+  if (filepath_.empty()) {
+    spdlog::error("{}: cannot rebuild released topology without a file path",
+                  name_);
+    return false;
+  }
+  spdlog::info("{}: rebuilding topology", name_);
+  return Load(filepath_);
+}
+
+
+void
+TriMesh::ReleaseTopology(vector<GLfloat> &vertices, vector<GLuint> &indices)
+{
+  if (topology_released_ || retention_ == Retention::kFull)
+    return;
+  if (!bounds_valid_)
+    UpdateBounds();
+  auto bytes_before = GetResidentBytes();
+
+  // drop properties and then all elements
+  if (has_vertex_texcoords2D())
+    release_vertex_texcoords2D();
+  if (has_vertex_normals())
+    release_vertex_normals();
+  if (has_face_normals())
+    release_face_normals();
+  if (has_halfedge_normals())
+    release_halfedge_normals();
+  clear();
+
+  // keep the packed arrays so buffers can be re-created without
+  // rebuilding the topology
+  if (retention_ == Retention::kCompact) {
+    compact_vertices_.swap(vertices);
+    compact_vertices_.shrink_to_fit();
+    compact_indices_.swap(indices);
+    compact_indices_.shrink_to_fit();
+  }
+  topology_released_ = true;
+
+  spdlog::info("{}: released topology, resident memory {:.2f} KB -> {:.2f} KB",
+               name_, static_cast<double>(bytes_before) / 1024.0,
+               static_cast<double>(GetResidentBytes()) / 1024.0);
+}
+
+
+MemoryStats
+TriMesh::GetMemoryStats() const
+{
+  MemoryStats stats;
+
+  // connectivity
+  stats.connectivity_bytes = n_vertices() * sizeof(Vertex) +
+    n_halfedges() * sizeof(Halfedge) + n_edges() * sizeof(Edge) +
+    n_faces() * sizeof(Face);
+
+  // properties (points, normals, texcoords, status, ...)
+  auto AddProperties = [&stats](const_prop_iterator begin, const_prop_iterator end) {
+    for (auto it = begin; it != end; ++it)
+      if (*it)
+        stats.property_bytes += (*it)->size_of();
+  };
+  AddProperties(vprops_begin(), vprops_end());
+  AddProperties(hprops_begin(), hprops_end());
+  AddProperties(eprops_begin(), eprops_end());
+  AddProperties(fprops_begin(), fprops_end());
+
+  // ray queries
+  if (bvh_)
+    stats.bvh_bytes = bvh_->GetMemoryBytes();
+
+  // compact arrays
+  stats.staging_bytes = compact_vertices_.capacity() * sizeof(GLfloat) +
+    compact_indices_.capacity() * sizeof(GLuint) +
+    ambient_occlusion_.capacity() * sizeof(float);
+
+  // gl buffers
+  stats.gpu_bytes = gpu_bytes_;
+  stats.upload_bytes = upload_bytes_;
+  return stats;
 }
 
 
@@ -53,19 +173,34 @@ TriMesh::~TriMesh()
 void
 TriMesh::DeleteGLBuffers()
 {
-  // delete vbos
-  glBindBuffer(GL_ARRAY_BUFFER, 0);
+  // nothing to delete (also keeps meshes that were never uploaded
+  // usable without a gl context)
+  if (!positions_normals_vbo_ && !positions_vbo_ && !ambient_occlusion_vbo_ &&
+      !faces_ebo_) {
+    gpu_bytes_ = 0;
+    return;
+  }
+
+  // delete vbos (which also unbinds them)
   if (positions_normals_vbo_) {
-    glDeleteBuffers(1, &positions_normals_vbo_);
+    GLState::Get().DeleteBuffers(1, &positions_normals_vbo_);
     positions_normals_vbo_ = 0;
   }
+  if (positions_vbo_) {
+    GLState::Get().DeleteBuffers(1, &positions_vbo_);
+    positions_vbo_ = 0;
+  }
+  if (ambient_occlusion_vbo_) {
+    GLState::Get().DeleteBuffers(1, &ambient_occlusion_vbo_);
+    ambient_occlusion_vbo_ = 0;
+  }
 
   // delete ebos
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
   if (faces_ebo_) {
-    glDeleteBuffers(1, &faces_ebo_);
+    GLState::Get().DeleteBuffers(1, &faces_ebo_);
     faces_ebo_ = 0;
   }
+  gpu_bytes_ = 0;
 }
 
 bool 
@@ -75,9 +210,21 @@ TriMesh::Load(const fs::path &filepath)
     OpenMesh::IO::Options::VertexNormal |
     OpenMesh::IO::Options::FaceNormal;
 
-  // save name
+  // save name (a different file invalidates the bvh and baked
+  // ambient occlusion)
+  if (filepath != filepath_) {
+    bvh_.reset();
+    ambient_occlusion_.clear();
+  }
   filepath_ = filepath;
 
+  // loaded topology supersedes any compact arrays
+  compact_vertices_.clear();
+  compact_vertices_.shrink_to_fit();
+  compact_indices_.clear();
+  compact_indices_.shrink_to_fit();
+  topology_released_ = false;
+
   // request vertex texture coordinates
   request_vertex_texcoords2D();
   if (!has_vertex_texcoords2D()) {
@@ -97,10 +244,17 @@ TriMesh::Load(const fs::path &filepath)
     return false;
   }
 
-  // read in mesh
+  // read in mesh. OpenMesh's readers are shared and keep per-file
+  // state, so meshes loading on other threads wait for their turn
   auto filename = filepath_.string();
   spdlog::info ("loading {}...", filename);
-  if (!OpenMesh::IO::read_mesh(*this, filename, opts)) {
+  bool read = false;
+  {
+    static std::mutex read_mutex;
+    std::lock_guard<std::mutex> lock(read_mutex);
+    read = OpenMesh::IO::read_mesh(*this, filename, opts);
+  }
+  if (!read) {
     spdlog::error("could not load mesh from {}", filename);
     return false;
   }
@@ -116,54 +270,268 @@ TriMesh::Load(const fs::path &filepath)
   // check if the mesh file contained vertex (or face normals) normals
   // if not, compute normals
   if(!opts.check(OpenMesh::IO::Options::FaceNormal))
-    update_face_normals();
+    UpdateFaceNormals();
   if(!opts.check(OpenMesh::IO::Options::VertexNormal))
-    update_vertex_normals();
+    UpdateVertexNormals(NormalWeighting::kUniform);
   if (has_halfedge_normals())
     update_halfedge_normals();
 
-  // dirty bound
-  // bound_dirty_ = true;
+  // dirty bound and gl buffers
+  bounds_valid_ = false;
+  gl_buffers_dirty_ = true;
   return true;
 
 }
 
 bool TriMesh::ComputeFaceNormals()
 {
-  auto FaceNormal = [&](TriMesh::FaceHandle fh) {
-    auto heh = halfedge_handle(fh);
-    Vec3r p0 = point(from_vertex_handle(heh));
-    Vec3r p1 = point(to_vertex_handle(heh));
-    auto vh2 = to_vertex_handle(next_halfedge_handle(heh));
-    Vec3r p2 = point(vh2);
-    Vec3r face_normal = (p1 - p0).cross(p2 - p0);
-    return face_normal.normalized();
-  };
+  if (!RequireTopology())
+    return false;
+  return UpdateFaceNormals();
+}
+
+bool TriMesh::ComputeVertexNormals(NormalWeighting weighting)
+{
+  if (!RequireTopology())
+    return false;
+  return UpdateVertexNormals(weighting);
+}
 
+
+bool
+TriMesh::UpdateFaceNormals()
+{
   if (!has_face_normals())
     return false;
-  for (auto fit = faces_begin(); fit != faces_end(); ++fit)
-    set_normal(*fit, FaceNormal(*fit));
+  if (!n_faces())
+    return true;
+
+  // run the flat-array kernel and copy the results into the property
+  vector<GLuint> indices(GetIndexBufferSize());
+  PackIndices(&indices[0]);
+  vector<Vec3r> face_normals(n_faces());
+  olio::ComputeFaceNormals(points(), &indices[0], n_faces(), &face_normals[0]);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, n_faces(), 4096),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t i = range.begin(); i != range.end(); ++i)
+      set_normal(face_handle(static_cast<unsigned>(i)), face_normals[i]);
+  });
+  gl_buffers_dirty_ = true;
   return true;
-  
 }
 
-bool TriMesh::ComputeVertexNormals()
+
+bool
+TriMesh::UpdateVertexNormals(NormalWeighting weighting)
 {
-  auto VertexNormal = [&](TriMesh::VertexHandle vh) {
-     Vec3r vertex_normal{0, 0, 0};
-     for (auto vfit = vf_iter(vh); vfit.is_valid(); ++vfit)
-       vertex_normal += normal(*vfit);
-     vertex_normal.normalize();
-     return vertex_normal;
-  };
+  if (!has_vertex_normals())
+    return false;
+  if (!n_vertices())
+    return true;
+
+  // run the flat-array kernel and copy the results into the property
+  vector<GLuint> indices(GetIndexBufferSize());
+  if (!indices.empty())
+    PackIndices(&indices[0]);
+  VertexCorners adjacency;
+  BuildVertexCorners(n_vertices(), indices.data(), n_faces(), adjacency);
+  vector<Vec3r> vertex_normals(n_vertices());
+  olio::ComputeVertexNormals(points(), indices.data(), n_faces(), adjacency,
+                             weighting, &vertex_normals[0]);
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, n_vertices(), 4096),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t i = range.begin(); i != range.end(); ++i)
+      set_normal(vertex_handle(static_cast<unsigned>(i)), vertex_normals[i]);
+  });
+  gl_buffers_dirty_ = true;
+  return true;
+}
+
+
+bool
+TriMesh::UpdateBVH(bool use_cache)
+{
+  using Clock = std::chrono::steady_clock;
+  if (!RebuildTopology())
+    return false;
+
+  auto cache_path = fs::path{filepath_.string() + ".bvh"};
+  auto stamp = use_cache ? GetSourceStamp() : 0;
+
+  auto bvh = std::make_shared<BVH>();
+  auto start = Clock::now();
+  if (stamp && bvh->Load(cache_path, stamp, n_faces())) {
+    auto ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+    spdlog::info("{}: read bvh from {} ({} nodes, {:.2f} ms)", name_,
+                 cache_path.string(), bvh->GetNodeCount(), ms);
+    bvh_ = bvh;
+    return true;
+  }
 
-  if (!has_vertex_normals() || !has_face_normals())
+  vector<GLuint> indices(GetIndexBufferSize());
+  if (indices.empty())
     return false;
-  for (auto vit = vertices_begin(); vit != vertices_end(); ++vit)
-    set_normal(*vit, VertexNormal(*vit));
+  PackIndices(&indices[0]);
+  if (!bvh->Build(points(), &indices[0], n_faces()))
+    return false;
+  auto ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+  spdlog::info("{}: built bvh ({} nodes, {:.2f} ms)", name_, bvh->GetNodeCount(), ms);
+  if (stamp && !bvh->Save(cache_path, stamp))
+    spdlog::warn("{}: bvh cache not written", name_);
+  bvh_ = bvh;
   return true;
+}
+
+
+uint64_t
+TriMesh::GetSourceStamp() const
+{
+  // caches are valid for the file's current size and modification time
+  if (filepath_.empty())
+    return 0;
+  boost::system::error_code ec;
+  auto file_size = fs::file_size(filepath_, ec);
+  auto write_time = ec ? 0 : fs::last_write_time(filepath_, ec);
+  if (ec)
+    return 0;
+  return static_cast<uint64_t>(file_size) * 0x9e3779b97f4a7c15ull ^
+    static_cast<uint64_t>(write_time);
+}
+
 
+bool
+TriMesh::UpdateAmbientOcclusion(const AOSettings &settings, bool use_cache,
+                                AOStats *stats)
+{
+  if (stats)
+    *stats = AOStats{};
+  if (!RebuildTopology())
+    return false;
+  if (!has_vertex_normals() && !UpdateVertexNormals(NormalWeighting::kUniform))
+    return false;
+
+  auto cache_path = fs::path{filepath_.string() + ".ao"};
+  auto stamp = use_cache ? GetSourceStamp() : 0;
+  if (stamp && LoadAmbientOcclusion(cache_path, stamp, settings, n_vertices(),
+                                    ambient_occlusion_)) {
+    spdlog::info("{}: read ambient occlusion from {}", name_, cache_path.string());
+    UploadAmbientOcclusion();
+    return true;
+  }
+
+  if (!bvh_ && !UpdateBVH(use_cache))
+    return false;
+  Vec3r bmin, bmax;
+  GetBoundingBox(bmin, bmax);
+  AOStats bake_stats;
+  if (!BakeAmbientOcclusion(*bvh_, points(), vertex_normals(), n_vertices(),
+                            (bmax - bmin).norm(), settings, ambient_occlusion_,
+                            &bake_stats)) {
+    ambient_occlusion_.clear();
+    return false;
+  }
+  spdlog::info("{}: baked ambient occlusion ({} rays/vertex, {:.2f} ms, "
+               "{:.2f} Mrays/s)", name_, settings.ray_count,
+               bake_stats.seconds * 1000.0, bake_stats.GetRaysPerSecond() * 1e-6);
+  if (stats)
+    *stats = bake_stats;
+  if (stamp && !SaveAmbientOcclusion(cache_path, stamp, settings, ambient_occlusion_))
+    spdlog::warn("{}: ambient occlusion cache not written", name_);
+  UploadAmbientOcclusion();
+  return true;
+}
+
+
+void
+TriMesh::UploadAmbientOcclusion()
+{
+  // only once the other buffers exist; UpdateGLBuffers uploads it
+  // along with them otherwise
+  if (!positions_normals_vbo_ || ambient_occlusion_.size() != vertex_count_)
+    return;
+  auto size = ambient_occlusion_.size() * sizeof(float);
+  if (!ambient_occlusion_vbo_) {
+    glGenBuffers(1, &ambient_occlusion_vbo_);
+    gpu_bytes_ += size;
+  }
+  GLState::Get().BindBuffer(GL_ARRAY_BUFFER, ambient_occlusion_vbo_);
+  glBufferData(GL_ARRAY_BUFFER, static_cast<GLsizeiptr>(size),
+               &ambient_occlusion_[0], GL_STATIC_DRAW);
+}
+
+
+void
+TriMesh::PackVertices(GLfloat *vertices, GLfloat *positions_only) const
+{
+  // work directly on the flat property arrays; every vertex writes its
+  // own slots, so the result doesn't depend on the scheduling
+  const auto *points = this->points();
+  const auto *normals = vertex_normals();
+  const auto *texcoords = has_vertex_texcoords2D() ? texcoords2D() : nullptr;
+  const size_t stride = GetVertexStride();
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, n_vertices(), 4096),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t i = range.begin(); i != range.end(); ++i) {
+      const auto &position = points[i];
+      if (vertices) {
+        // position
+        auto *vertex = vertices + i * stride;
+        vertex[0] = static_cast<GLfloat>(position[0]);
+        vertex[1] = static_cast<GLfloat>(position[1]);
+        vertex[2] = static_cast<GLfloat>(position[2]);
+        // normal
+        vertex[3] = static_cast<GLfloat>(normals[i][0]);
+        vertex[4] = static_cast<GLfloat>(normals[i][1]);
+        vertex[5] = static_cast<GLfloat>(normals[i][2]);
+        // texcoord
+        if (texcoords) {
+          vertex[6] = static_cast<GLfloat>(texcoords[i][0]);
+          vertex[7] = static_cast<GLfloat>(texcoords[i][1]);
+        }
+      }
+      // tightly packed positions for the depth pre-pass, so the pass
+      // fetches half the vertex data
+      if (positions_only) {
+        auto *position_only = positions_only + 3 * i;
+        position_only[0] = static_cast<GLfloat>(position[0]);
+        position_only[1] = static_cast<GLfloat>(position[1]);
+        position_only[2] = static_cast<GLfloat>(position[2]);
+      }
+    }
+  });
+}
+
+
+void
+TriMesh::PackIndices(GLuint *indices) const
+{
+  // same vertex order as fv_iter: start at the face halfedge's target
+  tbb::parallel_for(tbb::blocked_range<size_t>(0, n_faces(), 4096),
+                    [&](const tbb::blocked_range<size_t> &range) {
+    for (size_t i = range.begin(); i != range.end(); ++i) {
+      auto heh0 = halfedge_handle(face_handle(static_cast<unsigned>(i)));
+      auto heh1 = next_halfedge_handle(heh0);
+      auto heh2 = next_halfedge_handle(heh1);
+      auto *face = indices + 3 * i;
+      face[0] = static_cast<GLuint>(to_vertex_handle(heh0).idx());
+      face[1] = static_cast<GLuint>(to_vertex_handle(heh1).idx());
+      face[2] = static_cast<GLuint>(to_vertex_handle(heh2).idx());
+    }
+  });
+}
+
+
+void
+TriMesh::PackGLBuffers(vector<GLfloat> &vertices, vector<GLfloat> &positions_only,
+                       vector<GLuint> &indices) const
+{
+  vertices.resize(GetVertexBufferSize());
+  positions_only.resize(3 * n_vertices());
+  indices.resize(GetIndexBufferSize());
+  if (!n_vertices() || !n_faces())
+    return;
+  PackVertices(&vertices[0], &positions_only[0]);
+  PackIndices(&indices[0]);
 }
 
 
@@ -176,60 +544,143 @@ TriMesh::UpdateGLBuffers(bool force_update)
   // delete existing VBOs
   DeleteGLBuffers();
 
-  vector<Vec3r> positions, normals;
-  vector<int> face_indices;
-//   BuildWatertightSphere(center_, radius_, grid_nx_, grid_ny_, positions, normals,
-//                         face_indices);
-    Load(filepath_);
-
-    // fill positions, normals, and face_indices arrrays
-    for ( auto vit =  vertices_begin(); vit != vertices_end(); ++vit) {
-        // store Vec3r of coordinate position in positions
-        positions.push_back(point(*vit));
-        // store Vec3r of vertex normal in normals
-        normals.push_back(normal(*vit));
-    }
-    for (auto fit = faces_begin(); fit != faces_end(); ++fit) {
-        //face_indices.push_back(fit->idx());
-        for(auto fv_it = fv_iter(*fit); fv_it.is_valid(); ++fv_it){
-          face_indices.push_back(fv_it->idx());
-        }
+  // compact mode: re-create the buffers from the kept arrays
+  if (topology_released_ && retention_ == Retention::kCompact) {
+    vector<GLfloat> positions_only;
+    positions_only.reserve(vertex_count_ * 3);
+    for (size_t i = 0; i + 2 < compact_vertices_.size(); i += vertex_stride_) {
+      positions_only.push_back(compact_vertices_[i]);
+      positions_only.push_back(compact_vertices_[i + 1]);
+      positions_only.push_back(compact_vertices_[i + 2]);
     }
+    UploadGLBuffers(compact_vertices_, positions_only, compact_indices_);
+    return;
+  }
 
-  // interleave positions and normals
-  vector<GLfloat> positions_normals;
-  for (size_t i = 0; i < positions.size(); ++i) {
-    // position
-    positions_normals.push_back(static_cast<GLfloat>(positions[i][0]));
-    positions_normals.push_back(static_cast<GLfloat>(positions[i][1]));
-    positions_normals.push_back(static_cast<GLfloat>(positions[i][2]));
-    // normal
-    positions_normals.push_back(static_cast<GLfloat>(normals[i][0]));
-    positions_normals.push_back(static_cast<GLfloat>(normals[i][1]));
-    positions_normals.push_back(static_cast<GLfloat>(normals[i][2]));
+  // topology is only reloaded if it was released (none mode)
+  if (!RebuildTopology())
+    return;
+  has_texcoords_ = has_vertex_texcoords2D();
+  vertex_stride_ = GetVertexStride();
+  vertex_count_ = n_vertices();
+  face_indices_count_ = GetIndexBufferSize();
+
+  // compact mode keeps the packed arrays, so pack into vectors
+  if (retention_ == Retention::kCompact) {
+    vector<GLfloat> positions_normals, positions_only;
+    vector<GLuint> faces;
+    PackGLBuffers(positions_normals, positions_only, faces);
+    UploadGLBuffers(positions_normals, positions_only, faces);
+    if (!gl_buffers_dirty_)
+      ReleaseTopology(positions_normals, faces);
+    return;
+  }
+
+  // otherwise pack straight into the mapped gl buffers
+  if (!MapAndPackGLBuffers())
+    return;
+
+  // render-only mode: drop the topology once it's on the GPU
+  if (retention_ == Retention::kNone) {
+    vector<GLfloat> no_vertices;
+    vector<GLuint> no_indices;
+    ReleaseTopology(no_vertices, no_indices);
   }
-  vertex_count_ = positions.size();
-  face_indices_count_ = face_indices.size();
+}
+
+
+bool
+TriMesh::MapAndPackGLBuffers()
+{
+  if (!vertex_count_ || !face_indices_count_)
+    return false;
+
+  // allocate the buffer's storage and map it for writing
+  auto CreateMappedBuffer = [](GLenum target, size_t size, GLuint &buffer) {
+    glGenBuffers(1, &buffer);
+    GLState::Get().BindBuffer(target, buffer);
+    glBufferData(target, static_cast<GLsizeiptr>(size), nullptr, GL_STATIC_DRAW);
+    return glMapBufferRange(target, 0, static_cast<GLsizeiptr>(size),
+                            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+  };
+  auto UnmapBuffer = [this](GLenum target, void *data) {
+    // the data store can get corrupted (e.g. on a mode switch) while
+    // mapped; GL then reports it on unmap
+    if (data && glUnmapBuffer(target) == GL_TRUE)
+      return true;
+    spdlog::error("{}: failed to map gl buffer", name_);
+    DeleteGLBuffers();
+    return false;
+  };
+
+  // create VBO for positions and normals
+  auto vertices_size = GetVertexBufferSize() * sizeof(GLfloat);
+  auto vertices = CreateMappedBuffer(GL_ARRAY_BUFFER, vertices_size, positions_normals_vbo_);
+  if (vertices)
+    PackVertices(static_cast<GLfloat*>(vertices), nullptr);
+  if (!UnmapBuffer(GL_ARRAY_BUFFER, vertices))
+    return false;
+
+  // create position-only VBO for the depth pre-pass
+  auto positions_size = 3 * vertex_count_ * sizeof(GLfloat);
+  auto positions = CreateMappedBuffer(GL_ARRAY_BUFFER, positions_size, positions_vbo_);
+  if (positions)
+    PackVertices(nullptr, static_cast<GLfloat*>(positions));
+  if (!UnmapBuffer(GL_ARRAY_BUFFER, positions))
+    return false;
+
+  // create EBO for faces
+  auto faces_size = face_indices_count_ * sizeof(GLuint);
+  auto faces = CreateMappedBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_size, faces_ebo_);
+  if (faces)
+    PackIndices(static_cast<GLuint*>(faces));
+  if (!UnmapBuffer(GL_ELEMENT_ARRAY_BUFFER, faces))
+    return false;
+
+  // nothing is staged on the cpu
+  gpu_bytes_ = vertices_size + positions_size + faces_size;
+  upload_bytes_ = 0;
+  gl_buffers_dirty_ = false;
+  UploadAmbientOcclusion();
+  return true;
+}
+
+
+void
+TriMesh::UploadGLBuffers(const vector<GLfloat> &positions_normals,
+                         const vector<GLfloat> &positions_only,
+                         const vector<GLuint> &faces)
+{
+  if (!vertex_count_ || !face_indices_count_)
+    return;
+
+  // keep track of gpu memory, and the temporary arrays (which are
+  // only resident in compact mode)
+  gpu_bytes_ = (positions_normals.size() + positions_only.size()) * sizeof(GLfloat) +
+    faces.size() * sizeof(GLuint);
+  upload_bytes_ = positions_normals.capacity() * sizeof(GLfloat) +
+    positions_only.capacity() * sizeof(GLfloat) + faces.capacity() * sizeof(GLuint);
 
   // create VBO for positions and normals
   glGenBuffers(1, &positions_normals_vbo_);
-  glBindBuffer(GL_ARRAY_BUFFER, positions_normals_vbo_);
+  GLState::Get().BindBuffer(GL_ARRAY_BUFFER, positions_normals_vbo_);
   glBufferData(GL_ARRAY_BUFFER, positions_normals.size() * sizeof(GLfloat),
                &positions_normals[0], GL_STATIC_DRAW);
 
-  // create elements array
-  vector<GLuint> faces;
-  faces.reserve(face_indices.size());
-  for (auto index : face_indices)
-    faces.push_back(static_cast<GLuint>(index));
+  // create position-only VBO for the depth pre-pass
+  glGenBuffers(1, &positions_vbo_);
+  GLState::Get().BindBuffer(GL_ARRAY_BUFFER, positions_vbo_);
+  glBufferData(GL_ARRAY_BUFFER, positions_only.size() * sizeof(GLfloat),
+               &positions_only[0], GL_STATIC_DRAW);
 
   // create EBO for faces
   glGenBuffers(1, &faces_ebo_);
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_ebo_);
+  GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_ebo_);
   glBufferData(GL_ELEMENT_ARRAY_BUFFER, faces.size() * sizeof(GLuint),
                &faces[0], GL_STATIC_DRAW);
 
   gl_buffers_dirty_ = false;
+  UploadAmbientOcclusion();
 }
 
 
@@ -240,7 +691,9 @@ TriMesh::DrawGL(const GLDrawData &draw_data)
   auto material = draw_data.GetMaterial();
   if (!material)
     return;
-  auto shader = material->GetGLShader();
+  auto shader = draw_data.GetGLShader();
+  if (!shader)
+    shader = material->GetGLShader();
   if (!shader || !shader->Use())
     return;
 
@@ -252,27 +705,74 @@ TriMesh::DrawGL(const GLDrawData &draw_data)
     return;
 
   // enable depth test
-  glEnable(GL_DEPTH_TEST);
-  glDepthFunc(GL_LEQUAL);
+  GLState::Get().SetEnabled(GL_DEPTH_TEST, true);
+  GLState::Get().DepthFunc(draw_data.GetDepthFunc());
+
+  // depth pre-pass: only positions and MVP matrices are needed
+  if (draw_data.GetPositionsOnly()) {
+    if (!positions_vbo_)
+      return;
+    shader->SetTransforms(draw_data);
+    GLState::Get().BindBuffer(GL_ARRAY_BUFFER, positions_vbo_);
+    auto positions_attr_index = glGetAttribLocation(shader->GetProgramID(), "position");
+    if (positions_attr_index < 0)
+      return;
+    glVertexAttribPointer(static_cast<GLuint>(positions_attr_index), 3, GL_FLOAT,
+                          GL_FALSE, 3 * sizeof(GLfloat), (void*)(0));
+    glEnableVertexAttribArray(static_cast<GLuint>(positions_attr_index));
+    GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_ebo_);
+    glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(face_indices_count_),
+                   GL_UNSIGNED_INT, nullptr);
+    CheckOpenGLError();
+    return;
+  }
 
   // set up uniforms: MVP matrices, lights, material
   shader->SetupUniforms(draw_data);
 
   // enable positions attribute and set pointer
-  glBindBuffer(GL_ARRAY_BUFFER, positions_normals_vbo_);
+  auto stride = static_cast<GLsizei>(vertex_stride_ * sizeof(GLfloat));
+  GLState::Get().BindBuffer(GL_ARRAY_BUFFER, positions_normals_vbo_);
   auto positions_attr_index = glGetAttribLocation(shader->GetProgramID(), "position");
-  glVertexAttribPointer(positions_attr_index, 3, GL_FLOAT, GL_FALSE,
-                        6 * sizeof(GLfloat), (void*)(0));
-  glEnableVertexAttribArray(positions_attr_index);
+  if (positions_attr_index >= 0) {
+    glVertexAttribPointer(static_cast<GLuint>(positions_attr_index), 3, GL_FLOAT,
+                          GL_FALSE, stride, (void*)(0));
+    glEnableVertexAttribArray(static_cast<GLuint>(positions_attr_index));
+  }
 
   // enable normals attribute and set pointer
   auto normals_attr_index = glGetAttribLocation(shader->GetProgramID(), "normal");
-  glVertexAttribPointer(normals_attr_index, 3, GL_FLOAT, GL_FALSE,
-                        6 * sizeof(GLfloat), (void*)(3 * sizeof(GLfloat)));
-  glEnableVertexAttribArray(normals_attr_index);
+  if (normals_attr_index >= 0) {
+    glVertexAttribPointer(static_cast<GLuint>(normals_attr_index), 3, GL_FLOAT,
+                          GL_FALSE, stride, (void*)(3 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(static_cast<GLuint>(normals_attr_index));
+  }
+
+  // enable texcoords attribute (only present in HAS_TEXCOORDS variants)
+  auto texcoords_attr_index = glGetAttribLocation(shader->GetProgramID(), "texcoord");
+  if (texcoords_attr_index >= 0 && has_texcoords_) {
+    glVertexAttribPointer(static_cast<GLuint>(texcoords_attr_index), 2, GL_FLOAT,
+                          GL_FALSE, stride, (void*)(6 * sizeof(GLfloat)));
+    glEnableVertexAttribArray(static_cast<GLuint>(texcoords_attr_index));
+  }
+
+  // enable ambient occlusion attribute (only present in HAS_VERTEX_AO
+  // variants); unoccluded if it hasn't been baked
+  auto ao_attr_index = glGetAttribLocation(shader->GetProgramID(), "ambient_occlusion");
+  if (ao_attr_index >= 0) {
+    if (ambient_occlusion_vbo_) {
+      GLState::Get().BindBuffer(GL_ARRAY_BUFFER, ambient_occlusion_vbo_);
+      glVertexAttribPointer(static_cast<GLuint>(ao_attr_index), 1, GL_FLOAT,
+                            GL_FALSE, sizeof(GLfloat), (void*)(0));
+      glEnableVertexAttribArray(static_cast<GLuint>(ao_attr_index));
+    } else {
+      glDisableVertexAttribArray(static_cast<GLuint>(ao_attr_index));
+      glVertexAttrib1f(static_cast<GLuint>(ao_attr_index), 1.0f);
+    }
+  }
 
   // draw mesh
-  glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_ebo_);
+  GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, faces_ebo_);
   // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
   glDrawElements(GL_TRIANGLES, static_cast<GLsizei>(face_indices_count_),
                  GL_UNSIGNED_INT, nullptr);
@@ -282,5 +782,22 @@ TriMesh::DrawGL(const GLDrawData &draw_data)
 }
 
 
+bool
+TriMesh::GetGLDrawGeometry(GLDrawGeometry &geometry)
+{
+  if (gl_buffers_dirty_ || !positions_normals_vbo_)
+    UpdateGLBuffers(false);
+  if (!vertex_count_ || !face_indices_count_ ||
+      !positions_normals_vbo_ || !faces_ebo_)
+    return false;
+  geometry.vertex_buffer = positions_normals_vbo_;
+  geometry.positions_buffer = positions_vbo_;
+  geometry.ao_buffer = ambient_occlusion_vbo_;
+  geometry.index_buffer = faces_ebo_;
+  geometry.index_count = static_cast<GLsizei>(face_indices_count_);
+  geometry.vertex_stride = static_cast<GLsizei>(vertex_stride_ * sizeof(GLfloat));
+  geometry.has_texcoords = has_texcoords_;
+  return true;
+}
 
-}  // namespace olio
\ No newline at end of file
+}  // namespace olio
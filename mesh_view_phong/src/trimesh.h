@@ -6,9 +6,14 @@
 // From implementation of sphere class
 #include <string>
 #include <memory>
+#include <vector>
 #include "types.h"
 #include "utils/utils.h"
 #include "utils/material.h"
+#include "utils/memory_stats.h"
+#include "mesh_normals.h"
+#include "bvh.h"
+#include "ambient_occlusion.h"
 
 // OpenMesh::TriMesh_ArrayKernelT
 #include <boost/filesystem.hpp>
@@ -21,6 +26,7 @@
 namespace olio {
 // class GLDrawData
 class GLDrawData;
+struct GLDrawGeometry;
 // use Eigen instead of OpenMesh's default structures for Point and
 // Normal
 
@@ -45,30 +51,168 @@ public:
     // TriMesh& operator=(TriMesh &&) = delete;
     ~TriMesh();
 
+    //! \brief What the mesh keeps in CPU memory once its GL buffers
+    //!        have been uploaded
+    enum class Retention {
+      kFull = 0,    //!< keep topology and properties (editable)
+      kCompact,     //!< keep only the packed vertex and index arrays
+      kNone         //!< keep only bounds; reload from file when needed
+    };
+
     // TriMesh member functions
     bool Load(const boost::filesystem::path &filepath);
     void GetBoundingBox(Vec3r &bmin, Vec3r &bmax);
+    //! \brief Recompute the bounds on the next GetBoundingBox (after
+    //!        moving points through the OpenMesh interface). Ignored
+    //!        once the topology is released
+    void InvalidateBounds() {bounds_valid_ = bounds_valid_ && topology_released_;}
     bool ComputeFaceNormals();
-    bool ComputeVertexNormals();
+    bool ComputeVertexNormals(NormalWeighting weighting=NormalWeighting::kUniform);
+
+    //! \brief Set what to keep after upload. Takes effect on the next
+    //!        UpdateGLBuffers
+    void SetRetention(Retention retention) {retention_ = retention;}
+    Retention GetRetention() const {return retention_;}
+
+    //! \brief whether the half-edge topology and properties are
+    //!        resident (false after a compact/none upload)
+    bool HasTopology() const {return !topology_released_;}
+
+    //! \brief Make the topology available for editing, reloading it
+    //!        from file if it was released. The mesh is kept in full
+    //!        retention mode afterwards, so edits are not dropped on
+    //!        the next upload
+    //! \return true on success
+    bool RequireTopology();
+
+    //! \brief Build the BVH used for ray queries, or read it from the
+    //!        cache file next to the mesh (<mesh file>.bvh). Requires
+    //!        the topology; the BVH itself survives releasing it
+    //! \param[in] use_cache read/write the cache file
+    //! \return true on success
+    bool UpdateBVH(bool use_cache=true);
+
+    //! \brief BVH over the mesh triangles (nullptr if not built)
+    BVH::Ptr GetBVH() const {return bvh_;}
+
+    //! \brief Bake per-vertex ambient occlusion against the BVH
+    //!        (building it if needed), or read it from the cache file
+    //!        next to the mesh (<mesh file>.ao). The values survive
+    //!        releasing the topology and are uploaded as the
+    //!        "ambient_occlusion" vertex attribute
+    //! \param[in] settings baking parameters
+    //! \param[in] use_cache read/write the cache file
+    //! \param[out] stats rays cast and bake time (optional; zero rays
+    //!                   when read from the cache)
+    //! \return true on success
+    bool UpdateAmbientOcclusion(const AOSettings &settings=AOSettings{},
+                                bool use_cache=true, AOStats *stats=nullptr);
+
+    //! \brief whether ambient occlusion has been baked
+    bool HasAmbientOcclusion() const {return !ambient_occlusion_.empty();}
+
+    //! \brief baked per-vertex ambient occlusion (empty if not baked)
+    const std::vector<float>& GetAmbientOcclusion() const {return ambient_occlusion_;}
+
+    //! \brief CPU (connectivity, properties, compact arrays) and GPU
+    //!        memory held by the mesh
+    MemoryStats GetMemoryStats() const;
+
+    //! \brief Bytes of CPU memory held by the mesh
+    size_t GetResidentBytes() const {return GetMemoryStats().GetCPUBytes();}
 
     void SetFilePath(const boost::filesystem::path &filepath)
         {filepath_ = filepath;}
 
     boost::filesystem::path GetFilePath() const {return filepath_;}
 
+    //! \brief whether the GL vertex buffer carries texture coordinates
+    //!        (as uploaded, once the topology is released)
+    bool HasTexCoords() const {
+      return topology_released_ ? has_texcoords_ : has_vertex_texcoords2D();
+    }
+
+    //! \brief Number of floats per vertex in the interleaved vertex
+    //!        buffer (position, normal, and texcoord if available)
+    size_t GetVertexStride() const {
+      return topology_released_ ? vertex_stride_ : (has_vertex_texcoords2D() ? 8 : 6);
+    }
+
+    //! \brief Number of floats in the interleaved vertex buffer
+    size_t GetVertexBufferSize() const {return n_vertices() * GetVertexStride();}
+
+    //! \brief Number of indices in the triangle index buffer
+    size_t GetIndexBufferSize() const {return 3 * n_faces();}
+
+    //! \brief Pack vertices in parallel into preallocated (e.g. mapped)
+    //!        memory. No GL calls. Requires the topology to be resident
+    //! \param[out] vertices interleaved positions/normals(/texcoords):
+    //!                      GetVertexBufferSize() floats (or nullptr)
+    //! \param[out] positions_only tightly packed positions: 3 *
+    //!                            n_vertices() floats (or nullptr)
+    void PackVertices(GLfloat *vertices, GLfloat *positions_only) const;
+
+    //! \brief Pack triangle indices in parallel into preallocated
+    //!        memory of GetIndexBufferSize() indices. No GL calls
+    //! \param[out] indices triangle vertex indices
+    void PackIndices(GLuint *indices) const;
+
+    //! \brief Pack the data uploaded by UpdateGLBuffers into vectors
+    //!        (no GL calls). Requires the topology to be resident
+    //! \param[out] vertices interleaved positions/normals(/texcoords)
+    //! \param[out] positions_only tightly packed positions
+    //! \param[out] indices triangle vertex indices
+    void PackGLBuffers(std::vector<GLfloat> &vertices,
+                       std::vector<GLfloat> &positions_only,
+                       std::vector<GLuint> &indices) const;
+
     // opengl
     void DeleteGLBuffers();
     void UpdateGLBuffers(bool force_update=false);
     void DrawGL(const GLDrawData &draw_data);
+
+    //! \brief Get the gl buffers for drawing through a render queue
+    //!        (uploading them first if needed)
+    //! \param[out] geometry mesh buffers
+    //! \return true if the mesh has buffers to draw
+    bool GetGLDrawGeometry(GLDrawGeometry &geometry);
 protected:
+  bool UpdateFaceNormals();
+  bool UpdateVertexNormals(NormalWeighting weighting);
+  bool RebuildTopology();
+  void ReleaseTopology(std::vector<GLfloat> &vertices, std::vector<GLuint> &indices);
+  void UpdateBounds();
+  uint64_t GetSourceStamp() const;
+  void UploadAmbientOcclusion();
+  bool MapAndPackGLBuffers();
+  void UploadGLBuffers(const std::vector<GLfloat> &vertices,
+                       const std::vector<GLfloat> &positions_only,
+                       const std::vector<GLuint> &indices);
+
   boost::filesystem::path filepath_;
   std:: string name_;
   size_t vertex_count_ = 0;
   size_t face_indices_count_ = 0;
+  // render-only modes: cached bounds and compact arrays
+  Retention retention_ = Retention::kFull;
+  bool topology_released_ = false;
+  bool bounds_valid_ = false;
+  Vec3r bmin_{0, 0, 0};
+  Vec3r bmax_{0, 0, 0};
+  std::vector<GLfloat> compact_vertices_;  //!< interleaved (kCompact)
+  std::vector<GLuint> compact_indices_;    //!< triangle indices (kCompact)
+  BVH::Ptr bvh_;                           //!< ray query acceleration
+  std::vector<float> ambient_occlusion_;   //!< baked per-vertex occlusion
     // opengl
   bool gl_buffers_dirty_ = false;
+  bool has_texcoords_ = false;   //!< vbo has texcoords
+  size_t vertex_stride_ = 6;     //!< floats per vertex in vbo
   GLuint positions_normals_vbo_{0};
+  GLuint positions_vbo_{0};      //!< de-interleaved positions (depth pass)
   GLuint faces_ebo_{0};
+  GLuint ambient_occlusion_vbo_{0};
+  size_t gpu_bytes_ = 0;         //!< bytes in the vbos and ebo
+  size_t upload_bytes_ = 0;      //!< temporary arrays of last upload
   
 };
 
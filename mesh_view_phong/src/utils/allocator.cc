@@ -0,0 +1,204 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       allocator.cc
+//! \brief      Heap allocator statistics and per-thread arenas. With
+//!             OLIO_USE_JEMALLOC, malloc is jemalloc's; otherwise the
+//!             system allocator's statistics are reported
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/allocator.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <spdlog/spdlog.h>
+#include "utils/memory_stats.h"
+#if defined(OLIO_USE_JEMALLOC)
+#include <jemalloc/jemalloc.h>
+#elif defined(__GLIBC__)
+#include <malloc.h>
+#endif
+
+namespace olio {
+
+using namespace std;
+
+static atomic<bool> thread_arenas_enabled_g{true};
+
+#if defined(OLIO_USE_JEMALLOC)
+
+//! \brief Read a jemalloc statistic
+template <typename T>
+static bool
+ReadMallctl(const char *name, T &value)
+{
+  auto size = sizeof(T);
+  return mallctl(name, &value, &size, nullptr, 0) == 0;
+}
+
+
+// arenas created for loader threads. an exiting thread returns its
+// arena, so the next loader thread reuses it instead of creating one
+// (jemalloc arenas are never freed)
+static mutex free_arenas_mutex_g;
+static vector<unsigned> free_arenas_g;
+
+//! \brief Arena of a loader thread, returned to the pool on thread exit
+struct ThreadArena {
+  unsigned arena{0};
+  bool valid{false};
+
+  ~ThreadArena() {
+    if (!valid)
+      return;
+    lock_guard<mutex> lock(free_arenas_mutex_g);
+    free_arenas_g.push_back(arena);
+  }
+};
+static thread_local ThreadArena thread_arena_g;
+
+#endif
+
+
+const char*
+GetAllocatorName()
+{
+#if defined(OLIO_USE_JEMALLOC)
+  return "jemalloc";
+#else
+  return "system";
+#endif
+}
+
+
+bool
+GetAllocatorStats(AllocatorStats &stats)
+{
+  stats = AllocatorStats{};
+#if defined(OLIO_USE_JEMALLOC)
+  // statistics are snapshots, refreshed by advancing the epoch
+  uint64_t epoch = 1;
+  auto size = sizeof(epoch);
+  if (mallctl("epoch", &epoch, &size, &epoch, size) != 0)
+    return false;
+  if (!ReadMallctl("stats.allocated", stats.allocated) ||
+      !ReadMallctl("stats.active", stats.active) ||
+      !ReadMallctl("stats.resident", stats.resident) ||
+      !ReadMallctl("stats.mapped", stats.mapped) ||
+      !ReadMallctl("stats.metadata", stats.metadata))
+    return false;
+#if defined(MALLCTL_ARENAS_ALL)
+  // requests summed over all arenas (thread caches report theirs when
+  // they are flushed, so recent counts are approximate)
+  uint64_t small_requests = 0, large_requests = 0;
+  const auto arenas = std::to_string(MALLCTL_ARENAS_ALL);
+  if (ReadMallctl(("stats.arenas." + arenas + ".small.nrequests").c_str(), small_requests) &&
+      ReadMallctl(("stats.arenas." + arenas + ".large.nrequests").c_str(), large_requests))
+    stats.allocations = small_requests + large_requests;
+#endif
+  return true;
+#elif defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  // totals over all arenas. glibc doesn't report resident pages, so
+  // the memory obtained from the system is used instead
+  auto info = mallinfo2();
+  stats.allocated = info.uordblks + info.hblkhd;
+  stats.active = stats.allocated;
+  stats.mapped = info.arena + info.hblkhd;
+  stats.resident = stats.mapped;
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+void
+SetThreadArenasEnabled(bool enabled)
+{
+  thread_arenas_enabled_g = enabled;
+}
+
+
+bool
+UseThreadArena()
+{
+#if defined(OLIO_USE_JEMALLOC)
+  if (!thread_arenas_enabled_g)
+    return false;
+  auto &thread_arena = thread_arena_g;
+  if (thread_arena.valid)
+    return true;
+  unsigned arena = 0;
+  bool reused = false;
+  {
+    lock_guard<mutex> lock(free_arenas_mutex_g);
+    if (!free_arenas_g.empty()) {
+      arena = free_arenas_g.back();
+      free_arenas_g.pop_back();
+      reused = true;
+    }
+  }
+  if (!reused && !ReadMallctl("arenas.create", arena)) {
+    spdlog::warn("UseThreadArena: failed to create a jemalloc arena");
+    return false;
+  }
+  if (mallctl("thread.arena", nullptr, nullptr, &arena, sizeof(arena)) != 0) {
+    spdlog::warn("UseThreadArena: failed to switch to arena {}", arena);
+    lock_guard<mutex> lock(free_arenas_mutex_g);
+    free_arenas_g.push_back(arena);
+    return false;
+  }
+  thread_arena.arena = arena;
+  thread_arena.valid = true;
+  return true;
+#else
+  return false;
+#endif
+}
+
+
+void
+AllocatorPhase::Begin()
+{
+  valid_ = GetAllocatorStats(begin_stats_);
+}
+
+
+void
+AllocatorPhase::End()
+{
+  if (!valid_ || !GetAllocatorStats(end_stats_))
+    return;
+  allocations_ += end_stats_.allocations - begin_stats_.allocations;
+  allocated_delta_ += static_cast<int64_t>(end_stats_.allocated) -
+    static_cast<int64_t>(begin_stats_.allocated);
+}
+
+
+void
+AllocatorPhase::Print(size_t units, const std::string &unit_name) const
+{
+  if (!valid_) {
+    spdlog::info("allocator ({}) {}: no statistics", GetAllocatorName(), phase_);
+    return;
+  }
+  std::string allocations = "allocations n/a";
+  if (end_stats_.allocations) {
+    allocations = fmt::format("{} allocations", allocations_);
+    if (units)
+      allocations += fmt::format(" ({:.1f}/{})", static_cast<double>(allocations_) /
+                                 static_cast<double>(units), unit_name);
+  }
+  auto delta = static_cast<size_t>(allocated_delta_ < 0 ? -allocated_delta_ : allocated_delta_);
+  spdlog::info("allocator ({}) {}: {}, net {}{}; heap allocated {}, resident {}, "
+               "fragmentation {:.1f}%", GetAllocatorName(), phase_, allocations,
+               allocated_delta_ < 0 ? "-" : "+", FormatBytes(delta),
+               FormatBytes(end_stats_.allocated), FormatBytes(end_stats_.resident),
+               100.0 * end_stats_.GetFragmentation());
+}
+
+}  // namespace olio
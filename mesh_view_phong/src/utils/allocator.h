@@ -0,0 +1,95 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       allocator.h
+//! \brief      Heap allocator statistics and per-thread arenas. With
+//!             OLIO_USE_JEMALLOC, malloc is jemalloc's; otherwise the
+//!             system allocator's statistics are reported
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <string>
+#include <cstdint>
+#include "types.h"
+
+namespace olio {
+
+//! \struct AllocatorStats
+//! \brief Heap allocator counters
+struct AllocatorStats {
+  size_t allocated{0};     //!< bytes in live allocations
+  size_t active{0};        //!< bytes of pages holding live allocations
+  size_t resident{0};      //!< bytes the allocator holds in physical memory
+  size_t mapped{0};        //!< bytes the allocator has mapped
+  size_t metadata{0};      //!< allocator bookkeeping bytes
+  uint64_t allocations{0}; //!< allocations since startup (0 if unknown)
+
+  //! \brief Fraction of the allocator's resident bytes not backing live
+  //!        allocations (free blocks, partly used pages, metadata)
+  double GetFragmentation() const {
+    return resident > allocated ?
+      1.0 - static_cast<double>(allocated) / static_cast<double>(resident) : 0.0;
+  }
+};
+
+
+//! \brief Name of the heap allocator ("jemalloc" or "system")
+const char* GetAllocatorName();
+
+//! \brief Read the heap allocator's counters
+//! \param[out] stats allocator counters
+//! \return true on success (false if the allocator has no statistics)
+bool GetAllocatorStats(AllocatorStats &stats);
+
+//! \brief Enable/disable dedicated arenas for loader threads (see
+//!        UseThreadArena). Enabled by default
+void SetThreadArenasEnabled(bool enabled);
+
+//! \brief Move the calling (loader) thread to an arena of its own, so
+//!        threads loading in parallel don't contend for arena locks or
+//!        interleave their allocations with the render thread's. Only
+//!        has an effect with jemalloc, if thread arenas are enabled
+//! \return true if the thread now allocates from its own arena
+bool UseThreadArena();
+
+
+//! \class AllocatorPhase
+//! \brief Allocator counters accumulated over the intervals of a phase
+//!        (e.g. loading, uploading or drawing frames): allocations
+//!        made and net bytes allocated, and the heap's state at the end
+class AllocatorPhase {
+public:
+  //! \brief Constructor
+  //! \param[in] phase phase name used when printing
+  explicit AllocatorPhase(const std::string &phase) : phase_{phase} {}
+
+  //! \brief Start an interval of the phase
+  void Begin();
+
+  //! \brief End the current interval, adding its counts to the phase
+  void End();
+
+  //! \brief Print the phase's counts
+  //! \param[in] units if nonzero, also print allocations per unit
+  //!                  (frames, meshes, ...)
+  //! \param[in] unit_name name of a unit
+  void Print(size_t units=0, const std::string &unit_name="frame") const;
+
+  uint64_t GetAllocations() const {return allocations_;}
+  int64_t GetAllocatedDelta() const {return allocated_delta_;}
+  const AllocatorStats& GetEndStats() const {return end_stats_;}
+protected:
+  std::string phase_;
+  AllocatorStats begin_stats_;
+  AllocatorStats end_stats_;
+  uint64_t allocations_{0};
+  int64_t allocated_delta_{0};
+  bool valid_{false};
+};
+
+}  // namespace olio
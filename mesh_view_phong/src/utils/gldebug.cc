@@ -0,0 +1,228 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       gldebug.cc
+//! \brief      Driver debug messages (KHR_debug/ARB_debug_output)
+//!             routed to spdlog, in place of polling glGetError
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/gldebug.h"
+#include <spdlog/spdlog.h>
+#include "utils/glstate.h"
+
+namespace olio {
+
+using namespace std;
+
+static const char*
+GetSourceName(GLenum source)
+{
+  switch (source) {
+  case GL_DEBUG_SOURCE_API:
+    return "api";
+  case GL_DEBUG_SOURCE_WINDOW_SYSTEM:
+    return "window system";
+  case GL_DEBUG_SOURCE_SHADER_COMPILER:
+    return "shader compiler";
+  case GL_DEBUG_SOURCE_THIRD_PARTY:
+    return "third party";
+  case GL_DEBUG_SOURCE_APPLICATION:
+    return "application";
+  default:
+    return "other";
+  }
+}
+
+
+static const char*
+GetTypeName(GLenum type)
+{
+  switch (type) {
+  case GL_DEBUG_TYPE_ERROR:
+    return "error";
+  case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR:
+    return "deprecated behavior";
+  case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR:
+    return "undefined behavior";
+  case GL_DEBUG_TYPE_PORTABILITY:
+    return "portability";
+  case GL_DEBUG_TYPE_PERFORMANCE:
+    return "performance";
+  default:
+    return "other";
+  }
+}
+
+
+//! \brief Severity rank: higher is more severe
+static int
+GetSeverityRank(GLenum severity)
+{
+  switch (severity) {
+  case GL_DEBUG_SEVERITY_HIGH:
+    return 3;
+  case GL_DEBUG_SEVERITY_MEDIUM:
+    return 2;
+  case GL_DEBUG_SEVERITY_LOW:
+    return 1;
+  default:
+    return 0;
+  }
+}
+
+
+GLDebugOutput::GLDebugOutput(const Options &options) :
+  options_{options}
+{
+  khr_debug_ = GLEW_VERSION_4_3 || GLEW_KHR_debug;
+  supported_ = khr_debug_ || GLEW_ARB_debug_output;
+  if (!supported_) {
+    spdlog::info("GLDebugOutput: debug output not supported");
+    return;
+  }
+
+  if (khr_debug_) {
+    GLState::Get().SetEnabled(GL_DEBUG_OUTPUT, true);
+    GLState::Get().SetEnabled(GL_DEBUG_OUTPUT_SYNCHRONOUS, options_.synchronous);
+    glDebugMessageCallback(&GLDebugOutput::Callback, this);
+  } else {
+    GLState::Get().SetEnabled(GL_DEBUG_OUTPUT_SYNCHRONOUS_ARB, options_.synchronous);
+    glDebugMessageCallbackARB(&GLDebugOutput::Callback, this);
+  }
+
+  // let the driver drop what we'd filter anyway
+  auto min_rank = GetSeverityRank(options_.min_severity);
+  for (auto severity : {GL_DEBUG_SEVERITY_HIGH, GL_DEBUG_SEVERITY_MEDIUM,
+        GL_DEBUG_SEVERITY_LOW})
+    SetSeverityEnabled(severity, GetSeverityRank(severity) >= min_rank);
+  if (khr_debug_)
+    SetSeverityEnabled(GL_DEBUG_SEVERITY_NOTIFICATION, min_rank == 0);
+  SetSourceEnabled(GL_DEBUG_SOURCE_SHADER_COMPILER, options_.shader_compiler);
+  spdlog::info("GLDebugOutput: {} ({})", khr_debug_ ? "KHR_debug" : "ARB_debug_output",
+               options_.synchronous ? "synchronous" : "asynchronous");
+}
+
+
+GLDebugOutput::~GLDebugOutput()
+{
+  if (!supported_)
+    return;
+  if (khr_debug_)
+    glDebugMessageCallback(nullptr, nullptr);
+  else
+    glDebugMessageCallbackARB(nullptr, nullptr);
+}
+
+
+void
+GLDebugOutput::PrintStats() const
+{
+  lock_guard<mutex> lock(mutex_);
+  if (!message_count_)
+    return;
+  spdlog::info("gl debug output: {} messages ({} distinct, {} repeats suppressed)",
+               message_count_, message_counts_.size(), suppressed_count_);
+}
+
+
+bool
+GLDebugOutput::ParseSeverity(const string &name, GLenum &severity)
+{
+  if (name == "high")
+    severity = GL_DEBUG_SEVERITY_HIGH;
+  else if (name == "medium")
+    severity = GL_DEBUG_SEVERITY_MEDIUM;
+  else if (name == "low")
+    severity = GL_DEBUG_SEVERITY_LOW;
+  else if (name == "notification")
+    severity = GL_DEBUG_SEVERITY_NOTIFICATION;
+  else
+    return false;
+  return true;
+}
+
+
+void GLAPIENTRY
+GLDebugOutput::Callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                        GLsizei length, const GLchar *message, const void *user_param)
+{
+  auto *debug_output = static_cast<GLDebugOutput*>(const_cast<void*>(user_param));
+  if (!debug_output || !message)
+    return;
+  string text = length < 0 ? string(message) :
+    string(message, static_cast<size_t>(length));
+  debug_output->Report(source, type, id, severity, text);
+}
+
+
+void
+GLDebugOutput::Report(GLenum source, GLenum type, GLuint id, GLenum severity,
+                      const string &message)
+{
+  // drivers that ignore glDebugMessageControl
+  auto rank = GetSeverityRank(severity);
+  if (rank < GetSeverityRank(options_.min_severity))
+    return;
+  if (source == GL_DEBUG_SOURCE_SHADER_COMPILER && !options_.shader_compiler)
+    return;
+
+  // log the first occurrence, then only every order of magnitude
+  size_t count = 0;
+  {
+    lock_guard<mutex> lock(mutex_);
+    ++message_count_;
+    auto key = fmt::format("{}:{}:{}:{}:{}", source, type, id, severity, message);
+    count = ++message_counts_[key];
+    auto log_count = count;
+    while (log_count % 10 == 0)
+      log_count /= 10;
+    if (log_count != 1) {
+      ++suppressed_count_;
+      return;
+    }
+  }
+
+  auto level = spdlog::level::debug;
+  if (type == GL_DEBUG_TYPE_ERROR || rank == 3)
+    level = spdlog::level::err;
+  else if (rank == 2)
+    level = spdlog::level::warn;
+  else if (rank == 1)
+    level = spdlog::level::info;
+  if (count == 1)
+    spdlog::log(level, "gl {} {} ({}): {}", GetSourceName(source), GetTypeName(type),
+                id, message);
+  else
+    spdlog::log(level, "gl {} {} ({}), {} times: {}", GetSourceName(source),
+                GetTypeName(type), id, count, message);
+}
+
+
+void
+GLDebugOutput::SetSeverityEnabled(GLenum severity, bool enabled)
+{
+  if (khr_debug_)
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, severity, 0, nullptr,
+                          enabled ? GL_TRUE : GL_FALSE);
+  else
+    glDebugMessageControlARB(GL_DONT_CARE, GL_DONT_CARE, severity, 0, nullptr,
+                             enabled ? GL_TRUE : GL_FALSE);
+}
+
+
+void
+GLDebugOutput::SetSourceEnabled(GLenum source, bool enabled)
+{
+  if (khr_debug_)
+    glDebugMessageControl(source, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr,
+                          enabled ? GL_TRUE : GL_FALSE);
+  else
+    glDebugMessageControlARB(source, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr,
+                             enabled ? GL_TRUE : GL_FALSE);
+}
+
+}  // namespace olio
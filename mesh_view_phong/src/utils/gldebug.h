@@ -0,0 +1,77 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       gldebug.h
+//! \brief      Driver debug messages (KHR_debug/ARB_debug_output)
+//!             routed to spdlog, in place of polling glGetError
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <GL/glew.h>
+#include "types.h"
+
+namespace olio {
+
+//! \class GLDebugOutput
+//! \brief Installs a debug message callback that logs the driver's
+//!        messages with spdlog. Messages below a severity, and
+//!        shader compiler messages (GLShader prints the logs itself),
+//!        are filtered out by the driver. Repeats of a message are
+//!        only counted, and logged again at 10, 100, 1000, ...
+//!        occurrences. By default messages are asynchronous, i.e.,
+//!        free for the render thread, but may arrive on another thread
+//!        after the gl call that caused them.
+class GLDebugOutput {
+public:
+  struct Options {
+    //! lowest severity logged: GL_DEBUG_SEVERITY_HIGH, _MEDIUM, _LOW or
+    //! _NOTIFICATION (KHR_debug only)
+    GLenum min_severity{GL_DEBUG_SEVERITY_MEDIUM};
+    bool shader_compiler{false};  //!< log shader compiler messages
+    bool synchronous{false};      //!< report from within the gl call
+  };
+
+  //! \brief Constructor. Must be called with a current GL context;
+  //!        does nothing if it supports neither extension (check with
+  //!        IsSupported). Most drivers only send all messages to debug
+  //!        contexts (GLFW_OPENGL_DEBUG_CONTEXT).
+  explicit GLDebugOutput(const Options &options);
+  GLDebugOutput(const GLDebugOutput &) = delete;
+  GLDebugOutput& operator=(const GLDebugOutput &) = delete;
+  ~GLDebugOutput();
+
+  bool IsSupported() const {return supported_;}
+
+  //! \brief Log the number of messages received and suppressed
+  void PrintStats() const;
+
+  //! \brief Severity from its name (high, medium, low, notification)
+  //! \return false if the name is invalid
+  static bool ParseSeverity(const std::string &name, GLenum &severity);
+protected:
+  static void GLAPIENTRY Callback(GLenum source, GLenum type, GLuint id,
+                                  GLenum severity, GLsizei length,
+                                  const GLchar *message, const void *user_param);
+  void Report(GLenum source, GLenum type, GLuint id, GLenum severity,
+              const std::string &message);
+  void SetSeverityEnabled(GLenum severity, bool enabled);
+  void SetSourceEnabled(GLenum source, bool enabled);
+
+  Options options_;
+  bool supported_{false};
+  bool khr_debug_{false};     //!< KHR_debug (else ARB_debug_output)
+  mutable std::mutex mutex_;  //!< messages may arrive on driver threads
+  std::unordered_map<std::string, size_t> message_counts_;
+  size_t message_count_{0};
+  size_t suppressed_count_{0};
+};
+
+}  // namespace olio
@@ -14,11 +14,13 @@
 
 #include <string>
 #include <memory>
+#include <GL/glew.h>
 
 namespace olio {
 
 class Light;
 class Material;
+class GLShader;
 
 class GLDrawData {
 public:
@@ -32,18 +34,47 @@ public:
       {lights_ = lights;}
   inline void SetMaterial(std::shared_ptr<Material> material)
       {material_ = material;}
+  //! shader to draw with instead of the material's shader (e.g., a
+  //! specialized shader variant); cleared when set to nullptr
+  inline void SetGLShader(std::shared_ptr<GLShader> shader)
+      {glshader_ = shader;}
+  //! draw from the position-only vertex stream (depth pre-pass)
+  inline void SetPositionsOnly(bool positions_only)
+      {positions_only_ = positions_only;}
+  inline void SetDepthFunc(GLenum depth_func) {depth_func_ = depth_func;}
+  //! range of a uniform buffer holding this draw's ObjectBlock
+  //! (mv/normal matrices); when set, shaders read the transforms from
+  //! the buffer instead of per-draw uniforms
+  inline void SetObjectBlock(GLuint buffer, GLintptr offset, GLsizeiptr size)
+      {object_block_buffer_ = buffer; object_block_offset_ = offset;
+       object_block_size_ = size;}
   inline glm::mat4 GetModelMatrix() const {return model_matrix_;}
   inline glm::mat4 GetViewMatrix() const {return view_matrix_;}
   inline glm::mat4 GetProjectionMatrix() const {return projection_matrix_;}
   inline void GetLights(std::vector<std::shared_ptr<Light>> &lights) const
       {lights=lights_;}
+  inline const std::vector<std::shared_ptr<Light>>& GetLights() const
+      {return lights_;}
   inline std::shared_ptr<Material> GetMaterial() const {return material_;}
+  inline std::shared_ptr<GLShader> GetGLShader() const {return glshader_;}
+  inline bool GetPositionsOnly() const {return positions_only_;}
+  inline GLenum GetDepthFunc() const {return depth_func_;}
+  inline bool HasObjectBlock() const {return object_block_buffer_ != 0;}
+  inline GLuint GetObjectBlockBuffer() const {return object_block_buffer_;}
+  inline GLintptr GetObjectBlockOffset() const {return object_block_offset_;}
+  inline GLsizeiptr GetObjectBlockSize() const {return object_block_size_;}
 protected:
   glm::mat4 model_matrix_{1.0f};
   glm::mat4 view_matrix_{1.0f};
   glm::mat4 projection_matrix_{1.0f};
   std::vector<std::shared_ptr<Light>> lights_;
   std::shared_ptr<Material> material_;
+  std::shared_ptr<GLShader> glshader_;
+  bool positions_only_{false};
+  GLenum depth_func_{GL_LEQUAL};
+  GLuint object_block_buffer_{0};
+  GLintptr object_block_offset_{0};
+  GLsizeiptr object_block_size_{0};
 };
 
 
@@ -0,0 +1,108 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       glquery.cc
+//! \brief      Ring of GL query objects whose results are read back a
+//!             few frames late, so measuring never stalls the pipeline
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/glquery.h"
+
+namespace olio {
+
+using namespace std;
+
+GLQueryRing::GLQueryRing(GLenum target, size_t size) :
+  target_{target}
+{
+  supported_ = size > 0 && (target != GL_TIME_ELAPSED || GLEW_ARB_timer_query);
+  if (!supported_)
+    return;
+  queries_.resize(size, 0);
+  tags_.resize(size, 0);
+  glGenQueries(static_cast<GLsizei>(size), queries_.data());
+}
+
+
+GLQueryRing::~GLQueryRing()
+{
+  if (!queries_.empty())
+    glDeleteQueries(static_cast<GLsizei>(queries_.size()), queries_.data());
+}
+
+
+void
+GLQueryRing::Begin(int tag)
+{
+  if (!supported_ || active_)
+    return;
+  if (pending_ == queries_.size())
+    Resolve();
+  tags_[next_] = tag;
+  glBeginQuery(target_, queries_[next_]);
+  active_ = true;
+}
+
+
+void
+GLQueryRing::End()
+{
+  if (!active_)
+    return;
+  glEndQuery(target_);
+  next_ = (next_ + 1) % queries_.size();
+  ++pending_;
+  active_ = false;
+}
+
+
+bool
+GLQueryRing::Collect(uint64_t &value, int *tag)
+{
+  while (pending_ && results_.size() < queries_.size()) {
+    auto oldest = (next_ + queries_.size() - pending_) % queries_.size();
+    GLuint available = 0;
+    glGetQueryObjectuiv(queries_[oldest], GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+      break;
+    Resolve();
+  }
+  if (results_.empty())
+    return false;
+  value = results_.front().first;
+  if (tag)
+    *tag = results_.front().second;
+  results_.pop_front();
+  return true;
+}
+
+
+void
+GLQueryRing::Resolve()
+{
+  // read back the oldest query. GL_QUERY_RESULT blocks until the result
+  // is ready; callers that don't want to wait check availability first
+  if (!pending_)
+    return;
+  auto oldest = (next_ + queries_.size() - pending_) % queries_.size();
+  uint64_t value = 0;
+  if (GLEW_ARB_timer_query) {
+    GLuint64 value64 = 0;
+    glGetQueryObjectui64v(queries_[oldest], GL_QUERY_RESULT, &value64);
+    value = value64;
+  } else {
+    GLuint value32 = 0;
+    glGetQueryObjectuiv(queries_[oldest], GL_QUERY_RESULT, &value32);
+    value = value32;
+  }
+  --pending_;
+  results_.emplace_back(value, tags_[oldest]);
+  if (results_.size() > queries_.size())
+    results_.pop_front();
+}
+
+}  // namespace olio
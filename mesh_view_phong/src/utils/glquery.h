@@ -0,0 +1,66 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       glquery.h
+//! \brief      Ring of GL query objects whose results are read back a
+//!             few frames late, so measuring never stalls the pipeline
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <deque>
+#include <utility>
+#include <vector>
+#include <cstdint>
+#include <GL/glew.h>
+#include "types.h"
+
+namespace olio {
+
+//! \class GLQueryRing
+//! \brief Ring of GL query objects for one query target
+//!        (GL_SAMPLES_PASSED, GL_TIME_ELAPSED, ...)
+class GLQueryRing {
+public:
+  //! \brief Constructor. Must be called with a current GL context.
+  //! \param[in] target query target
+  //! \param[in] size number of queries in flight
+  explicit GLQueryRing(GLenum target, size_t size=4);
+  GLQueryRing(const GLQueryRing &) = delete;
+  GLQueryRing& operator=(const GLQueryRing &) = delete;
+  ~GLQueryRing();
+
+  //! \brief Whether the query target is supported by the context
+  bool IsSupported() const {return supported_;}
+
+  //! \brief Start a new query. If all queries are still in flight,
+  //!        the oldest one is resolved first (blocking).
+  //! \param[in] tag user value returned along with the query's result
+  void Begin(int tag=0);
+
+  //! \brief End the current query
+  void End();
+
+  //! \brief Fetch the oldest finished query result, without blocking
+  //! \param[out] value query result (nanoseconds for GL_TIME_ELAPSED)
+  //! \param[out] tag tag passed to Begin for this query (optional)
+  //! \return true if a result was available
+  bool Collect(uint64_t &value, int *tag=nullptr);
+protected:
+  void Resolve();
+
+  GLenum target_;
+  bool supported_{false};
+  bool active_{false};
+  std::vector<GLuint> queries_;
+  std::vector<int> tags_;
+  size_t next_{0};             //!< next query to issue
+  size_t pending_{0};          //!< number of queries in flight
+  std::deque<std::pair<uint64_t, int>> results_;
+};
+
+}  // namespace olio
@@ -0,0 +1,286 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       glrenderqueue.cc
+//! \brief      Render queue of POD draw packets with 64-bit sort keys,
+//!             radix sorted and submitted in one tight loop
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/glrenderqueue.h"
+#include <array>
+#include <cstring>
+#include <algorithm>
+#include <glm/ext.hpp>
+#include "utils/utils.h"
+#include "utils/glshader.h"
+#include "utils/glstate.h"
+#include "utils/light.h"
+#include "utils/material.h"
+
+namespace olio {
+
+using namespace std;
+
+// sort key fields (bit counts), most significant first
+static constexpr uint kLayerBits = 4;
+static constexpr uint kShaderBits = 10;
+static constexpr uint kMaterialBits = 12;
+static constexpr uint kDepthBits = 24;
+static constexpr uint kGeometryBits = 14;
+static_assert(kLayerBits + kShaderBits + kMaterialBits + kDepthBits + kGeometryBits == 64,
+              "sort key fields must fill 64 bits");
+
+static constexpr uint32_t kNoMaterial = ~uint32_t{0};
+
+uint64_t
+GLRenderQueue::MakeKey(uint layer, uint32_t shader, uint32_t material,
+                       float view_depth, uint32_t geometry)
+{
+  auto Clamp = [](uint64_t value, uint bits) {
+    return std::min(value, (uint64_t{1} << bits) - 1);
+  };
+
+  // non-negative floats order like their bit patterns: the top bits
+  // are a quantized depth that needs no near/far range
+  uint32_t depth_bits = 0;
+  if (view_depth > 0)
+    memcpy(&depth_bits, &view_depth, sizeof(depth_bits));
+  uint64_t depth = depth_bits >> (32 - kDepthBits);
+
+  uint64_t key = Clamp(layer, kLayerBits);
+  key = (key << kShaderBits) | Clamp(shader, kShaderBits);
+  key = (key << kMaterialBits) | Clamp(material, kMaterialBits);
+  key = (key << kDepthBits) | depth;
+  key = (key << kGeometryBits) | (geometry & ((1u << kGeometryBits) - 1));
+  return key;
+}
+
+
+void
+GLRenderQueue::Begin(const GLDrawData &pass_data)
+{
+  pass_data_ = pass_data;
+  packets_.clear();
+  shaders_.clear();
+  materials_.clear();
+  geometries_.clear();
+  transforms_.clear();
+}
+
+
+void
+GLRenderQueue::Add(uint layer, const shared_ptr<GLShader> &shader,
+                   const shared_ptr<Material> &material, const GLDrawGeometry &geometry,
+                   const glm::mat4 &model_matrix, GLintptr object_offset, float view_depth)
+{
+  auto positions_only = pass_data_.GetPositionsOnly();
+  if (!shader || !shader->GetProgramID() || !geometry.index_count || !geometry.index_buffer)
+    return;
+  if (positions_only ? !geometry.positions_buffer : (!geometry.vertex_buffer || !material))
+    return;
+
+  GLDrawPacket packet;
+  packet.shader = GetShaderIndex(shader);
+  packet.material = positions_only ? 0 : GetMaterialIndex(material);
+  packet.geometry = static_cast<uint32_t>(geometries_.size());
+  geometries_.push_back(geometry);
+  packet.transform = static_cast<uint32_t>(transforms_.size());
+  transforms_.push_back(Transform{model_matrix, object_offset});
+  packet.key = MakeKey(layer, packet.shader, packet.material, view_depth,
+                       positions_only ? geometry.positions_buffer : geometry.vertex_buffer);
+  packets_.push_back(packet);
+}
+
+
+void
+GLRenderQueue::Submit()
+{
+  stats_ = Stats{};
+  if (packets_.empty())
+    return;
+  SortPackets();
+
+  GLState::Get().SetEnabled(GL_DEPTH_TEST, true);
+  GLState::Get().DepthFunc(pass_data_.GetDepthFunc());
+  auto positions_only = pass_data_.GetPositionsOnly();
+  auto object_block = pass_data_.HasObjectBlock();
+  auto view_matrix = pass_data_.GetViewMatrix();
+  const auto &lights = pass_data_.GetLights();
+
+  const ShaderEntry *shader = nullptr;
+  const GLDrawGeometry *geometry = nullptr;
+  auto material = kNoMaterial;
+  bool shader_valid = false, material_valid = positions_only;
+  for (const auto &packet : packets_) {
+    // program (and lights) once per shader, material once per group
+    const auto &shader_entry = shaders_[packet.shader];
+    if (&shader_entry != shader) {
+      shader = &shader_entry;
+      geometry = nullptr;
+      material = kNoMaterial;
+      shader_valid = UseShader(shader_entry) &&
+        (positions_only || shader_entry.shader->SetLights(view_matrix, lights));
+      ++stats_.program_changes;
+    }
+    if (!positions_only && packet.material != material) {
+      material = packet.material;
+      material_valid = shader_valid &&
+        shader_entry.shader->SetMaterial(materials_[packet.material]);
+      ++stats_.material_changes;
+    }
+    if (!shader_valid || !material_valid)
+      continue;
+
+    // transforms
+    const auto &transform = transforms_[packet.transform];
+    if (object_block) {
+      GLState::Get().BindBufferRange(GL_UNIFORM_BUFFER, GLShader::kObjectBlockBinding,
+                                     pass_data_.GetObjectBlockBuffer(),
+                                     transform.object_offset,
+                                     pass_data_.GetObjectBlockSize());
+    } else {
+      glm::mat4 mv_matrix = view_matrix * transform.model_matrix;
+      glUniformMatrix4fv(shader_entry.mv_matrix, 1, GL_FALSE, glm::value_ptr(mv_matrix));
+      if (shader_entry.norm_matrix >= 0) {
+        glm::mat4 norm_matrix = glm::transpose(glm::inverse(mv_matrix));
+        glUniformMatrix4fv(shader_entry.norm_matrix, 1, GL_FALSE,
+                           glm::value_ptr(norm_matrix));
+      }
+    }
+
+    // vertex and index buffers
+    const auto &draw_geometry = geometries_[packet.geometry];
+    if (!geometry || geometry->vertex_buffer != draw_geometry.vertex_buffer ||
+        geometry->positions_buffer != draw_geometry.positions_buffer ||
+        geometry->index_buffer != draw_geometry.index_buffer) {
+      BindGeometry(shader_entry, draw_geometry);
+      geometry = &draw_geometry;
+      ++stats_.geometry_changes;
+    }
+    glDrawElements(GL_TRIANGLES, draw_geometry.index_count, GL_UNSIGNED_INT, nullptr);
+    ++stats_.draws;
+  }
+  CheckOpenGLError();
+}
+
+
+uint32_t
+GLRenderQueue::GetShaderIndex(const shared_ptr<GLShader> &shader)
+{
+  // passes use a handful of variants: a linear search is enough
+  for (size_t i = 0; i < shaders_.size(); ++i)
+    if (shaders_[i].shader == shader)
+      return static_cast<uint32_t>(i);
+
+  ShaderEntry entry;
+  entry.shader = shader;
+  entry.program = shader->GetProgramID();
+  entry.position = glGetAttribLocation(entry.program, "position");
+  entry.normal = glGetAttribLocation(entry.program, "normal");
+  entry.texcoord = glGetAttribLocation(entry.program, "texcoord");
+  entry.ambient_occlusion = glGetAttribLocation(entry.program, "ambient_occlusion");
+  entry.mv_matrix = glGetUniformLocation(entry.program, "mv_matrix");
+  entry.norm_matrix = glGetUniformLocation(entry.program, "norm_matrix");
+  entry.proj_matrix = glGetUniformLocation(entry.program, "proj_matrix");
+  shaders_.push_back(entry);
+  return static_cast<uint32_t>(shaders_.size() - 1);
+}
+
+
+uint32_t
+GLRenderQueue::GetMaterialIndex(const shared_ptr<Material> &material)
+{
+  for (size_t i = 0; i < materials_.size(); ++i)
+    if (materials_[i] == material)
+      return static_cast<uint32_t>(i);
+  materials_.push_back(material);
+  return static_cast<uint32_t>(materials_.size() - 1);
+}
+
+
+void
+GLRenderQueue::SortPackets()
+{
+  // LSD radix sort on 8-bit digits (stable), skipping digits that all
+  // keys share -- with few layers/shaders/materials most high digits
+  // are skipped
+  auto count = packets_.size();
+  sort_buffer_.resize(count);
+  auto *src = packets_.data();
+  auto *dst = sort_buffer_.data();
+  for (uint shift = 0; shift < 64; shift += 8) {
+    array<size_t, 256> offsets;
+    offsets.fill(0);
+    for (size_t i = 0; i < count; ++i)
+      ++offsets[(src[i].key >> shift) & 0xff];
+    if (offsets[(src[0].key >> shift) & 0xff] == count)
+      continue;
+    size_t offset = 0;
+    for (auto &digit_offset : offsets) {
+      auto digit_count = digit_offset;
+      digit_offset = offset;
+      offset += digit_count;
+    }
+    for (size_t i = 0; i < count; ++i)
+      dst[offsets[(src[i].key >> shift) & 0xff]++] = src[i];
+    swap(src, dst);
+  }
+  if (src != packets_.data())
+    packets_.swap(sort_buffer_);
+}
+
+
+bool
+GLRenderQueue::UseShader(const ShaderEntry &entry)
+{
+  if (!entry.program)
+    return false;
+  GLState::Get().UseProgram(entry.program);
+  if (!pass_data_.HasObjectBlock() && entry.proj_matrix >= 0) {
+    auto proj_matrix = pass_data_.GetProjectionMatrix();
+    glUniformMatrix4fv(entry.proj_matrix, 1, GL_FALSE, glm::value_ptr(proj_matrix));
+  }
+  return true;
+}
+
+
+void
+GLRenderQueue::BindGeometry(const ShaderEntry &entry, const GLDrawGeometry &geometry)
+{
+  auto EnableAttribute = [](GLint location, GLint size, GLsizei stride, size_t offset) {
+    if (location < 0)
+      return;
+    glVertexAttribPointer(static_cast<GLuint>(location), size, GL_FLOAT, GL_FALSE,
+                          stride, reinterpret_cast<void*>(offset));
+    glEnableVertexAttribArray(static_cast<GLuint>(location));
+  };
+
+  if (pass_data_.GetPositionsOnly()) {
+    GLState::Get().BindBuffer(GL_ARRAY_BUFFER, geometry.positions_buffer);
+    EnableAttribute(entry.position, 3, 3 * sizeof(GLfloat), 0);
+  } else {
+    GLState::Get().BindBuffer(GL_ARRAY_BUFFER, geometry.vertex_buffer);
+    EnableAttribute(entry.position, 3, geometry.vertex_stride, 0);
+    EnableAttribute(entry.normal, 3, geometry.vertex_stride, 3 * sizeof(GLfloat));
+    if (geometry.has_texcoords)
+      EnableAttribute(entry.texcoord, 2, geometry.vertex_stride, 6 * sizeof(GLfloat));
+
+    // unoccluded if ambient occlusion hasn't been baked
+    if (entry.ambient_occlusion >= 0) {
+      if (geometry.ao_buffer) {
+        GLState::Get().BindBuffer(GL_ARRAY_BUFFER, geometry.ao_buffer);
+        EnableAttribute(entry.ambient_occlusion, 1, sizeof(GLfloat), 0);
+      } else {
+        glDisableVertexAttribArray(static_cast<GLuint>(entry.ambient_occlusion));
+        glVertexAttrib1f(static_cast<GLuint>(entry.ambient_occlusion), 1.0f);
+      }
+    }
+  }
+  GLState::Get().BindBuffer(GL_ELEMENT_ARRAY_BUFFER, geometry.index_buffer);
+}
+
+}  // namespace olio
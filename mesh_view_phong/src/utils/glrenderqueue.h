@@ -0,0 +1,150 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       glrenderqueue.h
+//! \brief      Render queue of POD draw packets with 64-bit sort keys,
+//!             radix sorted and submitted in one tight loop
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include <type_traits>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "types.h"
+#include "utils/gldrawdata.h"
+
+namespace olio {
+
+class GLShader;
+class Material;
+
+//! \struct GLDrawGeometry
+//! \brief GL buffers of an indexed triangle mesh, i.e., everything the
+//!        queue needs to draw it without calling back into the mesh
+struct GLDrawGeometry {
+  GLuint vertex_buffer{0};     //!< interleaved position/normal(/texcoord)
+  GLuint positions_buffer{0};  //!< tightly packed positions (depth only)
+  GLuint ao_buffer{0};         //!< per-vertex ambient occlusion (optional)
+  GLuint index_buffer{0};
+  GLsizei index_count{0};
+  GLsizei vertex_stride{0};    //!< bytes per vertex in vertex_buffer
+  bool has_texcoords{false};
+};
+
+
+//! \struct GLDrawPacket
+//! \brief One recorded draw. Shader, material, geometry and transform
+//!        are indices into the queue's per-pass tables
+struct GLDrawPacket {
+  uint64_t key;
+  uint32_t shader;
+  uint32_t material;
+  uint32_t geometry;
+  uint32_t transform;
+};
+static_assert(std::is_pod<GLDrawPacket>::value, "GLDrawPacket must be POD");
+
+
+//! \class GLRenderQueue
+//! \brief Draws of one pass, recorded as packets and sorted by a
+//!        64-bit key (most significant first):
+//!
+//!          layer (4) | shader (10) | material (12) | depth (24) | geometry (14)
+//!
+//!        so each layer is drawn with as few program and material
+//!        changes as possible, and front-to-back within a material for
+//!        early depth rejection. Depth comes before geometry because
+//!        meshes are single draws: ordering by buffer would only undo
+//!        the depth order (the geometry field is the vertex buffer id,
+//!        standing in for a VAO). Shader and material ids that don't
+//!        fit share their field's last value and buffer ids wrap,
+//!        which only costs ordering, not correctness.
+//!        Submit issues the packets with gl calls only; uniform and
+//!        attribute locations are looked up once per program.
+class GLRenderQueue {
+public:
+  //! \brief State changes of the last Submit
+  struct Stats {
+    size_t draws{0};
+    size_t program_changes{0};
+    size_t material_changes{0};
+    size_t geometry_changes{0};
+
+    size_t GetStateChanges() const {
+      return program_changes + material_changes + geometry_changes;
+    }
+  };
+
+  //! \brief Start recording a pass, dropping the previous one
+  //! \param[in] pass_data view/projection matrices, lights, depth
+  //!                      function and vertex stream (positions only or
+  //!                      not) shared by all draws. If it has an object
+  //!                      block buffer, draws read their transforms
+  //!                      from it.
+  void Begin(const GLDrawData &pass_data);
+
+  //! \brief Record a draw
+  //! \param[in] layer draw layer (0-15; lower layers are drawn first)
+  //! \param[in] shader shader variant
+  //! \param[in] material material (ignored in positions-only passes)
+  //! \param[in] geometry mesh buffers
+  //! \param[in] model_matrix model matrix
+  //! \param[in] object_offset offset of the draw's ObjectBlock in the
+  //!                          pass's object block buffer
+  //! \param[in] view_depth view space distance used for front-to-back
+  //!                       ordering (e.g., of the bounding box center)
+  void Add(uint layer, const std::shared_ptr<GLShader> &shader,
+           const std::shared_ptr<Material> &material, const GLDrawGeometry &geometry,
+           const glm::mat4 &model_matrix, GLintptr object_offset, float view_depth);
+
+  //! \brief Sort the recorded packets and draw them
+  void Submit();
+
+  size_t GetPacketCount() const {return packets_.size();}
+  Stats GetStats() const {return stats_;}
+
+  //! \brief Build a sort key
+  static uint64_t MakeKey(uint layer, uint32_t shader, uint32_t material,
+                          float view_depth, uint32_t geometry);
+protected:
+  struct ShaderEntry {
+    std::shared_ptr<GLShader> shader;
+    GLuint program{0};
+    GLint position{-1};          //!< attribute locations
+    GLint normal{-1};
+    GLint texcoord{-1};
+    GLint ambient_occlusion{-1};
+    GLint mv_matrix{-1};         //!< uniform locations
+    GLint norm_matrix{-1};
+    GLint proj_matrix{-1};
+  };
+  struct Transform {
+    glm::mat4 model_matrix;
+    GLintptr object_offset;
+  };
+
+  uint32_t GetShaderIndex(const std::shared_ptr<GLShader> &shader);
+  uint32_t GetMaterialIndex(const std::shared_ptr<Material> &material);
+  void SortPackets();
+  bool UseShader(const ShaderEntry &entry);
+  void BindGeometry(const ShaderEntry &entry, const GLDrawGeometry &geometry);
+
+  GLDrawData pass_data_;
+  std::vector<GLDrawPacket> packets_;
+  std::vector<GLDrawPacket> sort_buffer_;
+  std::vector<ShaderEntry> shaders_;
+  std::vector<std::shared_ptr<Material>> materials_;
+  std::vector<GLDrawGeometry> geometries_;
+  std::vector<Transform> transforms_;
+  Stats stats_;
+};
+
+}  // namespace olio
@@ -19,6 +19,8 @@
 #include "utils/gldrawdata.h"
 #include "utils/light.h"
 #include "utils/material.h"
+#include "utils/gltexture.h"
+#include "utils/glstate.h"
 
 namespace olio {
 
@@ -49,9 +51,7 @@ GLShader::ReadTextFile(const fs::path &file_path, std::string &content)
 
 GLShader::~GLShader()
 {
-  glUseProgram(0);
-  if (program_id_)
-    glDeleteProgram(program_id_);
+  GLState::Get().DeleteProgram(program_id_);
 }
 
 
@@ -87,9 +87,51 @@ GLShader::PrintProgramLog(GLuint prog)
 }
 
 
+//! \brief Insert a "#define" line for each entry in defines right
+//!        after the shader's #version directive (which must remain the
+//!        first statement in the source)
+//! \param[in] source shader source
+//! \param[in] defines macros to define, e.g. "POINT_LIGHT_COUNT 3"
+//! \return shader source with the macros defined
+std::string
+GLShader::InjectDefines(const std::string &source,
+                        const std::vector<std::string> &defines)
+{
+  if (defines.empty())
+    return source;
+
+  string define_block;
+  for (const auto &define : defines)
+    define_block += "#define " + define + "\n";
+
+  // insert the defines after the #version line, if any
+  size_t insert_pos = 0;
+  auto version_pos = source.find("#version");
+  if (version_pos != string::npos) {
+    auto eol = source.find('\n', version_pos);
+    insert_pos = eol == string::npos ? source.size() : eol + 1;
+  }
+  auto result = source.substr(0, insert_pos);
+  if (insert_pos == source.size() && (result.empty() || result.back() != '\n'))
+    result += '\n';
+  result += define_block;
+  result += source.substr(insert_pos);
+  return result;
+}
+
+
 GLuint
 GLShader::LoadShaders(const fs::path &vertex_shader_path,
                       const fs::path &fragment_shader_path)
+{
+  return LoadShaders(vertex_shader_path, fragment_shader_path, {});
+}
+
+
+GLuint
+GLShader::LoadShaders(const fs::path &vertex_shader_path,
+                      const fs::path &fragment_shader_path,
+                      const std::vector<std::string> &defines)
 {
   // read vertex shader
   string vert_shader_src;
@@ -107,6 +149,10 @@ GLShader::LoadShaders(const fs::path &vertex_shader_path,
     return 0;
   }
 
+  // specialize shaders
+  vert_shader_src = InjectDefines(vert_shader_src, defines);
+  frag_shader_src = InjectDefines(frag_shader_src, defines);
+
   // create shaders
   auto vert_shader = glCreateShader(GL_VERTEX_SHADER);
   auto frag_shader = glCreateShader(GL_FRAGMENT_SHADER);
@@ -127,9 +173,7 @@ GLShader::LoadShaders(const fs::path &vertex_shader_path,
     PrintShaderLog(frag_shader);
 
   // delete existing program
-  glUseProgram(0);
-  if (program_id_)
-    glDeleteProgram(program_id_);
+  GLState::Get().DeleteProgram(program_id_);
 
   // create rendering program
   program_id_ = glCreateProgram();
@@ -142,6 +186,14 @@ GLShader::LoadShaders(const fs::path &vertex_shader_path,
   glGetProgramiv(program_id_, GL_LINK_STATUS, &linked);
   if (linked != 1)
     PrintProgramLog(program_id_);
+
+  // bind uniform blocks (if used by the shaders) to fixed binding points
+  auto frame_block_index = glGetUniformBlockIndex(program_id_, "FrameBlock");
+  if (frame_block_index != GL_INVALID_INDEX)
+    glUniformBlockBinding(program_id_, frame_block_index, kFrameBlockBinding);
+  auto object_block_index = glGetUniformBlockIndex(program_id_, "ObjectBlock");
+  if (object_block_index != GL_INVALID_INDEX)
+    glUniformBlockBinding(program_id_, object_block_index, kObjectBlockBinding);
   glDeleteShader(vert_shader);
   glDeleteShader(frag_shader);
   return program_id_;
@@ -153,11 +205,25 @@ GLShader::Use() const
 {
   if (!program_id_)
     return false;
-  glUseProgram(program_id_);
+  GLState::Get().UseProgram(program_id_);
   return true;
 }
 
 
+MemoryStats
+GLShader::GetMemoryStats() const
+{
+  MemoryStats stats;
+  if (!program_id_ || !GLEW_ARB_get_program_binary)
+    return stats;
+  GLint binary_length = 0;
+  glGetProgramiv(program_id_, GL_PROGRAM_BINARY_LENGTH, &binary_length);
+  if (binary_length > 0)
+    stats.gpu_bytes = static_cast<size_t>(binary_length);
+  return stats;
+}
+
+
 bool
 GLShader::SetUniformFloat(const std::string &name, GLfloat value) const
 {
@@ -316,6 +382,26 @@ GLShader::SetMVPMatrices(const glm::mat4 &model_matrix,
 }
 
 
+bool
+GLShader::SetTransforms(const GLDrawData &draw_data) const
+{
+  if (!program_id_)
+    return false;
+
+  // transforms were streamed into a uniform buffer: just point the
+  // ObjectBlock at this draw's range
+  if (draw_data.HasObjectBlock()) {
+    GLState::Get().BindBufferRange(GL_UNIFORM_BUFFER, kObjectBlockBinding,
+                                   draw_data.GetObjectBlockBuffer(),
+                                   draw_data.GetObjectBlockOffset(),
+                                   draw_data.GetObjectBlockSize());
+    return true;
+  }
+  return SetMVPMatrices(draw_data.GetModelMatrix(), draw_data.GetViewMatrix(),
+                        draw_data.GetProjectionMatrix());
+}
+
+
 bool
 GLShader::SetupUniforms(const GLDrawData &draw_data) const
 {
@@ -323,14 +409,11 @@ GLShader::SetupUniforms(const GLDrawData &draw_data) const
     return false;
 
   // set MVP matrices
-  if (!SetMVPMatrices(draw_data.GetModelMatrix(), draw_data.GetViewMatrix(),
-                      draw_data.GetProjectionMatrix()) || CheckOpenGLError())
+  if (!SetTransforms(draw_data))
     return false;
 
   // set lights
-  vector<Light::Ptr> lights;
-  draw_data.GetLights(lights);
-  if (!SetLights(draw_data.GetViewMatrix(), lights) || CheckOpenGLError())
+  if (!SetLights(draw_data.GetViewMatrix(), draw_data.GetLights()))
     return false;
 
   // set material
@@ -415,6 +498,12 @@ GLPhongShader::SetMaterial(Material::Ptr material) const
   SetUniformVec3("material.specular", phong_material->GetSpecular());
   SetUniformFloat("material.shininess",
                   static_cast<GLfloat>(phong_material->GetShininess()));
+
+  // diffuse map on texture unit 0 (variants without HAS_DIFFUSE_MAP
+  // have no diffuse_map uniform)
+  auto diffuse_map = phong_material->GetDiffuseMap();
+  if (diffuse_map && diffuse_map->Bind(0))
+    SetUniformInt("diffuse_map", 0);
   return true;
 }
 
@@ -14,10 +14,12 @@
 
 #include <string>
 #include <memory>
+#include <vector>
 #include <boost/filesystem.hpp>
 #include <GL/glew.h>
 #include <glm/glm.hpp>
 #include "types.h"
+#include "utils/memory_stats.h"
 
 namespace olio {
 
@@ -25,11 +27,28 @@ class GLDrawData;
 class Light;
 class Material;
 
+//! \brief std140 layout of the FrameBlock uniform block
+struct GLFrameBlock {
+  glm::mat4 proj_matrix;
+  glm::mat4 view_matrix;
+};
+
+//! \brief std140 layout of the ObjectBlock uniform block
+struct GLObjectBlock {
+  glm::mat4 mv_matrix;
+  glm::mat4 norm_matrix;
+};
+
 class GLShader {
 public:
   using Ptr = std::shared_ptr<GLShader>;
   using WeakPtr = std::weak_ptr<GLShader>;
 
+  // uniform buffer binding points of the FrameBlock (per-frame
+  // matrices) and ObjectBlock (per-draw matrices) uniform blocks
+  static constexpr GLuint kFrameBlockBinding = 0;
+  static constexpr GLuint kObjectBlockBinding = 1;
+
   GLShader() = default;
   GLShader(const GLShader &) = delete;
   GLShader(GLShader &&) = delete;
@@ -41,18 +60,29 @@ public:
                            std::string &content);
   static void PrintShaderLog(GLuint shader);
   static void PrintProgramLog(GLuint prog);
+  static std::string InjectDefines(const std::string &source,
+                                   const std::vector<std::string> &defines);
   virtual GLuint LoadShaders(const boost::filesystem::path &vertex_shader_path,
                            const boost::filesystem::path &fragment_shader_path);
+  virtual GLuint LoadShaders(const boost::filesystem::path &vertex_shader_path,
+                             const boost::filesystem::path &fragment_shader_path,
+                             const std::vector<std::string> &defines);
   virtual bool Use() const;
   virtual inline void SetProgramID(GLuint id) {program_id_ = id;}
   virtual inline GLuint GetProgramID() const {return program_id_;}
 
+  //! \brief GPU memory held by the linked program. Estimated from the
+  //!        program binary size (needs ARB_get_program_binary, 0
+  //!        otherwise)
+  virtual MemoryStats GetMemoryStats() const;
+
   virtual bool SetMVPMatrices(const Mat4r &model_matrix,
                               const Mat4r &view_matrix,
                               const Mat4r &proj_matrix) const;
   virtual bool SetMVPMatrices(const glm::mat4 &model_matrix,
                               const glm::mat4 &view_matrix,
                               const glm::mat4 &proj_matrix) const;
+  virtual bool SetTransforms(const GLDrawData &draw_data) const;
   virtual bool SetupUniforms(const GLDrawData &draw_data) const;
   virtual bool SetLights(const glm::mat4 &view_matrix,
                          const std::vector<std::shared_ptr<Light>> &lights) const;
@@ -0,0 +1,184 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       glshader_permutations.cc
+//! \brief      Compile-time specialized shader variants, compiled lazily
+//!             and cached by key
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/glshader_permutations.h"
+#include <chrono>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace olio {
+
+using namespace std;
+namespace fs=boost::filesystem;
+
+// must match MAX_LIGHTS in the shaders
+static constexpr uint kMaxPointLights = 10;
+
+GLShaderKey
+GLShaderKey::Canonical() const
+{
+  auto key = *this;
+  key.point_light_count = std::min(point_light_count, kMaxPointLights);
+
+  // depth-only variants don't shade, so lights, texcoords, and shading
+  // model are irrelevant
+  if (vertex_format == VertexFormat::kPositionOnly) {
+    key.shading = Shading::kPhong;
+    key.point_light_count = 0;
+    key.has_texcoords = false;
+    key.has_vertex_ao = false;
+  }
+
+  // diffuse maps are sampled per fragment, from the texcoords
+  if (shading != Shading::kPhong || !key.has_texcoords)
+    key.has_diffuse_map = false;
+  return key;
+}
+
+
+std::vector<std::string>
+GLShaderKey::GetDefines() const
+{
+  vector<string> defines;
+  defines.push_back(fmt::format("POINT_LIGHT_COUNT {}", point_light_count));
+  if (has_texcoords)
+    defines.emplace_back("HAS_TEXCOORDS");
+  if (has_vertex_ao)
+    defines.emplace_back("HAS_VERTEX_AO");
+  if (has_diffuse_map)
+    defines.emplace_back("HAS_DIFFUSE_MAP");
+  if (vertex_format == VertexFormat::kPositionOnly)
+    defines.emplace_back("POSITION_ONLY");
+  if (uniform_blocks)
+    defines.emplace_back("USE_UNIFORM_BLOCKS");
+  return defines;
+}
+
+
+uint64_t
+GLShaderKey::Pack() const
+{
+  return (static_cast<uint64_t>(shading) << 0) |
+    (static_cast<uint64_t>(vertex_format) << 8) |
+    (static_cast<uint64_t>(has_texcoords) << 16) |
+    (static_cast<uint64_t>(uniform_blocks) << 17) |
+    (static_cast<uint64_t>(has_vertex_ao) << 18) |
+    (static_cast<uint64_t>(has_diffuse_map) << 19) |
+    (static_cast<uint64_t>(point_light_count) << 24);
+}
+
+
+std::string
+GLShaderKey::ToString() const
+{
+  return fmt::format("{}, lights: {}, texcoords: {}, ao: {}, diffuse map: {}, {}{}",
+                     shading == Shading::kPhong ? "phong" : "gouraud",
+                     point_light_count, has_texcoords ? "yes" : "no",
+                     has_vertex_ao ? "yes" : "no", has_diffuse_map ? "yes" : "no",
+                     vertex_format == VertexFormat::kPositionOnly ?
+                     "position-only" : "position-normal",
+                     uniform_blocks ? ", uniform blocks" : "");
+}
+
+
+// ======================================================================
+// GLShaderPermutations class
+GLShaderPermutations::GLShaderPermutations(ShaderFactory factory) :
+  factory_{factory}
+{
+  if (!factory_)
+    factory_ = [] {return make_shared<GLPhongShader>();};
+}
+
+
+void
+GLShaderPermutations::SetShaderSources(GLShaderKey::Shading shading,
+                                       const fs::path &vertex_shader_path,
+                                       const fs::path &fragment_shader_path)
+{
+  sources_[shading] = ShaderSources{vertex_shader_path, fragment_shader_path};
+
+  // variants compiled from the previous sources are stale
+  for (auto it = variants_.begin(); it != variants_.end();) {
+    if (it->first.shading == shading)
+      it = variants_.erase(it);
+    else
+      ++it;
+  }
+}
+
+
+GLShader::Ptr
+GLShaderPermutations::Get(const GLShaderKey &key)
+{
+  auto canonical_key = key.Canonical();
+  auto it = variants_.find(canonical_key);
+  if (it != variants_.end())
+    return it->second.shader;
+
+  auto sources_it = sources_.find(canonical_key.shading);
+  if (sources_it == sources_.end()) {
+    spdlog::error("GLShaderPermutations::Get: no shader sources for {}",
+                  canonical_key.ToString());
+    return nullptr;
+  }
+
+  // compile new variant
+  auto start_time = chrono::steady_clock::now();
+  auto shader = factory_();
+  const auto &sources = sources_it->second;
+  if (!shader || !shader->LoadShaders(sources.vertex_path, sources.fragment_path,
+                                      canonical_key.GetDefines())) {
+    spdlog::error("GLShaderPermutations::Get: failed to compile variant ({})",
+                  canonical_key.ToString());
+    return nullptr;
+  }
+  chrono::duration<double, milli> elapsed = chrono::steady_clock::now() - start_time;
+  variants_[canonical_key] = Variant{shader, elapsed.count()};
+  total_compile_ms_ += elapsed.count();
+  spdlog::info("compiled shader variant ({}) in {:.2f} ms -- {} variant(s), "
+               "{:.2f} ms total", canonical_key.ToString(), elapsed.count(),
+               variants_.size(), total_compile_ms_);
+  return shader;
+}
+
+
+void
+GLShaderPermutations::PrintStats() const
+{
+  spdlog::info("shader variants: {}, total compile time: {:.2f} ms",
+               variants_.size(), total_compile_ms_);
+  for (const auto &variant : variants_)
+    spdlog::info("  ({}): {:.2f} ms", variant.first.ToString(),
+                 variant.second.compile_ms);
+}
+
+
+MemoryStats
+GLShaderPermutations::GetMemoryStats() const
+{
+  MemoryStats stats;
+  for (const auto &variant : variants_)
+    if (variant.second.shader)
+      stats += variant.second.shader->GetMemoryStats();
+  return stats;
+}
+
+
+void
+GLShaderPermutations::Clear()
+{
+  variants_.clear();
+  total_compile_ms_ = 0;
+}
+
+}  // namespace olio
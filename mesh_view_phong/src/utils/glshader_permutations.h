@@ -0,0 +1,125 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       glshader_permutations.h
+//! \brief      Compile-time specialized shader variants, compiled lazily
+//!             and cached by key
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <map>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <memory>
+#include <functional>
+#include <boost/filesystem.hpp>
+#include "types.h"
+#include "utils/glshader.h"
+
+namespace olio {
+
+//! \class GLShaderKey
+//! \brief Options that are baked into a shader variant as #defines
+class GLShaderKey {
+public:
+  enum class Shading : uchar {
+    kPhong = 0,               //!< per-fragment lighting
+    kGouraud                  //!< per-vertex lighting
+  };
+  enum class VertexFormat : uchar {
+    kPositionNormal = 0,      //!< interleaved position/normal(/texcoord)
+    kPositionOnly             //!< tightly packed positions (depth only)
+  };
+
+  Shading shading{Shading::kPhong};
+  VertexFormat vertex_format{VertexFormat::kPositionNormal};
+  uint point_light_count{0};  //!< number of point lights (unrolled loop)
+  bool has_texcoords{false};  //!< vertex buffer has texture coordinates
+  bool has_vertex_ao{false};  //!< per-vertex ambient occlusion attribute
+  bool has_diffuse_map{false};//!< sample diffuse_map (phong, with texcoords)
+  bool uniform_blocks{false}; //!< read matrices from Frame/ObjectBlock
+
+  //! \brief Drop options that don't affect the generated code, so
+  //!        equivalent keys map to the same variant
+  //! \return canonical key
+  GLShaderKey Canonical() const;
+
+  //! \brief Get the preprocessor definitions for this variant
+  //! \return list of definitions (without the "#define" prefix)
+  std::vector<std::string> GetDefines() const;
+
+  //! \brief Pack key into an integer (used for ordering and caching)
+  //! \return packed key
+  uint64_t Pack() const;
+
+  //! \brief Human readable description of the key
+  std::string ToString() const;
+
+  bool operator<(const GLShaderKey &rhs) const {return Pack() < rhs.Pack();}
+  bool operator==(const GLShaderKey &rhs) const {return Pack() == rhs.Pack();}
+};
+
+
+//! \class GLShaderPermutations
+//! \brief Cache of shader variants generated from a set of shader
+//!        sources. Each variant is compiled the first time it's
+//!        requested.
+class GLShaderPermutations {
+public:
+  using Ptr = std::shared_ptr<GLShaderPermutations>;
+  using ShaderFactory = std::function<GLShader::Ptr()>;
+
+  //! \brief Constructor
+  //! \param[in] factory function that creates the (uncompiled) shader
+  //!                    objects for new variants
+  explicit GLShaderPermutations(ShaderFactory factory=ShaderFactory{});
+
+  //! \brief Set vertex and fragment shader files for a shading model
+  //! \param[in] shading shading model
+  //! \param[in] vertex_shader_path vertex shader file
+  //! \param[in] fragment_shader_path fragment shader file
+  void SetShaderSources(GLShaderKey::Shading shading,
+                        const boost::filesystem::path &vertex_shader_path,
+                        const boost::filesystem::path &fragment_shader_path);
+
+  //! \brief Get (compiling on first use) the shader variant for key
+  //! \param[in] key variant options
+  //! \return shader for variant (nullptr on failure)
+  GLShader::Ptr Get(const GLShaderKey &key);
+
+  //! \brief Number of variants compiled so far
+  size_t GetVariantCount() const {return variants_.size();}
+
+  //! \brief Total time (in milliseconds) spent compiling variants
+  double GetTotalCompileTime() const {return total_compile_ms_;}
+
+  //! \brief Memory held by all compiled variants
+  MemoryStats GetMemoryStats() const;
+
+  //! \brief Print variant count and per-variant compile times
+  void PrintStats() const;
+
+  //! \brief Delete all compiled variants
+  void Clear();
+protected:
+  struct ShaderSources {
+    boost::filesystem::path vertex_path;
+    boost::filesystem::path fragment_path;
+  };
+  struct Variant {
+    GLShader::Ptr shader;
+    double compile_ms;
+  };
+  ShaderFactory factory_;
+  std::map<GLShaderKey::Shading, ShaderSources> sources_;
+  std::map<GLShaderKey, Variant> variants_;
+  double total_compile_ms_{0};
+};
+
+}  // namespace olio
@@ -0,0 +1,271 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       glstate.cc
+//! \brief      Shadow copy of the gl state set by the renderer, which
+//!             drops calls that wouldn't change anything
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/glstate.h"
+
+namespace olio {
+
+using namespace std;
+
+GLState&
+GLState::Get()
+{
+  static GLState state;
+  return state;
+}
+
+
+bool
+GLState::Count(bool changed)
+{
+  ++stats_.calls;
+  if (!changed)
+    ++stats_.redundant_calls;
+  return changed;
+}
+
+
+int
+GLState::GetBufferTargetIndex(GLenum target)
+{
+  switch (target) {
+  case GL_ARRAY_BUFFER:
+    return 0;
+  case GL_ELEMENT_ARRAY_BUFFER:
+    return 1;
+  case GL_UNIFORM_BUFFER:
+    return 2;
+  case GL_PIXEL_UNPACK_BUFFER:
+    return 3;
+  case GL_COPY_READ_BUFFER:
+    return 4;
+  case GL_COPY_WRITE_BUFFER:
+    return 5;
+  default:
+    return -1;
+  }
+}
+
+
+int
+GLState::GetCapabilityIndex(GLenum capability)
+{
+  switch (capability) {
+  case GL_DEPTH_TEST:
+    return 0;
+  case GL_BLEND:
+    return 1;
+  case GL_CULL_FACE:
+    return 2;
+  default:
+    return -1;
+  }
+}
+
+
+void
+GLState::UseProgram(GLuint program)
+{
+  if (Count(program_.Set(program)))
+    glUseProgram(program);
+}
+
+
+void
+GLState::BindVertexArray(GLuint vao)
+{
+  if (!Count(vertex_array_.Set(vao)))
+    return;
+  glBindVertexArray(vao);
+  // the element array binding is vertex array state
+  buffers_[1].known = false;
+}
+
+
+void
+GLState::BindBuffer(GLenum target, GLuint buffer)
+{
+  auto index = GetBufferTargetIndex(target);
+  if (!Count(index < 0 || buffers_[static_cast<size_t>(index)].Set(buffer)))
+    return;
+  glBindBuffer(target, buffer);
+}
+
+
+void
+GLState::BindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                         GLintptr offset, GLsizeiptr size)
+{
+  bool changed = true;
+  if (target == GL_UNIFORM_BUFFER && index < kUniformBindings)
+    changed = uniform_ranges_[index].Set(BufferRange{buffer, offset, size});
+  if (!Count(changed))
+    return;
+  glBindBufferRange(target, index, buffer, offset, size);
+  // also binds the generic target
+  auto target_index = GetBufferTargetIndex(target);
+  if (target_index >= 0)
+    buffers_[static_cast<size_t>(target_index)].Set(buffer);
+}
+
+
+void
+GLState::ActiveTexture(GLenum unit)
+{
+  if (Count(active_texture_.Set(unit)))
+    glActiveTexture(unit);
+}
+
+
+void
+GLState::BindTexture(GLenum target, GLuint texture)
+{
+  bool changed = true;
+  if (target == GL_TEXTURE_2D && active_texture_.known) {
+    auto unit = static_cast<size_t>(active_texture_.value - GL_TEXTURE0);
+    if (unit < kTextureUnits)
+      changed = textures_2d_[unit].Set(texture);
+  }
+  if (Count(changed))
+    glBindTexture(target, texture);
+}
+
+
+void
+GLState::SetEnabled(GLenum capability, bool enabled)
+{
+  auto index = GetCapabilityIndex(capability);
+  if (!Count(index < 0 || capabilities_[static_cast<size_t>(index)].Set(enabled)))
+    return;
+  if (enabled)
+    glEnable(capability);
+  else
+    glDisable(capability);
+}
+
+
+void
+GLState::DepthFunc(GLenum func)
+{
+  if (Count(depth_func_.Set(func)))
+    glDepthFunc(func);
+}
+
+
+void
+GLState::DepthMask(GLboolean mask)
+{
+  if (Count(depth_mask_.Set(mask)))
+    glDepthMask(mask);
+}
+
+
+void
+GLState::ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha)
+{
+  if (Count(color_mask_.Set(array<GLboolean, 4>{{red, green, blue, alpha}})))
+    glColorMask(red, green, blue, alpha);
+}
+
+
+void
+GLState::BlendFunc(GLenum source_factor, GLenum destination_factor)
+{
+  if (Count(blend_func_.Set(make_pair(source_factor, destination_factor))))
+    glBlendFunc(source_factor, destination_factor);
+}
+
+
+void
+GLState::CullFace(GLenum mode)
+{
+  if (Count(cull_face_.Set(mode)))
+    glCullFace(mode);
+}
+
+
+void
+GLState::DeleteBuffers(GLsizei count, const GLuint *buffers)
+{
+  if (count <= 0 || !buffers)
+    return;
+  for (GLsizei i = 0; i < count; ++i) {
+    if (!buffers[i])
+      continue;
+    for (auto &binding : buffers_)
+      if (binding.known && binding.value == buffers[i])
+        binding.value = 0;
+    for (auto &range : uniform_ranges_)
+      if (range.known && range.value.buffer == buffers[i])
+        range.known = false;
+  }
+  glDeleteBuffers(count, buffers);
+}
+
+
+void
+GLState::DeleteTextures(GLsizei count, const GLuint *textures)
+{
+  if (count <= 0 || !textures)
+    return;
+  for (GLsizei i = 0; i < count; ++i) {
+    if (!textures[i])
+      continue;
+    for (auto &binding : textures_2d_)
+      if (binding.known && binding.value == textures[i])
+        binding.value = 0;
+  }
+  glDeleteTextures(count, textures);
+}
+
+
+void
+GLState::DeleteProgram(GLuint program)
+{
+  if (!program)
+    return;
+  if (!program_.known || program_.value == program)
+    UseProgram(0);
+  glDeleteProgram(program);
+}
+
+
+void
+GLState::Invalidate()
+{
+  program_.known = false;
+  vertex_array_.known = false;
+  for (auto &binding : buffers_)
+    binding.known = false;
+  for (auto &range : uniform_ranges_)
+    range.known = false;
+  active_texture_.known = false;
+  for (auto &binding : textures_2d_)
+    binding.known = false;
+  for (auto &capability : capabilities_)
+    capability.known = false;
+  depth_func_.known = false;
+  depth_mask_.known = false;
+  color_mask_.known = false;
+  blend_func_.known = false;
+  cull_face_.known = false;
+}
+
+
+void
+GLState::BeginFrame()
+{
+  frame_stats_ = stats_;
+  stats_ = Stats{};
+}
+
+}  // namespace olio
@@ -0,0 +1,133 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       glstate.h
+//! \brief      Shadow copy of the gl state set by the renderer, which
+//!             drops calls that wouldn't change anything
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <array>
+#include <utility>
+#include <GL/glew.h>
+#include "types.h"
+
+namespace olio {
+
+//! \class GLState
+//! \brief Program, buffer, vertex array, texture, depth, blend and cull
+//!        state of the gl context, as set through this class. Setters
+//!        only call gl when the value differs from the cached one, and
+//!        count the calls they drop. All renderer code changes this
+//!        state through GLState; after gl calls that bypass it, call
+//!        Invalidate.
+class GLState {
+public:
+  //! \brief Call counts
+  struct Stats {
+    size_t calls{0};            //!< state setting calls made to GLState
+    size_t redundant_calls{0};  //!< calls dropped (no change)
+  };
+
+  //! \brief State of the (single) gl context. Must only be used on the
+  //!        render thread
+  static GLState& Get();
+
+  GLState(const GLState &) = delete;
+  GLState& operator=(const GLState &) = delete;
+
+  void UseProgram(GLuint program);
+  void BindVertexArray(GLuint vao);
+  void BindBuffer(GLenum target, GLuint buffer);
+  void BindBufferRange(GLenum target, GLuint index, GLuint buffer,
+                       GLintptr offset, GLsizeiptr size);
+  //! \param[in] unit texture unit (GL_TEXTURE0 + i)
+  void ActiveTexture(GLenum unit);
+  //! \brief Bind a texture to the active texture unit
+  void BindTexture(GLenum target, GLuint texture);
+
+  //! \brief glEnable/glDisable
+  void SetEnabled(GLenum capability, bool enabled);
+  void DepthFunc(GLenum func);
+  void DepthMask(GLboolean mask);
+  void ColorMask(GLboolean red, GLboolean green, GLboolean blue, GLboolean alpha);
+  void BlendFunc(GLenum source_factor, GLenum destination_factor);
+  void CullFace(GLenum mode);
+
+  //! \brief Delete buffers (unbinding them, as gl does)
+  void DeleteBuffers(GLsizei count, const GLuint *buffers);
+  //! \brief Delete textures (unbinding them from all units)
+  void DeleteTextures(GLsizei count, const GLuint *textures);
+  //! \brief Delete a program (switching to program 0 first if it's in
+  //!        use, so its id isn't reused while still current)
+  void DeleteProgram(GLuint program);
+
+  //! \brief Forget all cached state: the next call of every setter
+  //!        goes through
+  void Invalidate();
+
+  //! \brief End the current frame's call counts and start new ones
+  void BeginFrame();
+
+  //! \brief Call counts of the last complete frame
+  Stats GetFrameStats() const {return frame_stats_;}
+
+  //! \brief Call counts of the current frame so far
+  Stats GetStats() const {return stats_;}
+protected:
+  GLState() = default;
+
+  //! \brief Cached value, unknown until first set
+  template <typename T>
+  struct Cached {
+    T value{};
+    bool known{false};
+
+    //! \brief Update the value
+    //! \return true if it changed (or was unknown)
+    bool Set(const T &new_value) {
+      if (known && value == new_value)
+        return false;
+      value = new_value;
+      known = true;
+      return true;
+    }
+  };
+  struct BufferRange {
+    GLuint buffer;
+    GLintptr offset;
+    GLsizeiptr size;
+    bool operator==(const BufferRange &rhs) const {
+      return buffer == rhs.buffer && offset == rhs.offset && size == rhs.size;
+    }
+  };
+  static constexpr size_t kBufferTargets = 6;
+  static constexpr size_t kUniformBindings = 8;
+  static constexpr size_t kTextureUnits = 16;
+
+  bool Count(bool changed);
+  static int GetBufferTargetIndex(GLenum target);
+  static int GetCapabilityIndex(GLenum capability);
+
+  Cached<GLuint> program_;
+  Cached<GLuint> vertex_array_;
+  std::array<Cached<GLuint>, kBufferTargets> buffers_;
+  std::array<Cached<BufferRange>, kUniformBindings> uniform_ranges_;
+  Cached<GLenum> active_texture_;
+  std::array<Cached<GLuint>, kTextureUnits> textures_2d_;
+  std::array<Cached<bool>, 3> capabilities_;
+  Cached<GLenum> depth_func_;
+  Cached<GLboolean> depth_mask_;
+  Cached<std::array<GLboolean, 4>> color_mask_;
+  Cached<std::pair<GLenum, GLenum>> blend_func_;
+  Cached<GLenum> cull_face_;
+  Stats stats_;
+  Stats frame_stats_;
+};
+
+}  // namespace olio
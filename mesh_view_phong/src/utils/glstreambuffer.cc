@@ -0,0 +1,156 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       glstreambuffer.cc
+//! \brief      Multi-buffered streaming buffer for per-frame dynamic data
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/glstreambuffer.h"
+#include "utils/glstate.h"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+
+namespace olio {
+
+using namespace std;
+
+GLStreamBuffer::GLStreamBuffer(GLenum target, size_t frame_size,
+                               size_t frame_count) :
+  target_{target},
+  frame_size_{frame_size},
+  frame_count_{std::max<size_t>(frame_count, 1)}
+{
+  persistent_ = GLEW_ARB_buffer_storage && GLEW_ARB_sync;
+  glGenBuffers(1, &buffer_);
+  GLState::Get().BindBuffer(target_, buffer_);
+  if (persistent_) {
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT |
+      GL_MAP_COHERENT_BIT;
+    auto total_size = static_cast<GLsizeiptr>(frame_size_ * frame_count_);
+    glBufferStorage(target_, total_size, nullptr, flags);
+    mapped_ptr_ = static_cast<uchar*>(glMapBufferRange(target_, 0, total_size,
+                                                       flags));
+    if (!mapped_ptr_) {
+      spdlog::warn("GLStreamBuffer: persistent mapping failed -- "
+                   "falling back to buffer orphaning");
+      persistent_ = false;
+      GLState::Get().DeleteBuffers(1, &buffer_);
+      glGenBuffers(1, &buffer_);
+      GLState::Get().BindBuffer(target_, buffer_);
+    }
+  }
+  if (!persistent_) {
+    frame_count_ = 1;
+    glBufferData(target_, static_cast<GLsizeiptr>(frame_size_), nullptr,
+                 GL_STREAM_DRAW);
+  }
+  fences_.resize(frame_count_, nullptr);
+  GLState::Get().BindBuffer(target_, 0);
+  spdlog::info("GLStreamBuffer: {} x {} bytes ({})", frame_count_, frame_size_,
+               persistent_ ? "persistently mapped" : "orphaning");
+}
+
+
+GLStreamBuffer::~GLStreamBuffer()
+{
+  for (auto &fence : fences_)
+    if (fence)
+      glDeleteSync(fence);
+  if (buffer_) {
+    GLState::Get().BindBuffer(target_, buffer_);
+    if (mapped_ptr_ || frame_ptr_)
+      glUnmapBuffer(target_);
+    GLState::Get().DeleteBuffers(1, &buffer_);
+  }
+}
+
+
+bool
+GLStreamBuffer::BeginFrame()
+{
+  write_offset_ = 0;
+  if (persistent_) {
+    // wait until the GPU is done with this section. with three sections
+    // in flight the fence has almost always signaled already
+    auto &fence = fences_[frame_index_];
+    if (fence) {
+      GLbitfield wait_flags = 0;
+      while (true) {
+        auto status = glClientWaitSync(fence, wait_flags, 1000000);
+        if (status == GL_ALREADY_SIGNALED || status == GL_CONDITION_SATISFIED)
+          break;
+        if (status == GL_WAIT_FAILED) {
+          spdlog::error("GLStreamBuffer::BeginFrame: glClientWaitSync failed");
+          break;
+        }
+        wait_flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+      }
+      glDeleteSync(fence);
+      fence = nullptr;
+    }
+    frame_offset_ = frame_index_ * frame_size_;
+    frame_ptr_ = mapped_ptr_ + frame_offset_;
+    return true;
+  }
+
+  // orphan the old storage and map fresh memory
+  GLState::Get().BindBuffer(target_, buffer_);
+  auto size = static_cast<GLsizeiptr>(frame_size_);
+  glBufferData(target_, size, nullptr, GL_STREAM_DRAW);
+  frame_offset_ = 0;
+  frame_ptr_ = static_cast<uchar*>(glMapBufferRange(
+      target_, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT |
+      GL_MAP_UNSYNCHRONIZED_BIT));
+  GLState::Get().BindBuffer(target_, 0);
+  if (!frame_ptr_) {
+    spdlog::error("GLStreamBuffer::BeginFrame: glMapBufferRange failed");
+    return false;
+  }
+  return true;
+}
+
+
+void*
+GLStreamBuffer::Allocate(size_t size, size_t alignment, GLintptr &offset)
+{
+  if (!frame_ptr_)
+    return nullptr;
+  if (alignment > 1)
+    write_offset_ = (write_offset_ + alignment - 1) / alignment * alignment;
+  if (write_offset_ + size > frame_size_)
+    return nullptr;
+  auto ptr = frame_ptr_ + write_offset_;
+  offset = static_cast<GLintptr>(frame_offset_ + write_offset_);
+  write_offset_ += size;
+  return ptr;
+}
+
+
+void
+GLStreamBuffer::FinishWrites()
+{
+  // coherent persistent mappings need no flush
+  if (persistent_ || !frame_ptr_)
+    return;
+  GLState::Get().BindBuffer(target_, buffer_);
+  glUnmapBuffer(target_);
+  GLState::Get().BindBuffer(target_, 0);
+  frame_ptr_ = nullptr;
+}
+
+
+void
+GLStreamBuffer::EndFrame()
+{
+  if (persistent_) {
+    fences_[frame_index_] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    frame_index_ = (frame_index_ + 1) % frame_count_;
+    frame_ptr_ = nullptr;
+  }
+}
+
+}  // namespace olio
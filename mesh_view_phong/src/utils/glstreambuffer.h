@@ -0,0 +1,96 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       glstreambuffer.h
+//! \brief      Multi-buffered streaming buffer for per-frame dynamic data
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include <GL/glew.h>
+#include "types.h"
+#include "utils/memory_stats.h"
+
+namespace olio {
+
+//! \class GLStreamBuffer
+//! \brief Ring of per-frame sections in a GL buffer that the CPU writes
+//!        every frame.
+//!
+//! When ARB_buffer_storage is available, the buffer is allocated once,
+//! persistently mapped, and split into frame_count sections; a fence per
+//! section keeps the CPU from overwriting data the GPU is still
+//! reading. Otherwise (e.g., GL 3.1), the buffer is orphaned and mapped
+//! with GL_MAP_INVALIDATE_BUFFER_BIT each frame, which lets the driver
+//! hand out fresh storage without synchronizing.
+//!
+//! Usage per frame: BeginFrame(), Allocate() any number of times,
+//! FinishWrites(), issue draws that read from the buffer, EndFrame().
+class GLStreamBuffer {
+public:
+  using Ptr = std::shared_ptr<GLStreamBuffer>;
+
+  //! \brief Constructor. Must be called with a current GL context.
+  //! \param[in] target buffer target (e.g., GL_UNIFORM_BUFFER)
+  //! \param[in] frame_size bytes available per frame
+  //! \param[in] frame_count number of frames in flight (persistent mode)
+  GLStreamBuffer(GLenum target, size_t frame_size, size_t frame_count=3);
+  GLStreamBuffer(const GLStreamBuffer &) = delete;
+  GLStreamBuffer& operator=(const GLStreamBuffer &) = delete;
+  ~GLStreamBuffer();
+
+  //! \brief Whether the buffer is persistently mapped
+  bool IsPersistent() const {return persistent_;}
+
+  //! \brief GL buffer name
+  GLuint GetBufferID() const {return buffer_;}
+
+  //! \brief Bytes available per frame
+  size_t GetFrameSize() const {return frame_size_;}
+
+  //! \brief GPU memory held by the buffer (all frame sections)
+  MemoryStats GetMemoryStats() const {
+    MemoryStats stats;
+    stats.gpu_bytes = buffer_ ? frame_size_ * frame_count_ : 0;
+    return stats;
+  }
+
+  //! \brief Start writing the next frame's section; waits (only) if
+  //!        the GPU is still using that section
+  //! \return true on success
+  bool BeginFrame();
+
+  //! \brief Sub-allocate memory from the current frame's section
+  //! \param[in] size number of bytes
+  //! \param[in] alignment offset alignment in bytes
+  //! \param[out] offset offset of the allocation in the GL buffer
+  //! \return CPU pointer to write to (nullptr if out of space)
+  void* Allocate(size_t size, size_t alignment, GLintptr &offset);
+
+  //! \brief Make the frame's writes visible to GL. Must be called
+  //!        before issuing draws that read the data.
+  void FinishWrites();
+
+  //! \brief Mark the end of the draws that read the frame's data
+  void EndFrame();
+protected:
+  GLenum target_;
+  size_t frame_size_;
+  size_t frame_count_;
+  bool persistent_{false};
+  GLuint buffer_{0};
+  uchar *mapped_ptr_{nullptr};    //!< start of the whole buffer (persistent)
+  uchar *frame_ptr_{nullptr};     //!< start of the current frame's section
+  size_t frame_index_{0};
+  size_t frame_offset_{0};        //!< buffer offset of current section
+  size_t write_offset_{0};        //!< bytes used in current section
+  std::vector<GLsync> fences_;
+};
+
+}  // namespace olio
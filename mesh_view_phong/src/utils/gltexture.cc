@@ -0,0 +1,409 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       gltexture.cc
+//! \brief      Mipmapped 2D textures, decoded on worker threads and
+//!             uploaded incrementally within a per-frame time budget
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/gltexture.h"
+#include <chrono>
+#include <cstring>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include <opencv2/core.hpp>
+#include <opencv2/imgcodecs.hpp>
+#include <opencv2/imgproc.hpp>
+#include "utils/glstate.h"
+#include "utils/allocator.h"
+
+namespace olio {
+
+using namespace std;
+namespace fs=boost::filesystem;
+
+// bytes per glTexSubImage2D call: small enough to keep each call well
+// under a millisecond, so the time budget is honored closely
+static constexpr size_t kUploadStripBytes = size_t{256} << 10;
+
+// ======================================================================
+// GLTexture class
+GLTexture::~GLTexture()
+{
+  DeleteGLTexture();
+}
+
+
+bool
+GLTexture::Bind(GLuint unit) const
+{
+  if (!IsReady())
+    return false;
+  GLState::Get().ActiveTexture(GL_TEXTURE0 + unit);
+  GLState::Get().BindTexture(GL_TEXTURE_2D, texture_id_);
+  return true;
+}
+
+
+MemoryStats
+GLTexture::GetMemoryStats() const
+{
+  MemoryStats stats;
+  for (const auto &level : levels_)
+    stats.staging_bytes += level.pixels.capacity();
+  stats.gpu_bytes = gpu_bytes_;
+  return stats;
+}
+
+
+void
+GLTexture::DeleteGLTexture()
+{
+  if (!texture_id_)
+    return;
+  GLState::Get().DeleteTextures(1, &texture_id_);
+  texture_id_ = 0;
+  gpu_bytes_ = 0;
+  base_level_ = level_count_;
+}
+
+
+// ======================================================================
+// GLTextureCache class
+GLTextureCache::GLTextureCache(uint thread_count)
+{
+  if (!thread_count) {
+    auto hardware_threads = thread::hardware_concurrency();
+    thread_count = hardware_threads > 1 ? hardware_threads - 1 : 1;
+  }
+  workers_.reserve(thread_count);
+  for (uint i = 0; i < thread_count; ++i)
+    workers_.emplace_back(&GLTextureCache::DecodeLoop, this);
+}
+
+
+GLTextureCache::~GLTextureCache()
+{
+  {
+    lock_guard<mutex> lock(mutex_);
+    stop_ = true;
+  }
+  decode_cv_.notify_all();
+  for (auto &worker : workers_)
+    worker.join();
+  Clear();
+}
+
+
+GLTexture::Ptr
+GLTextureCache::Get(const fs::path &path)
+{
+  boost::system::error_code ec;
+  auto canonical_path = fs::canonical(path, ec);
+  if (ec) {
+    spdlog::error("GLTextureCache::Get: {} does not exist", path.string());
+    return nullptr;
+  }
+  auto &texture = textures_[canonical_path.string()];
+  if (texture)
+    return texture;
+
+  texture = make_shared<GLTexture>(canonical_path);
+  {
+    lock_guard<mutex> lock(mutex_);
+    decode_queue_.push_back(texture);
+  }
+  decode_cv_.notify_one();
+  return texture;
+}
+
+
+void
+GLTextureCache::Update(double budget_ms)
+{
+  using Clock = chrono::steady_clock;
+  auto start = Clock::now();
+  stats_.frame_uploaded_bytes = 0;
+
+  // take over the textures decoded since the last frame
+  vector<Decoded> decoded;
+  {
+    lock_guard<mutex> lock(mutex_);
+    decoded.swap(decoded_);
+  }
+  for (auto &entry : decoded)
+    StartUpload(entry);
+  if (uploading_.empty())
+    return;
+
+  // upload strips round-robin, so every texture gets its coarse levels
+  // (and becomes usable) before any texture gets its finest one
+  auto budget = chrono::duration<double, milli>(budget_ms);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+  do {
+    auto texture = uploading_.front();
+    uploading_.pop_front();
+    if (UploadStrip(*texture))
+      uploading_.push_back(texture);
+  } while (!uploading_.empty() && Clock::now() - start < budget);
+  glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+  GLState::Get().BindTexture(GL_TEXTURE_2D, 0);
+  stats_.upload_ms += chrono::duration<double, milli>(Clock::now() - start).count();
+}
+
+
+size_t
+GLTextureCache::GetPendingCount() const
+{
+  size_t count = 0;
+  for (const auto &texture : textures_) {
+    auto state = texture.second->GetState();
+    if (state == GLTexture::State::kDecoding || state == GLTexture::State::kUploading)
+      ++count;
+  }
+  return count;
+}
+
+
+size_t
+GLTextureCache::GetTextureCount() const
+{
+  return textures_.size();
+}
+
+
+GLTextureCache::Stats
+GLTextureCache::GetStats() const
+{
+  auto stats = stats_;
+  lock_guard<mutex> lock(mutex_);
+  stats.decoded_textures = decoded_count_;
+  stats.failed_textures = failed_count_;
+  stats.decode_ms = decode_ms_;
+  return stats;
+}
+
+
+MemoryStats
+GLTextureCache::GetMemoryStats() const
+{
+  MemoryStats stats;
+  for (const auto &texture : textures_)
+    stats += texture.second->GetMemoryStats();
+  {
+    // decoded levels not yet handed over to the render thread
+    lock_guard<mutex> lock(mutex_);
+    for (const auto &entry : decoded_)
+      for (const auto &level : entry.levels)
+        stats.staging_bytes += level.pixels.capacity();
+  }
+  return stats;
+}
+
+
+void
+GLTextureCache::PrintStats() const
+{
+  auto stats = GetStats();
+  spdlog::info("textures: {} ({} pending, {} failed), decode: {:.1f} ms, "
+               "upload: {} in {:.1f} ms", textures_.size(), GetPendingCount(),
+               stats.failed_textures, stats.decode_ms,
+               FormatBytes(stats.uploaded_bytes), stats.upload_ms);
+}
+
+
+void
+GLTextureCache::Clear()
+{
+  {
+    unique_lock<mutex> lock(mutex_);
+    decode_queue_.clear();
+    while (busy_workers_)
+      idle_cv_.wait(lock);
+    decoded_.clear();
+  }
+  for (auto &texture : textures_)
+    texture.second->DeleteGLTexture();
+  textures_.clear();
+  uploading_.clear();
+}
+
+
+void
+GLTextureCache::DecodeLoop()
+{
+  using Clock = chrono::steady_clock;
+  UseThreadArena();
+  unique_lock<mutex> lock(mutex_);
+  while (!stop_) {
+    if (decode_queue_.empty()) {
+      decode_cv_.wait(lock);
+      continue;
+    }
+    Decoded decoded;
+    decoded.texture = decode_queue_.front();
+    decode_queue_.pop_front();
+    ++busy_workers_;
+
+    // decode without holding the lock
+    lock.unlock();
+    auto start = Clock::now();
+    if (!Decode(decoded.texture->GetPath(), decoded.levels)) {
+      spdlog::error("GLTextureCache: failed to read {}",
+                    decoded.texture->GetPath().string());
+      decoded.levels.clear();
+    }
+    auto ms = chrono::duration<double, milli>(Clock::now() - start).count();
+    lock.lock();
+
+    decode_ms_ += ms;
+    if (decoded.levels.empty())
+      ++failed_count_;
+    else
+      ++decoded_count_;
+    decoded_.push_back(std::move(decoded));
+    --busy_workers_;
+    idle_cv_.notify_all();
+  }
+}
+
+
+bool
+GLTextureCache::Decode(const fs::path &path, vector<GLTexture::Level> &levels)
+{
+  auto image = cv::imread(path.string(), cv::IMREAD_UNCHANGED);
+  if (image.empty())
+    return false;
+
+  // 8 bits per channel
+  if (image.depth() == CV_16U)
+    image.convertTo(image, CV_8U, 1.0 / 257.0);
+  else if (image.depth() == CV_32F || image.depth() == CV_64F)
+    image.convertTo(image, CV_8U, 255.0);
+  else if (image.depth() != CV_8U)
+    image.convertTo(image, CV_8U);
+
+  // RGBA channel order (OpenCV decodes to BGR(A))
+  cv::Mat rgba;
+  switch (image.channels()) {
+  case 1:
+    cv::cvtColor(image, rgba, cv::COLOR_GRAY2RGBA);
+    break;
+  case 3:
+    cv::cvtColor(image, rgba, cv::COLOR_BGR2RGBA);
+    break;
+  case 4:
+    cv::cvtColor(image, rgba, cv::COLOR_BGRA2RGBA);
+    break;
+  default:
+    return false;
+  }
+  image.release();
+
+  // gl expects the bottom row first
+  cv::flip(rgba, rgba, 0);
+
+  // mip chain: each level is the area average of the previous one, down
+  // to 1x1
+  levels.clear();
+  cv::Mat level_image = rgba;
+  while (true) {
+    GLTexture::Level level;
+    level.width = level_image.cols;
+    level.height = level_image.rows;
+    auto row_bytes = static_cast<size_t>(level.width) * 4;
+    level.pixels.resize(row_bytes * static_cast<size_t>(level.height));
+    for (int row = 0; row < level.height; ++row)
+      memcpy(level.pixels.data() + row_bytes * static_cast<size_t>(row),
+             level_image.ptr<uchar>(row), row_bytes);
+    levels.push_back(std::move(level));
+    if (level_image.cols == 1 && level_image.rows == 1)
+      break;
+
+    cv::Mat next_image;
+    cv::resize(level_image, next_image, cv::Size{std::max(1, level_image.cols / 2),
+                                                 std::max(1, level_image.rows / 2)},
+               0, 0, cv::INTER_AREA);
+    level_image = next_image;
+  }
+  return true;
+}
+
+
+void
+GLTextureCache::StartUpload(Decoded &decoded)
+{
+  auto &texture = *decoded.texture;
+  if (decoded.levels.empty()) {
+    texture.state_ = GLTexture::State::kFailed;
+    return;
+  }
+  texture.levels_ = std::move(decoded.levels);
+  texture.width_ = texture.levels_.front().width;
+  texture.height_ = texture.levels_.front().height;
+  texture.level_count_ = static_cast<int>(texture.levels_.size());
+  texture.base_level_ = texture.level_count_;
+  texture.upload_row_ = 0;
+  texture.state_ = GLTexture::State::kUploading;
+
+  // allocate storage for all levels up front; UploadStrip fills it in
+  // from the coarsest level
+  glGenTextures(1, &texture.texture_id_);
+  GLState::Get().BindTexture(GL_TEXTURE_2D, texture.texture_id_);
+  texture.gpu_bytes_ = 0;
+  for (int i = 0; i < texture.level_count_; ++i) {
+    const auto &level = texture.levels_[static_cast<size_t>(i)];
+    glTexImage2D(GL_TEXTURE_2D, i, GL_RGBA8, level.width, level.height, 0,
+                 GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    texture.gpu_bytes_ += level.pixels.size();
+  }
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, texture.level_count_ - 1);
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.level_count_ - 1);
+  uploading_.push_back(decoded.texture);
+}
+
+
+bool
+GLTextureCache::UploadStrip(GLTexture &texture)
+{
+  if (!texture.texture_id_ || texture.base_level_ <= 0)
+    return false;
+  auto level_index = texture.base_level_ - 1;
+  auto &level = texture.levels_[static_cast<size_t>(level_index)];
+
+  // next strip of rows (at least one row)
+  auto row_bytes = static_cast<size_t>(level.width) * 4;
+  auto rows = static_cast<int>(std::max<size_t>(1, kUploadStripBytes / row_bytes));
+  rows = std::min(rows, level.height - texture.upload_row_);
+  GLState::Get().BindTexture(GL_TEXTURE_2D, texture.texture_id_);
+  glTexSubImage2D(GL_TEXTURE_2D, level_index, 0, texture.upload_row_, level.width, rows,
+                  GL_RGBA, GL_UNSIGNED_BYTE,
+                  level.pixels.data() + row_bytes * static_cast<size_t>(texture.upload_row_));
+  auto strip_bytes = row_bytes * static_cast<size_t>(rows);
+  stats_.uploaded_bytes += strip_bytes;
+  stats_.frame_uploaded_bytes += strip_bytes;
+  texture.upload_row_ += rows;
+  if (texture.upload_row_ < level.height)
+    return true;
+
+  // level complete: sample down to it and release its pixels
+  texture.base_level_ = level_index;
+  texture.upload_row_ = 0;
+  glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level_index);
+  vector<uchar>().swap(level.pixels);
+  if (level_index > 0)
+    return true;
+  texture.levels_.clear();
+  texture.state_ = GLTexture::State::kComplete;
+  return false;
+}
+
+}  // namespace olio
@@ -0,0 +1,198 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       gltexture.h
+//! \brief      Mipmapped 2D textures, decoded on worker threads and
+//!             uploaded incrementally within a per-frame time budget
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <memory>
+#include <string>
+#include <vector>
+#include <condition_variable>
+#include <GL/glew.h>
+#include <boost/filesystem.hpp>
+#include "types.h"
+#include "utils/memory_stats.h"
+
+namespace olio {
+
+//! \class GLTexture
+//! \brief RGBA8 2D texture with a full mip chain. Levels are uploaded
+//!        from the coarsest to the finest, and GL_TEXTURE_BASE_LEVEL
+//!        tracks the finest uploaded level, so the texture can be
+//!        sampled (blurry at first) as soon as its 1x1 level is in.
+//!        Apart from the path, all members belong to the render thread
+class GLTexture {
+public:
+  using Ptr = std::shared_ptr<GLTexture>;
+
+  //! \brief One mip level
+  struct Level {
+    int width{0};
+    int height{0};
+    std::vector<uchar> pixels;  //!< tightly packed RGBA8, bottom row first
+  };
+
+  enum class State : uchar {
+    kDecoding = 0,    //!< queued for (or being decoded by) a worker
+    kUploading,       //!< decoded, levels being uploaded
+    kComplete,        //!< all levels uploaded
+    kFailed           //!< image could not be read
+  };
+
+  //! \brief Constructor
+  //! \param[in] path image file
+  explicit GLTexture(const boost::filesystem::path &path) : path_{path} {}
+  ~GLTexture();
+  GLTexture(const GLTexture &) = delete;
+  GLTexture& operator=(const GLTexture &) = delete;
+
+  boost::filesystem::path GetPath() const {return path_;}
+  State GetState() const {return state_;}
+
+  //! \brief Size of level 0 (zero until decoded)
+  Vec2i GetSize() const {return Vec2i{width_, height_};}
+
+  //! \brief Number of mip levels (zero until decoded)
+  int GetLevelCount() const {return level_count_;}
+
+  //! \brief Finest level uploaded so far (level count if none)
+  int GetBaseLevel() const {return base_level_;}
+
+  //! \brief Whether at least one level has been uploaded
+  bool IsReady() const {return texture_id_ && base_level_ < level_count_;}
+
+  //! \brief Whether all levels have been uploaded
+  bool IsComplete() const {return state_ == State::kComplete;}
+
+  //! \brief Bind texture to a texture unit (render thread)
+  //! \param[in] unit texture unit index (0 for GL_TEXTURE0)
+  //! \return true if the texture is ready and was bound
+  bool Bind(GLuint unit) const;
+
+  GLuint GetTextureID() const {return texture_id_;}
+
+  //! \brief Decoded levels awaiting upload (staging) and gl storage
+  MemoryStats GetMemoryStats() const;
+
+  //! \brief Delete the gl texture (must be called with the gl context
+  //!        current)
+  void DeleteGLTexture();
+protected:
+  friend class GLTextureCache;
+
+  boost::filesystem::path path_;
+  State state_{State::kDecoding};
+  int width_{0};
+  int height_{0};
+  int level_count_{0};
+  int base_level_{0};
+  int upload_row_{0};            //!< next row of level base_level_ - 1
+  std::vector<Level> levels_;    //!< released as they are uploaded
+  size_t gpu_bytes_{0};
+  GLuint texture_id_{0};
+};
+
+
+//! \class GLTextureCache
+//! \brief Textures deduplicated by path. Get only queues an image for
+//!        decoding; worker threads read it (OpenCV), convert it to
+//!        RGBA8 and build its mip chain, and Update uploads decoded
+//!        levels on the render thread in row strips until the frame's
+//!        time budget is spent. Loading many large textures then
+//!        neither blocks startup nor causes frame hitches
+class GLTextureCache {
+public:
+  using Ptr = std::shared_ptr<GLTextureCache>;
+
+  //! \brief Upload statistics
+  struct Stats {
+    size_t decoded_textures{0};  //!< decoded since created
+    size_t failed_textures{0};
+    size_t uploaded_bytes{0};    //!< uploaded since created
+    double decode_ms{0};         //!< summed over the worker threads
+    double upload_ms{0};         //!< render thread time spent in Update
+    size_t frame_uploaded_bytes{0};  //!< uploaded by the last Update
+  };
+
+  //! \brief Constructor. Starts the decoding threads.
+  //! \param[in] thread_count number of decoding threads (0: one less
+  //!                         than the number of hardware threads)
+  explicit GLTextureCache(uint thread_count=0);
+
+  //! \brief Destructor. Stops the decoding threads and deletes the gl
+  //!        textures; must be called with the gl context current.
+  ~GLTextureCache();
+  GLTextureCache(const GLTextureCache &) = delete;
+  GLTextureCache& operator=(const GLTextureCache &) = delete;
+
+  //! \brief Get the texture for an image file, queuing it for decoding
+  //!        on first request
+  //! \param[in] path image file
+  //! \return texture (nullptr if the file doesn't exist)
+  GLTexture::Ptr Get(const boost::filesystem::path &path);
+
+  //! \brief Upload decoded levels until budget_ms milliseconds have
+  //!        been spent (at least one strip per call). Must be called on
+  //!        the render thread, with the gl context current.
+  //! \param[in] budget_ms time budget in milliseconds
+  void Update(double budget_ms);
+
+  //! \brief Number of textures that are not yet complete
+  size_t GetPendingCount() const;
+
+  //! \brief Number of textures in the cache
+  size_t GetTextureCount() const;
+
+  Stats GetStats() const;
+
+  //! \brief Memory held by all textures
+  MemoryStats GetMemoryStats() const;
+
+  //! \brief Print texture counts, decode and upload times
+  void PrintStats() const;
+
+  //! \brief Delete all textures (waits for the ones being decoded)
+  void Clear();
+protected:
+  struct Decoded {
+    GLTexture::Ptr texture;
+    std::vector<GLTexture::Level> levels;  //!< empty if decoding failed
+  };
+
+  void DecodeLoop();
+  static bool Decode(const boost::filesystem::path &path,
+                     std::vector<GLTexture::Level> &levels);
+  void StartUpload(Decoded &decoded);
+  bool UploadStrip(GLTexture &texture);
+
+  std::map<std::string, GLTexture::Ptr> textures_;  //!< by canonical path
+  std::deque<GLTexture::Ptr> uploading_;            //!< render thread only
+  Stats stats_;
+
+  // shared with the decoding threads (guarded by mutex_)
+  mutable std::mutex mutex_;
+  std::condition_variable decode_cv_;
+  std::condition_variable idle_cv_;
+  std::deque<GLTexture::Ptr> decode_queue_;
+  std::vector<Decoded> decoded_;          //!< awaiting upload
+  size_t busy_workers_{0};
+  size_t decoded_count_{0};
+  size_t failed_count_{0};
+  double decode_ms_{0};
+  bool stop_{false};
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace olio
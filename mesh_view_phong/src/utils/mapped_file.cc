@@ -0,0 +1,169 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       mapped_file.cc
+//! \brief      Read-only memory mapped file
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/mapped_file.h"
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+namespace olio {
+
+using namespace std;
+namespace fs = boost::filesystem;
+
+namespace {
+size_t
+GetPageSize()
+{
+#if defined(_WIN32)
+  SYSTEM_INFO info;
+  GetSystemInfo(&info);
+  return static_cast<size_t>(info.dwPageSize);
+#else
+  auto page_size = sysconf(_SC_PAGESIZE);
+  return page_size > 0 ? static_cast<size_t>(page_size) : 4096;
+#endif
+}
+}  // namespace
+
+
+MappedFile::~MappedFile()
+{
+  Close();
+}
+
+
+bool
+MappedFile::Open(const fs::path &path)
+{
+  Close();
+#if defined(_WIN32)
+  auto file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ,
+                          nullptr, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, nullptr);
+  if (file == INVALID_HANDLE_VALUE) {
+    spdlog::error("MappedFile: could not open {}", path.string());
+    return false;
+  }
+  LARGE_INTEGER file_size;
+  if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart <= 0) {
+    spdlog::error("MappedFile: empty file {}", path.string());
+    CloseHandle(file);
+    return false;
+  }
+  auto mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  auto data = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+  if (!data) {
+    spdlog::error("MappedFile: could not map {}", path.string());
+    if (mapping)
+      CloseHandle(mapping);
+    CloseHandle(file);
+    return false;
+  }
+  file_handle_ = file;
+  mapping_handle_ = mapping;
+  size_ = static_cast<size_t>(file_size.QuadPart);
+#else
+  int fd = open(path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    spdlog::error("MappedFile: could not open {}", path.string());
+    return false;
+  }
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0 || file_stat.st_size <= 0) {
+    spdlog::error("MappedFile: empty file {}", path.string());
+    close(fd);
+    return false;
+  }
+  auto size = static_cast<size_t>(file_stat.st_size);
+  auto data = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  if (data == MAP_FAILED) {
+    spdlog::error("MappedFile: could not map {}", path.string());
+    close(fd);
+    return false;
+  }
+  // chunks are read in arbitrary order; don't read ahead
+  madvise(data, size, MADV_RANDOM);
+  fd_ = fd;
+  size_ = size;
+#endif
+  data_ = static_cast<const uchar*>(data);
+  return true;
+}
+
+
+void
+MappedFile::Close()
+{
+  if (!data_)
+    return;
+#if defined(_WIN32)
+  UnmapViewOfFile(data_);
+  CloseHandle(static_cast<HANDLE>(mapping_handle_));
+  CloseHandle(static_cast<HANDLE>(file_handle_));
+  mapping_handle_ = nullptr;
+  file_handle_ = nullptr;
+#else
+  munmap(const_cast<uchar*>(data_), size_);
+  close(fd_);
+  fd_ = -1;
+#endif
+  data_ = nullptr;
+  size_ = 0;
+}
+
+
+bool
+MappedFile::Prefetch(size_t offset, size_t size) const
+{
+  if (!data_ || offset > size_ || size > size_ - offset)
+    return false;
+  if (!size)
+    return true;
+
+  // touch one byte per page; the reads block until the page is in
+  auto page_size = GetPageSize();
+  volatile uchar sum = 0;
+  for (size_t i = offset; i < offset + size; i += page_size)
+    sum = static_cast<uchar>(sum + data_[i]);
+  sum = static_cast<uchar>(sum + data_[offset + size - 1]);
+  (void)sum;
+  return true;
+}
+
+
+void
+MappedFile::Release(size_t offset, size_t size) const
+{
+  if (!data_ || offset >= size_ || !size)
+    return;
+  size = std::min(size, size_ - offset);
+#if defined(_WIN32)
+  // views of read-only file mappings are trimmed by the OS working
+  // set manager; unlocking marks the range as a candidate
+  VirtualUnlock(const_cast<uchar*>(data_) + offset, size);
+#else
+  // only whole pages inside the range can be dropped
+  auto page_size = GetPageSize();
+  auto begin = (offset + page_size - 1) / page_size * page_size;
+  auto end = (offset + size) / page_size * page_size;
+  if (end > begin)
+    madvise(const_cast<uchar*>(data_) + begin, end - begin, MADV_DONTNEED);
+#endif
+}
+
+}  // namespace olio
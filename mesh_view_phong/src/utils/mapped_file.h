@@ -0,0 +1,67 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       mapped_file.h
+//! \brief      Read-only memory mapped file
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <cstddef>
+#include <boost/filesystem.hpp>
+#include "types.h"
+
+namespace olio {
+
+//! \class MappedFile
+//! \brief Read-only memory mapping of a whole file. Pages are read
+//!        from disk on first access; Prefetch faults a range in
+//!        (e.g. on a loader thread) and Release gives its pages back
+//!        to the OS
+class MappedFile {
+public:
+  MappedFile() = default;
+  ~MappedFile();
+  MappedFile(const MappedFile &) = delete;
+  MappedFile& operator=(const MappedFile &) = delete;
+
+  //! \brief Map file (closing any previously mapped file)
+  //! \param[in] path file to map
+  //! \return true on success
+  bool Open(const boost::filesystem::path &path);
+
+  //! \brief Unmap the file
+  void Close();
+
+  bool IsOpen() const {return data_ != nullptr;}
+  const uchar* GetData() const {return data_;}
+  size_t GetSize() const {return size_;}
+
+  //! \brief Fault in the pages of a range, blocking until they have
+  //!        been read
+  //! \param[in] offset first byte
+  //! \param[in] size number of bytes
+  //! \return false if the range is outside the file
+  bool Prefetch(size_t offset, size_t size) const;
+
+  //! \brief Tell the OS the pages of a range are no longer needed.
+  //!        They are re-read from the file on the next access
+  //! \param[in] offset first byte
+  //! \param[in] size number of bytes
+  void Release(size_t offset, size_t size) const;
+protected:
+  const uchar *data_{nullptr};
+  size_t size_{0};
+#if defined(_WIN32)
+  void *file_handle_{nullptr};
+  void *mapping_handle_{nullptr};
+#else
+  int fd_{-1};
+#endif
+};
+
+}  // namespace olio
@@ -18,6 +18,7 @@
 namespace olio {
 
 class GLShader;
+class GLTexture;
 
 //! \class Material
 //! \brief Material class
@@ -90,11 +91,21 @@ public:
   //! \brief Get shininess coefficient (Phong exponent)
   //! \return Shininess coefficient
   Real GetShininess() const {return shininess_;}
+
+  //! \brief Set diffuse texture (modulates the diffuse and ambient
+  //!        coefficients; needs texture coordinates)
+  //! \param[in] texture diffuse texture (nullptr for none)
+  void SetDiffuseMap(std::shared_ptr<GLTexture> texture) {diffuse_map_ = texture;}
+
+  //! \brief Get diffuse texture
+  //! \return Diffuse texture (nullptr if none)
+  std::shared_ptr<GLTexture> GetDiffuseMap() const {return diffuse_map_;}
 protected:
   Vec3r ambient_{0, 0, 0};      //!< ambient coefficients
   Vec3r diffuse_{0, 0, 0};      //!< diffuse coefficients
   Vec3r specular_{0, 0, 0};     //!< specular coefficients
   Real shininess_{1};           //!< shininess coefficient
+  std::shared_ptr<GLTexture> diffuse_map_;  //!< diffuse texture
 };
 
 }  // namespace olio
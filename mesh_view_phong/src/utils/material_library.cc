@@ -0,0 +1,224 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       material_library.cc
+//! \brief      Wavefront MTL import into deduplicated PhongMaterials
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/material_library.h"
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <spdlog/spdlog.h>
+#include "utils/gltexture.h"
+
+namespace olio {
+
+using namespace std;
+namespace fs=boost::filesystem;
+
+namespace {
+
+//! \brief Split a line into its keyword and the rest (both without
+//!        surrounding whitespace)
+void
+SplitKeyword(const string &line, string &keyword, string &rest)
+{
+  static const char *whitespace = " \t\r\n";
+  keyword.clear();
+  rest.clear();
+  auto begin = line.find_first_not_of(whitespace);
+  if (begin == string::npos)
+    return;
+  auto end = line.find_first_of(whitespace, begin);
+  keyword = line.substr(begin, end == string::npos ? string::npos : end - begin);
+  if (end == string::npos)
+    return;
+  auto rest_begin = line.find_first_not_of(whitespace, end);
+  auto rest_end = line.find_last_not_of(whitespace);
+  if (rest_begin != string::npos)
+    rest = line.substr(rest_begin, rest_end - rest_begin + 1);
+}
+
+
+bool
+ParseVec3(const string &text, Vec3r &vec)
+{
+  istringstream in(text);
+  Real values[3];
+  if (!(in >> values[0]))
+    return false;
+  // a single value applies to all channels
+  if (!(in >> values[1] >> values[2]))
+    values[1] = values[2] = values[0];
+  vec = Vec3r{values[0], values[1], values[2]};
+  return true;
+}
+
+
+//! \brief Texture file of a map_* statement: the last token, after any
+//!        options (-s, -o, -bm, ...)
+fs::path
+GetMapPath(const string &text, const fs::path &mtl_dir)
+{
+  auto begin = text.find_last_of(" \t");
+  auto name = begin == string::npos ? text : text.substr(begin + 1);
+  replace(name.begin(), name.end(), '\\', '/');
+  fs::path path{name};
+  return path.is_absolute() ? path : mtl_dir / path;
+}
+
+}  // namespace
+
+
+bool
+MaterialLibrary::LoadMTL(const fs::path &path)
+{
+  boost::system::error_code ec;
+  auto canonical_path = fs::canonical(path, ec);
+  if (ec) {
+    spdlog::error("MaterialLibrary::LoadMTL: {} does not exist", path.string());
+    return false;
+  }
+  auto key = canonical_path.string();
+  if (libraries_.count(key))
+    return true;
+
+  ifstream in(key);
+  if (!in) {
+    spdlog::error("MaterialLibrary::LoadMTL: could not open {}", key);
+    return false;
+  }
+  auto mtl_dir = canonical_path.parent_path();
+  auto &library = libraries_[key];
+  string name, line, keyword, rest;
+  PhongMaterial::Ptr material;
+  auto AddMaterial = [&]() {
+    if (material)
+      library[name] = Deduplicate(material);
+    material = nullptr;
+  };
+  while (getline(in, line)) {
+    SplitKeyword(line, keyword, rest);
+    if (keyword.empty() || keyword[0] == '#')
+      continue;
+    if (keyword == "newmtl") {
+      AddMaterial();
+      name = rest;
+      // coefficients missing from the file default to a gray diffuse
+      // material
+      material = make_shared<PhongMaterial>(Vec3r{0, 0, 0}, Vec3r{.8f, .8f, .8f},
+                                            Vec3r{0, 0, 0}, 1);
+      continue;
+    }
+    if (!material)
+      continue;
+    Vec3r coeffs;
+    if (keyword == "Ka" && ParseVec3(rest, coeffs)) {
+      material->SetAmbient(coeffs);
+    } else if (keyword == "Kd" && ParseVec3(rest, coeffs)) {
+      material->SetDiffuse(coeffs);
+    } else if (keyword == "Ks" && ParseVec3(rest, coeffs)) {
+      material->SetSpecular(coeffs);
+    } else if (keyword == "Ns" && ParseVec3(rest, coeffs)) {
+      material->SetShininess(std::max(Real{1}, coeffs[0]));
+    } else if (keyword == "map_Kd" && texture_cache_ && !rest.empty()) {
+      auto texture = texture_cache_->Get(GetMapPath(rest, mtl_dir));
+      if (texture)
+        material->SetDiffuseMap(texture);
+    }
+  }
+  AddMaterial();
+  spdlog::info("{}: {} materials", canonical_path.filename().string(), library.size());
+  return true;
+}
+
+
+PhongMaterial::Ptr
+MaterialLibrary::LoadOBJMaterial(const fs::path &obj_path)
+{
+  ifstream in(obj_path.string());
+  if (!in) {
+    spdlog::error("MaterialLibrary::LoadOBJMaterial: could not open {}",
+                  obj_path.string());
+    return nullptr;
+  }
+
+  // mtllib lines up to the first usemtl (or face)
+  vector<fs::path> mtl_paths;
+  string line, keyword, rest, material_name;
+  while (getline(in, line)) {
+    if (line.empty() || line[0] == 'v' || line[0] == '#')
+      continue;
+    SplitKeyword(line, keyword, rest);
+    if (keyword == "mtllib") {
+      mtl_paths.push_back(obj_path.parent_path() / rest);
+    } else if (keyword == "usemtl") {
+      material_name = rest;
+      break;
+    } else if (keyword == "f") {
+      break;
+    }
+  }
+  if (material_name.empty())
+    return nullptr;
+
+  for (const auto &mtl_path : mtl_paths) {
+    if (!LoadMTL(mtl_path))
+      continue;
+    auto material = GetMaterial(mtl_path, material_name);
+    if (material)
+      return material;
+  }
+  spdlog::warn("{}: material {} not found", obj_path.filename().string(), material_name);
+  return nullptr;
+}
+
+
+PhongMaterial::Ptr
+MaterialLibrary::GetMaterial(const fs::path &mtl_path, const std::string &name) const
+{
+  boost::system::error_code ec;
+  auto canonical_path = fs::canonical(mtl_path, ec);
+  if (ec)
+    return nullptr;
+  auto library = libraries_.find(canonical_path.string());
+  if (library == libraries_.end())
+    return nullptr;
+  auto material = library->second.find(name);
+  return material == library->second.end() ? nullptr : material->second;
+}
+
+
+PhongMaterial::Ptr
+MaterialLibrary::Deduplicate(PhongMaterial::Ptr material)
+{
+  if (!material)
+    return nullptr;
+  // scenes have few materials: a linear search is enough
+  for (const auto &existing : materials_) {
+    if (existing == material ||
+        (existing->GetAmbient() == material->GetAmbient() &&
+         existing->GetDiffuse() == material->GetDiffuse() &&
+         existing->GetSpecular() == material->GetSpecular() &&
+         existing->GetShininess() == material->GetShininess() &&
+         existing->GetDiffuseMap() == material->GetDiffuseMap()))
+      return existing;
+  }
+  materials_.push_back(material);
+  return material;
+}
+
+
+void
+MaterialLibrary::Clear()
+{
+  libraries_.clear();
+  materials_.clear();
+}
+
+}  // namespace olio
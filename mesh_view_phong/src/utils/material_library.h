@@ -0,0 +1,79 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       material_library.h
+//! \brief      Wavefront MTL import into deduplicated PhongMaterials
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <map>
+#include <string>
+#include <vector>
+#include <memory>
+#include <boost/filesystem.hpp>
+#include "types.h"
+#include "utils/material.h"
+
+namespace olio {
+
+class GLTextureCache;
+
+//! \class MaterialLibrary
+//! \brief Materials read from .mtl files. Materials with the same
+//!        coefficients and textures are shared, whichever file or name
+//!        they come from, so draws can be grouped by material
+class MaterialLibrary {
+public:
+  using Ptr = std::shared_ptr<MaterialLibrary>;
+
+  //! \brief Constructor
+  //! \param[in] texture_cache cache for map_Kd textures (optional;
+  //!                          textures are ignored without it)
+  explicit MaterialLibrary(GLTextureCache *texture_cache=nullptr) :
+    texture_cache_{texture_cache} {}
+
+  //! \brief Read an .mtl file (once; later calls return the cached
+  //!        result). Supports Ka, Kd, Ks, Ns and map_Kd.
+  //! \param[in] path mtl file
+  //! \return true on success
+  bool LoadMTL(const boost::filesystem::path &path);
+
+  //! \brief Get the material of an OBJ file: the first material named
+  //!        by a usemtl line, looked up in the file's mtllib files
+  //!        (which are loaded). Only the lines before the first face
+  //!        are read.
+  //! \param[in] obj_path obj file
+  //! \return material (nullptr if the file doesn't reference one)
+  PhongMaterial::Ptr LoadOBJMaterial(const boost::filesystem::path &obj_path);
+
+  //! \brief Get a material by name from a loaded mtl file
+  //! \param[in] mtl_path mtl file
+  //! \param[in] name material name
+  //! \return material (nullptr if not found)
+  PhongMaterial::Ptr GetMaterial(const boost::filesystem::path &mtl_path,
+                                 const std::string &name) const;
+
+  //! \brief Get the library's material equal to material, adding
+  //!        material to the library if there is none
+  //! \param[in] material material
+  //! \return shared material
+  PhongMaterial::Ptr Deduplicate(PhongMaterial::Ptr material);
+
+  //! \brief Unique materials
+  const std::vector<PhongMaterial::Ptr>& GetMaterials() const {return materials_;}
+
+  void Clear();
+protected:
+  using NamedMaterials = std::map<std::string, PhongMaterial::Ptr>;
+
+  GLTextureCache *texture_cache_;
+  std::map<std::string, NamedMaterials> libraries_;  //!< by canonical mtl path
+  std::vector<PhongMaterial::Ptr> materials_;
+};
+
+}  // namespace olio
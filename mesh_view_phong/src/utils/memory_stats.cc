@@ -0,0 +1,174 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       memory_stats.cc
+//! \brief      CPU/GPU memory accounting for scene resources
+//! \author     Hadi Fadaifard, 2022
+
+#include "utils/memory_stats.h"
+#include "utils/allocator.h"
+#include <algorithm>
+#include <cstdio>
+#include <spdlog/spdlog.h>
+#if defined(__linux__) || defined(__APPLE__)
+#include <unistd.h>
+#include <sys/resource.h>
+#endif
+#if defined(__APPLE__)
+#include <mach/mach.h>
+#endif
+
+namespace olio {
+
+using namespace std;
+
+MemoryStats&
+MemoryStats::operator+=(const MemoryStats &rhs)
+{
+  connectivity_bytes += rhs.connectivity_bytes;
+  property_bytes += rhs.property_bytes;
+  staging_bytes += rhs.staging_bytes;
+  bvh_bytes += rhs.bvh_bytes;
+  gpu_bytes += rhs.gpu_bytes;
+  upload_bytes = std::max(upload_bytes, rhs.upload_bytes);
+  return *this;
+}
+
+
+void
+MemoryReport::Add(const std::string &name, const MemoryStats &stats)
+{
+  entries_.emplace_back(name, stats);
+}
+
+
+MemoryStats
+MemoryReport::GetTotal() const
+{
+  MemoryStats total;
+  for (const auto &entry : entries_)
+    total += entry.second;
+  return total;
+}
+
+
+void
+MemoryReport::Print(const std::string &title) const
+{
+  auto PrintStats = [](const std::string &name, const MemoryStats &stats) {
+    spdlog::info("  {:<24} cpu {:>10} (topology {:>10}, properties {:>10}, "
+                 "staging {:>10}, bvh {:>10})  gpu {:>10}", name,
+                 FormatBytes(stats.GetCPUBytes()),
+                 FormatBytes(stats.connectivity_bytes),
+                 FormatBytes(stats.property_bytes),
+                 FormatBytes(stats.staging_bytes),
+                 FormatBytes(stats.bvh_bytes),
+                 FormatBytes(stats.gpu_bytes));
+  };
+  spdlog::info("{}:", title);
+  for (const auto &entry : entries_)
+    PrintStats(entry.first, entry.second);
+  auto total = GetTotal();
+  PrintStats("total", total);
+  spdlog::info("  peak upload staging {}, process rss {} (peak {})",
+               FormatBytes(total.upload_bytes), FormatBytes(GetProcessRSS()),
+               FormatBytes(GetProcessPeakRSS()));
+  AllocatorStats allocator_stats;
+  if (GetAllocatorStats(allocator_stats))
+    spdlog::info("  heap ({}) allocated {}, resident {}, fragmentation {:.1f}%",
+                 GetAllocatorName(), FormatBytes(allocator_stats.allocated),
+                 FormatBytes(allocator_stats.resident),
+                 100.0 * allocator_stats.GetFragmentation());
+}
+
+
+void
+PeakMemoryTracker::Begin(const std::string &phase)
+{
+  phase_ = phase;
+  peak_bytes_ = 0;
+  peak_rss_ = GetProcessRSS();
+}
+
+
+void
+PeakMemoryTracker::Sample(size_t bytes)
+{
+  peak_bytes_ = std::max(peak_bytes_, bytes);
+  peak_rss_ = std::max(peak_rss_, GetProcessRSS());
+}
+
+
+void
+PeakMemoryTracker::End()
+{
+  peak_rss_ = std::max(peak_rss_, GetProcessRSS());
+  spdlog::info("{}: peak accounted memory {}, peak process rss {}", phase_,
+               FormatBytes(peak_bytes_), FormatBytes(peak_rss_));
+}
+
+
+std::string
+FormatBytes(size_t bytes)
+{
+  const char *units[] = {"B", "KB", "MB", "GB"};
+  auto value = static_cast<double>(bytes);
+  size_t unit = 0;
+  while (value >= 1024.0 && unit < 3) {
+    value /= 1024.0;
+    ++unit;
+  }
+  if (!unit)
+    return fmt::format("{} B", bytes);
+  return fmt::format("{:.2f} {}", value, units[unit]);
+}
+
+
+size_t
+GetProcessRSS()
+{
+#if defined(__linux__)
+  FILE *file = fopen("/proc/self/statm", "r");
+  if (!file)
+    return 0;
+  long pages = 0, resident = 0;
+  auto count = fscanf(file, "%ld %ld", &pages, &resident);
+  fclose(file);
+  if (count != 2)
+    return 0;
+  return static_cast<size_t>(resident) * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#elif defined(__APPLE__)
+  mach_task_basic_info info;
+  mach_msg_type_number_t count = MACH_TASK_BASIC_INFO_COUNT;
+  if (task_info(mach_task_self(), MACH_TASK_BASIC_INFO,
+                reinterpret_cast<task_info_t>(&info), &count) != KERN_SUCCESS)
+    return 0;
+  return static_cast<size_t>(info.resident_size);
+#else
+  return 0;
+#endif
+}
+
+
+size_t
+GetProcessPeakRSS()
+{
+#if defined(__linux__) || defined(__APPLE__)
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#if defined(__APPLE__)
+  return static_cast<size_t>(usage.ru_maxrss);
+#else
+  return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#else
+  return 0;
+#endif
+}
+
+}  // namespace olio
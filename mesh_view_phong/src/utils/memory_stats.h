@@ -0,0 +1,99 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       memory_stats.h
+//! \brief      CPU/GPU memory accounting for scene resources
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <utility>
+#include "types.h"
+
+namespace olio {
+
+//! \struct MemoryStats
+//! \brief Bytes held by a resource, split by where they live
+struct MemoryStats {
+  size_t connectivity_bytes{0};  //!< OpenMesh vertices/halfedges/edges/faces
+  size_t property_bytes{0};      //!< OpenMesh properties (points, normals, ...)
+  size_t staging_bytes{0};       //!< resident CPU vertex/index arrays
+  size_t bvh_bytes{0};           //!< ray query acceleration structures
+  size_t gpu_bytes{0};           //!< GL buffers and programs
+  size_t upload_bytes{0};        //!< peak temporary CPU bytes of the last
+                                 //!  upload (not resident)
+
+  //! \brief Resident CPU bytes
+  size_t GetCPUBytes() const {
+    return connectivity_bytes + property_bytes + staging_bytes + bvh_bytes;
+  }
+
+  //! \brief Resident CPU and GPU bytes
+  size_t GetTotalBytes() const {return GetCPUBytes() + gpu_bytes;}
+
+  MemoryStats& operator+=(const MemoryStats &rhs);
+};
+
+
+//! \class MemoryReport
+//! \brief Per-resource memory stats of a scene
+class MemoryReport {
+public:
+  //! \brief Add a resource to the report
+  //! \param[in] name resource name
+  //! \param[in] stats resource memory stats
+  void Add(const std::string &name, const MemoryStats &stats);
+
+  //! \brief Sum of all resources
+  MemoryStats GetTotal() const;
+
+  //! \brief Print one line per resource, and the total
+  //! \param[in] title report title
+  void Print(const std::string &title) const;
+protected:
+  std::vector<std::pair<std::string, MemoryStats>> entries_;
+};
+
+
+//! \class PeakMemoryTracker
+//! \brief Tracks the peak of sampled (accounted) bytes and the process
+//!        resident set size over a phase, e.g. loading and uploading
+//!        the scene
+class PeakMemoryTracker {
+public:
+  //! \brief Start a new phase
+  //! \param[in] phase phase name used when printing
+  void Begin(const std::string &phase);
+
+  //! \brief Record the bytes currently accounted for
+  //! \param[in] bytes accounted bytes
+  void Sample(size_t bytes);
+
+  //! \brief End the phase and print the peaks
+  void End();
+
+  size_t GetPeakBytes() const {return peak_bytes_;}
+  size_t GetPeakRSS() const {return peak_rss_;}
+protected:
+  std::string phase_;
+  size_t peak_bytes_{0};
+  size_t peak_rss_{0};
+};
+
+
+//! \brief Format a byte count with a binary unit (B, KB, MB, GB)
+std::string FormatBytes(size_t bytes);
+
+//! \brief Current resident set size of the process (0 if unavailable)
+size_t GetProcessRSS();
+
+//! \brief Peak resident set size of the process (0 if unavailable)
+size_t GetProcessPeakRSS();
+
+}  // namespace olio
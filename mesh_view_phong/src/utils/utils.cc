@@ -18,6 +18,7 @@ namespace olio {
 
 using namespace std;
 
+#ifdef OLIO_SYNC_GL_ERRORS
 bool
 CheckOpenGLError()
 {
@@ -30,5 +31,6 @@ CheckOpenGLError()
   }
   return found_error;
 }
+#endif
 
 }  // namespace olio
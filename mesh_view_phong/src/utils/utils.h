@@ -19,7 +19,16 @@
 
 namespace olio {
 
+//! \brief Log (and clear) pending gl errors. glGetError can stall the
+//!        pipeline, so it's only called in builds with
+//!        OLIO_SYNC_GL_ERRORS (debug builds); other builds rely on
+//!        GLDebugOutput
+//! \return true if there were errors
+#ifdef OLIO_SYNC_GL_ERRORS
 bool CheckOpenGLError();
+#else
+inline bool CheckOpenGLError() {return false;}
+#endif
 
 inline void
 GLMToEigen(const glm::mat4 &glm_mat, Mat4r &m)
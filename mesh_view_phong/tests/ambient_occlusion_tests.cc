@@ -0,0 +1,98 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       ambient_occlusion_tests.cc
+//! \brief      Tests of the ambient occlusion bake
+//! \author     Hadi Fadaifard, 2022
+
+#include <limits>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "ambient_occlusion.h"
+#include "bvh.h"
+#include "mesh_normals.h"
+#include "test_utils.h"
+
+using namespace olio;
+using namespace std;
+
+namespace {
+struct BakeInput {
+  vector<Vec3r> points;
+  vector<uint32_t> indices;
+  vector<Vec3r> normals;
+  BVH bvh;
+  Real diagonal{0};
+};
+
+
+void
+GetBakeInput(uint32_t grid_size, bool flat, BakeInput &input)
+{
+  GetBumpyGrid(grid_size, input.points, input.indices);
+  if (flat) {
+    for (auto &point : input.points)
+      point[2] = 0;
+  }
+  auto face_count = input.indices.size() / 3;
+  VertexCorners adjacency;
+  BuildVertexCorners(input.points.size(), input.indices.data(), face_count, adjacency);
+  input.normals.resize(input.points.size());
+  ComputeVertexNormals(input.points.data(), input.indices.data(), face_count,
+                       adjacency, NormalWeighting::kAngle, input.normals.data());
+  REQUIRE(input.bvh.Build(input.points.data(), input.indices.data(), face_count));
+  Vec3r bmin{Vec3r::Constant(std::numeric_limits<Real>::max())};
+  Vec3r bmax{Vec3r::Constant(std::numeric_limits<Real>::lowest())};
+  for (const auto &point : input.points) {
+    bmin = bmin.cwiseMin(point);
+    bmax = bmax.cwiseMax(point);
+  }
+  input.diagonal = (bmax - bmin).norm();
+}
+
+
+vector<float>
+Bake(const BakeInput &input, const AOSettings &settings)
+{
+  vector<float> occlusion;
+  REQUIRE(BakeAmbientOcclusion(input.bvh, input.points.data(), input.normals.data(),
+                               input.points.size(), input.diagonal, settings,
+                               occlusion));
+  REQUIRE(occlusion.size() == input.points.size());
+  return occlusion;
+}
+}  // namespace
+
+
+TEST_CASE("a plane occludes nothing above it", "[ao]")
+{
+  BakeInput input;
+  GetBakeInput(16, true, input);
+  AOSettings settings;
+  settings.ray_count = 16;
+  for (auto value : Bake(input, settings))
+    CHECK(value == 1.0f);
+}
+
+
+TEST_CASE("ambient occlusion is deterministic", "[ao]")
+{
+  BakeInput input;
+  GetBakeInput(200, false, input);
+  AOSettings settings;
+  settings.ray_count = 16;
+  auto first = Bake(input, settings);
+  bool occluded = false;
+  for (auto value : first) {
+    REQUIRE(value >= 0.0f);
+    REQUIRE(value <= 1.0f);
+    occluded = occluded || value < 1.0f;
+  }
+  CHECK(occluded);
+  for (int run = 0; run < 3; ++run)
+    CHECK(Bake(input, settings) == first);
+}
@@ -0,0 +1,153 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       bvh_tests.cc
+//! \brief      Tests of the BVH and its cache files
+//! \author     Hadi Fadaifard, 2022
+
+#include <string>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "bvh.h"
+#include "test_utils.h"
+
+using namespace olio;
+using namespace std;
+
+namespace {
+constexpr uint64_t kStamp = 42;
+
+template <typename T>
+void
+Append(string &contents, const T *data, size_t count)
+{
+  contents.append(reinterpret_cast<const char*>(data), count * sizeof(T));
+}
+
+
+//! \brief Cache file contents with the given nodes (face i is triangle i)
+string
+GetCacheContents(const vector<BVH::Node> &nodes, const vector<Vec3f> &triangles)
+{
+  size_t face_count = triangles.size() / 3;
+  uint64_t header[3] = {kStamp, face_count, nodes.size()};
+  vector<uint32_t> face_ids(face_count);
+  for (size_t i = 0; i < face_count; ++i)
+    face_ids[i] = static_cast<uint32_t>(i);
+  string contents{"OLIOBVH1"};
+  Append(contents, header, 3);
+  Append(contents, nodes.data(), nodes.size());
+  Append(contents, face_ids.data(), face_ids.size());
+  Append(contents, triangles.data(), triangles.size());
+  return contents;
+}
+
+
+//! \brief Chain of interior nodes: node 2i has children 2i + 1 (a leaf
+//!        holding triangle i) and 2i + 2 (the next link). The last node
+//!        is a leaf, at the given depth
+vector<BVH::Node>
+GetChain(uint32_t depth)
+{
+  vector<BVH::Node> nodes(2 * depth + 1);
+  for (auto &node : nodes) {
+    for (int k = 0; k < 3; ++k) {
+      node.bmin[k] = -1e3f;
+      node.bmax[k] = 1e3f;
+    }
+    node.offset = 0;
+    node.count = 0;
+  }
+  for (uint32_t i = 0; i < depth; ++i) {
+    nodes[2 * i].offset = 2 * i + 1;
+    nodes[2 * i + 1].offset = i;
+    nodes[2 * i + 1].count = 1;
+  }
+  nodes.back().offset = depth;
+  nodes.back().count = 1;
+  return nodes;
+}
+
+
+//! \brief Triangles facing +z, triangle i at z = -i
+vector<Vec3f>
+GetTriangleStack(size_t count)
+{
+  vector<Vec3f> triangles;
+  for (size_t i = 0; i < count; ++i) {
+    auto z = -static_cast<float>(i);
+    triangles.emplace_back(-1, -1, z);
+    triangles.emplace_back(1, -1, z);
+    triangles.emplace_back(0, 1, z);
+  }
+  return triangles;
+}
+}  // namespace
+
+
+TEST_CASE("bvh cache round trip", "[bvh]")
+{
+  vector<Vec3r> points;
+  vector<uint32_t> indices;
+  GetBumpyGrid(16, points, indices);
+  size_t face_count = indices.size() / 3;
+  BVH bvh;
+  REQUIRE(bvh.Build(points.data(), indices.data(), face_count));
+
+  TempDir dir;
+  auto path = dir.GetPath() / "grid.bvh";
+  REQUIRE(bvh.Save(path, kStamp));
+  BVH cached;
+  CHECK_FALSE(cached.Load(path, kStamp + 1, face_count));
+  REQUIRE(cached.Load(path, kStamp, face_count));
+  CHECK(cached.GetNodeCount() == bvh.GetNodeCount());
+
+  Ray ray;
+  ray.origin = Vec3f{0.3f, 0.6f, 10};
+  RayHit hit, cached_hit;
+  REQUIRE(bvh.Intersect(ray, hit));
+  REQUIRE(cached.Intersect(ray, cached_hit));
+  CHECK(cached_hit.face == hit.face);
+  CHECK(cached_hit.t == hit.t);
+}
+
+
+TEST_CASE("bvh cache rejects trees deeper than the traversal stack", "[bvh]")
+{
+  TempDir dir;
+  SECTION("shallow chain") {
+    uint32_t depth = 40;
+    auto triangles = GetTriangleStack(depth + 1);
+    auto path = dir.WriteFile("shallow.bvh", GetCacheContents(GetChain(depth),
+                                                              triangles));
+    BVH bvh;
+    REQUIRE(bvh.Load(path, kStamp, depth + 1));
+    Ray ray;
+    ray.origin = Vec3f{0, 0, 1};
+    RayHit hit;
+    REQUIRE(bvh.Intersect(ray, hit));
+    CHECK(hit.face == 0);
+  }
+  SECTION("deep chain") {
+    uint32_t depth = 200;
+    auto triangles = GetTriangleStack(depth + 1);
+    auto path = dir.WriteFile("deep.bvh", GetCacheContents(GetChain(depth),
+                                                           triangles));
+    BVH bvh;
+    CHECK_FALSE(bvh.Load(path, kStamp, depth + 1));
+    CHECK(bvh.GetNodeCount() == 0);
+  }
+  SECTION("node that lists its parent as a child") {
+    uint32_t depth = 4;
+    auto nodes = GetChain(depth);
+    nodes[2].offset = 0;
+    auto path = dir.WriteFile("cycle.bvh", GetCacheContents(
+                                nodes, GetTriangleStack(depth + 1)));
+    BVH bvh;
+    CHECK_FALSE(bvh.Load(path, kStamp, depth + 1));
+  }
+}
@@ -0,0 +1,141 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       material_library_tests.cc
+//! \brief      Tests of MTL import, and of the diffuse maps of OBJ
+//!             materials reaching the shader
+//! \author     Hadi Fadaifard, 2022
+
+#include <string>
+#include <catch2/catch.hpp>
+#include "trimesh.h"
+#include "utils/glrenderqueue.h"
+#include "utils/gltexture.h"
+#include "utils/glshader_permutations.h"
+#include "utils/material_library.h"
+#include "test_utils.h"
+
+using namespace olio;
+using namespace std;
+
+namespace {
+// 2x2 checker (plain PPM)
+const char *kCheckerPPM =
+  "P3\n2 2\n255\n"
+  "255 255 255  0 0 0\n"
+  "0 0 0  255 255 255\n";
+
+const char *kCheckerMTL =
+  "newmtl checker\n"
+  "Ka 0 0 0\n"
+  "Kd 0.5 0.5 0.5\n"
+  "Ks 0 0 0\n"
+  "map_Kd checker.ppm\n";
+
+// unit square with texture coordinates, using the checker material
+const char *kCheckerOBJ =
+  "mtllib checker.mtl\n"
+  "usemtl checker\n"
+  "v 0 0 0\n"
+  "v 1 0 0\n"
+  "v 1 1 0\n"
+  "v 0 1 0\n"
+  "vt 0 0\n"
+  "vt 1 0\n"
+  "vt 1 1\n"
+  "vt 0 1\n"
+  "f 1/1 2/2 3/3\n"
+  "f 1/1 3/3 4/4\n";
+
+
+// the shader variant the viewer selects for a mesh and material
+// (with the material's diffuse map uploaded)
+GLShaderKey
+GetMeshShaderKey(const TriMesh &mesh, const PhongMaterial &material)
+{
+  GLShaderKey key;
+  key.shading = GLShaderKey::Shading::kPhong;
+  key.has_texcoords = mesh.HasTexCoords();
+  key.has_diffuse_map = material.GetDiffuseMap() != nullptr;
+  return key.Canonical();
+}
+}  // namespace
+
+
+TEST_CASE("mtl coefficients and diffuse map", "[material]")
+{
+  TempDir dir;
+  dir.WriteFile("checker.ppm", kCheckerPPM);
+  auto mtl_path = dir.WriteFile("checker.mtl", kCheckerMTL);
+  GLTextureCache texture_cache{1};
+  MaterialLibrary library{&texture_cache};
+  REQUIRE(library.LoadMTL(mtl_path));
+  auto material = library.GetMaterial(mtl_path, "checker");
+  REQUIRE(material);
+  CHECK(material->GetDiffuse() == Vec3r(0.5, 0.5, 0.5));
+  REQUIRE(material->GetDiffuseMap());
+  CHECK(material->GetDiffuseMap()->GetPath() ==
+        boost::filesystem::canonical(dir.GetPath() / "checker.ppm"));
+
+  // without a texture cache, maps are ignored
+  MaterialLibrary untextured_library;
+  REQUIRE(untextured_library.LoadMTL(mtl_path));
+  auto untextured = untextured_library.GetMaterial(mtl_path, "checker");
+  REQUIRE(untextured);
+  CHECK_FALSE(untextured->GetDiffuseMap());
+}
+
+
+TEST_CASE("obj map_Kd is sampled after a compact upload", "[material][gl]")
+{
+  InstallGLBufferStubs();
+  TempDir dir;
+  dir.WriteFile("checker.ppm", kCheckerPPM);
+  dir.WriteFile("checker.mtl", kCheckerMTL);
+  auto obj_path = dir.WriteFile("checker.obj", kCheckerOBJ);
+  GLTextureCache texture_cache{1};
+  MaterialLibrary library{&texture_cache};
+  auto material = library.LoadOBJMaterial(obj_path);
+  REQUIRE(material);
+  REQUIRE(material->GetDiffuseMap());
+
+  // the viewer's default retention releases the topology on upload
+  TriMesh mesh;
+  mesh.SetRetention(TriMesh::Retention::kCompact);
+  REQUIRE(mesh.Load(obj_path));
+  CHECK(GetMeshShaderKey(mesh, *material).has_diffuse_map);
+  mesh.UpdateGLBuffers();
+  REQUIRE_FALSE(mesh.HasTopology());
+  CHECK(GetMeshShaderKey(mesh, *material).has_diffuse_map);
+  GLDrawGeometry geometry;
+  REQUIRE(mesh.GetGLDrawGeometry(geometry));
+  CHECK(geometry.has_texcoords);
+}
+
+
+TEST_CASE("diffuse maps need texcoords", "[material]")
+{
+  TempDir dir;
+  dir.WriteFile("checker.ppm", kCheckerPPM);
+  dir.WriteFile("checker.mtl", kCheckerMTL);
+  // same material, but no texture coordinates
+  auto obj_path = dir.WriteFile("untextured.obj",
+                                "mtllib checker.mtl\n"
+                                "usemtl checker\n"
+                                "v 0 0 0\n"
+                                "v 1 0 0\n"
+                                "v 1 1 0\n"
+                                "f 1 2 3\n");
+  GLTextureCache texture_cache{1};
+  MaterialLibrary library{&texture_cache};
+  auto material = library.LoadOBJMaterial(obj_path);
+  REQUIRE(material);
+  TriMesh mesh;
+  REQUIRE(mesh.Load(obj_path));
+  CHECK_FALSE(mesh.HasTexCoords());
+  CHECK_FALSE(GetMeshShaderKey(mesh, *material).has_diffuse_map);
+}
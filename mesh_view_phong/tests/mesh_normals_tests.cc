@@ -0,0 +1,181 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       mesh_normals_tests.cc
+//! \brief      Tests of the flat-array face/vertex normal kernels
+//! \author     Hadi Fadaifard, 2022
+
+#include <cmath>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "mesh_normals.h"
+#include "test_utils.h"
+
+using namespace olio;
+using namespace std;
+
+namespace {
+// tolerance of normals computed in Real (float or double) precision
+constexpr double kTolerance = 1e-5;
+
+double
+Distance(const Vec3r &a, const Vec3r &b)
+{
+  return static_cast<double>((a - b).norm());
+}
+
+
+vector<Vec3r>
+GetVertexNormals(const vector<Vec3r> &points, const vector<uint32_t> &indices,
+                 NormalWeighting weighting)
+{
+  VertexCorners adjacency;
+  BuildVertexCorners(points.size(), indices.data(), indices.size() / 3, adjacency);
+  vector<Vec3r> normals(points.size());
+  ComputeVertexNormals(points.data(), indices.data(), indices.size() / 3,
+                       adjacency, weighting, normals.data());
+  return normals;
+}
+
+
+// straightforward face-order scatter, in double precision
+vector<Vec3d>
+GetReferenceVertexNormals(const vector<Vec3r> &points,
+                          const vector<uint32_t> &indices, NormalWeighting weighting)
+{
+  vector<Vec3d> normals(points.size(), Vec3d::Zero());
+  for (size_t f = 0; f < indices.size() / 3; ++f) {
+    const auto *face = &indices[3 * f];
+    for (size_t k = 0; k < 3; ++k) {
+      Vec3d p0 = points[face[k]].cast<double>();
+      Vec3d e1 = points[face[(k + 1) % 3]].cast<double>() - p0;
+      Vec3d e2 = points[face[(k + 2) % 3]].cast<double>() - p0;
+      Vec3d face_normal = e1.cross(e2);
+      double weight = 1.0;
+      if (weighting == NormalWeighting::kArea)
+        weight = face_normal.norm();
+      else if (weighting == NormalWeighting::kAngle)
+        weight = std::acos(e1.normalized().dot(e2.normalized()));
+      normals[face[k]] += weight * face_normal.normalized();
+    }
+  }
+  for (auto &normal : normals)
+    normal.normalize();
+  return normals;
+}
+}  // namespace
+
+
+TEST_CASE("face normals follow the winding", "[normals]")
+{
+  vector<Vec3r> points{Vec3r{0, 0, 0}, Vec3r{2, 0, 0}, Vec3r{0, 3, 0},
+                       Vec3r{1, 1, 1}};
+  vector<uint32_t> indices{0, 1, 2,  0, 2, 1,  0, 1, 1};
+  vector<Vec3r> normals(3);
+  ComputeFaceNormals(points.data(), indices.data(), 3, normals.data());
+  CHECK(Distance(normals[0], Vec3r{0, 0, 1}) <= kTolerance);
+  CHECK(Distance(normals[1], Vec3r{0, 0, -1}) <= kTolerance);
+  // degenerate faces get a zero normal
+  CHECK(normals[2] == Vec3r::Zero());
+}
+
+
+TEST_CASE("cube face normals point outward", "[normals]")
+{
+  vector<Vec3r> points;
+  vector<uint32_t> indices;
+  GetCube(points, indices);
+  vector<Vec3r> normals(indices.size() / 3);
+  ComputeFaceNormals(points.data(), indices.data(), normals.size(), normals.data());
+  for (size_t f = 0; f < normals.size(); ++f) {
+    // the face's centroid lies on its side of the cube, so the
+    // outward normal is its (only) nonzero coordinate
+    Vec3r centroid = (points[indices[3 * f]] + points[indices[3 * f + 1]] +
+                      points[indices[3 * f + 2]]) / 3;
+    Eigen::Index axis = 0;
+    centroid.cwiseAbs().maxCoeff(&axis);
+    Vec3r expected = Vec3r::Zero();
+    expected[axis] = centroid[axis] > 0 ? 1 : -1;
+    INFO("face " << f);
+    CHECK(Distance(normals[f], expected) <= kTolerance);
+  }
+}
+
+
+TEST_CASE("vertex corners are grouped by vertex in increasing order", "[normals]")
+{
+  // vertex 4 is isolated
+  vector<uint32_t> indices{0, 1, 2,  0, 2, 3};
+  VertexCorners adjacency;
+  BuildVertexCorners(5, indices.data(), 2, adjacency);
+  CHECK(adjacency.offsets == vector<uint32_t>({0, 2, 3, 5, 6, 6}));
+  CHECK(adjacency.corners == vector<uint32_t>({0, 3, 1, 2, 4, 5}));
+}
+
+
+TEST_CASE("vertex normals of a plane are the plane normal", "[normals]")
+{
+  vector<Vec3r> points{Vec3r{0, 0, 0}, Vec3r{1, 0, 0}, Vec3r{3, 1, 0},
+                       Vec3r{0, 2, 0}, Vec3r{5, 5, 5}};
+  vector<uint32_t> indices{0, 1, 2,  0, 2, 3};
+  for (auto weighting : {NormalWeighting::kUniform, NormalWeighting::kArea,
+                         NormalWeighting::kAngle}) {
+    auto normals = GetVertexNormals(points, indices, weighting);
+    INFO("weighting " << static_cast<int>(weighting));
+    for (size_t v = 0; v < 4; ++v)
+      CHECK(Distance(normals[v], Vec3r{0, 0, 1}) <= kTolerance);
+    // isolated vertices get a zero normal
+    CHECK(normals[4] == Vec3r::Zero());
+  }
+}
+
+
+TEST_CASE("angle weighted cube normals point along the diagonals", "[normals]")
+{
+  // each corner of the cube sees a right angle on each of its three
+  // sides, however the sides are split into triangles
+  vector<Vec3r> points;
+  vector<uint32_t> indices;
+  GetCube(points, indices);
+  auto normals = GetVertexNormals(points, indices, NormalWeighting::kAngle);
+  for (size_t v = 0; v < points.size(); ++v) {
+    INFO("vertex " << v);
+    CHECK(Distance(normals[v], points[v].normalized()) <= kTolerance);
+  }
+}
+
+
+TEST_CASE("vertex normals match a face-order reference", "[normals]")
+{
+  vector<Vec3r> points;
+  vector<uint32_t> indices;
+  GetBumpyGrid(64, points, indices);
+  for (auto weighting : {NormalWeighting::kUniform, NormalWeighting::kArea,
+                         NormalWeighting::kAngle}) {
+    auto normals = GetVertexNormals(points, indices, weighting);
+    auto reference = GetReferenceVertexNormals(points, indices, weighting);
+    double max_error = 0;
+    for (size_t v = 0; v < points.size(); ++v)
+      max_error = std::max(max_error, (normals[v].cast<double>() - reference[v]).norm());
+    INFO("weighting " << static_cast<int>(weighting));
+    CHECK(max_error <= kTolerance);
+  }
+}
+
+
+TEST_CASE("vertex normals are deterministic", "[normals]")
+{
+  vector<Vec3r> points;
+  vector<uint32_t> indices;
+  GetBumpyGrid(300, points, indices);
+  for (auto weighting : {NormalWeighting::kUniform, NormalWeighting::kArea,
+                         NormalWeighting::kAngle}) {
+    auto first = GetVertexNormals(points, indices, weighting);
+    for (int run = 0; run < 3; ++run)
+      CHECK(GetVertexNormals(points, indices, weighting) == first);
+  }
+}
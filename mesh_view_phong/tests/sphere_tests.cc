@@ -0,0 +1,124 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       sphere_tests.cc
+//! \brief      Tests of the watertight sphere tessellation
+//! \author     Hadi Fadaifard, 2022
+
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "sphere.h"
+
+using namespace olio;
+using namespace std;
+
+namespace {
+struct SphereArrays {
+  vector<GLfloat> vertices;
+  vector<GLuint> indices;
+};
+
+
+SphereArrays
+BuildSphere(const Vec3r &center, Real radius, uint grid_nx, uint grid_ny)
+{
+  size_t vertex_count = 0, index_count = 0;
+  GetWatertightSphereSize(grid_nx, grid_ny, vertex_count, index_count);
+  SphereArrays sphere;
+  sphere.vertices.resize(6 * vertex_count);
+  sphere.indices.resize(index_count);
+  BuildWatertightSphereVertices(center, radius, grid_nx, grid_ny, sphere.vertices.data());
+  BuildWatertightSphereIndices(grid_nx, grid_ny, sphere.indices.data());
+  return sphere;
+}
+
+
+Vec3d
+GetPosition(const SphereArrays &sphere, GLuint index)
+{
+  const auto *vertex = &sphere.vertices[6 * index];
+  return Vec3d{vertex[0], vertex[1], vertex[2]};
+}
+}  // namespace
+
+
+TEST_CASE("watertight sphere counts", "[sphere]")
+{
+  for (auto grid : {make_pair(3u, 2u), make_pair(10u, 10u), make_pair(64u, 17u),
+                    make_pair(2048u, 2048u)}) {
+    size_t vertex_count = 0, index_count = 0;
+    GetWatertightSphereSize(grid.first, grid.second, vertex_count, index_count);
+    // grid_ny - 1 rings plus two poles; two triangles per quad
+    // between rings and one per pole fan segment
+    size_t nx = grid.first, ny = grid.second;
+    INFO(nx << "x" << ny);
+    CHECK(vertex_count == nx * (ny - 1) + 2);
+    CHECK(index_count == 6 * nx * (ny - 1));
+  }
+}
+
+
+TEST_CASE("watertight sphere vertices lie on the sphere", "[sphere]")
+{
+  const Vec3r center{1, -2, 3};
+  const Real radius = 2;
+  auto sphere = BuildSphere(center, radius, 48, 31);
+  double max_radius_error = 0, max_normal_error = 0;
+  for (size_t i = 0; i < sphere.vertices.size() / 6; ++i) {
+    const auto *vertex = &sphere.vertices[6 * i];
+    Vec3d offset = Vec3d{vertex[0], vertex[1], vertex[2]} - center.cast<double>();
+    Vec3d normal{vertex[3], vertex[4], vertex[5]};
+    max_radius_error = std::max(max_radius_error, std::abs(offset.norm() - radius));
+    max_normal_error = std::max(max_normal_error, (normal - offset / radius).norm());
+  }
+  CHECK(max_radius_error <= 1e-5);
+  CHECK(max_normal_error <= 1e-5);
+}
+
+
+TEST_CASE("watertight sphere is closed and oriented outward", "[sphere]")
+{
+  for (auto grid : {make_pair(3u, 2u), make_pair(16u, 9u), make_pair(100u, 100u)}) {
+    auto sphere = BuildSphere(Vec3r{0, 0, 0}, 1, grid.first, grid.second);
+    auto vertex_count = sphere.vertices.size() / 6;
+    INFO(grid.first << "x" << grid.second);
+
+    // every directed edge is used once, and its reverse is too
+    map<pair<GLuint, GLuint>, int> edges;
+    bool in_range = true, outward = true;
+    for (size_t f = 0; f < sphere.indices.size() / 3; ++f) {
+      const auto *face = &sphere.indices[3 * f];
+      for (int k = 0; k < 3; ++k) {
+        in_range = in_range && face[k] < vertex_count;
+        ++edges[make_pair(face[k], face[(k + 1) % 3])];
+      }
+      if (!in_range)
+        break;
+      Vec3d p0 = GetPosition(sphere, face[0]);
+      Vec3d normal = (GetPosition(sphere, face[1]) - p0).cross(GetPosition(sphere, face[2]) - p0);
+      outward = outward && normal.dot(p0 + GetPosition(sphere, face[1]) +
+                                      GetPosition(sphere, face[2])) > 0;
+    }
+    REQUIRE(in_range);
+    CHECK(outward);
+    size_t bad_edges = 0;
+    for (const auto &edge : edges) {
+      auto reverse = edges.find(make_pair(edge.first.second, edge.first.first));
+      if (edge.second != 1 || reverse == edges.end() || reverse->second != 1)
+        ++bad_edges;
+    }
+    CHECK(bad_edges == 0);
+
+    // genus 0: V - E + F = 2
+    auto euler = static_cast<long>(vertex_count) - static_cast<long>(edges.size() / 2) +
+      static_cast<long>(sphere.indices.size() / 3);
+    CHECK(euler == 2);
+  }
+}
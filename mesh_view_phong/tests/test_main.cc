@@ -0,0 +1,13 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       test_main.cc
+//! \brief      Catch2 entry point of olio_tests
+//! \author     Hadi Fadaifard, 2022
+
+#define CATCH_CONFIG_MAIN
+#include <catch2/catch.hpp>
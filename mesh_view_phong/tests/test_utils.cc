@@ -0,0 +1,202 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       test_utils.cc
+//! \brief      Scratch files and in-memory gl buffers for the tests
+//! \author     Hadi Fadaifard, 2022
+
+#include "test_utils.h"
+#include <cmath>
+#include <map>
+#include <sstream>
+#include <boost/filesystem/fstream.hpp>
+
+namespace olio {
+
+using namespace std;
+namespace fs=boost::filesystem;
+
+void
+GetCube(vector<Vec3r> &points, vector<uint32_t> &indices)
+{
+  points.clear();
+  for (int i = 0; i < 8; ++i)
+    points.push_back(Vec3r{Real(i & 1 ? 1 : -1), Real(i & 2 ? 1 : -1),
+                            Real(i & 4 ? 1 : -1)});
+  // two triangles per side: -z, +z, -y, +y, -x, +x
+  indices = {0, 2, 3,  0, 3, 1,
+             4, 5, 7,  4, 7, 6,
+             0, 1, 5,  0, 5, 4,
+             2, 6, 7,  2, 7, 3,
+             0, 4, 6,  0, 6, 2,
+             1, 3, 7,  1, 7, 5};
+}
+
+
+void
+GetBumpyGrid(uint32_t size, vector<Vec3r> &points, vector<uint32_t> &indices)
+{
+  points.clear();
+  indices.clear();
+  auto scale = 1.0 / size;
+  for (uint32_t j = 0; j <= size; ++j)
+    for (uint32_t i = 0; i <= size; ++i) {
+      auto x = i * scale, y = j * scale;
+      auto z = 0.2 * std::sin(7.0 * x) * std::cos(5.0 * y) + 0.05 * x * x;
+      points.push_back(Vec3d{x, y, z}.cast<Real>());
+    }
+  for (uint32_t j = 0; j < size; ++j)
+    for (uint32_t i = 0; i < size; ++i) {
+      auto v = j * (size + 1) + i;
+      indices.insert(indices.end(), {v, v + 1, v + size + 2,
+                                     v, v + size + 2, v + size + 1});
+    }
+}
+
+
+string
+ToOFF(const vector<Vec3r> &points, const vector<uint32_t> &indices)
+{
+  ostringstream out;
+  out.precision(9);
+  out << "OFF\n" << points.size() << " " << indices.size() / 3 << " 0\n";
+  for (const auto &point : points)
+    out << point[0] << " " << point[1] << " " << point[2] << "\n";
+  for (size_t i = 0; i + 2 < indices.size(); i += 3)
+    out << "3 " << indices[i] << " " << indices[i + 1] << " " << indices[i + 2] << "\n";
+  return out.str();
+}
+
+
+TempDir::TempDir() :
+  path_{fs::temp_directory_path() / fs::unique_path("olio_tests_%%%%-%%%%-%%%%")}
+{
+  fs::create_directories(path_);
+}
+
+
+TempDir::~TempDir()
+{
+  boost::system::error_code ec;
+  fs::remove_all(path_, ec);
+}
+
+
+fs::path
+TempDir::WriteFile(const string &filename, const string &contents) const
+{
+  auto filepath = path_ / filename;
+  fs::ofstream out{filepath, ios::binary};
+  out << contents;
+  return out ? filepath : fs::path{};
+}
+
+
+namespace {
+// in-memory buffers, and the buffer bound to each target
+map<GLuint, vector<unsigned char>> stub_buffers_g;
+map<GLenum, GLuint> stub_bindings_g;
+GLuint stub_next_buffer_g = 1;
+
+vector<unsigned char>*
+GetBoundBuffer(GLenum target)
+{
+  auto it = stub_buffers_g.find(stub_bindings_g[target]);
+  return it != stub_buffers_g.end() ? &it->second : nullptr;
+}
+
+
+void GLAPIENTRY
+StubGenBuffers(GLsizei n, GLuint *buffers)
+{
+  for (GLsizei i = 0; i < n; ++i) {
+    buffers[i] = stub_next_buffer_g++;
+    stub_buffers_g[buffers[i]];
+  }
+}
+
+
+void GLAPIENTRY
+StubBindBuffer(GLenum target, GLuint buffer)
+{
+  stub_bindings_g[target] = buffer;
+}
+
+
+void GLAPIENTRY
+StubBufferData(GLenum target, GLsizeiptr size, const void *data, GLenum /*usage*/)
+{
+  auto buffer = GetBoundBuffer(target);
+  if (!buffer)
+    return;
+  const auto *bytes = static_cast<const unsigned char*>(data);
+  if (bytes)
+    buffer->assign(bytes, bytes + size);
+  else
+    buffer->assign(static_cast<size_t>(size), 0);
+}
+
+
+void* GLAPIENTRY
+StubMapBufferRange(GLenum target, GLintptr offset, GLsizeiptr length,
+                   GLbitfield /*access*/)
+{
+  auto buffer = GetBoundBuffer(target);
+  if (!buffer || offset < 0 || length <= 0 ||
+      static_cast<size_t>(offset + length) > buffer->size())
+    return nullptr;
+  return &(*buffer)[static_cast<size_t>(offset)];
+}
+
+
+GLboolean GLAPIENTRY
+StubUnmapBuffer(GLenum target)
+{
+  return GetBoundBuffer(target) ? GL_TRUE : GL_FALSE;
+}
+
+
+void GLAPIENTRY
+StubDeleteBuffers(GLsizei n, const GLuint *buffers)
+{
+  for (GLsizei i = 0; i < n; ++i) {
+    stub_buffers_g.erase(buffers[i]);
+    for (auto &binding : stub_bindings_g)
+      if (binding.second == buffers[i])
+        binding.second = 0;
+  }
+}
+}  // namespace
+
+
+void
+InstallGLBufferStubs()
+{
+  __glewGenBuffers = StubGenBuffers;
+  __glewBindBuffer = StubBindBuffer;
+  __glewBufferData = StubBufferData;
+  __glewMapBufferRange = StubMapBufferRange;
+  __glewUnmapBuffer = StubUnmapBuffer;
+  __glewDeleteBuffers = StubDeleteBuffers;
+}
+
+
+const vector<unsigned char>*
+GetStubBuffer(GLuint buffer)
+{
+  auto it = stub_buffers_g.find(buffer);
+  return it != stub_buffers_g.end() ? &it->second : nullptr;
+}
+
+
+size_t
+GetStubBufferCount()
+{
+  return stub_buffers_g.size();
+}
+
+}  // namespace olio
@@ -0,0 +1,93 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       test_utils.h
+//! \brief      Scratch files and in-memory gl buffers for the tests
+//! \author     Hadi Fadaifard, 2022
+
+#pragma once
+
+#include <cstring>
+#include <string>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <GL/glew.h>
+#include "types.h"
+
+namespace olio {
+
+//! \brief Cube [-1, 1]^3 with outward facing (counterclockwise)
+//!        triangles. Vertex i is at (+-1, +-1, +-1), with the signs
+//!        given by bits 0, 1 and 2 of i
+//! \param[out] points 8 vertex positions
+//! \param[out] indices 12 triangles
+void GetCube(std::vector<Vec3r> &points, std::vector<uint32_t> &indices);
+
+//! \brief Grid of size x size quads over [0, 1]^2, split into
+//!        triangles facing +z, with heights varying smoothly, so
+//!        triangle areas and angles differ
+//! \param[out] points (size + 1)^2 vertex positions
+//! \param[out] indices 2 * size^2 triangles
+void GetBumpyGrid(uint32_t size, std::vector<Vec3r> &points,
+                  std::vector<uint32_t> &indices);
+
+//! \brief Format a triangle mesh as an OFF file
+std::string ToOFF(const std::vector<Vec3r> &points,
+                  const std::vector<uint32_t> &indices);
+
+//! \class TempDir
+//! \brief Unique scratch directory, removed with its contents on
+//!        destruction
+class TempDir {
+public:
+  TempDir();
+  TempDir(const TempDir &) = delete;
+  TempDir& operator=(const TempDir &) = delete;
+  ~TempDir();
+
+  //! \brief Write a text file into the directory
+  //! \param[in] filename file name (relative to the directory)
+  //! \param[in] contents file contents
+  //! \return path of the file (empty on failure)
+  boost::filesystem::path WriteFile(const std::string &filename,
+                                    const std::string &contents) const;
+
+  const boost::filesystem::path& GetPath() const {return path_;}
+protected:
+  boost::filesystem::path path_;
+};
+
+//! \brief Point the GLEW buffer entry points (glGenBuffers,
+//!        glBindBuffer, glBufferData, glMapBufferRange, glUnmapBuffer,
+//!        glDeleteBuffers) at in-memory buffers, so uploads can be
+//!        checked without a gl context
+void InstallGLBufferStubs();
+
+//! \brief Contents of an in-memory buffer
+//! \param[in] buffer buffer name
+//! \return buffer data (nullptr if the buffer doesn't exist)
+const std::vector<unsigned char>* GetStubBuffer(GLuint buffer);
+
+//! \brief Number of in-memory buffers that have not been deleted
+size_t GetStubBufferCount();
+
+//! \brief Reinterpret the contents of an in-memory buffer
+//! \return buffer elements (empty if the buffer doesn't exist)
+template <typename T>
+std::vector<T> GetStubBufferData(GLuint buffer)
+{
+  std::vector<T> data;
+  auto bytes = GetStubBuffer(buffer);
+  if (!bytes)
+    return data;
+  data.resize(bytes->size() / sizeof(T));
+  if (!data.empty())
+    std::memcpy(&data[0], bytes->data(), data.size() * sizeof(T));
+  return data;
+}
+
+}  // namespace olio
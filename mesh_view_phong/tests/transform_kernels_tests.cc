@@ -0,0 +1,248 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       transform_kernels_tests.cc
+//! \brief      Tests of the batched SoA transform kernels against
+//!             XformPoint/XformVector
+//! \author     Hadi Fadaifard, 2022
+
+#include <cmath>
+#include <random>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "transform_kernels.h"
+
+using namespace olio;
+using namespace std;
+
+namespace {
+// counts around the simd widths (4 and 8 lanes), and above the
+// threshold at which the kernels split the input across threads
+const size_t kCounts[] = {1, 3, 4, 5, 7, 8, 9, 13, 16, 17, 1003, 65536 + 13};
+
+vector<Vec3r>
+GetRandomPoints(size_t count, uint32_t seed)
+{
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> uniform(-10, 10);
+  vector<Vec3r> points(count);
+  for (auto &point : points)
+    point = Vec3r{static_cast<Real>(uniform(rng)), static_cast<Real>(uniform(rng)),
+                  static_cast<Real>(uniform(rng))};
+  return points;
+}
+
+
+//! \brief Rotation, scale and translation
+Mat4r
+GetAffineTransform()
+{
+  Mat4r xform{Mat4r::Identity()};
+  xform.topLeftCorner<3, 3>() = Real(1.5) *
+    Eigen::AngleAxis<Real>(Real(0.7), Vec3r{1, 2, 3}.normalized()).toRotationMatrix();
+  xform.topRightCorner<3, 1>() = Vec3r{Real(0.1), -2, 3};
+  return xform;
+}
+
+
+//! \brief Perspective projection behind an affine transform (w stays
+//!        away from zero for the random points)
+Mat4r
+GetProjectiveTransform()
+{
+  Mat4r projection{Mat4r::Identity()};
+  projection(3, 2) = Real(0.02);
+  projection(3, 3) = 1;
+  return projection * GetAffineTransform();
+}
+
+
+//! \brief Largest error relative to (1 + |reference|)
+double
+GetMaxError(const vector<Vec3r> &result, const vector<Vec3r> &reference)
+{
+  double max_error = 0;
+  for (size_t i = 0; i < reference.size(); ++i) {
+    auto scale = 1.0 + static_cast<double>(reference[i].norm());
+    max_error = std::max(max_error,
+                         static_cast<double>((result[i] - reference[i]).norm()) / scale);
+  }
+  return max_error;
+}
+
+
+//! \brief Rotation with non-uniform scale (and a translation, which
+//!        vectors and normals must ignore)
+Mat4r
+GetNonUniformTransform()
+{
+  Mat4r xform{GetAffineTransform()};
+  xform.topLeftCorner<3, 3>() = xform.topLeftCorner<3, 3>() *
+    Vec3r{3, Real(0.5), 1}.asDiagonal();
+  return xform;
+}
+
+
+template <typename SoA>
+vector<Vec3r>
+GetTransformedPoints(const Mat4r &xform, const vector<Vec3r> &points, bool in_place)
+{
+  SoA input, output;
+  ToSoA(points.data(), points.size(), input);
+  if (in_place) {
+    TransformPoints(xform, input, input);
+    output = input;
+  } else {
+    TransformPoints(xform, input, output);
+  }
+  vector<Vec3r> result(output.size());
+  FromSoA(output, result.data());
+  return result;
+}
+
+
+template <typename SoA>
+void
+CheckPoints(const Mat4r &xform, double tolerance)
+{
+  for (auto count : kCounts) {
+    auto points = GetRandomPoints(count, static_cast<uint32_t>(count));
+    vector<Vec3r> reference(count);
+    for (size_t i = 0; i < count; ++i)
+      reference[i] = XformPoint(xform, points[i]);
+    INFO("count " << count << " (" << GetTransformKernelsISA() << ")");
+    auto result = GetTransformedPoints<SoA>(xform, points, false);
+    REQUIRE(result.size() == count);
+    CHECK(GetMaxError(result, reference) <= tolerance);
+    CHECK(GetTransformedPoints<SoA>(xform, points, true) == result);
+  }
+}
+
+
+enum class LinearKind {kVectors, kNormals};
+
+template <typename SoA>
+vector<Vec3r>
+GetTransformedVectors(const Mat4r &xform, LinearKind kind, const vector<Vec3r> &vectors,
+                      bool in_place)
+{
+  SoA input, output;
+  ToSoA(vectors.data(), vectors.size(), input);
+  auto &result_soa = in_place ? input : output;
+  if (kind == LinearKind::kVectors)
+    TransformVectors(xform, input, result_soa);
+  else
+    TransformNormals(xform, input, result_soa);
+  vector<Vec3r> result(result_soa.size());
+  FromSoA(result_soa, result.data());
+  return result;
+}
+
+
+template <typename SoA>
+void
+CheckVectors(const Mat4r &xform, LinearKind kind, double tolerance)
+{
+  Mat4r normal_xform{Mat4r::Identity()};
+  normal_xform.topLeftCorner<3, 3>() =
+    xform.topLeftCorner<3, 3>().inverse().transpose();
+  for (auto count : kCounts) {
+    auto vectors = GetRandomPoints(count, static_cast<uint32_t>(count) + 1);
+    vectors[count / 2] = Vec3r::Zero();
+    vector<Vec3r> reference(count);
+    for (size_t i = 0; i < count; ++i) {
+      if (kind == LinearKind::kVectors)
+        reference[i] = XformVector(xform, vectors[i]);
+      else
+        reference[i] = XformVector(normal_xform, vectors[i]).normalized();
+    }
+    INFO("count " << count << " (" << GetTransformKernelsISA() << ")");
+    auto result = GetTransformedVectors<SoA>(xform, kind, vectors, false);
+    REQUIRE(result.size() == count);
+    CHECK(GetMaxError(result, reference) <= tolerance);
+    CHECK(result[count / 2] == Vec3r::Zero());
+    CHECK(GetTransformedVectors<SoA>(xform, kind, vectors, true) == result);
+  }
+}
+}  // namespace
+
+
+TEST_CASE("soa round trip", "[transform]")
+{
+  auto points = GetRandomPoints(13, 1);
+  SoAPointsd soa;
+  ToSoA(points.data(), points.size(), soa);
+  REQUIRE(soa.size() == points.size());
+  vector<Vec3r> result(soa.size());
+  FromSoA(soa, result.data());
+  CHECK(result == points);
+}
+
+
+TEST_CASE("batched point transforms match XformPoint", "[transform]")
+{
+  SECTION("affine") {
+    CheckPoints<SoAPointsf>(GetAffineTransform(), 1e-5);
+    CheckPoints<SoAPointsd>(GetAffineTransform(), 1e-5);
+  }
+  SECTION("projective") {
+    CheckPoints<SoAPointsf>(GetProjectiveTransform(), 1e-5);
+    CheckPoints<SoAPointsd>(GetProjectiveTransform(), 1e-5);
+  }
+}
+
+
+TEST_CASE("batched transforms of empty inputs", "[transform]")
+{
+  SoAPointsf input, output;
+  output.resize(3);
+  TransformPoints(GetAffineTransform(), input, output);
+  CHECK(output.size() == 0);
+}
+
+
+TEST_CASE("batched vector transforms match XformVector", "[transform]")
+{
+  CheckVectors<SoAPointsf>(GetNonUniformTransform(), LinearKind::kVectors, 1e-5);
+  CheckVectors<SoAPointsd>(GetNonUniformTransform(), LinearKind::kVectors, 1e-5);
+}
+
+
+TEST_CASE("batched normal transforms use the inverse transpose", "[transform]")
+{
+  SECTION("uniform scale") {
+    CheckVectors<SoAPointsf>(GetAffineTransform(), LinearKind::kNormals, 1e-5);
+    CheckVectors<SoAPointsd>(GetAffineTransform(), LinearKind::kNormals, 1e-5);
+  }
+  SECTION("non-uniform scale") {
+    CheckVectors<SoAPointsf>(GetNonUniformTransform(), LinearKind::kNormals, 1e-5);
+    CheckVectors<SoAPointsd>(GetNonUniformTransform(), LinearKind::kNormals, 1e-5);
+  }
+}
+
+
+TEST_CASE("transformed normals stay perpendicular to transformed tangents",
+          "[transform]")
+{
+  // a tangent plane spanned by two vectors maps to the plane spanned by
+  // their transforms; the transformed normal must stay perpendicular
+  auto xform = GetNonUniformTransform();
+  auto tangents = GetRandomPoints(2 * 37, 3);
+  vector<Vec3r> normals(37);
+  for (size_t i = 0; i < normals.size(); ++i)
+    normals[i] = tangents[2 * i].cross(tangents[2 * i + 1]);
+  auto result_normals = GetTransformedVectors<SoAPointsf>(xform, LinearKind::kNormals,
+                                                          normals, false);
+  auto result_tangents = GetTransformedVectors<SoAPointsd>(xform, LinearKind::kVectors,
+                                                           tangents, false);
+  for (size_t i = 0; i < normals.size(); ++i) {
+    for (int k = 0; k < 2; ++k) {
+      auto tangent = result_tangents[2 * i + static_cast<size_t>(k)].normalized();
+      CHECK(std::abs(static_cast<double>(result_normals[i].dot(tangent))) < 1e-5);
+    }
+  }
+}
@@ -0,0 +1,275 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file       trimesh_tests.cc
+//! \brief      Tests of TriMesh loading, bounds, normals, and packing
+//!             and uploading of its gl buffers (with gl stubbed)
+//! \author     Hadi Fadaifard, 2022
+
+#include <algorithm>
+#include <vector>
+#include <catch2/catch.hpp>
+#include "trimesh.h"
+#include "utils/glrenderqueue.h"
+#include "test_utils.h"
+
+using namespace olio;
+using namespace std;
+
+namespace {
+constexpr double kTolerance = 1e-5;
+
+// unit square in the xy plane, with texture coordinates
+const char *kTexturedQuadOBJ =
+  "v 0 0 0\n"
+  "v 1 0 0\n"
+  "v 1 1 0\n"
+  "v 0 1 0\n"
+  "vt 0 0\n"
+  "vt 1 0\n"
+  "vt 1 1\n"
+  "vt 0 1\n"
+  "f 1/1 2/2 3/3\n"
+  "f 1/1 3/3 4/4\n";
+
+
+double
+Distance(const Vec3r &a, const Vec3r &b)
+{
+  return static_cast<double>((a - b).norm());
+}
+
+
+// whether face b lists the vertices of face a in the same cyclic order
+bool
+IsSameFace(const GLuint *a, const GLuint *b)
+{
+  for (int k = 0; k < 3; ++k)
+    if (a[0] == b[k] && a[1] == b[(k + 1) % 3] && a[2] == b[(k + 2) % 3])
+      return true;
+  return false;
+}
+
+
+// write the cube as an OFF file and load it
+bool
+LoadCube(const TempDir &dir, TriMesh &mesh)
+{
+  vector<Vec3r> points;
+  vector<uint32_t> indices;
+  GetCube(points, indices);
+  auto filepath = dir.WriteFile("cube.off", ToOFF(points, indices));
+  return !filepath.empty() && mesh.Load(filepath);
+}
+}  // namespace
+
+
+TEST_CASE("load an OFF mesh", "[trimesh]")
+{
+  TempDir dir;
+  TriMesh mesh;
+  REQUIRE(LoadCube(dir, mesh));
+  CHECK(mesh.n_vertices() == 8);
+  CHECK(mesh.n_faces() == 12);
+  CHECK(mesh.HasTopology());
+  CHECK_FALSE(mesh.HasTexCoords());
+  CHECK(mesh.GetVertexStride() == 6);
+  CHECK(mesh.GetVertexBufferSize() == 8 * 6);
+  CHECK(mesh.GetIndexBufferSize() == 36);
+
+  // the file has no normals, so they are computed
+  REQUIRE(mesh.has_vertex_normals());
+  for (auto vh : mesh.vertices())
+    CHECK(static_cast<double>(mesh.normal(vh).norm()) == Approx(1.0).margin(kTolerance));
+}
+
+
+TEST_CASE("load an OBJ mesh with texture coordinates", "[trimesh]")
+{
+  TempDir dir;
+  TriMesh mesh;
+  REQUIRE(mesh.Load(dir.WriteFile("quad.obj", kTexturedQuadOBJ)));
+  CHECK(mesh.n_vertices() == 4);
+  CHECK(mesh.n_faces() == 2);
+  REQUIRE(mesh.HasTexCoords());
+  CHECK(mesh.GetVertexStride() == 8);
+  CHECK(mesh.texcoord2D(mesh.vertex_handle(2)) == Vec2r(1, 1));
+  CHECK(mesh.texcoord2D(mesh.vertex_handle(3)) == Vec2r(0, 1));
+}
+
+
+TEST_CASE("loading a missing file fails", "[trimesh]")
+{
+  TempDir dir;
+  TriMesh mesh;
+  CHECK_FALSE(mesh.Load(dir.GetPath() / "missing.off"));
+}
+
+
+TEST_CASE("bounding box", "[trimesh]")
+{
+  TempDir dir;
+  TriMesh mesh;
+  Vec3r bmin, bmax;
+  mesh.GetBoundingBox(bmin, bmax);
+  CHECK(bmin == Vec3r::Zero());
+  CHECK(bmax == Vec3r::Zero());
+
+  REQUIRE(LoadCube(dir, mesh));
+  mesh.GetBoundingBox(bmin, bmax);
+  CHECK(bmin == Vec3r(-1, -1, -1));
+  CHECK(bmax == Vec3r(1, 1, 1));
+
+  // bounds are cached until invalidated
+  mesh.set_point(mesh.vertex_handle(0), Vec3r{-3, 0.5, 0});
+  mesh.GetBoundingBox(bmin, bmax);
+  CHECK(bmin == Vec3r(-1, -1, -1));
+  mesh.InvalidateBounds();
+  mesh.GetBoundingBox(bmin, bmax);
+  CHECK(bmin == Vec3r(-3, -1, -1));
+  CHECK(bmax == Vec3r(1, 1, 1));
+}
+
+
+TEST_CASE("mesh face and vertex normals", "[trimesh]")
+{
+  TempDir dir;
+  TriMesh mesh;
+  REQUIRE(LoadCube(dir, mesh));
+
+  REQUIRE(mesh.ComputeFaceNormals());
+  for (auto fh : mesh.faces()) {
+    Vec3r centroid{0, 0, 0};
+    for (auto fv_it = mesh.cfv_iter(fh); fv_it.is_valid(); ++fv_it)
+      centroid += mesh.point(*fv_it) / 3;
+    Eigen::Index axis = 0;
+    centroid.cwiseAbs().maxCoeff(&axis);
+    Vec3r expected = Vec3r::Zero();
+    expected[axis] = centroid[axis] > 0 ? 1 : -1;
+    CHECK(Distance(mesh.normal(fh), expected) <= kTolerance);
+  }
+
+  REQUIRE(mesh.ComputeVertexNormals(NormalWeighting::kAngle));
+  for (auto vh : mesh.vertices())
+    CHECK(Distance(mesh.normal(vh), mesh.point(vh).normalized()) <= kTolerance);
+}
+
+
+TEST_CASE("pack gl buffers", "[trimesh]")
+{
+  TempDir dir;
+  TriMesh mesh;
+  REQUIRE(mesh.Load(dir.WriteFile("quad.obj", kTexturedQuadOBJ)));
+  vector<GLfloat> vertices, positions_only;
+  vector<GLuint> indices;
+  mesh.PackGLBuffers(vertices, positions_only, indices);
+  REQUIRE(vertices.size() == 4 * 8);
+  REQUIRE(positions_only.size() == 4 * 3);
+  REQUIRE(indices.size() == 6);
+
+  // interleaved position, normal, texcoord
+  for (auto vh : mesh.vertices()) {
+    auto i = static_cast<size_t>(vh.idx());
+    const auto *vertex = &vertices[8 * i];
+    const auto &point = mesh.point(vh);
+    const auto &texcoord = mesh.texcoord2D(vh);
+    INFO("vertex " << i);
+    for (Eigen::Index k = 0; k < 3; ++k) {
+      CHECK(vertex[k] == static_cast<GLfloat>(point[k]));
+      CHECK(positions_only[3 * i + static_cast<size_t>(k)] == static_cast<GLfloat>(point[k]));
+    }
+    CHECK(vertex[3] == Approx(0).margin(kTolerance));
+    CHECK(vertex[4] == Approx(0).margin(kTolerance));
+    CHECK(vertex[5] == Approx(1).margin(kTolerance));
+    CHECK(vertex[6] == static_cast<GLfloat>(texcoord[0]));
+    CHECK(vertex[7] == static_cast<GLfloat>(texcoord[1]));
+  }
+
+  // the faces of the file, up to rotation
+  const GLuint expected[] = {0, 1, 2,  0, 2, 3};
+  CHECK(IsSameFace(expected, &indices[0]));
+  CHECK(IsSameFace(expected + 3, &indices[3]));
+}
+
+
+TEST_CASE("upload gl buffers", "[trimesh][gl]")
+{
+  InstallGLBufferStubs();
+  auto retention = GENERATE(TriMesh::Retention::kFull, TriMesh::Retention::kCompact,
+                            TriMesh::Retention::kNone);
+  INFO("retention " << static_cast<int>(retention));
+  TempDir dir;
+  auto buffer_count = GetStubBufferCount();
+  {
+    TriMesh mesh;
+    REQUIRE(LoadCube(dir, mesh));
+    vector<GLfloat> vertices, positions_only;
+    vector<GLuint> indices;
+    mesh.PackGLBuffers(vertices, positions_only, indices);
+    Vec3r bmin, bmax;
+    mesh.GetBoundingBox(bmin, bmax);
+
+    mesh.SetRetention(retention);
+    for (bool force_update : {false, true}) {
+      INFO("force update " << force_update);
+      mesh.UpdateGLBuffers(force_update);
+      CHECK(mesh.HasTopology() == (retention == TriMesh::Retention::kFull));
+      CHECK_FALSE(mesh.HasTexCoords());
+      CHECK(mesh.GetVertexStride() == 6);
+
+      GLDrawGeometry geometry;
+      REQUIRE(mesh.GetGLDrawGeometry(geometry));
+      CHECK(geometry.index_count == 36);
+      CHECK(static_cast<size_t>(geometry.vertex_stride) == 6 * sizeof(GLfloat));
+      CHECK_FALSE(geometry.has_texcoords);
+      CHECK(GetStubBufferData<GLfloat>(geometry.vertex_buffer) == vertices);
+      CHECK(GetStubBufferData<GLfloat>(geometry.positions_buffer) == positions_only);
+      CHECK(GetStubBufferData<GLuint>(geometry.index_buffer) == indices);
+      CHECK(GetStubBufferCount() == buffer_count + 3);
+
+      // bounds outlive the topology
+      Vec3r upload_bmin, upload_bmax;
+      mesh.GetBoundingBox(upload_bmin, upload_bmax);
+      CHECK(upload_bmin == bmin);
+      CHECK(upload_bmax == bmax);
+    }
+  }
+  // the mesh deletes its buffers
+  CHECK(GetStubBufferCount() == buffer_count);
+}
+
+
+TEST_CASE("texcoords outlive the topology", "[trimesh][gl]")
+{
+  // the viewer checks for texcoords (before or after uploading) to
+  // decide whether a mesh can use its diffuse map
+  InstallGLBufferStubs();
+  auto retention = GENERATE(TriMesh::Retention::kCompact, TriMesh::Retention::kNone);
+  INFO("retention " << static_cast<int>(retention));
+  TempDir dir;
+  TriMesh mesh;
+  REQUIRE(mesh.Load(dir.WriteFile("quad.obj", kTexturedQuadOBJ)));
+  mesh.SetRetention(retention);
+  REQUIRE(mesh.HasTexCoords());
+  vector<GLfloat> vertices, positions_only;
+  vector<GLuint> indices;
+  mesh.PackGLBuffers(vertices, positions_only, indices);
+
+  for (bool force_update : {false, true}) {
+    INFO("force update " << force_update);
+    mesh.UpdateGLBuffers(force_update);
+    CHECK_FALSE(mesh.HasTopology());
+    CHECK(mesh.HasTexCoords());
+    CHECK(mesh.GetVertexStride() == 8);
+
+    GLDrawGeometry geometry;
+    REQUIRE(mesh.GetGLDrawGeometry(geometry));
+    CHECK(geometry.has_texcoords);
+    CHECK(static_cast<size_t>(geometry.vertex_stride) == 8 * sizeof(GLfloat));
+    CHECK(GetStubBufferData<GLfloat>(geometry.vertex_buffer) == vertices);
+  }
+}
@@ -0,0 +1,95 @@
+// ======================================================================
+// Olio: Simple renderer
+// Copyright (C) 2022 by Hadi Fadaifard
+//
+// Author: Hadi Fadaifard, 2022
+// ======================================================================
+
+//! \file  olio_octree.cc
+//! \brief Preprocess a mesh into an .octree file (chunked octree with
+//!        simplified interior nodes) for out-of-core viewing with
+//!        olio_mesh_view
+//! \author Hadi Fadaifard, 2022
+
+#include <iostream>
+#include <string>
+#include <boost/filesystem.hpp>
+#include <boost/program_options.hpp>
+#include <spdlog/spdlog.h>
+#include "types.h"
+#include "octree_builder.h"
+#include "utils/memory_stats.h"
+
+using namespace std;
+using namespace olio;
+namespace fs = boost::filesystem;
+
+bool
+ParseArguments(int argc, char **argv, std::string *input, std::string *output,
+               OctreeBuildSettings *settings)
+{
+  namespace po = boost::program_options;
+  po::options_description desc("options");
+  std::string temp_dir;
+  try {
+    desc.add_options()
+      ("help,h", "print usage")
+      ("input,i", po::value<std::string>(input)->required(),
+       "Source mesh (obj files are streamed; other formats must fit in memory)")
+      ("output,o", po::value<std::string>(output),
+       "Octree file (default: <input>.octree)")
+      ("chunk_triangles,c",
+       po::value<uint32_t>(&settings->max_chunk_triangles)->default_value(65536),
+       "Maximum triangles per leaf chunk")
+      ("cluster_resolution,r",
+       po::value<uint>(&settings->cluster_resolution)->default_value(64),
+       "Simplification grid cells per interior node axis")
+      ("max_depth,d", po::value<uint>(&settings->max_depth)->default_value(16),
+       "Maximum octree depth")
+      ("temp_dir,t", po::value<std::string>(&temp_dir),
+       "Directory for temporary files (default: next to the output)");
+
+    // parse arguments
+    po::variables_map vm;
+    po::store(po::parse_command_line(argc, argv, desc), vm);
+    if (vm.count("help")) {
+      cout << desc << endl;
+      return false;
+    }
+    po::notify(vm);
+    if (output->empty())
+      *output = *input + ".octree";
+    settings->temp_dir = temp_dir;
+  } catch(std::exception &e) {
+    cout << desc << endl;
+    spdlog::error("{}", e.what());
+    return false;
+  } catch(...) {
+    cout << desc << endl;
+    spdlog::error("Invalid arguments");
+    return false;
+  }
+  return true;
+}
+
+
+//! \brief Main executable function
+int
+main(int argc, char **argv)
+{
+  std::string input, output;
+  OctreeBuildSettings settings;
+  if (!ParseArguments(argc, argv, &input, &output, &settings))
+    return -1;
+
+  OctreeBuildStats stats;
+  if (!BuildOctreeMesh(input, output, settings, &stats)) {
+    spdlog::error("Failed to build octree for {}", input);
+    return -1;
+  }
+  spdlog::info("{}: {} triangles, {} nodes ({} leaves, depth {}), {} in {:.1f} s",
+               output, stats.triangle_count, stats.node_count, stats.leaf_count,
+               stats.max_depth, FormatBytes(static_cast<size_t>(stats.file_bytes)), stats.seconds);
+  spdlog::info("peak rss {}", FormatBytes(GetProcessPeakRSS()));
+  return 0;
+}